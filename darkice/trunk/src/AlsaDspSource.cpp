@@ -43,6 +43,24 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#else
+#error need signal.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
 #include "Util.h"
 #include "Exception.h"
 #include "AlsaDspSource.h"
@@ -80,10 +98,24 @@ AlsaDspSource :: isBigEndian ( void ) const                  throw ()
 void
 AlsaDspSource :: init (  const char      * name )    throw ( Exception )
 {
-    pcmName       = Util::strDup( name);
-    captureHandle = 0;
-    bufferTime    = 1000000; // Do 1s buffering
-    running       = false;
+    pcmName           = Util::strDup( name);
+    captureHandle     = 0;
+    bufferTime        = 1000000; // Do 1s buffering
+    running           = false;
+    pollFds           = 0;
+    numPollFds        = 0;
+    periodSize        = 0;
+    useMmap           = false;
+    mmapOffset        = 0;
+    periods           = 4;
+    bufferSize        = 0;
+    fillXruns         = false;
+    xrunSilence       = 0;
+    silenceBuffer     = 0;
+    silenceBufferSize = 0;
+    silenceInPlace    = false;
+    xruns             = 0;
+    lastXrun          = 0;
 }
 
 
@@ -108,6 +140,7 @@ bool
 AlsaDspSource :: open ( void )                       throw ( Exception )
 {
     unsigned int        u;
+    int                 n;
     snd_pcm_format_t    format;
     snd_pcm_hw_params_t *hwParams;
 
@@ -128,7 +161,8 @@ AlsaDspSource :: open ( void )                       throw ( Exception )
             return false;
     }
 
-    if (snd_pcm_open(&captureHandle, pcmName, SND_PCM_STREAM_CAPTURE, 0) < 0) {
+    if (snd_pcm_open(&captureHandle, pcmName, SND_PCM_STREAM_CAPTURE,
+                     SND_PCM_NONBLOCK) < 0) {
         captureHandle = 0;
         return false;
     }
@@ -146,7 +180,15 @@ AlsaDspSource :: open ( void )                       throw ( Exception )
                         "parameter structure");
     }
 
-    if (snd_pcm_hw_params_set_access(captureHandle, hwParams,
+    if (useMmap
+     && snd_pcm_hw_params_set_access(captureHandle, hwParams,
+                                     SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0) {
+        reportEvent(2, "AlsaDspSource :: can't memory map", pcmName);
+        useMmap = false;
+    }
+
+    if (!useMmap
+     && snd_pcm_hw_params_set_access(captureHandle, hwParams,
                                      SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
         snd_pcm_hw_params_free(hwParams);
         close();
@@ -173,7 +215,7 @@ AlsaDspSource :: open ( void )                       throw ( Exception )
         throw Exception( __FILE__, __LINE__, "can't set channels", u);
     }
 
-    u = 4;
+    u = getPeriods();
     if (snd_pcm_hw_params_set_periods_near(captureHandle, hwParams, &u, 0)
                                                                           < 0) {
         snd_pcm_hw_params_free(hwParams);
@@ -195,6 +237,18 @@ AlsaDspSource :: open ( void )                       throw ( Exception )
         throw Exception( __FILE__, __LINE__, "can't set hardware parameters");
     }
 
+    if (snd_pcm_hw_params_get_period_size(hwParams, &periodSize, 0) < 0) {
+        snd_pcm_hw_params_free(hwParams);
+        close();
+        throw Exception( __FILE__, __LINE__, "can't get period size");
+    }
+
+    if (snd_pcm_hw_params_get_buffer_size(hwParams, &bufferSize) < 0) {
+        snd_pcm_hw_params_free(hwParams);
+        close();
+        throw Exception( __FILE__, __LINE__, "can't get buffer size");
+    }
+
     snd_pcm_hw_params_free(hwParams);
 
     if (snd_pcm_prepare(captureHandle) < 0) {
@@ -203,12 +257,180 @@ AlsaDspSource :: open ( void )                       throw ( Exception )
                         "for use");
     }
 
+    if ((n = snd_pcm_poll_descriptors_count(captureHandle)) <= 0) {
+        close();
+        throw Exception( __FILE__, __LINE__, "no descriptors to poll");
+    }
+    numPollFds = n;
+    pollFds    = new struct pollfd[numPollFds];
+    if (snd_pcm_poll_descriptors(captureHandle, pollFds, numPollFds) < 0) {
+        close();
+        throw Exception( __FILE__, __LINE__, "can't get descriptors to poll");
+    }
+
     bytesPerFrame = getChannel() * getBitsPerSample() / 8;
 
+    // silence to read in place from, signed samples are silent at 0
+    silenceBufferSize = periodSize * bytesPerFrame;
+    silenceBuffer     = new unsigned char[silenceBufferSize];
+    memset(silenceBuffer, 0, silenceBufferSize);
+    xrunSilence       = 0;
+    silenceInPlace    = false;
+
     return true;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Start capturing
+ *----------------------------------------------------------------------------*/
+void
+AlsaDspSource :: start ( void )                      throw ()
+{
+    if (snd_pcm_state(captureHandle) == SND_PCM_STATE_PREPARED) {
+        snd_pcm_start(captureHandle);
+    }
+    running = true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Tell how many frames went by since the overrun
+ *----------------------------------------------------------------------------*/
+unsigned long long
+AlsaDspSource :: framesSinceXrun ( void )            throw ()
+{
+    snd_pcm_status_t  * status;
+    snd_timestamp_t     now;
+    snd_timestamp_t     trigger;
+    long long           usec   = 0;
+
+    if (snd_pcm_status_malloc(&status) < 0) {
+        return 0;
+    }
+
+    // the trigger time stamp of an overrun is when it happened
+    if (snd_pcm_status(captureHandle, status) == 0
+     && snd_pcm_status_get_state(status) == SND_PCM_STATE_XRUN) {
+        snd_pcm_status_get_tstamp(status, &now);
+        snd_pcm_status_get_trigger_tstamp(status, &trigger);
+        usec = (now.tv_sec - trigger.tv_sec) * 1000000LL
+             + (now.tv_usec - trigger.tv_usec);
+    }
+
+    snd_pcm_status_free(status);
+
+    return usec > 0 ? usec * getSampleRate() / 1000000ULL : 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Take the silence to fill in for overruns
+ *----------------------------------------------------------------------------*/
+unsigned int
+AlsaDspSource :: takeXrunSilence ( unsigned int  len )   throw ()
+{
+    unsigned long long  frames = len / bytesPerFrame;
+
+    if (frames > xrunSilence) {
+        frames = xrunSilence;
+    }
+    xrunSilence -= frames;
+
+    return frames * bytesPerFrame;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Recover from an error
+ *----------------------------------------------------------------------------*/
+void
+AlsaDspSource :: recover (  int     err )            throw ( Exception )
+{
+    if (err == -EPIPE) {
+        // preparing the PCM drops the whole buffer captured
+        unsigned long long  lost = bufferSize + framesSinceXrun();
+
+        ++xruns;
+        lastXrun = time(0);
+        reportEvent(1, "AlsaDspSource :: Buffer overrun! count, frames lost",
+                    xruns, lost);
+        if (fillXruns) {
+            xrunSilence += lost;
+        }
+    }
+
+    if ((err = snd_pcm_recover(captureHandle, err, 1)) < 0) {
+        throw Exception(__FILE__, __LINE__, snd_strerror(err));
+    }
+
+    start();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wait for a period to be captured
+ *----------------------------------------------------------------------------*/
+bool
+AlsaDspSource :: waitForPeriod ( unsigned long long  timeout )
+                                                    throw ( Exception )
+{
+    unsigned long long  deadline = Util::getMonotonicTime() + timeout;
+    unsigned long long  now;
+    snd_pcm_sframes_t   avail;
+    unsigned short      revents;
+    struct timespec     timespec;
+    sigset_t            sigset;
+    int                 ret;
+
+    // mask out SIGUSR1, as we're expecting that signal for other reasons
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGUSR1);
+
+    while (true) {
+        if ((avail = snd_pcm_avail_update(captureHandle)) < 0) {
+            recover(avail);
+            continue;
+        }
+        if ((snd_pcm_uframes_t) avail >= periodSize) {
+            return true;
+        }
+
+        now = Util::getMonotonicTime();
+        if (now >= deadline) {
+            return false;
+        }
+        timespec.tv_sec  = (deadline - now) / 1000000ULL;
+        timespec.tv_nsec = (deadline - now) % 1000000ULL * 1000L;
+
+        ret = ppoll(pollFds, numPollFds, &timespec, &sigset);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw Exception(__FILE__, __LINE__, "poll error", errno);
+        }
+        if (ret == 0) {
+            return false;
+        }
+
+        // the PCM tells what the poll meant for it
+        ret = snd_pcm_poll_descriptors_revents(captureHandle,
+                                               pollFds,
+                                               numPollFds,
+                                               &revents);
+        if (ret < 0) {
+            throw Exception(__FILE__, __LINE__, snd_strerror(ret));
+        }
+        if ((revents & POLLERR)
+         && snd_pcm_state(captureHandle) == SND_PCM_STATE_PREPARED) {
+            start();
+        }
+        // overruns and suspends show up in the next avail_update
+    }
+}
+
+
 /*------------------------------------------------------------------------------
  *  Check whether read() would return anything
  *----------------------------------------------------------------------------*/
@@ -221,19 +443,14 @@ AlsaDspSource :: canRead ( unsigned int    sec,
     }
 
     if ( !running ) {
-        snd_pcm_start(captureHandle); 
-        running = true;
-    }
-
-    /*
-     * FIXME How to check for available frames? It
-     * seems like snd_pcm_wait stops working when
-     * it comes to ALSA plugins... :-(
-     *
-     * int milliDelay = sec * 1000 + usec/1000;
-     * return snd_pcm_wait(captureHandle, milliDelay)!=0;
-     */
-    return true; // bad!!
+        start();
+    }
+
+    if ( xrunSilence ) {
+        return true;
+    }
+
+    return waitForPeriod(sec * 1000000ULL + usec);
 }
 
 
@@ -246,27 +463,129 @@ AlsaDspSource :: read (    void          * buf,
 {
     snd_pcm_sframes_t ret;
 
-    if ( !isOpen() ) {
+    if ( !isOpen() || len < (unsigned int) bytesPerFrame ) {
         return 0;
     }
 
-    do {
+    if ( !running ) {
+        start();
+    }
+
+    if ( xrunSilence ) {
+        len = takeXrunSilence(len);
+        memset(buf, 0, len);
+        return len;
+    }
+
+    while (true) {
         ret = snd_pcm_readi(captureHandle, buf, len/bytesPerFrame);
 
-        // Check for buffer overrun
-        if (ret == -EPIPE) {
-            reportEvent(1, "AlsaDspSource :: Buffer overrun!");
-            snd_pcm_prepare(captureHandle);
-            ret = -EAGAIN;
+        if (ret > 0) {
+            return ret * bytesPerFrame;
         }
-    } while (ret == -EAGAIN);
 
-    if ( ret < 0 ) {
-        throw Exception(__FILE__, __LINE__, snd_strerror(ret));
+        if (ret == 0 || ret == -EAGAIN) {
+            // not a single period in the time the whole buffer takes
+            // to fill means the device has stopped
+            if (!waitForPeriod(getBufferTime())) {
+                throw Exception(__FILE__, __LINE__,
+                                "no audio captured from", pcmName);
+            }
+        } else {
+            recover(ret);
+        }
     }
+}
 
-    running = true;
-    return ret * bytesPerFrame;
+
+/*------------------------------------------------------------------------------
+ *  Read from the audio source in place
+ *----------------------------------------------------------------------------*/
+unsigned int
+AlsaDspSource :: readInPlace (  const void   ** buf,
+                                unsigned int    len )   throw ( Exception )
+{
+    const snd_pcm_channel_area_t  * areas;
+    snd_pcm_uframes_t               frames;
+    snd_pcm_sframes_t               avail;
+    int                             ret;
+
+    if ( !isOpen() || len < (unsigned int) bytesPerFrame ) {
+        return 0;
+    }
+
+    if ( !running ) {
+        start();
+    }
+
+    if ( xrunSilence ) {
+        silenceInPlace = true;
+        *buf           = silenceBuffer;
+        return takeXrunSilence(len < silenceBufferSize ? len
+                                                       : silenceBufferSize);
+    }
+    silenceInPlace = false;
+
+    while (true) {
+        if ((avail = snd_pcm_avail_update(captureHandle)) < 0) {
+            recover(avail);
+            continue;
+        }
+
+        if (avail == 0) {
+            // not a single period in the time the whole buffer takes
+            // to fill means the device has stopped
+            if (!waitForPeriod(getBufferTime())) {
+                throw Exception(__FILE__, __LINE__,
+                                "no audio captured from", pcmName);
+            }
+            continue;
+        }
+
+        // may be less than asked for, where the buffer wraps around
+        frames = len / bytesPerFrame;
+        if (frames > (snd_pcm_uframes_t) avail) {
+            frames = avail;
+        }
+        if ((ret = snd_pcm_mmap_begin(captureHandle,
+                                      &areas,
+                                      &mmapOffset,
+                                      &frames)) < 0) {
+            recover(ret);
+            continue;
+        }
+
+        // interleaved frames, all channels are in the first area
+        if (areas[0].first % 8 || areas[0].step != bytesPerFrame * 8u) {
+            throw Exception(__FILE__, __LINE__,
+                            "memory mapped frames not interleaved", pcmName);
+        }
+
+        *buf = (const unsigned char *) areas[0].addr
+             + areas[0].first / 8
+             + mmapOffset * bytesPerFrame;
+        return frames * bytesPerFrame;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Give the frames read in place back
+ *----------------------------------------------------------------------------*/
+void
+AlsaDspSource :: releaseInPlace (   unsigned int    len )   throw ( Exception )
+{
+    snd_pcm_uframes_t   frames = len / bytesPerFrame;
+    snd_pcm_sframes_t   ret;
+
+    if ( !isOpen() || silenceInPlace ) {
+        return;
+    }
+
+    ret = snd_pcm_mmap_commit(captureHandle, mmapOffset, frames);
+    if (ret < 0 || (snd_pcm_uframes_t) ret != frames) {
+        recover(ret < 0 ? ret : -EPIPE);
+    }
 }
 
 
@@ -281,9 +600,15 @@ AlsaDspSource :: close ( void )                  throw ( Exception )
     }
 
     snd_pcm_close(captureHandle);
-
-    captureHandle  = 0;
-    running        = false;
+    delete[] pollFds;
+    delete[] silenceBuffer;
+
+    captureHandle     = 0;
+    running           = false;
+    pollFds           = 0;
+    numPollFds        = 0;
+    silenceBuffer     = 0;
+    silenceBufferSize = 0;
 }
 
 #endif // HAVE_ALSA_LIB
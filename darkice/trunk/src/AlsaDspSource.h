@@ -48,6 +48,18 @@
 #include "Reporter.h"
 #include "AudioSource.h"
 
+#ifdef HAVE_TIME_H
+#include <time.h>
+#else
+#error need time.h
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#else
+#error need poll.h
+#endif
+
 #ifdef HAVE_ALSA_LIB
 #include <alsa/asoundlib.h>
 #else
@@ -66,6 +78,10 @@
 /**
  *  An audio input based on the ALSA sound system 
  *
+ *  The PCM is opened non-blocking, and is waited for by polling its
+ *  descriptors, thus canRead() sleeps until a period has been captured,
+ *  or the time given runs out.
+ *
  *  @author  $Author$
  *  @version $Revision$
  */
@@ -94,11 +110,84 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
          */
         bool running;
 
+        /**
+         *  The descriptors to poll for the PCM to have captured audio.
+         */
+        struct pollfd *pollFds;
+
+        /**
+         *  The number of descriptors in pollFds.
+         */
+        unsigned int numPollFds;
+
+        /**
+         *  The number of frames in a period, the least waited for.
+         */
+        snd_pcm_uframes_t periodSize;
+
+        /**
+         *  Capture through the memory mapped buffer of the PCM.
+         */
+        bool useMmap;
+
+        /**
+         *  The offset in the memory mapped buffer of the frames
+         *  read in place, not yet released.
+         */
+        snd_pcm_uframes_t mmapOffset;
+
         /**
          *  Number of useconds to do buffering in the audio device.
          */
         unsigned int bufferTime;
 
+        /**
+         *  Number of periods the buffer of the audio device is made of.
+         */
+        unsigned int periods;
+
+        /**
+         *  The number of frames in the buffer of the audio device.
+         */
+        snd_pcm_uframes_t bufferSize;
+
+        /**
+         *  Fill the audio lost to overruns with silence.
+         */
+        bool fillXruns;
+
+        /**
+         *  The number of frames of silence still to fill in for
+         *  overruns.
+         */
+        unsigned long long xrunSilence;
+
+        /**
+         *  A buffer of silence, to read in place from while filling in
+         *  for overruns.
+         */
+        unsigned char *silenceBuffer;
+
+        /**
+         *  The size of silenceBuffer in bytes.
+         */
+        unsigned int silenceBufferSize;
+
+        /**
+         *  True if the data read in place is from silenceBuffer.
+         */
+        bool silenceInPlace;
+
+        /**
+         *  The number of overruns since the object was created.
+         */
+        unsigned long xruns;
+
+        /**
+         *  The wall clock time of the last overrun, or 0 if none.
+         */
+        time_t lastXrun;
+
 
     protected:
 
@@ -130,6 +219,53 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
         void
         strip ( void )                              throw ( Exception );
 
+        /**
+         *  Start capturing, if the PCM is not capturing already.
+         */
+        void
+        start ( void )                              throw ();
+
+        /**
+         *  Tell how many frames went by since the PCM overran,
+         *  while in the overrun state.
+         *
+         *  @return the number of frames since the overrun,
+         *          0 if not known.
+         */
+        unsigned long long
+        framesSinceXrun ( void )                    throw ();
+
+        /**
+         *  Take the frames of silence to fill in for overruns.
+         *
+         *  @param len the maximum number of bytes to take.
+         *  @return the number of bytes of silence taken.
+         */
+        unsigned int
+        takeXrunSilence ( unsigned int  len )       throw ();
+
+        /**
+         *  Recover the PCM from an error, such as an overrun or
+         *  a suspend, and start capturing again. Overruns are
+         *  counted, and the audio lost filled in if asked for.
+         *
+         *  @param err the negative error code returned by ALSA.
+         *  @exception Exception if the PCM can not be recovered.
+         */
+        void
+        recover (   int             err )           throw ( Exception );
+
+        /**
+         *  Wait for the PCM to have captured at least a period.
+         *
+         *  @param timeout the maximum microseconds to wait.
+         *  @return true if a period is ready to be read, false if the
+         *          time ran out.
+         *  @exception Exception
+         */
+        bool
+        waitForPeriod ( unsigned long long  timeout )   throw ( Exception );
+
 
     public:
 
@@ -204,6 +340,17 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
         virtual bool
         isBigEndian ( void ) const           throw ();
 
+        /**
+         *  Tell if 8 bit data from this source is signed or unsigned.
+         *
+         *  @return true, as 8 bit samples are recorded as S8
+         */
+        virtual inline bool
+        isSigned8 ( void ) const            throw ()
+        {
+            return true;
+        }
+
         /**
          *  Open the AlsaDspSource.
          *  This does not put Alsa device into recording mode.
@@ -257,6 +404,42 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
         read (                  void          * buf,
                                 unsigned int    len )   throw ( Exception );
 
+        /**
+         *  Tell if the AlsaDspSource hands out the audio in place, in the
+         *  memory mapped buffer of the PCM.
+         *
+         *  @return true if capturing through the memory mapped buffer,
+         *          false otherwise.
+         */
+        inline virtual bool
+        canReadInPlace ( void ) const                   throw ()
+        {
+            return isOpen() && useMmap;
+        }
+
+        /**
+         *  Read from the AlsaDspSource in place: get a pointer to the
+         *  frames captured in the memory mapped buffer of the PCM.
+         *  Puts the PCM into recording mode.
+         *
+         *  @param buf set to point to the data read.
+         *  @param len the maximum number of bytes to read.
+         *  @return the number of bytes read (may be less than len).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        readInPlace (           const void   ** buf,
+                                unsigned int    len )   throw ( Exception );
+
+        /**
+         *  Give the frames read in place back to the PCM.
+         *
+         *  @param len the number of bytes read by readInPlace().
+         *  @exception Exception
+         */
+        virtual void
+        releaseInPlace (        unsigned int    len )   throw ( Exception );
+
         /**
          *  Close the AlsaDspSource.
          *
@@ -285,6 +468,86 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
         setBufferTime( unsigned int time ) {
             bufferTime = time;
         }
+
+        /**
+         *  Returns the number of periods the buffer is made of.
+         *
+         *  @return the number of periods in the buffer.
+         */
+        inline virtual unsigned int
+        getPeriods( void ) const
+        {
+            return periods;
+        }
+
+        /**
+         *  Sets the number of periods the buffer is made of, that is
+         *  the number of times the device is read in the buffer time.
+         *
+         *  @param periods the number of periods in the buffer.
+         */
+        inline virtual void
+        setPeriods( unsigned int periods ) {
+            this->periods = periods;
+        }
+
+        /**
+         *  Fill the audio lost to overruns with silence, thus keep the
+         *  outputs in step with the wall clock.
+         *
+         *  @param fill true to fill in silence for overruns.
+         */
+        inline virtual void
+        setFillXruns( bool fill ) {
+            fillXruns = fill;
+        }
+
+        /**
+         *  Returns the number of overruns so far.
+         *
+         *  @return the number of overruns.
+         */
+        inline virtual unsigned long
+        getXruns( void ) const
+        {
+            return xruns;
+        }
+
+        /**
+         *  Returns the wall clock time of the last overrun.
+         *
+         *  @return the time of the last overrun, or 0 if none.
+         */
+        inline virtual time_t
+        getLastXrun( void ) const
+        {
+            return lastXrun;
+        }
+
+        /**
+         *  Tell if the capture goes through the memory mapped buffer
+         *  of the PCM.
+         *
+         *  @return true if memory mapped capture is asked for.
+         */
+        inline virtual bool
+        getMmap( void ) const
+        {
+            return useMmap;
+        }
+
+        /**
+         *  Capture through the memory mapped buffer of the PCM, so that
+         *  the audio is read in place instead of copied out. Takes
+         *  effect with the next open(). PCMs that can't be memory
+         *  mapped are read the usual way.
+         *
+         *  @param mmap true to capture through the memory mapped buffer.
+         */
+        inline virtual void
+        setMmap( bool mmap ) {
+            useMmap = mmap;
+        }
 };
 
 
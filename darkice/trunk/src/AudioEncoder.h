@@ -36,7 +36,20 @@
 
 /* ============================================================ include files */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
 #include "Referable.h"
+#include "Util.h"
 #include "Sink.h"
 #include "AudioSource.h"
 
@@ -121,6 +134,51 @@ class AudioEncoder : public Sink, public virtual Referable
          */
         unsigned int        outChannel;
 
+        /**
+         *  The title of the stream, or 0 if not set.
+         */
+        char              * title;
+
+        /**
+         *  Set when the title was changed since the encoder last
+         *  looked at it.
+         */
+        bool                titleChanged;
+
+        /**
+         *  Mutex protecting the title, which is set from an other thread
+         *  than the one encoding.
+         */
+        pthread_mutex_t     titleMutex;
+
+        /**
+         *  A pre-encoded silent frame, written in place of encoding
+         *  silence, or 0.
+         */
+        unsigned char     * silentFrame;
+
+        /**
+         *  The length of the silent frame in bytes.
+         */
+        unsigned int        silentFrameLen;
+
+        /**
+         *  The number of samples in the silent frame, at the output
+         *  sample rate.
+         */
+        unsigned int        silentFrameSamples;
+
+        /**
+         *  The input samples of silence not yet covered by silent
+         *  frames, multiplied by the output sample rate.
+         */
+        unsigned long long  silentInput;
+
+        /**
+         *  True while silent frames are written instead of encoding.
+         */
+        bool                silent;
+
         /**
          *  Initialize the object.
          *
@@ -158,6 +216,16 @@ class AudioEncoder : public Sink, public virtual Referable
             this->outSampleRate    = outSampleRate;
             this->outChannel       = outChannel;
 
+            title        = 0;
+            titleChanged = false;
+            pthread_mutex_init( &titleMutex, 0);
+
+            silentFrame        = 0;
+            silentFrameLen     = 0;
+            silentFrameSamples = 0;
+            silentInput        = 0;
+            silent             = false;
+
             if ( outQuality < -0.1 || 1.0 < outQuality ) {
                 throw Exception( __FILE__, __LINE__, "invalid encoder quality");
             }
@@ -171,6 +239,11 @@ class AudioEncoder : public Sink, public virtual Referable
         inline void
         strip ( void )                                  throw ( Exception )
         {
+            delete[] title;
+            title = 0;
+            pthread_mutex_destroy( &titleMutex);
+            delete[] silentFrame;
+            silentFrame = 0;
         }
 
 
@@ -315,6 +388,190 @@ class AudioEncoder : public Sink, public virtual Referable
         }
 
 
+        /**
+         *  Record a new bit rate of the output, for encoders that change
+         *  their bit rate while encoding.
+         *
+         *  @param outBitrate the new bit rate of the output (kbits/sec).
+         */
+        inline void
+        storeOutBitrate (   unsigned int    outBitrate )    throw ()
+        {
+            this->outBitrate = outBitrate;
+        }
+
+        /**
+         *  Record a new title of the stream, for encoders that send the
+         *  title in band. May be called from any thread.
+         *
+         *  @param title the new title.
+         *  @exception Exception
+         */
+        inline void
+        storeTitle (    const char    * title )     throw ( Exception )
+        {
+            char  * t = Util::strDup( title);
+
+            pthread_mutex_lock( &titleMutex);
+            delete[] this->title;
+            this->title  = t;
+            titleChanged = true;
+            pthread_mutex_unlock( &titleMutex);
+        }
+
+        /**
+         *  Tell if the title changed since the last call, and clear
+         *  the change.
+         *
+         *  @return true if the title changed, false otherwise.
+         */
+        inline bool
+        takeTitleChange ( void )                    throw ()
+        {
+            bool    changed;
+
+            pthread_mutex_lock( &titleMutex);
+            changed      = titleChanged;
+            titleChanged = false;
+            pthread_mutex_unlock( &titleMutex);
+
+            return changed;
+        }
+
+        /**
+         *  Get a copy of the title of the stream.
+         *
+         *  @return a copy of the title, to be freed with delete[] by
+         *          the caller, or 0 if no title was set.
+         *  @exception Exception
+         */
+        inline char *
+        copyTitle ( void )                          throw ( Exception )
+        {
+            char  * t;
+
+            pthread_mutex_lock( &titleMutex);
+            t = title ? Util::strDup( title) : 0;
+            pthread_mutex_unlock( &titleMutex);
+
+            return t;
+        }
+
+        /**
+         *  Set the pre-encoded silent frame to write in place of
+         *  encoding silence. Encoders call this when opened, if their
+         *  format has such a frame.
+         *
+         *  @param frame the frame, allocated with new[], owned by the
+         *         AudioEncoder from now on. May be 0.
+         *  @param len the length of the frame in bytes.
+         *  @param samples the number of samples in the frame,
+         *         at the output sample rate.
+         */
+        inline void
+        setSilentFrame (    unsigned char * frame,
+                            unsigned int    len,
+                            unsigned int    samples )   throw ()
+        {
+            delete[] silentFrame;
+            silentFrame        = frame;
+            silentFrameLen     = len;
+            silentFrameSamples = samples;
+        }
+
+        /**
+         *  Tell if there is a pre-encoded silent frame.
+         *
+         *  @return true if a silent frame was set, false otherwise.
+         */
+        inline bool
+        hasSilentFrame ( void ) const               throw ()
+        {
+            return silentFrame != 0;
+        }
+
+        /**
+         *  Count the silent frames that cover input samples of silence,
+         *  carrying the remainder over to the next call. Starts a run
+         *  of silence, if not in one yet.
+         *
+         *  @param samples the number of input samples of silence.
+         *  @param frameSamples the number of samples in a silent frame.
+         *  @param frameRate the sample rate of the silent frames.
+         *  @return the number of silent frames to write.
+         */
+        inline unsigned int
+        countSilentFrames ( unsigned int    samples,
+                            unsigned int    frameSamples,
+                            unsigned int    frameRate )     throw ()
+        {
+            unsigned long long  frame = (unsigned long long) frameSamples
+                                      * inSampleRate;
+            unsigned int        frames;
+
+            silent       = true;
+            silentInput += (unsigned long long) samples * frameRate;
+            frames       = silentInput / frame;
+            silentInput -= frames * frame;
+
+            return frames;
+        }
+
+        /**
+         *  Write the pre-encoded silent frames covering input samples
+         *  of silence to the underlying sink.
+         *
+         *  @param samples the number of input samples of silence.
+         *  @return true if written, false if there is no silent frame.
+         *  @exception Exception
+         */
+        inline bool
+        writeSilentFrames ( unsigned int    samples )   throw ( Exception )
+        {
+            if ( !silentFrame ) {
+                return false;
+            }
+
+            unsigned int    frames = countSilentFrames( samples,
+                                                        silentFrameSamples,
+                                                        outSampleRate);
+
+            while ( frames-- ) {
+                sink->write( silentFrame, silentFrameLen);
+                sink->markFrameEnd();
+            }
+
+            return true;
+        }
+
+        /**
+         *  Tell if silent frames are written instead of encoding.
+         *
+         *  @return true if in a run of silence, false otherwise.
+         */
+        inline bool
+        isSilent ( void ) const                     throw ()
+        {
+            return silent;
+        }
+
+        /**
+         *  End a run of silence, as encoding goes on.
+         *
+         *  @return true if there was a run of silence, false otherwise.
+         */
+        inline bool
+        endSilence ( void )                         throw ()
+        {
+            bool    was = silent;
+
+            silent      = false;
+            silentInput = 0;
+
+            return was;
+        }
+
+
     public:
 
         /**
@@ -428,6 +685,74 @@ class AudioEncoder : public Sink, public virtual Referable
             return outBitrate;
         }
 
+        /**
+         *  Change the bit rate of the output while encoding. Only some
+         *  encoders support this, the rest leave the bit rate as it is.
+         *
+         *  @param bitrate the new bit rate of the output (kbits/sec).
+         *  @return true if the bit rate was changed, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        setOutBitrate ( unsigned int    bitrate )   throw ( Exception )
+        {
+            return false;
+        }
+
+        /**
+         *  Change the title of the stream while encoding. Only encoders
+         *  that can carry the title in the encoded stream support this,
+         *  the rest leave the title to the server.
+         *
+         *  @param title the new title.
+         *  @return true if the title is sent in the stream, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        setTitle (  const char    * title )         throw ( Exception )
+        {
+            return false;
+        }
+
+        /**
+         *  Write silence, without encoding it. Encoders that support
+         *  this send pre-encoded silent frames instead, costing next to
+         *  no CPU, and go back to encoding with the next write().
+         *
+         *  @param samples the number of input samples of silence.
+         *  @return true if the silence was written, false if the
+         *          encoder does not support this.
+         *  @exception Exception
+         */
+        inline virtual bool
+        writeSilence (  unsigned int    samples )   throw ( Exception )
+        {
+            return false;
+        }
+
+        /**
+         *  Write audio known to be silent, as pre-encoded silent frames
+         *  if the encoder supports it, or else encode it.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written (may be less than len).
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        writeSilent (   const void    * buf,
+                        unsigned int    len )       throw ( Exception )
+        {
+            unsigned int    sampleSize = (getInBitsPerSample() / 8)
+                                       * getInChannel();
+
+            if ( writeSilence( len / sampleSize) ) {
+                return len - len % sampleSize;
+            }
+
+            return write( buf, len);
+        }
+
         /**
          *  Get the encoding quality of the output, for variable bitrate
          *  encodings.
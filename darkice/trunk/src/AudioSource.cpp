@@ -68,7 +68,13 @@ AudioSource :: createDspSource( const char    * deviceName,
                                                             throw ( Exception )
 {
     
-    if ( Util::strEq( deviceName, "/dev/tty", 8) ) {
+    if ( Util::strEq( deviceName, "relay:", 6) ) {
+        Reporter::reportEvent( 1, "Relaying encoded stream:", deviceName + 6);
+        return new RelaySource( deviceName + 6,
+                                sampleRate,
+                                bitsPerSample,
+                                channel);
+    } else if ( Util::strEq( deviceName, "/dev/tty", 8) ) {
 #if defined( SUPPORT_SERIAL_ULAW )
         Reporter::reportEvent( 1, "Using Serial Ulaw input device:",
                                   deviceName);
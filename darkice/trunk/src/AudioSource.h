@@ -241,6 +241,18 @@ class AudioSource : public Source, public virtual Reporter
 #endif
         }
 
+        /**
+         *  Tell if 8 bit data from this source is signed or unsigned.
+         *  Unsigned 8 bit samples are silent at 0x80, signed ones at 0.
+         *
+         *  @return true if 8 bit samples are signed, false if unsigned
+         */
+        virtual bool
+        isSigned8 ( void ) const            throw ()
+        {
+            return false;
+        }
+
         /**
          *  Get the sample rate per seconds for this AudioSource.
          *
@@ -330,6 +342,11 @@ class AudioSource : public Source, public virtual Reporter
 #include "SerialUlaw.h"
 #endif
 
+/*------------------------------------------------------------------------------
+ *  The already encoded input, always there
+ *----------------------------------------------------------------------------*/
+#include "RelaySource.h"
+
 
 /* ====================================================== function prototypes */
 
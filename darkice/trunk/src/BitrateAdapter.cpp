@@ -0,0 +1,199 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : BitrateAdapter.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+
+#include "Util.h"
+#include "Exception.h"
+#include "BitrateAdapter.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+BitrateAdapter :: init (    AudioEncoder          * encoder,
+                            BufferedSink          * buffer,
+                            TcpSocket             * socket,
+                            unsigned int            minBitrate,
+                            unsigned int            maxBitrate,
+                            unsigned int            maxDelay )
+                                                        throw ( Exception )
+{
+    if ( !encoder || !buffer || !socket ) {
+        throw Exception( __FILE__, __LINE__, "no encoder, buffer or socket");
+    }
+    if ( !minBitrate || minBitrate > maxBitrate ) {
+        throw Exception( __FILE__, __LINE__, "bad minimum bitrate",
+                         minBitrate);
+    }
+    if ( !maxDelay ) {
+        throw Exception( __FILE__, __LINE__, "no maximum delay");
+    }
+
+    this->encoder    = encoder;
+    this->buffer     = buffer;
+    this->socket     = socket;
+    this->minBitrate = minBitrate;
+    this->maxBitrate = maxBitrate;
+    this->maxDelay   = maxDelay;
+    this->adapting   = true;
+    this->lastCheck  = 0;
+    this->lastChange = 0;
+    this->lowSince   = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the encoder
+ *----------------------------------------------------------------------------*/
+bool
+BitrateAdapter :: open ( void )                         throw ( Exception )
+{
+    unsigned long long  now = Util::getMonotonicTime();
+
+    // give the new connection some time before judging it
+    lastCheck  = now;
+    lastChange = now;
+    lowSince   = now;
+
+    return encoder->open();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write data to the encoder
+ *----------------------------------------------------------------------------*/
+unsigned int
+BitrateAdapter :: write (   const void    * buf,
+                            unsigned int    len )       throw ( Exception )
+{
+    if ( adapting ) {
+        adapt();
+    }
+
+    return encoder->write( buf, len);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write silent audio to the encoder
+ *----------------------------------------------------------------------------*/
+unsigned int
+BitrateAdapter :: writeSilent ( const void    * buf,
+                                unsigned int    len )   throw ( Exception )
+{
+    if ( adapting ) {
+        adapt();
+    }
+
+    return encoder->writeSilent( buf, len);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Check the backlog, and change the bit rate if needed
+ *----------------------------------------------------------------------------*/
+void
+BitrateAdapter :: adapt ( void )                        throw ( Exception )
+{
+    unsigned long long  now     = Util::getMonotonicTime();
+    unsigned int        bitrate = encoder->getOutBitrate();
+    unsigned long       delay;
+
+    if ( now - lastCheck < checkInterval || !bitrate ) {
+        return;
+    }
+    lastCheck = now;
+
+    // the time it takes to send what is buffered, and what the socket
+    // holds at the current bit rate: bits / (kbits / sec) = msec
+    delay = buffer->getLag()
+          + (unsigned long long) socket->getBacklog() * 8 / bitrate;
+
+    if ( delay > maxDelay ) {
+        lowSince = now;
+        if ( bitrate > minBitrate && now - lastChange >= downInterval ) {
+            unsigned int    step = bitrate * 3 / 4;
+
+            changeBitrate( step > minBitrate ? step : minBitrate, now);
+        }
+    } else if ( delay > maxDelay / 4 ) {
+        lowSince = now;
+    } else if ( bitrate < maxBitrate && now - lowSince >= upInterval ) {
+        unsigned int    step = bitrate + (maxBitrate + 7) / 8;
+
+        changeBitrate( step < maxBitrate ? step : maxBitrate, now);
+        lowSince = now;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Change the bit rate of the encoder
+ *----------------------------------------------------------------------------*/
+void
+BitrateAdapter :: changeBitrate (   unsigned int            bitrate,
+                                    unsigned long long      now )
+                                                        throw ( Exception )
+{
+    unsigned int    oldBitrate = encoder->getOutBitrate();
+
+    if ( !encoder->setOutBitrate( bitrate) ) {
+        reportEvent( 2, "encoder can't change bitrate, not adapting");
+        adapting = false;
+        return;
+    }
+
+    lastChange = now;
+    reportEvent( 2, "adapted bitrate from", oldBitrate,
+                    "to", encoder->getOutBitrate());
+}
+
@@ -0,0 +1,346 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : BitrateAdapter.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef BITRATE_ADAPTER_H
+#define BITRATE_ADAPTER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Ref.h"
+#include "Reporter.h"
+#include "Sink.h"
+#include "AudioEncoder.h"
+#include "BufferedSink.h"
+#include "TcpSocket.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A Sink in front of an audio encoder, that adapts the bit rate of
+ *  the encoder to what the network connection of the output can take.
+ *  The backlog of the output, the data buffered but not yet received by
+ *  the server, is checked as data is written. If it grows beyond a
+ *  limit, the bit rate is stepped down, and once the backlog stays low
+ *  for a while, it is stepped back up, within the bounds given.
+ *
+ *  As the bit rate is changed from write(), it is changed in the thread
+ *  doing the encoding.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class BitrateAdapter : public Sink, public virtual Reporter
+{
+    private:
+
+        /**
+         *  How often to check the backlog, in microseconds.
+         */
+        static const unsigned long long checkInterval = 1000000ULL;
+
+        /**
+         *  The minimum time between stepping the bit rate down,
+         *  to let the backlog drain at the new bit rate, in microseconds.
+         */
+        static const unsigned long long downInterval = 5000000ULL;
+
+        /**
+         *  How long the backlog has to stay low before stepping the bit
+         *  rate up, in microseconds.
+         */
+        static const unsigned long long upInterval = 30000000ULL;
+
+        /**
+         *  The encoder to adapt the bit rate of.
+         */
+        Ref<AudioEncoder>       encoder;
+
+        /**
+         *  The buffer of the output.
+         */
+        Ref<BufferedSink>       buffer;
+
+        /**
+         *  The socket of the output.
+         */
+        Ref<TcpSocket>          socket;
+
+        /**
+         *  The lowest bit rate to step down to, in kbits/sec.
+         */
+        unsigned int            minBitrate;
+
+        /**
+         *  The highest bit rate to step up to, in kbits/sec.
+         */
+        unsigned int            maxBitrate;
+
+        /**
+         *  The backlog to step the bit rate down at, in milliseconds.
+         */
+        unsigned int            maxDelay;
+
+        /**
+         *  False if the encoder turned out not to support changing
+         *  its bit rate.
+         */
+        bool                    adapting;
+
+        /**
+         *  The time the backlog was last checked.
+         */
+        unsigned long long      lastCheck;
+
+        /**
+         *  The time the bit rate was last changed.
+         */
+        unsigned long long      lastChange;
+
+        /**
+         *  The time since the backlog has been low.
+         */
+        unsigned long long      lowSince;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param encoder the encoder to adapt the bit rate of.
+         *  @param buffer the buffer of the output.
+         *  @param socket the socket of the output.
+         *  @param minBitrate the lowest bit rate, in kbits/sec.
+         *  @param maxBitrate the highest bit rate, in kbits/sec.
+         *  @param maxDelay the backlog to step down at, in milliseconds.
+         *  @exception Exception
+         */
+        void
+        init (  AudioEncoder          * encoder,
+                BufferedSink          * buffer,
+                TcpSocket             * socket,
+                unsigned int            minBitrate,
+                unsigned int            maxBitrate,
+                unsigned int            maxDelay )      throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        inline void
+        strip ( void )                                  throw ( Exception )
+        {
+        }
+
+        /**
+         *  Check the backlog, and change the bit rate if needed.
+         *
+         *  @exception Exception
+         */
+        void
+        adapt ( void )                                  throw ( Exception );
+
+        /**
+         *  Change the bit rate of the encoder.
+         *
+         *  @param bitrate the new bit rate, in kbits/sec.
+         *  @param now the current time.
+         *  @exception Exception
+         */
+        void
+        changeBitrate ( unsigned int            bitrate,
+                        unsigned long long      now )   throw ( Exception );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        BitrateAdapter ( void )                         throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param encoder the encoder to adapt the bit rate of.
+         *  @param buffer the buffer of the output.
+         *  @param socket the socket of the output.
+         *  @param minBitrate the lowest bit rate to step down to,
+         *         in kbits/sec.
+         *  @param maxBitrate the highest bit rate to step up to,
+         *         in kbits/sec.
+         *  @param maxDelay the backlog to step the bit rate down at,
+         *         in milliseconds.
+         *  @exception Exception
+         */
+        inline
+        BitrateAdapter (    AudioEncoder          * encoder,
+                            BufferedSink          * buffer,
+                            TcpSocket             * socket,
+                            unsigned int            minBitrate,
+                            unsigned int            maxBitrate,
+                            unsigned int            maxDelay )
+                                                        throw ( Exception )
+        {
+            init( encoder, buffer, socket, minBitrate, maxBitrate, maxDelay);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~BitrateAdapter ( void )                        throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Open the encoder.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                                   throw ( Exception );
+
+        /**
+         *  Check if the encoder is open.
+         *
+         *  @return true if the encoder is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return encoder->isOpen();
+        }
+
+        /**
+         *  Check if the encoder is ready to accept data.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the encoder is ready to accept data,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canWrite (  unsigned int    sec,
+                    unsigned int    usec )              throw ( Exception )
+        {
+            return encoder->canWrite( sec, usec);
+        }
+
+        /**
+         *  Write data to the encoder, adapting the bit rate first
+         *  if needed.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written (may be less than len).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        write ( const void    * buf,
+                unsigned int    len )                   throw ( Exception );
+
+        /**
+         *  Write audio known to be silent to the encoder, adapting the
+         *  bit rate first if needed.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written (may be less than len).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeSilent (   const void    * buf,
+                        unsigned int    len )           throw ( Exception );
+
+        /**
+         *  Flush the encoder.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        flush ( void )                                  throw ( Exception )
+        {
+            encoder->flush();
+        }
+
+        /**
+         *  Cut what the encoder has been doing so far, and start anew.
+         */
+        inline virtual void
+        cut ( void )                                    throw ()
+        {
+            encoder->cut();
+        }
+
+        /**
+         *  Close the encoder.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        close ( void )                                  throw ( Exception )
+        {
+            encoder->close();
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* BITRATE_ADAPTER_H */
+
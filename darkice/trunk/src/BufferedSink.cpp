@@ -57,6 +57,7 @@
 
 
 #include "Exception.h"
+#include "Util.h"
 #include "BufferedSink.h"
 
 
@@ -95,12 +96,23 @@ BufferedSink :: init (  Sink          * sink,
     this->bufferSize  -= this->bufferSize % this->chunkSize;
     this->peak         = 0;
     this->misalignment = 0;
-    this->buffer       = new unsigned char[bufferSize];
-    this->bufferEnd    = buffer + bufferSize;
-    this->inp          = buffer;
-    this->outp         = buffer;
+    // the ring may be larger, but only bufferSize bytes of it are used
+    this->ring         = new RingBuffer( bufferSize ? bufferSize : 1);
     this->bOpen        = true;
     this->openAttempts = 0; 
+    this->framed       = false;
+    this->inTotal      = 0;
+    this->outTotal     = 0;
+    this->frameStart   = 0;
+    this->droppedFrames = 0;
+    this->frames.clear();
+    this->spool        = 0;
+    this->spoolRate    = 0;
+    this->spoolStart   = 0;
+    this->reopenTime   = 0;
+    this->rateStart    = Util::getMonotonicTime();
+    this->rateBytes    = 0;
+    this->inRate       = 0;
 }
 
 
@@ -116,7 +128,11 @@ BufferedSink :: BufferedSink (  const BufferedSink &  buffer )
     this->misalignment = buffer.misalignment;
     this->bOpen        = buffer.bOpen;
     this->openAttempts = buffer.openAttempts; 
-    memcpy( this->buffer, buffer.buffer, this->bufferSize);
+    this->droppedFrames = buffer.droppedFrames;
+    this->spool        = buffer.spool;
+    this->spoolRate    = buffer.spoolRate;
+    this->inTotal      = ring->put( buffer.ring->getReadPtr(),
+                                    buffer.ring->getUsed());
 }
 
 
@@ -131,7 +147,7 @@ BufferedSink :: strip ( void )                      throw ( Exception )
     }
 
     sink = 0;                                   // delete the reference
-    delete buffer;
+    delete ring;
 }
 
 
@@ -151,7 +167,11 @@ BufferedSink :: operator= (     const BufferedSink &  buffer )
         this->misalignment = buffer.misalignment;
         this->bOpen        = buffer.bOpen;
         this->openAttempts = buffer.openAttempts;
-        memcpy( this->buffer, buffer.buffer, this->bufferSize);
+        this->droppedFrames = buffer.droppedFrames;
+        this->spool        = buffer.spool;
+        this->spoolRate    = buffer.spoolRate;
+        this->inTotal      = ring->put( buffer.ring->getReadPtr(),
+                                        buffer.ring->getUsed());
     }
 
     return *this;
@@ -172,8 +192,7 @@ BufferedSink :: store (     const void    * buffer,
 {
     const unsigned char   * buf;
     unsigned int            size;
-    unsigned int            i;
-    unsigned char         * oldInp;
+    unsigned int            used;
 
     if ( !buffer ) {
         throw Exception( __FILE__, __LINE__, "buffer is null");
@@ -183,8 +202,12 @@ BufferedSink :: store (     const void    * buffer,
         return 0;
     }
 
-    unsigned int remaining = this->bufferSize - ( outp <= inp ? inp - outp : 
-                             (bufferEnd - outp) + (inp - this->buffer) );
+    unsigned int remaining = this->bufferSize - ring->getUsed();
+
+    if ( framed && remaining < bufferSize && bufferSize <= this->bufferSize
+      && dropFrames( bufferSize - remaining) ) {
+        remaining = this->bufferSize - ring->getUsed();
+    }
 
     // react only to the first overrun whenever there is a series of overruns
     if ( remaining + chunkSize <= bufferSize && remaining > chunkSize  ) {
@@ -193,7 +216,6 @@ BufferedSink :: store (     const void    * buffer,
                          "buffer overrun");
     }
 
-    oldInp = inp;
     buf    = (const unsigned char *) buffer;
     
     // adjust so it is a multiple of chunkSize
@@ -201,67 +223,174 @@ BufferedSink :: store (     const void    * buffer,
 
     // cut the front of the supplied buffer if it wouldn't fit
     if ( bufferSize > this->bufferSize ) {
-        size  = this->bufferSize - 1;
-        size -= size % chunkSize;       // keep it a multiple of chunkSize
+        size  = this->bufferSize;
         buf  += bufferSize - size;
     } else {
         size = bufferSize;
     }
 
-    // copy the data into the buffer
-    i = bufferEnd - inp;
-    if ( (i % chunkSize) != 0 ) {
-        throw Exception( __FILE__, __LINE__, "copy quantity not aligned", i);
+    // lose the oldest data if there is not enough room
+    used = ring->getUsed();
+    if ( used + size > this->bufferSize ) {
+        ring->release( used + size - this->bufferSize);
+        consume( used + size - this->bufferSize);
     }
 
-    if ( size <= i ) {
-        // the place between inp and bufferEnd is
-        // big enough to hold the data
-        
-        memcpy( inp, buf, size);
-        inp = slidePointer( inp, size);
+    // the free space of the ring is always contiguous
+    memcpy( ring->getWritePtr(), buf, size);
+    ring->commit( size);
+    inTotal += size;
 
-        // adjust outp, lose the data that was overwritten, if any
-        if ( outp > oldInp && outp <= inp ) {
-            outp = slidePointer( inp, chunkSize);
-        }
+    updatePeak();
 
-    } else {
-        // the place between inp and bufferEnd is not
-        // big enough to hold the data
-        // writing will take place in two turns, once from
-        // inp -> bufferEnd, then from buffer ->
-
-        memcpy( inp, buf, i);
-        i = size - i;
-        if ( (i % chunkSize) != 0 ) {
-            throw Exception(__FILE__, __LINE__, "copy quantity not aligned", i);
-        }
-        memcpy( this->buffer, buf, i);
-        inp = slidePointer( this->buffer, i);
-        
-        // adjust outp, lose the data that was overwritten, if any
-        if ( outp <= oldInp ) {
-            if ( outp < inp ) {
-                outp = slidePointer( inp, chunkSize);
-            }
-        } else {
-            outp = slidePointer( inp, chunkSize);
+    return size;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Account for len bytes removed from the start of the buffer
+ *  Forget the frame ends passed, and remember where the frame at the
+ *  start of the buffer started
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: consume (   unsigned int    len )       throw ()
+{
+    outTotal += len;
+
+    while ( !frames.empty() && frames.front() <= outTotal ) {
+        frameStart = frames.front();
+        frames.pop_front();
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Drop the oldest whole frames to make room for need bytes
+ *----------------------------------------------------------------------------*/
+bool
+BufferedSink :: dropFrames (    unsigned int    need )  throw ()
+{
+    std::deque<unsigned long long>::iterator    it       = frames.begin();
+    unsigned long long                          start    = outTotal;
+    unsigned int                                headLen  = 0;
+    unsigned int                                dropped  = 0;
+    unsigned int                                noFrames = 0;
+    unsigned char                             * head     = ring->getReadPtr();
+
+    // the frame at the start was partly sent already, it has to be completed
+    if ( outTotal > frameStart ) {
+        if ( it == frames.end() ) {
+            return false;
         }
+        start   = *it;
+        headLen = start - outTotal;
+        ++it;
     }
 
-    updatePeak();
+    for ( ; it != frames.end() && dropped < need; ++it ) {
+        dropped = *it - start;
+        ++noFrames;
+    }
 
-    if ( ((inp - this->buffer) % chunkSize) != 0 ) {
-        throw Exception( __FILE__, __LINE__,
-                         "inp not aligned", inp - this->buffer);
+    if ( dropped < need ) {
+        return false;
     }
-    if ( ((outp - this->buffer) % chunkSize) != 0 ) {
-        throw Exception( __FILE__, __LINE__,
-                         "outp not aligned", outp - this->buffer);
+
+    // move the rest of the partly sent frame right before the frames kept
+    memmove( head + dropped, head, headLen);
+
+    // the end of the last dropped frame becomes the end of the kept one
+    frames.erase( frames.begin(), frames.begin() + noFrames);
+    ring->release( dropped);
+    outTotal   += dropped;
+    frameStart += dropped;
+
+    droppedFrames += noFrames;
+    reportEvent( 4, "BufferedSink :: dropFrames, dropped frames:", noFrames,
+                 "total:", droppedFrames);
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Mark the end of a frame at the end of the data written so far
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: markFrameEnd ( void )               throw ( Exception )
+{
+    if ( chunkSize != 1 ) {
+        return;
     }
 
-    return size;
+    framed = true;
+
+    if ( inTotal == outTotal ) {
+        // all has been written already, the next frame starts here
+        frameStart = inTotal;
+    } else if ( frames.empty() || frames.back() != inTotal ) {
+        frames.push_back( inTotal);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Append data to the spool
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: spoolData ( const struct iovec    * vec,
+                            unsigned int            count )     throw ()
+{
+    if ( !isSpooling() ) {
+        spoolStart = Util::getMonotonicTime();
+        reportEvent( 2, "BufferedSink, buffer full, spooling to",
+                     spool->getFileName());
+    }
+
+    if ( !spool->append( vec, count) ) {
+        if ( framed ) {
+            ++droppedFrames;
+        }
+        reportEvent( 4, "BufferedSink :: spoolData, spool full, dropped",
+                     Util::vecLen( vec, count));
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send spooled data, paced to spoolRate percent of len
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: drainSpool (    unsigned int    len )   throw ()
+{
+    const unsigned char   * data;
+    unsigned int            size;
+    unsigned int            limit = (unsigned long long) len * spoolRate / 100;
+    unsigned int            soFar = 0;
+    unsigned int            length;
+
+    while ( soFar < limit && sink->canWrite( 0, 0) ) {
+        if ( !(data = spool->peek( size)) ) {
+            break;
+        }
+        size = size < limit - soFar ? size : limit - soFar;
+        try {
+            length = sink->write( data, size);
+        } catch ( Exception &e ) {
+            length = 0;
+            reportEvent( 3, "Exception caught in BufferedSink :: drainSpool");
+        }
+        if ( !length ) {
+            break;
+        }
+        spool->release( length);
+        soFar += length;
+    }
+
+    if ( soFar && !isSpooling() ) {
+        reportEvent( 2, "BufferedSink, spool sent, live again after seconds:",
+                     (Util::getMonotonicTime() - spoolStart) / 1000000);
+    }
 }
 
 
@@ -273,14 +402,40 @@ unsigned int
 BufferedSink :: write (    const void    * buf,
                            unsigned int    len )       throw ( Exception )
 {
-    unsigned int    length = 0;
-    unsigned int    soFar = 0;
-    unsigned char * b = (unsigned char *) buf;
+    struct iovec    vec;
 
     if ( !buf ) {
         throw Exception( __FILE__, __LINE__, "buf is null");
     }
 
+    vec.iov_base = (void *) buf;
+    vec.iov_len  = len;
+
+    return writeVec( &vec, 1);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write some data from several buffers to the sink
+ *----------------------------------------------------------------------------*/
+unsigned int
+BufferedSink :: writeVec ( const struct iovec    * vec,
+                           unsigned int            count )  throw ( Exception )
+{
+    struct iovec        fresh[maxVec];
+    struct iovec      * v;
+    unsigned int        n;
+    unsigned int        len;
+    unsigned int        length = 0;
+    unsigned int        soFar  = 0;
+    unsigned int        size;
+    unsigned int        i;
+
+    if ( count > maxVec || (count > 1 && chunkSize > 1) ) {
+        // write the buffers one by one
+        return Sink::writeVec( vec, count);
+    }
+
     if ( !isOpen() ) {
         return 0;
     }
@@ -289,7 +444,7 @@ BufferedSink :: write (    const void    * buf,
         return 0;
     }
     
-    if ( !sink->isOpen() && openAttempts < 10 ) {
+    if ( !sink->isOpen() && openAttempts < 10 && !spool.get() ) {
         // try to reopen underlying sink, because it has closed on its own
         openAttempts++;
         try {
@@ -309,104 +464,119 @@ BufferedSink :: write (    const void    * buf,
             throw Exception( __FILE__, __LINE__,
                              "reopen failed");
         }
+    } else if ( !sink->isOpen() && spool.get()
+             && Util::getMonotonicTime() - reopenTime >= reopenDelay ) {
+        // with a spool, keep on trying for as long as it takes,
+        // while spooling what can't be sent
+        reopenTime = Util::getMonotonicTime();
+        try {
+            sink->open();
+        } catch ( Exception &e ) {
+            reportEvent( 4,"BufferedSink :: write,",
+                         "couldn't reopen underlying sink, spooling");
+        }
     }
 
     // make it a multiple of chunkSize
+    len  = Util::vecLen( vec, count);
     len -= len % chunkSize;
 
-    // try to write data from the buffer first, if any
-    if ( inp != outp ) {
-        unsigned int    size  = 0;
-        unsigned int    total = 0;
-
-        if ( outp > inp ) {
-            // valuable data is between outp -> bufferEnd and buffer -> inp
-            // try to write the outp -> bufferEnd
-            // the rest will be written in the next if
-
-            size    = bufferEnd - outp;
-            size   -= size % chunkSize;
-            if( size > len * 2 ) {
-                // do not try to send the content of the entire buffer at once,
-                // but limit sending to a multiple of len
-                // this prevents a surge of data to underlying buffer
-                // which is important especially during a lot of packet loss
-                size = len * 2;
-            }
-            soFar   = 0;
-
-            while ( outp > inp && soFar < size && sink->canWrite( 0, 0) ) {
-                try {
-                    length  = sink->write( outp + soFar, size - soFar);
-                } catch (Exception &e) {
-                    length = 0;
-                    reportEvent(3,"Exception caught in BufferedSink :: write1");
-                }
-                outp    = slidePointer( outp, length);
-                soFar  += length;
-            }
+    // measure the rate the data comes in at
+    {
+        unsigned long long  now = Util::getMonotonicTime();
 
-            total += soFar;
+        rateBytes += len;
+        if ( now - rateStart >= 1000000 ) {
+            inRate    = rateBytes * 1000000ULL / (now - rateStart);
+            rateStart = now;
+            rateBytes = 0;
         }
+    }
 
-        if ( outp < inp ) {
-            // valuable data is between outp and inp
-            // in the previous if wrote all data from the end
-            // this part will write the rest
+    // try to write data from the buffer first, if any
+    if ( (size = ring->getUsed()) ) {
+        if( size > len * 2 ) {
+            // do not try to send the content of the entire buffer at once,
+            // but limit sending to a multiple of len
+            // this prevents a surge of data to underlying buffer
+            // which is important especially during a lot of packet loss
+            size = len * 2;
+        }
+        size -= size % chunkSize;
 
-            size    = inp - outp;
-            if( size > len * 2 ) {
-                // prevent a surge of data to underlying buffer
-                size = len * 2;
+        // the stored data is contiguous, even if it wraps around
+        while ( soFar < size && sink->canWrite( 0, 0) ) {
+            try {
+                length  = sink->write( ring->getReadPtr(), size - soFar);
+            } catch (Exception &e) {
+                length = 0;
+                reportEvent(3,"Exception caught in BufferedSink :: write1");
             }
-            soFar   = 0;
-
-            while ( soFar < size && sink->canWrite( 0, 0) ) {
-                try {
-                    length  = sink->write( outp + soFar, size - soFar);
-                } catch (Exception &e) {
-                    length = 0;
-                    reportEvent(3,"Exception caught in BufferedSink :: write2" );
-                }
-                outp    = slidePointer( outp, length);
-                soFar  += length;
+            if ( !length ) {
+                break;
             }
-
-            total += soFar;
-        }
-
-        while ( (outp - buffer) % chunkSize ) {
-            slidePointer( outp, 1);
+            ring->release( length);
+            soFar  += length;
+            consume( length);
         }
 
         // calulate the misalignment to chunkSize boundaries
-        misalignment = (chunkSize - (total % chunkSize)) % chunkSize;
+        misalignment = (chunkSize - (soFar % chunkSize)) % chunkSize;
     }
 
     if ( !align() ) {
         return 0;
     }
 
+    // catch up with the spool once the buffer has been emptied
+    if ( isSpooling() && !ring->getUsed() ) {
+        drainSpool( len);
+    }
+
+    // only write the whole chunks of the fresh data
+    memcpy( fresh, vec, count * sizeof(struct iovec));
+    v = fresh;
+    n = count;
+    if ( n > 0 ) {
+        fresh[n - 1].iov_len -= Util::vecLen( fresh, n) - len;
+    }
+
     // the internal buffer is empty, try to write the fresh data
+    // directly, without copying it into the buffer
     soFar = 0;
-    if ( inp == outp ) { 
+    if ( !ring->getUsed() && !isSpooling() ) { 
         while ( soFar < len && sink->canWrite( 0, 0) ) {
             try {
-                soFar += sink->write( b + soFar, len - soFar);
+                length = sink->writeVec( v, n);
             } catch (Exception &e) {
+                length = 0;
                 reportEvent(3,"Exception caught in BufferedSink :: write3");
             }
+            if ( !length ) {
+                break;
+            }
+            soFar += length;
+            v      = Util::skipVec( v, n, length);
         }
+        inTotal  += soFar;
+        outTotal += soFar;
     }
-    length = soFar;
 
     // calulate the misalignment to chunkSize boundaries
-    misalignment = (chunkSize - (length % chunkSize)) % chunkSize;
+    misalignment = (chunkSize - (soFar % chunkSize)) % chunkSize;
 
-    if ( length < len ) {
+    if ( soFar < len ) {
         // if not all fresh could be written, store the remains
-
-        store( b + length, len - length);
+        // once spooling, keep spooling, so that the order is kept
+        if ( spool.get() && chunkSize == 1
+          && ( isSpooling()
+            || ring->getUsed() + (len - soFar) > bufferSize ) ) {
+            spoolData( v, n);
+        } else {
+            for ( i = 0; i < n; ++i ) {
+                store( v[i].iov_base, v[i].iov_len);
+            }
+        }
     }
 
     updatePeak();
@@ -428,7 +598,14 @@ BufferedSink :: close ( void )                      throw ( Exception )
 
     flush();
     sink->close();
-    inp = outp = buffer;
+    ring->clear();
+    inTotal = outTotal = frameStart = 0;
+    frames.clear();
     bOpen = false;
+
+    if ( droppedFrames ) {
+        reportEvent( 3, "BufferedSink :: close, frames dropped on overflow:",
+                     droppedFrames);
+    }
 }
 
@@ -36,8 +36,12 @@
 
 /* ============================================================ include files */
 
+#include <deque>
+
 #include "Ref.h"
 #include "Reporter.h"
+#include "RingBuffer.h"
+#include "DiskSpool.h"
 #include "Sink.h"
 
 
@@ -53,6 +57,12 @@
  *  A Sink First-In First-Out buffer.
  *  This buffer can always be written to, it overwrites any
  *  data contained if needed.
+ *  If the writer marks the ends of the encoded frames with
+ *  markFrameEnd(), the oldest whole frames are dropped on overflow,
+ *  instead of cutting into the data at an arbitrary byte.
+ *  With a DiskSpool set, data that does not fit into the buffer is
+ *  spooled to disk instead, and sent once the buffer has been emptied,
+ *  faster than realtime, until the output catches up.
  *  The class is not thread-safe.
  *
  *  @author  $Author$
@@ -63,17 +73,24 @@ class BufferedSink : public Sink, public virtual Reporter
     private:
 
         /**
-         *  The buffer.
+         *  The maximum number of buffers handled by writeVec() at once.
          */
-        unsigned char     * buffer;
+        static const unsigned int   maxVec = 8;
 
         /**
-         *  The end of the buffer.
+         *  The time to wait between attempts to reopen the underlying
+         *  Sink when spooling, in microseconds.
          */
-        unsigned char     * bufferEnd;
+        static const unsigned int   reopenDelay = 1000000;
 
         /**
-         *  The size of the buffer.
+         *  The buffer.
+         */
+        RingBuffer        * ring;
+
+        /**
+         *  The size of the buffer. The ring may be larger, but only
+         *  this much of it is used.
          */
         unsigned int        bufferSize;
 
@@ -94,16 +111,6 @@ class BufferedSink : public Sink, public virtual Reporter
          */
         unsigned int        misalignment;
 
-        /**
-         *  Start of free territory in buffer.
-         */
-        unsigned char     * inp;
-
-        /**
-         *  Start of sensible data in buffer.
-         */
-        unsigned char     * outp;
-
 
         /**
          *  The underlying Sink.
@@ -121,6 +128,78 @@ class BufferedSink : public Sink, public virtual Reporter
           */
         unsigned int       openAttempts;  
 
+        /**
+         *  Flag to show that the writer marks the frame ends.
+         */
+        bool                                framed;
+
+        /**
+         *  The stream position of the end of the data in the buffer.
+         *  Stream positions count the bytes ever stored, and are used
+         *  to refer to the frame ends.
+         */
+        unsigned long long                  inTotal;
+
+        /**
+         *  The stream position of the start of the data in the buffer.
+         */
+        unsigned long long                  outTotal;
+
+        /**
+         *  The stream position where the frame being sent started.
+         *  If less than outTotal, part of the frame at the start of the
+         *  buffer has already been written to the underlying Sink.
+         */
+        unsigned long long                  frameStart;
+
+        /**
+         *  The stream positions of the ends of the frames in the buffer.
+         */
+        std::deque<unsigned long long>      frames;
+
+        /**
+         *  The number of frames dropped so far because of overflow.
+         */
+        unsigned long                       droppedFrames;
+
+        /**
+         *  The disk spool taking the data that does not fit, if any.
+         */
+        Ref<DiskSpool>                      spool;
+
+        /**
+         *  The rate to send the spooled data at, in percent of the
+         *  rate the data is written at.
+         */
+        unsigned int                        spoolRate;
+
+        /**
+         *  The time spooling started at, in microseconds.
+         */
+        unsigned long long                  spoolStart;
+
+        /**
+         *  The time of the last attempt to reopen the underlying Sink,
+         *  in microseconds.
+         */
+        unsigned long long                  reopenTime;
+
+        /**
+         *  The start of the current period of measuring the rate the
+         *  data is written at, in microseconds.
+         */
+        unsigned long long                  rateStart;
+
+        /**
+         *  The number of bytes written in the current measuring period.
+         */
+        unsigned int                        rateBytes;
+
+        /**
+         *  The rate the data is written at, in bytes per second.
+         */
+        unsigned int                        inRate;
+
         /**
          *  Initialize the object.
          *
@@ -143,26 +222,61 @@ class BufferedSink : public Sink, public virtual Reporter
         strip ( void )                                  throw ( Exception );
 
         /**
-         *  Slide a pointer in the internal buffer by offset. If the pointer
-         *  would reach beyond the end of the buffer, it goes wraps around.
+         *  Account for data removed from the start of the buffer, either
+         *  because it has been written to the underlying Sink, or because
+         *  it was overwritten. The ring has to be released by the caller.
          *
-         *  @param p the pointer to slide.
-         *  @param offset the amount to slide with.
-         *  @return pointer p + offset, wrapped around if needed.
-         */
-        inline unsigned char *
-        slidePointer (
-                        unsigned char * p,
-                        unsigned int    offset )        throw ()
-        {
-            p += offset;
-            while ( p >= bufferEnd ) {
-                p -= bufferSize;
-            }
+         *  @param len the number of bytes removed.
+         */
+        void
+        consume (   unsigned int    len )               throw ();
 
-            return p;
+        /**
+         *  Make room in the buffer by dropping the oldest whole frames.
+         *  If the frame at the start of the buffer has been partly
+         *  written already, it is kept, and the frames after it are
+         *  dropped.
+         *
+         *  @param need the number of bytes to free up at least.
+         *  @return true if enough room was made, false if there were
+         *          not enough complete frames in the buffer. In this
+         *          case nothing is dropped.
+         */
+        bool
+        dropFrames (    unsigned int    need )          throw ();
+
+        /**
+         *  Tell if data is being spooled, that is, the output is
+         *  not live.
+         *
+         *  @return true if the spool holds data, false otherwise.
+         */
+        inline bool
+        isSpooling ( void ) const                       throw ()
+        {
+            return spool.get() && spool->getPending() > 0;
         }
 
+        /**
+         *  Append data to the spool. If the spool is full, the data
+         *  is dropped.
+         *
+         *  @param vec the buffers to spool.
+         *  @param count the number of buffers in vec.
+         */
+        void
+        spoolData ( const struct iovec    * vec,
+                    unsigned int            count )     throw ();
+
+        /**
+         *  Send spooled data to the underlying Sink, at most spoolRate
+         *  percent of the length of the data just written.
+         *
+         *  @param len the number of bytes just written.
+         */
+        void
+        drainSpool (    unsigned int    len )           throw ();
+
         /**
          *  Update the peak buffer usage indicator.
          *
@@ -173,7 +287,7 @@ class BufferedSink : public Sink, public virtual Reporter
         {
             unsigned int    u;
 
-            u = outp <= inp ? inp - outp : (bufferEnd - outp) + (inp - buffer);
+            u = ring->getUsed();
             
             // report new peaks if it is either significantly more severe than
             // the previously reported peak
@@ -315,6 +429,59 @@ class BufferedSink : public Sink, public virtual Reporter
             return peak;
         }
 
+        /**
+         *  Get the number of frames dropped because of overflow.
+         *
+         *  @return the number of frames dropped so far.
+         */
+        inline unsigned long
+        getDroppedFrames ( void ) const                 throw ()
+        {
+            return droppedFrames;
+        }
+
+        /**
+         *  Set a disk spool to take the data that does not fit into
+         *  the buffer. Only used if chunkSize is 1.
+         *
+         *  @param spool the spool to use, or 0 not to spool.
+         *  @param rate the rate to send the spooled data at, in percent
+         *         of the rate the data is written at. Must be more than
+         *         100 for the output to catch up.
+         */
+        inline void
+        setSpool (  DiskSpool     * spool,
+                    unsigned int    rate )              throw ()
+        {
+            this->spool     = spool;
+            this->spoolRate = rate;
+        }
+
+        /**
+         *  Get the number of bytes waiting in the spool.
+         *
+         *  @return the number of bytes spooled, not yet sent.
+         */
+        inline unsigned long long
+        getSpooled ( void ) const                       throw ()
+        {
+            return spool.get() ? spool->getPending() : 0;
+        }
+
+        /**
+         *  Get how far the output is behind, that is, how long it takes
+         *  to write the data buffered and spooled, at the rate data is
+         *  written at.
+         *
+         *  @return the lag of the output, in milliseconds.
+         */
+        inline unsigned long
+        getLag ( void ) const                           throw ()
+        {
+            return inRate ? (ring->getUsed() + getSpooled()) * 1000 / inRate
+                          : 0;
+        }
+
         /**
          *  Open the BufferedSink. Opens the underlying Sink.
          *  
@@ -372,6 +539,32 @@ class BufferedSink : public Sink, public virtual Reporter
         write (    const void    * buf,
                    unsigned int    len )                throw ( Exception );
 
+        /**
+         *  Write data from several buffers to the BufferedSink.
+         *  Works as write(), but hands the data to the underlying Sink
+         *  with as few writeVec() calls as possible. Stored data that
+         *  wraps around the end of the internal buffer is written with
+         *  a single call as well.
+         *
+         *  @param vec the buffers to write, in order.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes written (may be less than the
+         *          total length of the buffers).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeVec ( const struct iovec    * vec,
+                   unsigned int            count )      throw ( Exception );
+
+        /**
+         *  Mark the end of an encoded frame, at the end of the data
+         *  written so far. Only used if chunkSize is 1.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        markFrameEnd ( void )                           throw ( Exception );
+
         /**
          *  Flush all data that was written to the BufferedSink to the
          *  underlying Sink.
@@ -114,10 +114,13 @@ CastSink :: open ( void )                       throw ( Exception )
         return false;
     }
 
+    // send the login headers in as few segments as possible
+    getSocket()->setCork( true);
     if ( !sendLogin() ) {
         close();
         return false;
     }
+    getSocket()->setCork( false);
 
     if ( streamDump != 0 ) {
         if ( !streamDump->isOpen() ) {
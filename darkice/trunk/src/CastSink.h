@@ -179,6 +179,24 @@ class CastSink : public Sink, public virtual Reporter
             return socket.get();
         }
 
+        /**
+         *  Send stream data to the server. The default implementation
+         *  writes the data to the socket as it is, subclasses that need
+         *  to frame the data on the wire override this.
+         *
+         *  @param vec the buffers to send, in order.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes of stream data sent (may be less
+         *          than the total length of the buffers).
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        sendData (  const struct iovec    * vec,
+                    unsigned int            count )     throw ( Exception )
+        {
+            return getSink()->writeVec( vec, count);
+        }
+
 
     public:
 
@@ -325,11 +343,34 @@ class CastSink : public Sink, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        throw ( Exception )
         {
+            struct iovec    vec;
+
             if ( streamDump != 0 ) {
                 streamDump->write( buf, len);
             }
 
-            return getSink()->write( buf, len);
+            vec.iov_base = (void *) buf;
+            vec.iov_len  = len;
+            return sendData( &vec, 1);
+        }
+
+        /**
+         *  Write data from several buffers to the CastSink.
+         *
+         *  @param vec the buffers to write, in order.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes written (may be less than the
+         *          total length of the buffers).
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        writeVec (     const struct iovec    * vec,
+                       unsigned int            count )  throw ( Exception )
+        {
+            if ( streamDump != 0 ) {
+                streamDump->writeVec( vec, count);
+            }
+            return sendData( vec, count);
         }
 
         /**
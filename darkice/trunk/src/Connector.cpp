@@ -55,9 +55,10 @@ static const char fileid[] = "$Id$";
 void
 Connector :: init ( Source          * source )        throw ( Exception )
 {
-    this->source   = source;
-    this->sinks    = 0;
-    this->numSinks = 0;
+    this->source          = source;
+    this->sinks           = 0;
+    this->numSinks        = 0;
+    this->silenceDetector = 0;
 }
 
 
@@ -67,7 +68,8 @@ Connector :: init ( Source          * source )        throw ( Exception )
 void
 Connector :: strip ( void )                             throw ( Exception )
 {
-    source = 0;
+    source          = 0;
+    silenceDetector = 0;
 
     if ( sinks ) {
         unsigned int    u;
@@ -89,6 +91,7 @@ Connector :: Connector (    const Connector &   connector ) throw ( Exception )
     unsigned int    u;
 
     init( connector.source.get());
+    silenceDetector = connector.silenceDetector;
 
     for ( u = 0; u < connector.numSinks; ++u ) {
         attach( connector.sinks[u].get() );
@@ -110,6 +113,7 @@ Connector :: operator= (    const Connector &   connector ) throw ( Exception )
 
         // then fill in
         init( connector.source.get() );
+        silenceDetector = connector.silenceDetector;
 
         for ( u = 0; u < connector.numSinks; ++u ) {
             attach( connector.sinks[u].get() );
@@ -269,16 +273,24 @@ Connector :: transfer ( unsigned long       bytes,
         return 0;
     }
 
-    unsigned char * buf = new unsigned char[bufSize];
+    // with sources that can, the sinks read the data in place
+    bool            inPlace = source->canReadInPlace();
+    unsigned char * buf     = inPlace ? 0 : new unsigned char[bufSize];
 
     reportEvent( 6, "Connector :: transfer, bytes", bytes);
     
     for ( b = 0; !bytes || b < bytes; ) {
         unsigned int    d = 0;
         unsigned int    e = 0;
+        bool            silent;
+        const void    * data = buf;
 
         if ( source->canRead( sec, usec) ) {
-            d = source->read( buf, bufSize);
+            if ( inPlace ) {
+                d = source->readInPlace( &data, bufSize);
+            } else {
+                d = source->read( buf, bufSize);
+            }
 
             // check for EOF
             if ( d == 0 ) {
@@ -286,12 +298,16 @@ Connector :: transfer ( unsigned long       bytes,
                 break;
             }
 
+            silent = silenceDetector.get()
+                  && silenceDetector->isSilent( data, d);
+
             for ( u = 0; u < numSinks; ++u ) {
 
                 if ( sinks[u]->canWrite( sec, usec) ) {
                     try {
                         // we expect the sink to accept all data written
-                        e = sinks[u]->write( buf, d);
+                        e = silent ? sinks[u]->writeSilent( data, d)
+                                   : sinks[u]->write( data, d);
                     } catch ( Exception     & e ) {
                         sinks[u]->close();
                         detach( sinks[u].get() );
@@ -303,6 +319,9 @@ Connector :: transfer ( unsigned long       bytes,
                         if ( numSinks == 0 ) {
                             reportEvent( 4,
                                         "Connector :: transfer, no more sinks");
+                            if ( inPlace ) {
+                                source->releaseInPlace( d);
+                            }
                             delete[] buf;
                             return b;
                         }
@@ -312,7 +331,10 @@ Connector :: transfer ( unsigned long       bytes,
                     }
                 }
             }
-            
+
+            if ( inPlace ) {
+                source->releaseInPlace( d);
+            }
             b += d;
         } else {
             reportEvent( 3, "Connector :: transfer, can't read");
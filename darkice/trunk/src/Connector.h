@@ -41,6 +41,7 @@
 #include "Reporter.h"
 #include "Source.h"
 #include "Sink.h"
+#include "SilenceDetector.h"
 
 
 /* ================================================================ constants */
@@ -96,6 +97,12 @@ class Connector : public virtual Referable, public virtual Reporter
          */
         unsigned int    numSinks;
 
+        /**
+         *  The detector of silence in the audio read from the source,
+         *  if any. Silent buffers are written with Sink::writeSilent().
+         */
+        Ref<SilenceDetector>    silenceDetector;
+
         /**
          *  Default constructor. Always throws an Exception.
          *
@@ -197,6 +204,19 @@ class Connector : public virtual Referable, public virtual Reporter
         virtual void
         attach (    Sink          * sink )              throw ( Exception );
 
+        /**
+         *  Set the detector of silence in the audio read from the source.
+         *  The buffers it finds silent are written to the Sinks as
+         *  silence, that encoders write as pre-encoded silent frames.
+         *
+         *  @param detector the silence detector, or 0 for none.
+         */
+        inline virtual void
+        setSilenceDetector (    SilenceDetector   * detector )  throw ()
+        {
+            silenceDetector = detector;
+        }
+
         /**
          *  Open the connector. Opens the Source and the Sinks if necessary.
          *
@@ -76,7 +76,12 @@
 #include "IceCast.h"
 #include "IceCast2.h"
 #include "ShoutCast.h"
+#include "ShoutCast2.h"
 #include "FileCast.h"
+#include "RtpSink.h"
+#include "HlsSink.h"
+#include "RelaySink.h"
+#include "HttpMount.h"
 #include "MultiThreadedConnector.h"
 #include "DarkIce.h"
 
@@ -104,6 +109,10 @@
 #include "aacPlusEncoder.h"
 #endif
 
+#ifdef HAVE_OPENSSL_LIB
+#include "TlsSocket.h"
+#endif
+
 
 /* ===================================================  local data structures */
 
@@ -177,6 +186,43 @@ DarkIce :: init ( const Config      & config )              throw ( Exception )
     str = cs->get( "rtprio" );
     realTimeSchedPriority = (str != NULL) ? Util::strToL( str ) : 4;
 
+    // the number of seconds to remember the addresses of the servers for
+    str      = cs->get( "dnsCacheTime");
+    resolver = new Resolver( str ? Util::strToL( str) : 300);
+
+    // the title of the streams, changed while streaming
+    str      = cs->get( "metadataInterval");
+    metadata = new MetadataUpdater( cs->get( "metadataFile"),
+                                    str ? Util::strToL( str) : 5);
+    listeners = new ListenerMonitor();
+
+#ifdef HAVE_EVENT_LOOP
+    // the number of threads driving the network outputs
+    str          = cs->get( "networkThreads");
+    noEventLoops = str ? Util::strToL( str) : 1;
+    if ( noEventLoops == 0 || noEventLoops > maxEventLoops ) {
+        throw Exception( __FILE__, __LINE__,
+                         "networkThreads out of range", noEventLoops);
+    }
+    for ( unsigned int i = 0; i < noEventLoops; ++i ) {
+        eventLoops[i] = new EventLoop();
+    }
+    noLoopSockets = 0;
+
+    // the built-in HTTP server, served by the first event loop
+    str = cs->get( "httpPort");
+    if ( str ) {
+        unsigned int    httpPort = Util::strToL( str);
+
+        if ( httpPort == 0 || httpPort > 65535 ) {
+            throw Exception( __FILE__, __LINE__, "bad httpPort", httpPort);
+        }
+        httpServer = new HttpServer( eventLoops[0].get(),
+                                     cs->get( "httpAddress"),
+                                     httpPort);
+    }
+#endif
+
     // the [input] section
     if ( !(cs = config.get( "input")) ) {
         throw Exception( __FILE__, __LINE__, "no section [input] in config");
@@ -198,13 +244,91 @@ DarkIce :: init ( const Config      & config )              throw ( Exception )
                                                     sampleRate,
                                                     bitsPerSample,
                                                     channel );
+#ifdef SUPPORT_ALSA_DSP
+    // settings that only make sense for ALSA capture
+    AlsaDspSource * alsa = dynamic_cast<AlsaDspSource *>( dsp.get());
+    if ( alsa ) {
+        str = cs->get( "alsaMmap");
+        alsa->setMmap( str && Util::strEq( str, "yes"));
+        str = cs->get( "alsaBufferTime");
+        if ( str ) {
+            alsa->setBufferTime( Util::strToL( str) * 1000);
+        }
+        str = cs->get( "alsaPeriods");
+        if ( str ) {
+            alsa->setPeriods( Util::strToL( str));
+        }
+        if ( alsa->getBufferTime() == 0 || alsa->getPeriods() < 2 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "bad alsaBufferTime or alsaPeriods");
+        }
+        str = cs->get( "alsaFillXruns");
+        alsa->setFillXruns( str && Util::strEq( str, "yes"));
+    }
+#endif
+#ifdef SUPPORT_PULSEAUDIO_DSP
+    // the buffer attributes to ask the PulseAudio server for
+    PulseAudioDspSource * pulse = dynamic_cast<PulseAudioDspSource *>(
+                                                                dsp.get());
+    if ( pulse ) {
+        str = cs->get( "paFragSize");
+        if ( str ) {
+            pulse->setFragTime( Util::strToL( str) * 1000);
+        }
+        str = cs->get( "paMaxLength");
+        if ( str ) {
+            pulse->setMaxTime( Util::strToL( str) * 1000);
+        }
+        if ( pulse->getMaxTime()
+          && pulse->getMaxTime() < pulse->getFragTime() ) {
+            throw Exception( __FILE__, __LINE__,
+                             "paMaxLength shorter than paFragSize");
+        }
+    }
+#endif
+
+    relay           = dynamic_cast<RelaySource *>( dsp.get());
+    if ( relay.get() ) {
+        // keep reconnecting to the relayed stream, unless asked otherwise
+        str = cs->get( "relayGiveUp");
+        relay->setGiveUpTime( str ? Util::strToL( str) : 0);
+    }
     encConnector    = new MultiThreadedConnector( dsp.get(), reconnect );
 
+    // write pre-encoded silent frames while the input is silent
+    str = cs->get( "silenceSubstitute");
+    if ( str && Util::strEq( str, "yes") ) {
+        const char    * level = cs->get( "silenceLevel");
+        const char    * hold  = cs->get( "silenceHold");
+
+        if ( relay.get() ) {
+            throw Exception( __FILE__, __LINE__,
+                             "silenceSubstitute is not supported when "
+                             "relaying");
+        }
+        encConnector->setSilenceDetector( new SilenceDetector(
+                                    dsp.get(),
+                                    level ? Util::strToD( level) : -90.0,
+                                    hold ? Util::strToL( hold) : 5));
+    }
+
     noAudioOuts = 0;
     configIceCast( config, bufferSecs);
     configIceCast2( config, bufferSecs);
     configShoutCast( config, bufferSecs);
     configFileCast( config);
+    configRtp( config);
+    configHls( config);
+    configHttp( config);
+
+    // noAudioOuts may count past the outputs set up, thus look at them all
+    for ( unsigned int u = 0; u < maxOutput; ++u ) {
+        if ( audioOuts[u].encoder.get() ) {
+            metadata->addOutput( audioOuts[u].bareEncoder.get(),
+                                 audioOuts[u].server.get(),
+                                 audioOuts[u].admin.get());
+        }
+    }
 }
 
 
@@ -233,11 +357,13 @@ DarkIce :: configIceCast (  const Config      & config,
         }
 
 #if !defined HAVE_LAME_LIB && !defined HAVE_TWOLAME_LIB
-        throw Exception( __FILE__, __LINE__,
-                         "DarkIce not compiled with lame or twolame support, "
-                         "thus can't connect to IceCast 1.x, stream: ",
-                         stream);
-#else
+        if ( !relay.get() ) {
+            throw Exception( __FILE__, __LINE__,
+                             "DarkIce not compiled with lame or twolame "
+                             "support, thus can't connect to IceCast 1.x, "
+                             "stream: ", stream);
+        }
+#endif
 
         const char                * str;
 
@@ -364,7 +490,8 @@ DarkIce :: configIceCast (  const Config      & config,
             }
         }
         // streaming related stuff
-        audioOuts[u].socket = new TcpSocket( server, port);
+        audioOuts[u].socket = createTcpSocket( cs, server, port);
+        configTcpSocket( cs, audioOuts[u].socket.get(), bitrate);
         audioOuts[u].server = new IceCast( audioOuts[u].socket.get(),
                                            password,
                                            mountPoint,
@@ -388,9 +515,15 @@ DarkIce :: configIceCast (  const Config      & config,
         // augment audio outs with a buffer when used from encoder
         audioOut = new BufferedSink( audioOuts[u].server.get(),
                                                   bufferSize, 1);
+        configBufferedSink( cs, audioOut);
 
+        if ( relay.get() ) {
+            // the relayed stream goes out as it is
+            relay->setOutputFormat( str);
+            audioOuts[u].encoder = new RelaySink( relay.get(), audioOut);
+        }
 #ifdef HAVE_LAME_LIB
-        if ( Util::strEq( str, "mp3") ) {
+        if ( !relay.get() && Util::strEq( str, "mp3") ) {
             audioOuts[u].encoder = new LameLibEncoder( audioOut,
                                           dsp.get(),
                                           bitrateMode,
@@ -403,7 +536,7 @@ DarkIce :: configIceCast (  const Config      & config,
         }
 #endif
 #ifdef HAVE_TWOLAME_LIB
-        if ( Util::strEq( str, "mp2") ) {
+        if ( !relay.get() && Util::strEq( str, "mp2") ) {
             audioOuts[u].encoder = new TwoLameLibEncoder(
                                             audioOut,
                                             dsp.get(),
@@ -414,8 +547,10 @@ DarkIce :: configIceCast (  const Config      & config,
         }
 #endif
 
-        encConnector->attach( audioOuts[u].encoder.get());
-#endif // HAVE_LAME_LIB || HAVE_TWOLAME_LIB
+        audioOuts[u].bareEncoder = dynamic_cast<AudioEncoder *>(
+                                                audioOuts[u].encoder.get());
+        encConnector->attach( audioOuts[u].encoder.get(),
+                              getFeeder( audioOuts[u].socket.get()));
     }
 
     noAudioOuts += u;
@@ -472,6 +607,8 @@ DarkIce :: configIceCast2 (  const Config      & config,
         const char                * fileDateFormat  = 0;
         BufferedSink              * audioOut        = 0;
         int                         bufferSize      = 0;
+        IceCast2::Protocol          protocol        = IceCast2::source;
+        bool                        chunked         = false;
 
         str         = cs->getForSure( "format", " missing in section ", stream);
         if ( Util::strEq( str, "vorbis") ) {
@@ -553,6 +690,17 @@ DarkIce :: configIceCast2 (  const Config      & config,
         str         = cs->get( "fileAddDate");
         fileAddDate = str ? (Util::strEq( str, "yes") ? true : false) : false;
         fileDateFormat = cs->get( "fileDateFormat");
+        str         = cs->get( "protocol");
+        if ( !str || Util::strEq( str, "source") ) {
+            protocol = IceCast2::source;
+        } else if ( Util::strEq( str, "put") ) {
+            protocol = IceCast2::put;
+        } else {
+            throw Exception( __FILE__, __LINE__,
+                             "unsupported protocol: ", str);
+        }
+        str         = cs->get( "chunked");
+        chunked     = str ? (Util::strEq( str, "yes") ? true : false) : false;
 
         bufferSize = dsp->getSampleSize() * dsp->getSampleRate() * bufferSecs;
         reportEvent( 3, "buffer size: ", bufferSize);
@@ -587,7 +735,9 @@ DarkIce :: configIceCast2 (  const Config      & config,
         }
 
         // streaming related stuff
-        audioOuts[u].socket = new TcpSocket( server, port);
+        audioOuts[u].socket = createTcpSocket( cs, server, port);
+        configTcpSocket( cs, audioOuts[u].socket.get(), bitrate);
+        audioOuts[u].admin  = createAdminSocket( cs, server, port);
         audioOuts[u].server = new IceCast2( audioOuts[u].socket.get(),
                                             password,
                                             mountPoint,
@@ -598,139 +748,207 @@ DarkIce :: configIceCast2 (  const Config      & config,
                                             url,
                                             genre,
                                             isPublic,
-                                            localDumpFile);
+                                            localDumpFile,
+                                            protocol,
+                                            chunked);
 
         audioOut = new BufferedSink( audioOuts[u].server.get(),
                                      bufferSize, 1);
+        configBufferedSink( cs, audioOut);
 
-        switch ( format ) {
-            case IceCast2::mp3:
+        if ( relay.get() ) {
+            // the relayed stream goes out as it is
+            relay->setOutputFormat( cs->get( "format"));
+            audioOuts[u].encoder = new RelaySink( relay.get(), audioOut);
+        } else {
+            switch ( format ) {
+                case IceCast2::mp3:
 #ifndef HAVE_LAME_LIB
-                throw Exception( __FILE__, __LINE__,
-                                 "DarkIce not compiled with lame support, "
-                                 "thus can't create mp3 stream: ",
-                                 stream);
+                    throw Exception( __FILE__, __LINE__,
+                                     "DarkIce not compiled with lame support, "
+                                     "thus can't create mp3 stream: ",
+                                     stream);
 #else
-                audioOuts[u].encoder = new LameLibEncoder(
-                                             audioOut,
-                                             dsp.get(),
-                                             bitrateMode,
-                                             bitrate,
-                                             quality,
-                                             sampleRate,
-                                             channel,
-                                             lowpass,
-                                             highpass );
+                    audioOuts[u].encoder = new LameLibEncoder(
+                                                 audioOut,
+                                                 dsp.get(),
+                                                 bitrateMode,
+                                                 bitrate,
+                                                 quality,
+                                                 sampleRate,
+                                                 channel,
+                                                 lowpass,
+                                                 highpass );
 
 #endif // HAVE_LAME_LIB
-                break;
+                    break;
 
 
-            case IceCast2::oggVorbis:
+                case IceCast2::oggVorbis:
 #ifndef HAVE_VORBIS_LIB
-                throw Exception( __FILE__, __LINE__,
-                                "DarkIce not compiled with Ogg Vorbis support, "
-                                "thus can't Ogg Vorbis stream: ",
-                                stream);
+                    throw Exception( __FILE__, __LINE__,
+                                    "DarkIce not compiled with Ogg Vorbis "
+                                    "support, thus can't Ogg Vorbis stream: ",
+                                    stream);
 #else
 
-                audioOuts[u].encoder = new VorbisLibEncoder(
-                                               audioOut,
-                                               dsp.get(),
-                                               bitrateMode,
-                                               bitrate,
-                                               quality,
-                                               sampleRate,
-                                               dsp->getChannel(),
-                                               maxBitrate);
+                    audioOuts[u].encoder = new VorbisLibEncoder(
+                                                   audioOut,
+                                                   dsp.get(),
+                                                   bitrateMode,
+                                                   bitrate,
+                                                   quality,
+                                                   sampleRate,
+                                                   dsp->getChannel(),
+                                                   maxBitrate);
 
 #endif // HAVE_VORBIS_LIB
-                break;
+                    break;
 
-            case IceCast2::oggOpus:
+                case IceCast2::oggOpus:
 #ifndef HAVE_OPUS_LIB
-                throw Exception( __FILE__, __LINE__,
-                                "DarkIce not compiled with Ogg Opus support, "
-                                "thus can't Ogg Opus stream: ",
-                                stream);
+                    throw Exception( __FILE__, __LINE__,
+                                    "DarkIce not compiled with Ogg Opus "
+                                    "support, thus can't Ogg Opus stream: ",
+                                    stream);
 #else
 
-                audioOuts[u].encoder = new OpusLibEncoder(
-                                               audioOut,
-                                               dsp.get(),
-                                               bitrateMode,
-                                               bitrate,
-                                               quality,
-                                               sampleRate,
-                                               dsp->getChannel(),
-                                               maxBitrate);
+                    audioOuts[u].encoder = new OpusLibEncoder(
+                                                   audioOut,
+                                                   dsp.get(),
+                                                   bitrateMode,
+                                                   bitrate,
+                                                   quality,
+                                                   sampleRate,
+                                                   dsp->getChannel(),
+                                                   maxBitrate);
 
 #endif // HAVE_OPUS_LIB
-                break;
+                    break;
 
-            case IceCast2::mp2:
+                case IceCast2::mp2:
 #ifndef HAVE_TWOLAME_LIB
-                throw Exception( __FILE__, __LINE__,
-                                 "DarkIce not compiled with TwoLame support, "
-                                 "thus can't create mp2 stream: ",
-                                 stream);
+                    throw Exception( __FILE__, __LINE__,
+                                     "DarkIce not compiled with TwoLame "
+                                     "support, thus can't create mp2 stream: ",
+                                     stream);
 #else
-                audioOuts[u].encoder = new TwoLameLibEncoder(
-                                                audioOut,
-                                                dsp.get(),
-                                                bitrateMode,
-                                                bitrate,
-                                                sampleRate,
-                                                channel );
+                    audioOuts[u].encoder = new TwoLameLibEncoder(
+                                                    audioOut,
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    sampleRate,
+                                                    channel );
 
 #endif // HAVE_TWOLAME_LIB
-                break;
+                    break;
 
 
-            case IceCast2::aac:
+                case IceCast2::aac:
 #ifndef HAVE_FAAC_LIB
-                throw Exception( __FILE__, __LINE__,
-                                "DarkIce not compiled with AAC support, "
-                                "thus can't aac stream: ",
-                                stream);
+                    throw Exception( __FILE__, __LINE__,
+                                    "DarkIce not compiled with AAC support, "
+                                    "thus can't aac stream: ",
+                                    stream);
 #else
-                audioOuts[u].encoder = new FaacEncoder(
-                                          audioOut,
-                                          dsp.get(),
-                                          bitrateMode,
-                                          bitrate,
-                                          quality,
-                                          sampleRate,
-                                          dsp->getChannel());
+                    audioOuts[u].encoder = new FaacEncoder(
+                                              audioOut,
+                                              dsp.get(),
+                                              bitrateMode,
+                                              bitrate,
+                                              quality,
+                                              sampleRate,
+                                              dsp->getChannel());
 
 #endif // HAVE_FAAC_LIB
-                break;
+                    break;
 
-            case IceCast2::aacp:
+                case IceCast2::aacp:
 #ifndef HAVE_AACPLUS_LIB
-                throw Exception( __FILE__, __LINE__,
-                                "DarkIce not compiled with AAC+ support, "
-                                "thus can't aacp stream: ",
-                                stream);
+                    throw Exception( __FILE__, __LINE__,
+                                    "DarkIce not compiled with AAC+ support, "
+                                    "thus can't aacp stream: ",
+                                    stream);
 #else
-                audioOuts[u].encoder = new aacPlusEncoder(
-                                             audioOut,
-                                             dsp.get(),
-                                             bitrateMode,
-                                             bitrate,
-                                             quality,
-                                             sampleRate,
-                                             channel );
+                    audioOuts[u].encoder = new aacPlusEncoder(
+                                                 audioOut,
+                                                 dsp.get(),
+                                                 bitrateMode,
+                                                 bitrate,
+                                                 quality,
+                                                 sampleRate,
+                                                 channel );
 
 #endif // HAVE_AACPLUS_LIB
-                break;
+                    break;
+
+                default:
+                    throw Exception( __FILE__, __LINE__,
+                                    "Illegal stream format: ", format);
+            }
+        }
+
+        // the encoder itself, as Sinks may be put in front of it
+        audioOuts[u].bareEncoder = dynamic_cast<AudioEncoder *>(
+                                                audioOuts[u].encoder.get());
 
-            default:
+        // adapt the bitrate to what the network takes, if asked for
+        str = cs->get( "adaptiveBitrate");
+        if ( str && Util::strEq( str, "yes") ) {
+            if ( relay.get() ) {
                 throw Exception( __FILE__, __LINE__,
-                                "Illegal stream format: ", format);
+                                 "adaptiveBitrate can't change the bitrate "
+                                 "of a relayed stream: ", stream);
+            }
+            if ( (format != IceCast2::oggVorbis && format != IceCast2::oggOpus)
+              || (format == IceCast2::oggVorbis
+                  && bitrateMode == AudioEncoder::vbr)
+              || !bitrate ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "adaptiveBitrate needs a bitrate based "
+                                 "Ogg Vorbis or Opus stream: ", stream);
+            }
+            audioOuts[u].encoder = configBitrateAdapter( cs,
+                    audioOuts[u].bareEncoder.get(),
+                    audioOut,
+                    audioOuts[u].socket.get(),
+                    bitrate);
         }
 
-        encConnector->attach( audioOuts[u].encoder.get());
+        // suspend encoding while no one listens, if asked for
+        str = cs->get( "onDemand");
+        if ( str && Util::strEq( str, "yes") ) {
+            OnDemandSink  * onDemand;
+            unsigned int    grace;
+
+            if ( relay.get() ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "onDemand has no encoder to suspend "
+                                 "when relaying: ", stream);
+            }
+            if ( format == IceCast2::oggVorbis || format == IceCast2::aacp ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "onDemand needs an mp3, mp2, aac "
+                                 "or Opus stream: ", stream);
+            }
+            str   = cs->get( "onDemandGrace");
+            grace = str ? Util::strToL( str) : 60;
+
+            onDemand = new OnDemandSink(
+                            audioOuts[u].bareEncoder.get(),
+                            audioOuts[u].encoder.get());
+            // a socket of its own, as the metadata updater thread
+            // uses the admin socket of the output at the same time
+            listeners->addOutput( onDemand,
+                        dynamic_cast<IceCast2 *>( audioOuts[u].server.get()),
+                        createAdminSocket( cs, server, port),
+                        grace);
+            audioOuts[u].encoder = onDemand;
+        }
+
+        encConnector->attach( audioOuts[u].encoder.get(),
+                              getFeeder( audioOuts[u].socket.get()));
     }
 
     noAudioOuts += u;
@@ -762,11 +980,13 @@ DarkIce :: configShoutCast (    const Config      & config,
         }
 
 #ifndef HAVE_LAME_LIB
-        throw Exception( __FILE__, __LINE__,
-                         "DarkIce not compiled with lame support, "
-                         "thus can't connect to ShoutCast, stream: ",
-                         stream);
-#else
+        if ( !relay.get() ) {
+            throw Exception( __FILE__, __LINE__,
+                             "DarkIce not compiled with lame support, "
+                             "thus can't connect to ShoutCast, stream: ",
+                             stream);
+        }
+#endif
 
         const char                * str;
 
@@ -788,11 +1008,14 @@ DarkIce :: configShoutCast (    const Config      & config,
         const char                * irc             = 0;
         const char                * aim             = 0;
         const char                * icq             = 0;
+        bool                        ultravox        = false;
+        const char                * user            = 0;
+        unsigned int                streamId        = 1;
         const char                * localDumpName   = 0;
         FileSink                  * localDumpFile   = 0;
         bool                        fileAddDate     = false;
         const char                * fileDateFormat  = 0;
-        AudioEncoder              * encoder         = 0;
+        BufferedSink              * audioOut        = 0;
         int                         bufferSize      = 0;
 
         str         = cs->get( "sampleRate");
@@ -859,7 +1082,22 @@ DarkIce :: configShoutCast (    const Config      & config,
         fileAddDate = str ? (Util::strEq( str, "yes") ? true : false) : false;
         fileDateFormat = cs->get( "fileDateFormat");
 
-        bufferSize = dsp->getBitsPerSample() / 8 * dsp->getSampleRate() * dsp->getChannel() * bufferSecs;
+        // the ShoutCast DNAS 2 source protocol, if asked for
+        str         = cs->get( "protocol");
+        if ( str && Util::strEq( str, "ultravox") ) {
+            ultravox = true;
+        } else if ( str && !Util::strEq( str, "icy") ) {
+            throw Exception( __FILE__, __LINE__,
+                             "unsupported ShoutCast protocol: ", str);
+        }
+        user        = cs->get( "user");
+        str         = cs->get( "streamId");
+        streamId    = str ? Util::strToL( str) : 1;
+        if ( ultravox && (streamId == 0 || streamId > 65535) ) {
+            throw Exception( __FILE__, __LINE__, "bad streamId", streamId);
+        }
+
+        bufferSize = dsp->getSampleSize() * dsp->getSampleRate() * bufferSecs;
         reportEvent( 3, "buffer size: ", bufferSize);
 
         localDumpName = cs->get( "localDumpFile");
@@ -892,40 +1130,299 @@ DarkIce :: configShoutCast (    const Config      & config,
         }
 
         // streaming related stuff
-        audioOuts[u].socket = new TcpSocket( server, port);
-        audioOuts[u].server = new ShoutCast( audioOuts[u].socket.get(),
-                                             password,
-                                             mountPoint,
-                                             bitrate,
-                                             name,
-                                             url,
-                                             genre,
-                                             isPublic,
-                                             irc,
-                                             aim,
-                                             icq,
-                                             localDumpFile);
-
-
-        encoder = new LameLibEncoder( audioOuts[u].server.get(),
-                                      dsp.get(),
-                                      bitrateMode,
-                                      bitrate,
-                                      quality,
-                                      sampleRate,
-                                      channel,
-                                      lowpass,
-                                      highpass );
-        audioOuts[u].encoder = new BufferedSink(encoder, bufferSize, dsp->getSampleSize());
+        audioOuts[u].socket = createTcpSocket( cs, server, port);
+        configTcpSocket( cs, audioOuts[u].socket.get(), bitrate);
+        if ( ultravox ) {
+            audioOuts[u].server = new ShoutCast2( audioOuts[u].socket.get(),
+                                                  password,
+                                                  user,
+                                                  streamId,
+                                                  bitrate,
+                                                  name,
+                                                  url,
+                                                  genre,
+                                                  isPublic,
+                                                  localDumpFile);
+        } else {
+            // the admin page is on the listener port, below the source port
+            audioOuts[u].admin  = createAdminSocket( cs, server, port - 1);
+            audioOuts[u].server = new ShoutCast( audioOuts[u].socket.get(),
+                                                 password,
+                                                 mountPoint,
+                                                 bitrate,
+                                                 name,
+                                                 url,
+                                                 genre,
+                                                 isPublic,
+                                                 irc,
+                                                 aim,
+                                                 icq,
+                                                 localDumpFile);
+        }
 
-        encConnector->attach( audioOuts[u].encoder.get());
+
+        // augment audio outs with a buffer when used from encoder
+        audioOut = new BufferedSink( audioOuts[u].server.get(),
+                                     bufferSize, 1);
+        configBufferedSink( cs, audioOut);
+
+        if ( relay.get() ) {
+            // the relayed stream goes out as it is
+            relay->setOutputFormat( "mp3");
+            audioOuts[u].encoder = new RelaySink( relay.get(), audioOut);
+        } else {
+#ifdef HAVE_LAME_LIB
+            audioOuts[u].encoder = new LameLibEncoder( audioOut,
+                                                       dsp.get(),
+                                                       bitrateMode,
+                                                       bitrate,
+                                                       quality,
+                                                       sampleRate,
+                                                       channel,
+                                                       lowpass,
+                                                       highpass );
 #endif // HAVE_LAME_LIB
+        }
+
+        audioOuts[u].bareEncoder = dynamic_cast<AudioEncoder *>(
+                                                audioOuts[u].encoder.get());
+        encConnector->attach( audioOuts[u].encoder.get(),
+                              getFeeder( audioOuts[u].socket.get()));
     }
 
     noAudioOuts += u;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Configure the buffer of a network output
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configBufferedSink ( const ConfigSection    * cs,
+                                BufferedSink           * buffer )
+                                                            throw ( Exception )
+{
+    const char            * str;
+    unsigned long long      maxSize;
+    unsigned int            rate;
+
+    if ( !(str = cs->get( "spoolFile")) ) {
+        return;
+    }
+
+    maxSize = 100;
+    if ( cs->get( "spoolMaxSize") ) {
+        if ( Util::strToL( cs->get( "spoolMaxSize")) <= 0 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "spoolMaxSize must be positive: ",
+                             cs->get( "spoolMaxSize"));
+        }
+        maxSize = Util::strToL( cs->get( "spoolMaxSize"));
+    }
+
+    rate = 150;
+    if ( cs->get( "spoolRate") ) {
+        if ( Util::strToL( cs->get( "spoolRate")) <= 100 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "spoolRate must be more than 100: ",
+                             cs->get( "spoolRate"));
+        }
+        rate = Util::strToL( cs->get( "spoolRate"));
+    }
+
+    buffer->setSpool( new DiskSpool( str, maxSize * 1024 * 1024), rate);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Create the socket of a network output
+ *----------------------------------------------------------------------------*/
+TcpSocket *
+DarkIce :: createTcpSocket (    const ConfigSection    * cs,
+                                const char             * server,
+                                unsigned int             port )
+                                                        throw ( Exception )
+{
+    const char    * str;
+
+    str = cs->get( "tls");
+    if ( !str || !Util::strEq( str, "yes") ) {
+        return new TcpSocket( server, port);
+    }
+
+#ifndef HAVE_OPENSSL_LIB
+    throw Exception( __FILE__, __LINE__,
+                     "DarkIce not compiled with OpenSSL support, "
+                     "thus can't connect with TLS to: ", server);
+#else
+    bool            verify;
+
+    str    = cs->get( "tlsVerify");
+    verify = str ? (Util::strEq( str, "no") ? false : true) : true;
+
+    return new TlsSocket( server, port, cs->get( "tlsCaFile"), verify);
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Create the socket to the admin interface of the server of an output
+ *----------------------------------------------------------------------------*/
+TcpSocket *
+DarkIce :: createAdminSocket (  const ConfigSection    * cs,
+                                const char             * server,
+                                unsigned int             port )
+                                                        throw ( Exception )
+{
+    TcpSocket     * socket = createTcpSocket( cs, server, port);
+    const char    * str;
+
+    // a blocking socket, as used from the metadata updater thread
+    socket->setResolver( resolver.get());
+    str = cs->get( "connectTimeout");
+    if ( str && Util::strToL( str) > 0 ) {
+        socket->setConnectTimeout( Util::strToL( str));
+    }
+
+    return socket;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Configure the socket of a network output
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configTcpSocket (    const ConfigSection    * cs,
+                                TcpSocket              * socket,
+                                unsigned int             bitrate )
+                                                            throw ( Exception )
+{
+    const char    * str;
+
+    socket->setResolver( resolver.get());
+
+    str = cs->get( "connectTimeout");
+    if ( str ) {
+        if ( Util::strToL( str) <= 0 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "connectTimeout must be positive: ", str);
+        }
+        socket->setConnectTimeout( Util::strToL( str));
+    }
+
+    // kernel socket tuning
+    str = cs->get( "sendBufferSize");
+    socket->setSendBufferSize( str ? Util::strToL( str) : 0);
+    str = cs->get( "notSentLowat");
+    socket->setNotSentLowat( str ? Util::strToL( str) : 0);
+    str = cs->get( "noDelay");
+    socket->setNoDelay( str ? (Util::strEq( str, "yes") ? true : false)
+                            : false);
+    str = cs->get( "userTimeout");
+    socket->setUserTimeout( str ? Util::strToL( str) : 0);
+    {
+        unsigned int    idle;
+        unsigned int    interval;
+        unsigned int    count;
+
+        str      = cs->get( "keepAliveIdle");
+        idle     = str ? Util::strToL( str) : 0;
+        str      = cs->get( "keepAliveInterval");
+        interval = str ? Util::strToL( str) : 0;
+        str      = cs->get( "keepAliveCount");
+        count    = str ? Util::strToL( str) : 0;
+        socket->setKeepAlive( idle, interval, count);
+    }
+
+    // pacing, relative to the nominal bitrate
+    str = cs->get( "paceRate");
+    if ( str ) {
+        unsigned int    rate;
+        unsigned int    burst;
+
+        if ( Util::strToL( str) < 100 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "paceRate must be at least 100: ", str);
+        }
+        if ( !bitrate ) {
+            throw Exception( __FILE__, __LINE__,
+                             "paceRate needs a bitrate");
+        }
+        // bitrate is in kbps, rate is in bytes per second
+        rate  = bitrate * 1000 / 8 * Util::strToL( str) / 100;
+        str   = cs->get( "paceBurst");
+        burst = str ? Util::strToL( str) : 0;
+        // allow at least the login to go out at once
+        burst = burst < minPaceBurst ? minPaceBurst : burst;
+        socket->setPacing( rate, burst);
+    }
+
+#ifdef HAVE_EVENT_LOOP
+    // spread the sockets evenly over the event loops
+    socket->setEventLoop( eventLoops[noLoopSockets++ % noEventLoops].get());
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the feeder writing to a network output
+ *----------------------------------------------------------------------------*/
+unsigned int
+DarkIce :: getFeeder (  TcpSocket      * socket )       throw ()
+{
+#ifdef HAVE_EVENT_LOOP
+    for ( unsigned int i = 0; i < noEventLoops; ++i ) {
+        if ( socket->getEventLoop() == eventLoops[i].get() ) {
+            return i + 1;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Create the bitrate adapter of a network output
+ *----------------------------------------------------------------------------*/
+BitrateAdapter *
+DarkIce :: configBitrateAdapter (   const ConfigSection    * cs,
+                                    AudioEncoder           * encoder,
+                                    BufferedSink           * buffer,
+                                    TcpSocket              * socket,
+                                    unsigned int             bitrate )
+                                                        throw ( Exception )
+{
+    const char    * str;
+    unsigned int    minBitrate;
+    unsigned int    maxDelay;
+
+    str        = cs->get( "adaptiveMinBitrate");
+    minBitrate = str ? Util::strToL( str) : bitrate / 2;
+    str        = cs->get( "adaptiveMaxDelay");
+    maxDelay   = str ? Util::strToL( str) : defaultAdaptiveDelay;
+
+    if ( !minBitrate || minBitrate > bitrate ) {
+        throw Exception( __FILE__, __LINE__,
+                         "adaptiveMinBitrate must be between 1 and bitrate",
+                         minBitrate);
+    }
+    if ( !maxDelay ) {
+        throw Exception( __FILE__, __LINE__,
+                         "adaptiveMaxDelay must be positive");
+    }
+
+    reportEvent( 3, "adaptive bitrate from", minBitrate, "to", bitrate);
+
+    return new BitrateAdapter( encoder,
+                               buffer,
+                               socket,
+                               minBitrate,
+                               bitrate,
+                               maxDelay);
+}
+
+
 /*------------------------------------------------------------------------------
  *  Look for the FileCast stream outputs in the config file
  *----------------------------------------------------------------------------*/
@@ -1062,7 +1559,12 @@ DarkIce :: configFileCast (  const Config      & config )
         audioOuts[u].socket = 0;
         audioOuts[u].server = new FileCast( targetFile );
 
-        if ( Util::strEq( format, "mp3") ) {
+        if ( relay.get() ) {
+            // the relayed stream is recorded as it is
+            relay->setOutputFormat( format);
+            audioOuts[u].encoder = new RelaySink( relay.get(),
+                                                  audioOuts[u].server.get());
+        } else if ( Util::strEq( format, "mp3") ) {
 #ifndef HAVE_LAME_LIB
                 throw Exception( __FILE__, __LINE__,
                                  "DarkIce not compiled with lame support, "
@@ -1164,6 +1666,8 @@ DarkIce :: configFileCast (  const Config      & config )
                                 "Illegal stream format: ", format);
         }
 
+        audioOuts[u].bareEncoder = dynamic_cast<AudioEncoder *>(
+                                                audioOuts[u].encoder.get());
         encConnector->attach( audioOuts[u].encoder.get());
     }
 
@@ -1172,43 +1676,713 @@ DarkIce :: configFileCast (  const Config      & config )
 
 
 /*------------------------------------------------------------------------------
- *  Set POSIX real-time scheduling
+ *  Look for the RTP stream outputs in the config file
  *----------------------------------------------------------------------------*/
 void
-DarkIce :: setRealTimeScheduling ( void )               throw ( Exception )
+DarkIce :: configRtp (  const Config      & config )
+                                                        throw ( Exception )
 {
-// Only if the OS has the POSIX real-time scheduling functions implemented.
-#if defined( HAVE_SCHED_GETSCHEDULER ) && defined( HAVE_SCHED_GETPARAM )
-    int                 high_priority;
-    struct sched_param  param;
+    // look for RTP encoder output streams,
+    // sections [rtp-0], [rtp-1], ...
+    char            stream[]        = "rtp- ";
+    size_t          streamLen       = Util::strLen( stream);
+    unsigned int    u;
 
-    /* store the old scheduling parameters */
-    if ( (origSchedPolicy = sched_getscheduler(0)) == -1 ) {
-        throw Exception( __FILE__, __LINE__, "sched_getscheduler", errno);
-    }
+    for ( u = noAudioOuts; u < maxOutput; ++u ) {
+        const ConfigSection    * cs;
 
-    if ( sched_getparam( 0, &param) == -1 ) {
-        throw Exception( __FILE__, __LINE__, "sched_getparam", errno);
-    }
-    origSchedPriority = param.sched_priority;
+        // ugly hack to change the section name to "stream0", "stream1", etc.
+        stream[streamLen-1] = '0' + (u - noAudioOuts);
 
-    /* set SCHED_FIFO with max - 1 priority or user configured value */
-    if ( (high_priority = sched_get_priority_max(SCHED_FIFO)) == -1 ) {
-        throw Exception(__FILE__,__LINE__,"sched_get_priority_max",errno);
-    }
-    reportEvent( 8, "scheduler high priority", high_priority);
+        if ( !(cs = config.get( stream)) ) {
+            break;
+        }
 
-    if (realTimeSchedPriority > high_priority) {
-        param.sched_priority = high_priority - 1;
-    } else {
-        param.sched_priority = realTimeSchedPriority;
-    }
+        if ( relay.get() ) {
+            throw Exception( __FILE__, __LINE__,
+                             "a relayed stream can only go to the icecast, "
+                             "shoutcast and file outputs: ", stream);
+        }
 
-    if ( sched_setscheduler( 0, SCHED_FIFO, &param) == -1 ) {
-        reportEvent( 1,
-                     "Could not set POSIX real-time scheduling, "
-                     "this may cause recording skips.\n"
-                     "Try to run darkice as the super-user.");
+        const char                * str;
+
+        const char                * format          = 0;
+        AudioEncoder::BitrateMode   bitrateMode;
+        unsigned int                bitrate         = 0;
+        double                      quality         = 0.0;
+        unsigned int                sampleRate      = 0;
+        int                         lowpass         = 0;
+        int                         highpass        = 0;
+        const char                * address         = 0;
+        unsigned int                port            = 0;
+        unsigned int                payloadType     = 0;
+        unsigned int                ttl             = 0;
+        const char                * sdpFile         = 0;
+        bool                        fec             = false;
+        unsigned int                expectedLoss    = 0;
+        RtpSink::Payload            payload;
+        RtpSink                   * rtpSink;
+
+        format      = cs->getForSure( "format", " missing in section ", stream);
+        if ( Util::strEq( format, "opus") ) {
+            payload = RtpSink::opus;
+        } else if ( Util::strEq( format, "mp3")
+                 || Util::strEq( format, "mp2") ) {
+            payload = RtpSink::mpa;
+        } else {
+            throw Exception( __FILE__, __LINE__,
+                             "unsupported stream format for RTP: ", format);
+        }
+
+        address     = cs->getForSure( "address", " missing in section ", stream);
+        str         = cs->getForSure( "port", " missing in section ", stream);
+        port        = Util::strToL( str);
+        if ( port == 0 || port > 65535 ) {
+            throw Exception( __FILE__, __LINE__, "bad RTP port", port);
+        }
+        str         = cs->get( "payloadType");
+        payloadType = str ? Util::strToL( str) : 96;
+        str         = cs->get( "ttl");
+        ttl         = str ? Util::strToL( str) : 0;
+        sdpFile     = cs->get( "sdpFile");
+
+        str         = cs->get( "fec");
+        fec         = str ? (Util::strEq( str, "yes") ? true : false) : false;
+        str         = cs->get( "expectedLoss");
+        expectedLoss = str ? Util::strToL( str) : 10;
+        if ( fec && payload != RtpSink::opus ) {
+            throw Exception( __FILE__, __LINE__,
+                             "forward error correction needs the opus format, "
+                             "section: ", stream);
+        }
+        if ( fec && (expectedLoss == 0 || expectedLoss > 100) ) {
+            throw Exception( __FILE__, __LINE__,
+                             "expectedLoss out of range", expectedLoss);
+        }
+
+        str         = cs->get( "sampleRate");
+        sampleRate  = str ? Util::strToL( str) : dsp->getSampleRate();
+
+        str         = cs->get( "bitrate");
+        bitrate     = str ? Util::strToL( str) : 0;
+        str         = cs->get( "quality");
+        quality     = str ? Util::strToD( str) : 0.0;
+
+        str         = cs->getForSure( "bitrateMode",
+                                      " not specified in section ",
+                                      stream);
+        if ( Util::strEq( str, "cbr") ) {
+            bitrateMode = AudioEncoder::cbr;
+
+            if ( bitrate == 0 ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "bitrate not specified for CBR encoding");
+            }
+        } else if ( Util::strEq( str, "abr") ) {
+            bitrateMode = AudioEncoder::abr;
+
+            if ( bitrate == 0 ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "bitrate not specified for ABR encoding");
+            }
+        } else if ( Util::strEq( str, "vbr") ) {
+            bitrateMode = AudioEncoder::vbr;
+
+            if ( cs->get( "quality" ) == 0 ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "quality not specified for VBR encoding");
+            }
+        } else {
+            throw Exception( __FILE__, __LINE__,
+                             "invalid bitrate mode: ", str);
+        }
+
+        str         = cs->get( "lowpass");
+        lowpass     = str ? Util::strToL( str) : 0;
+        str         = cs->get( "highpass");
+        highpass    = str ? Util::strToL( str) : 0;
+
+        // go on and create the things
+
+        // the RTP sink stands in for the server, there is no login
+        rtpSink = new RtpSink( address,
+                               port,
+                               payload,
+                               payloadType,
+                               ttl,
+                               sdpFile);
+
+        audioOuts[u].socket = 0;
+        audioOuts[u].server = 0;
+
+        if ( Util::strEq( format, "mp3") ) {
+#ifndef HAVE_LAME_LIB
+                delete rtpSink;
+                throw Exception( __FILE__, __LINE__,
+                                 "DarkIce not compiled with lame support, "
+                                 "thus can't create mp3 stream: ",
+                                 stream);
+#else
+                audioOuts[u].encoder = new LameLibEncoder(
+                                                    rtpSink,
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    quality,
+                                                    sampleRate,
+                                                    dsp->getChannel(),
+                                                    lowpass,
+                                                    highpass );
+#endif // HAVE_LAME_LIB
+        } else if ( Util::strEq( format, "mp2") ) {
+#ifndef HAVE_TWOLAME_LIB
+                delete rtpSink;
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with TwoLAME support, "
+                                "thus can't create MPEG Audio Layer 2 stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new TwoLameLibEncoder(
+                                                    rtpSink,
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    sampleRate,
+                                                    dsp->getChannel() );
+#endif // HAVE_TWOLAME_LIB
+        } else {
+#ifndef HAVE_OPUS_LIB
+                delete rtpSink;
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with Ogg Opus support, "
+                                "thus can't Ogg Opus stream: ",
+                                stream);
+#else
+                OpusLibEncoder    * opusEncoder = new OpusLibEncoder(
+                                                    rtpSink,
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    quality,
+                                                    dsp->getSampleRate(),
+                                                    dsp->getChannel() );
+
+                audioOuts[u].encoder = opusEncoder;
+                if ( fec ) {
+                    opusEncoder->setExpectedLoss( expectedLoss);
+                }
+#endif // HAVE_OPUS_LIB
+        }
+
+        audioOuts[u].bareEncoder = dynamic_cast<AudioEncoder *>(
+                                                audioOuts[u].encoder.get());
+        encConnector->attach( audioOuts[u].encoder.get());
+    }
+
+    noAudioOuts += u;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Look for the HLS outputs in the config file
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configHls (  const Config      & config )
+                                                        throw ( Exception )
+{
+    // look for HLS encoder output streams,
+    // sections [hls-0], [hls-1], ...
+    char            stream[]        = "hls- ";
+    size_t          streamLen       = Util::strLen( stream);
+    unsigned int    u;
+
+    for ( u = noAudioOuts; u < maxOutput; ++u ) {
+        const ConfigSection    * cs;
+
+        // ugly hack to change the section name to "stream0", "stream1", etc.
+        stream[streamLen-1] = '0' + (u - noAudioOuts);
+
+        if ( !(cs = config.get( stream)) ) {
+            break;
+        }
+
+        if ( relay.get() ) {
+            throw Exception( __FILE__, __LINE__,
+                             "a relayed stream can only go to the icecast, "
+                             "shoutcast and file outputs: ", stream);
+        }
+
+        const char                * str;
+
+        const char                * format          = 0;
+        AudioEncoder::BitrateMode   bitrateMode;
+        unsigned int                bitrate         = 0;
+        double                      quality         = 0.0;
+        unsigned int                sampleRate      = 0;
+        int                         lowpass         = 0;
+        int                         highpass        = 0;
+        const char                * directory       = 0;
+        const char                * baseName        = 0;
+        unsigned int                segmentDuration = 0;
+        unsigned int                playlistSize    = 0;
+        HlsSink                   * hlsSink;
+
+        format      = cs->getForSure( "format", " missing in section ", stream);
+        if ( !Util::strEq( format, "mp3")
+          && !Util::strEq( format, "aac")
+          && !Util::strEq( format, "aacp") ) {
+            throw Exception( __FILE__, __LINE__,
+                             "unsupported stream format for HLS: ", format);
+        }
+
+        directory   = cs->getForSure( "directory",
+                                      " missing in section ",
+                                      stream);
+        baseName    = cs->get( "baseName");
+        baseName    = baseName ? baseName : "stream";
+        str         = cs->get( "segmentDuration");
+        segmentDuration = str ? Util::strToL( str) : 6;
+        str         = cs->get( "playlistSize");
+        playlistSize = str ? Util::strToL( str) : 6;
+
+        str         = cs->get( "sampleRate");
+        sampleRate  = str ? Util::strToL( str) : dsp->getSampleRate();
+
+        str         = cs->get( "bitrate");
+        bitrate     = str ? Util::strToL( str) : 0;
+        str         = cs->get( "quality");
+        quality     = str ? Util::strToD( str) : 0.0;
+
+        str         = cs->getForSure( "bitrateMode",
+                                      " not specified in section ",
+                                      stream);
+        if ( Util::strEq( str, "cbr") ) {
+            bitrateMode = AudioEncoder::cbr;
+
+            if ( bitrate == 0 ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "bitrate not specified for CBR encoding");
+            }
+        } else if ( Util::strEq( str, "abr") ) {
+            bitrateMode = AudioEncoder::abr;
+
+            if ( bitrate == 0 ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "bitrate not specified for ABR encoding");
+            }
+        } else if ( Util::strEq( str, "vbr") ) {
+            bitrateMode = AudioEncoder::vbr;
+
+            if ( cs->get( "quality" ) == 0 ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "quality not specified for VBR encoding");
+            }
+        } else {
+            throw Exception( __FILE__, __LINE__,
+                             "invalid bitrate mode: ", str);
+        }
+
+        if (Util::strEq(format, "aac") && bitrateMode != AudioEncoder::abr) {
+            throw Exception(__FILE__, __LINE__,
+                            "currently the AAC format only supports "
+                            "average bitrate mode");
+        }
+
+        if (Util::strEq(format, "aacp") && bitrateMode != AudioEncoder::cbr) {
+            throw Exception(__FILE__, __LINE__,
+                            "currently the AAC+ format only supports "
+                            "constant bitrate mode");
+        }
+
+        str         = cs->get( "lowpass");
+        lowpass     = str ? Util::strToL( str) : 0;
+        str         = cs->get( "highpass");
+        highpass    = str ? Util::strToL( str) : 0;
+
+        // go on and create the things
+
+        // the segmenter stands in for the server, the encoder
+        // writes to it directly
+        hlsSink = new HlsSink( directory,
+                               baseName,
+                               Util::strEq( format, "mp3") ? HlsSink::mpa
+                                                           : HlsSink::aac,
+                               segmentDuration,
+                               playlistSize);
+
+        audioOuts[u].socket = 0;
+        audioOuts[u].server = 0;
+
+        if ( Util::strEq( format, "mp3") ) {
+#ifndef HAVE_LAME_LIB
+                delete hlsSink;
+                throw Exception( __FILE__, __LINE__,
+                                 "DarkIce not compiled with lame support, "
+                                 "thus can't create mp3 stream: ",
+                                 stream);
+#else
+                audioOuts[u].encoder = new LameLibEncoder(
+                                                    hlsSink,
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    quality,
+                                                    sampleRate,
+                                                    dsp->getChannel(),
+                                                    lowpass,
+                                                    highpass );
+#endif // HAVE_LAME_LIB
+        } else if ( Util::strEq( format, "aac") ) {
+#ifndef HAVE_FAAC_LIB
+                delete hlsSink;
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with AAC support, "
+                                "thus can't aac stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new FaacEncoder(
+                                                hlsSink,
+                                                dsp.get(),
+                                                bitrateMode,
+                                                bitrate,
+                                                quality,
+                                                sampleRate,
+                                                dsp->getChannel());
+#endif // HAVE_FAAC_LIB
+        } else {
+#ifndef HAVE_AACPLUS_LIB
+                delete hlsSink;
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with AAC+ support, "
+                                "thus can't aacplus stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new aacPlusEncoder(
+                                                hlsSink,
+                                                dsp.get(),
+                                                bitrateMode,
+                                                bitrate,
+                                                quality,
+                                                sampleRate,
+                                                dsp->getChannel());
+#endif // HAVE_AACPLUS_LIB
+        }
+
+        audioOuts[u].bareEncoder = dynamic_cast<AudioEncoder *>(
+                                                audioOuts[u].encoder.get());
+        encConnector->attach( audioOuts[u].encoder.get());
+    }
+
+    noAudioOuts += u;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Look for the outputs of the built-in HTTP server in the config file
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configHttp ( const Config      & config )
+                                                        throw ( Exception )
+{
+#ifndef HAVE_EVENT_LOOP
+    if ( config.get( "http-0") ) {
+        throw Exception( __FILE__, __LINE__,
+                         "DarkIce not compiled with the network event loop, "
+                         "thus can't serve HTTP streams");
+    }
+#else
+    // look for HTTP encoder output streams,
+    // sections [http-0], [http-1], ...
+    char            stream[]        = "http- ";
+    size_t          streamLen       = Util::strLen( stream);
+    unsigned int    u;
+
+    for ( u = noAudioOuts; u < maxOutput; ++u ) {
+        const ConfigSection    * cs;
+
+        // ugly hack to change the section name to "stream0", "stream1", etc.
+        stream[streamLen-1] = '0' + (u - noAudioOuts);
+
+        if ( !(cs = config.get( stream)) ) {
+            break;
+        }
+
+        if ( relay.get() ) {
+            throw Exception( __FILE__, __LINE__,
+                             "a relayed stream can only go to the icecast, "
+                             "shoutcast and file outputs: ", stream);
+        }
+
+        const char                * str;
+
+        const char                * format          = 0;
+        AudioEncoder::BitrateMode   bitrateMode;
+        unsigned int                bitrate         = 0;
+        double                      quality         = 0.0;
+        unsigned int                sampleRate      = 0;
+        int                         lowpass         = 0;
+        int                         highpass        = 0;
+        const char                * mountPoint      = 0;
+        const char                * name            = 0;
+        const char                * contentType     = 0;
+        unsigned int                burstSize       = 0;
+        unsigned int                maxLag          = 0;
+        unsigned int                maxListeners    = 0;
+        HttpMount                 * mount;
+
+        if ( !httpServer.get() ) {
+            throw Exception( __FILE__, __LINE__,
+                             "httpPort missing in section [general], "
+                             "needed by section ", stream);
+        }
+
+        format      = cs->getForSure( "format", " missing in section ", stream);
+        if ( Util::strEq( format, "vorbis")
+          || Util::strEq( format, "opus") ) {
+            contentType = "application/ogg";
+        } else if ( Util::strEq( format, "mp3")
+                 || Util::strEq( format, "mp2") ) {
+            contentType = "audio/mpeg";
+        } else if ( Util::strEq( format, "aac") ) {
+            contentType = "audio/aac";
+        } else if ( Util::strEq( format, "aacp") ) {
+            contentType = "audio/aacp";
+        } else {
+            throw Exception( __FILE__, __LINE__,
+                             "unsupported stream format: ", format);
+        }
+
+        mountPoint  = cs->getForSure( "mountPoint",
+                                      " missing in section ",
+                                      stream);
+        name        = cs->get( "name");
+        str         = cs->get( "burstSize");
+        burstSize   = str ? Util::strToL( str) : 65536;
+        str         = cs->get( "maxLag");
+        maxLag      = str ? Util::strToL( str) : 4 * burstSize;
+        str         = cs->get( "maxListeners");
+        maxListeners = str ? Util::strToL( str) : 0;
+
+        str         = cs->get( "sampleRate");
+        sampleRate  = str ? Util::strToL( str) : dsp->getSampleRate();
+
+        str         = cs->get( "bitrate");
+        bitrate     = str ? Util::strToL( str) : 0;
+        str         = cs->get( "quality");
+        quality     = str ? Util::strToD( str) : 0.0;
+
+        str         = cs->getForSure( "bitrateMode",
+                                      " not specified in section ",
+                                      stream);
+        if ( Util::strEq( str, "cbr") ) {
+            bitrateMode = AudioEncoder::cbr;
+
+            if ( bitrate == 0 ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "bitrate not specified for CBR encoding");
+            }
+        } else if ( Util::strEq( str, "abr") ) {
+            bitrateMode = AudioEncoder::abr;
+
+            if ( bitrate == 0 ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "bitrate not specified for ABR encoding");
+            }
+        } else if ( Util::strEq( str, "vbr") ) {
+            bitrateMode = AudioEncoder::vbr;
+
+            if ( cs->get( "quality" ) == 0 ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "quality not specified for VBR encoding");
+            }
+        } else {
+            throw Exception( __FILE__, __LINE__,
+                             "invalid bitrate mode: ", str);
+        }
+
+        if (Util::strEq(format, "aac") && bitrateMode != AudioEncoder::abr) {
+            throw Exception(__FILE__, __LINE__,
+                            "currently the AAC format only supports "
+                            "average bitrate mode");
+        }
+
+        if (Util::strEq(format, "aacp") && bitrateMode != AudioEncoder::cbr) {
+            throw Exception(__FILE__, __LINE__,
+                            "currently the AAC+ format only supports "
+                            "constant bitrate mode");
+        }
+
+        str         = cs->get( "lowpass");
+        lowpass     = str ? Util::strToL( str) : 0;
+        str         = cs->get( "highpass");
+        highpass    = str ? Util::strToL( str) : 0;
+
+        // go on and create the things
+
+        // the mount point stands in for the server, the encoder
+        // writes to it directly
+        mount = new HttpMount( mountPoint,
+                               contentType,
+                               name,
+                               burstSize,
+                               maxLag,
+                               maxListeners);
+        httpServer->addMount( mount);
+
+        audioOuts[u].socket = 0;
+        audioOuts[u].server = 0;
+
+        if ( Util::strEq( format, "mp3") ) {
+#ifndef HAVE_LAME_LIB
+                throw Exception( __FILE__, __LINE__,
+                                 "DarkIce not compiled with lame support, "
+                                 "thus can't create mp3 stream: ",
+                                 stream);
+#else
+                audioOuts[u].encoder = new LameLibEncoder(
+                                                    mount,
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    quality,
+                                                    sampleRate,
+                                                    dsp->getChannel(),
+                                                    lowpass,
+                                                    highpass );
+#endif // HAVE_LAME_LIB
+        } else if ( Util::strEq( format, "mp2") ) {
+#ifndef HAVE_TWOLAME_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with TwoLAME support, "
+                                "thus can't create MPEG Audio Layer 2 stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new TwoLameLibEncoder(
+                                                    mount,
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    sampleRate,
+                                                    dsp->getChannel() );
+#endif // HAVE_TWOLAME_LIB
+        } else if ( Util::strEq( format, "vorbis") ) {
+#ifndef HAVE_VORBIS_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with Ogg Vorbis support, "
+                                "thus can't Ogg Vorbis stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new VorbisLibEncoder(
+                                                    mount,
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    quality,
+                                                    dsp->getSampleRate(),
+                                                    dsp->getChannel() );
+#endif // HAVE_VORBIS_LIB
+        } else if ( Util::strEq( format, "opus") ) {
+#ifndef HAVE_OPUS_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with Ogg Opus support, "
+                                "thus can't Ogg Opus stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new OpusLibEncoder(
+                                                    mount,
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    quality,
+                                                    dsp->getSampleRate(),
+                                                    dsp->getChannel() );
+#endif // HAVE_OPUS_LIB
+        } else if ( Util::strEq( format, "aac") ) {
+#ifndef HAVE_FAAC_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with AAC support, "
+                                "thus can't aac stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new FaacEncoder(
+                                                mount,
+                                                dsp.get(),
+                                                bitrateMode,
+                                                bitrate,
+                                                quality,
+                                                sampleRate,
+                                                dsp->getChannel());
+#endif // HAVE_FAAC_LIB
+        } else {
+#ifndef HAVE_AACPLUS_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with AAC+ support, "
+                                "thus can't aacplus stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new aacPlusEncoder(
+                                                mount,
+                                                dsp.get(),
+                                                bitrateMode,
+                                                bitrate,
+                                                quality,
+                                                sampleRate,
+                                                dsp->getChannel());
+#endif // HAVE_AACPLUS_LIB
+        }
+
+        audioOuts[u].bareEncoder = dynamic_cast<AudioEncoder *>(
+                                                audioOuts[u].encoder.get());
+        encConnector->attach( audioOuts[u].encoder.get());
+    }
+
+    if ( httpServer.get() ) {
+        httpServer->open();
+    }
+
+    noAudioOuts += u;
+#endif // HAVE_EVENT_LOOP
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set POSIX real-time scheduling
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: setRealTimeScheduling ( void )               throw ( Exception )
+{
+// Only if the OS has the POSIX real-time scheduling functions implemented.
+#if defined( HAVE_SCHED_GETSCHEDULER ) && defined( HAVE_SCHED_GETPARAM )
+    int                 high_priority;
+    struct sched_param  param;
+
+    /* store the old scheduling parameters */
+    if ( (origSchedPolicy = sched_getscheduler(0)) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "sched_getscheduler", errno);
+    }
+
+    if ( sched_getparam( 0, &param) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "sched_getparam", errno);
+    }
+    origSchedPriority = param.sched_priority;
+
+    /* set SCHED_FIFO with max - 1 priority or user configured value */
+    if ( (high_priority = sched_get_priority_max(SCHED_FIFO)) == -1 ) {
+        throw Exception(__FILE__,__LINE__,"sched_get_priority_max",errno);
+    }
+    reportEvent( 8, "scheduler high priority", high_priority);
+
+    if (realTimeSchedPriority > high_priority) {
+        param.sched_priority = high_priority - 1;
+    } else {
+        param.sched_priority = realTimeSchedPriority;
+    }
+
+    if ( sched_setscheduler( 0, SCHED_FIFO, &param) == -1 ) {
+        reportEvent( 1,
+                     "Could not set POSIX real-time scheduling, "
+                     "this may cause recording skips.\n"
+                     "Try to run darkice as the super-user.");
     } else {
         /* ask the new priortiy and report it */
         if ( sched_getparam( 0, &param) == -1 ) {
@@ -1272,9 +2446,15 @@ DarkIce :: encode ( void )                          throw ( Exception )
         throw Exception( __FILE__, __LINE__, "can't open connector");
     }
 
-    bytes = dsp->getSampleRate() * dsp->getSampleSize() * duration;
+    if ( relay.get() ) {
+        // the duration of a relayed stream is not known from its bytes,
+        // and it is read a whole frame at a time
+        len = encConnector->transfer( 0, RelaySource::maxFrameSize, 1, 0 );
+    } else {
+        bytes = dsp->getSampleRate() * dsp->getSampleSize() * duration;
 
-    len = encConnector->transfer( bytes, 4096, 1, 0 );
+        len = encConnector->transfer( bytes, 4096, 1, 0 );
+    }
 
     reportEvent( 1, len, "bytes transferred to the encoders");
 
@@ -1292,6 +2472,16 @@ DarkIce :: run ( void )                             throw ( Exception )
 {
     reportEvent( 3, "encoding");
 
+#ifdef HAVE_EVENT_LOOP
+    // the sockets are driven by the event loops from the moment they open
+    for ( unsigned int i = 0; i < noEventLoops; ++i ) {
+        eventLoops[i]->start();
+    }
+#endif
+
+    metadata->start();
+    listeners->start();
+
     if (enableRealTime) {
         setRealTimeScheduling();
     }
@@ -1299,6 +2489,18 @@ DarkIce :: run ( void )                             throw ( Exception )
     if (enableRealTime) {
         setOriginalScheduling();
     }
+
+    listeners->stop();
+    metadata->stop();
+
+#ifdef HAVE_EVENT_LOOP
+    for ( unsigned int i = 0; i < noEventLoops; ++i ) {
+        eventLoops[i]->stop();
+    }
+    if ( httpServer.get() ) {
+        httpServer->close();
+    }
+#endif
     reportEvent( 3, "encoding ends");
 
     return 0;
@@ -1317,3 +2519,13 @@ DarkIce :: cut ( void )                             throw ()
 
     reportEvent( 5, "cutting ends");
 }
+
+
+/*------------------------------------------------------------------------------
+ *  Change the title of the streams
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: setTitle (   const char    * title )         throw ()
+{
+    metadata->setTitle( title);
+}
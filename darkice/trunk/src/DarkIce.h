@@ -54,10 +54,17 @@
 #include "Ref.h"
 #include "AudioSource.h"
 #include "BufferedSink.h"
+#include "BitrateAdapter.h"
 #include "Connector.h"
+#include "MultiThreadedConnector.h"
 #include "AudioEncoder.h"
 #include "TcpSocket.h"
 #include "CastSink.h"
+#include "EventLoop.h"
+#include "HttpServer.h"
+#include "Resolver.h"
+#include "MetadataUpdater.h"
+#include "ListenerMonitor.h"
 #include "DarkIceConfig.h"
 
 
@@ -84,14 +91,27 @@ class DarkIce : public virtual Referable, public virtual Reporter
          *  <supported output types> * <outputs per type>
          */
         static const unsigned int       maxOutput = 4 * 7;
+
+        /**
+         *  The smallest burst allowed when pacing an output, in bytes.
+         */
+        static const unsigned int       minPaceBurst = 4096;
+
+        /**
+         *  The default backlog to step down the bitrate of an adaptive
+         *  output at, in milliseconds.
+         */
+        static const unsigned int       defaultAdaptiveDelay = 2000;
         
         /**
          *  Type describing each lame library output.
          */
         typedef struct {
             Ref<Sink>               encoder;
+            Ref<AudioEncoder>       bareEncoder;
             Ref<TcpSocket>          socket;
             Ref<CastSink>           server;
+            Ref<TcpSocket>          admin;
         } Output;
 
         /**
@@ -104,6 +124,48 @@ class DarkIce : public virtual Referable, public virtual Reporter
          */
         unsigned int            noAudioOuts;
 
+        /**
+         *  The resolver shared by the network outputs.
+         */
+        Ref<Resolver>           resolver;
+
+        /**
+         *  The updater changing the title of the streams.
+         */
+        Ref<MetadataUpdater>    metadata;
+
+        /**
+         *  The monitor suspending the outputs no one listens to.
+         */
+        Ref<ListenerMonitor>    listeners;
+
+#ifdef HAVE_EVENT_LOOP
+        /**
+         *  The maximum number of network event loops.
+         */
+        static const unsigned int       maxEventLoops = 16;
+
+        /**
+         *  The network event loops driving the output sockets.
+         */
+        Ref<EventLoop>          eventLoops[maxEventLoops];
+
+        /**
+         *  Number of network event loops.
+         */
+        unsigned int            noEventLoops;
+
+        /**
+         *  Number of sockets assigned to the event loops so far.
+         */
+        unsigned int            noLoopSockets;
+
+        /**
+         *  The built-in HTTP server, serving the [http-x] outputs.
+         */
+        Ref<HttpServer>         httpServer;
+#endif
+
         /**
          *  Duration of playing, in seconds.
          */
@@ -114,10 +176,16 @@ class DarkIce : public virtual Referable, public virtual Reporter
          */
         Ref<AudioSource>        dsp;
 
+        /**
+         *  The dsp, if it relays an encoded stream, 0 otherwise.
+         *  The outputs then pass the stream on without encoding.
+         */
+        Ref<RelaySource>        relay;
+
         /**
          *  The encoding Connector, connecting the dsp to the encoders.
          */
-        Ref<Connector>          encConnector;
+        Ref<MultiThreadedConnector> encConnector;
 
         /**
          *  Should we turn real-time scheduling on ?
@@ -188,6 +256,102 @@ class DarkIce : public virtual Referable, public virtual Reporter
         configShoutCast (   const Config   & config,
                             unsigned int     bufferSecs )   throw ( Exception );
 
+        /**
+         *  Configure the buffer of a network output, based on the
+         *  output's config section. Called from the configXXX functions.
+         *
+         *  @param cs the config section of the output.
+         *  @param buffer the buffer to configure.
+         *  @exception Exception
+         */
+        void
+        configBufferedSink (    const ConfigSection    * cs,
+                                BufferedSink           * buffer )
+                                                            throw ( Exception );
+
+        /**
+         *  Create the socket of a network output, based on the
+         *  output's config section: a TlsSocket if TLS is asked for,
+         *  a plain TcpSocket otherwise. Called from the configXXX
+         *  functions.
+         *
+         *  @param cs the config section of the output.
+         *  @param server the host name of the server.
+         *  @param port the port of the server.
+         *  @return the socket.
+         *  @exception Exception
+         */
+        TcpSocket *
+        createTcpSocket (   const ConfigSection    * cs,
+                            const char             * server,
+                            unsigned int             port )
+                                                            throw ( Exception );
+
+        /**
+         *  Create the socket to connect to the admin interface of the
+         *  server of a network output, for changing the title of the
+         *  stream. Called from the configXXX functions.
+         *
+         *  @param cs the config section of the output.
+         *  @param server the host name of the server.
+         *  @param port the port of the admin interface.
+         *  @return the socket.
+         *  @exception Exception
+         */
+        TcpSocket *
+        createAdminSocket ( const ConfigSection    * cs,
+                            const char             * server,
+                            unsigned int             port )
+                                                            throw ( Exception );
+
+        /**
+         *  Configure a socket of a network output, based on the
+         *  output's config section. Called from the configXXX functions.
+         *
+         *  @param cs the config section of the output.
+         *  @param socket the socket to configure.
+         *  @param bitrate the nominal bitrate of the output, in kbps,
+         *         or 0 if not known.
+         *  @exception Exception
+         */
+        void
+        configTcpSocket (   const ConfigSection    * cs,
+                            TcpSocket              * socket,
+                            unsigned int             bitrate )
+                                                            throw ( Exception );
+
+        /**
+         *  Get the feeder of a network output for the connector: the
+         *  outputs driven by the same event loop are written from a
+         *  single thread.
+         *
+         *  @param socket the socket of the output.
+         *  @return the feeder, or 0 for a thread of its own.
+         */
+        unsigned int
+        getFeeder (         TcpSocket              * socket )   throw ();
+
+        /**
+         *  Create a bitrate adapter for a network output, based on the
+         *  output's config section. Called from the configXXX functions.
+         *
+         *  @param cs the config section of the output.
+         *  @param encoder the encoder of the output.
+         *  @param buffer the buffer of the output.
+         *  @param socket the socket of the output.
+         *  @param bitrate the nominal bitrate of the output, in kbps,
+         *         the highest bitrate to adapt to.
+         *  @return the bitrate adapter, to attach instead of the encoder.
+         *  @exception Exception
+         */
+        BitrateAdapter *
+        configBitrateAdapter (  const ConfigSection    * cs,
+                                AudioEncoder           * encoder,
+                                BufferedSink           * buffer,
+                                TcpSocket              * socket,
+                                unsigned int             bitrate )
+                                                            throw ( Exception );
+
         /**
          *  Look for file outputs from the config file.
          *  Called from init()
@@ -200,6 +364,42 @@ class DarkIce : public virtual Referable, public virtual Reporter
         configFileCast  (   const Config   & config )
                                                             throw ( Exception );
 
+        /**
+         *  Look for RTP outputs from the config file.
+         *  Called from init()
+         *
+         *  @param config the config Object to read initialization
+         *                information from.
+         *  @exception Exception
+         */
+        void
+        configRtp       (   const Config   & config )
+                                                            throw ( Exception );
+
+        /**
+         *  Look for HLS outputs from the config file.
+         *  Called from init()
+         *
+         *  @param config the config Object to read initialization
+         *                information from.
+         *  @exception Exception
+         */
+        void
+        configHls       (   const Config   & config )
+                                                            throw ( Exception );
+
+        /**
+         *  Look for the outputs of the built-in HTTP server from the
+         *  config file. Called from init()
+         *
+         *  @param config the config Object to read initialization
+         *                information from.
+         *  @exception Exception
+         */
+        void
+        configHttp      (   const Config   & config )
+                                                            throw ( Exception );
+
         /**
          *  Set POSIX real-time scheduling for the encoding process,
          *  if user permissions enable it.
@@ -310,6 +510,15 @@ class DarkIce : public virtual Referable, public virtual Reporter
         virtual void
         cut ( void )                                throw ();
 
+        /**
+         *  Change the title of the streams, without reconnecting to
+         *  the servers. May be called from any thread.
+         *
+         *  @param title the new title.
+         */
+        virtual void
+        setTitle (  const char    * title )         throw ();
+
 };
 
 
@@ -0,0 +1,252 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : DiskSpool.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#else
+#error need sys/mman.h
+#endif
+
+
+#include "Util.h"
+#include "Exception.h"
+#include "DiskSpool.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+DiskSpool :: init ( const char            * fileName,
+                    unsigned long long      maxSize )   throw ( Exception )
+{
+    if ( !fileName ) {
+        throw Exception( __FILE__, __LINE__, "no spool file name");
+    }
+
+    this->fileName    = Util::strDup( fileName);
+    this->maxSize     = maxSize;
+    this->readOffset  = 0;
+    this->writeOffset = 0;
+    this->map         = 0;
+    this->mapOffset   = 0;
+    this->punchOffset = 0;
+
+    fd = ::open( fileName, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    if ( fd == -1 ) {
+        delete[] this->fileName;
+        throw Exception( __FILE__, __LINE__, "can't open spool file: ",
+                         fileName, errno);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+DiskSpool :: strip ( void )                             throw ( Exception )
+{
+    unmap();
+    ::close( fd);
+    unlink( fileName);
+    delete[] fileName;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Unmap the read window
+ *----------------------------------------------------------------------------*/
+void
+DiskSpool :: unmap ( void )                             throw ()
+{
+    if ( map ) {
+        munmap( map, windowSize);
+        map = 0;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Append data to the end of the spool
+ *----------------------------------------------------------------------------*/
+bool
+DiskSpool :: append (   const struct iovec    * vec,
+                        unsigned int            count ) throw ()
+{
+    struct iovec        buf[maxVec];
+    struct iovec      * v   = buf;
+    unsigned int        len = Util::vecLen( vec, count);
+    unsigned int        done = 0;
+    ssize_t             ret;
+
+    if ( count > maxVec || getPending() + len > maxSize ) {
+        return false;
+    }
+
+    memcpy( buf, vec, count * sizeof(struct iovec));
+    while ( done < len ) {
+        if ( (ret = writev( fd, v, count)) == -1 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            reportEvent( 2, "DiskSpool :: append, write error", errno);
+            // don't leave a partial block behind
+            if ( ftruncate( fd, writeOffset) == -1 ) {
+                reportEvent( 2, "DiskSpool :: append, truncate error", errno);
+            }
+            return false;
+        }
+        done += ret;
+        v     = Util::skipVec( v, count, ret);
+    }
+
+    writeOffset += len;
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the data at the start of the spool
+ *----------------------------------------------------------------------------*/
+const unsigned char *
+DiskSpool :: peek ( unsigned int          & len )       throw ()
+{
+    unsigned long long      end;
+    void                  * p;
+
+    len = 0;
+    if ( readOffset == writeOffset ) {
+        return 0;
+    }
+
+    // move the window if the start of the data is not in it
+    if ( !map || readOffset < mapOffset
+              || readOffset >= mapOffset + windowSize ) {
+        unmap();
+        mapOffset = readOffset - readOffset % sysconf( _SC_PAGESIZE);
+        p = mmap( 0, windowSize, PROT_READ, MAP_SHARED, fd, mapOffset);
+        if ( p == MAP_FAILED ) {
+            reportEvent( 2, "DiskSpool :: peek, mmap error", errno);
+            return 0;
+        }
+        map = (unsigned char *) p;
+    }
+
+    // the window may reach beyond the end of the file, don't read there
+    end = mapOffset + windowSize < writeOffset ? mapOffset + windowSize
+                                               : writeOffset;
+    len = end - readOffset;
+
+    return map + (readOffset - mapOffset);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Remove data from the start of the spool
+ *----------------------------------------------------------------------------*/
+void
+DiskSpool :: release (  unsigned int    len )           throw ()
+{
+    readOffset += len;
+
+    if ( readOffset == writeOffset ) {
+        // all read, give back the disk space
+        unmap();
+        if ( ftruncate( fd, 0) == -1 ) {
+            reportEvent( 2, "DiskSpool :: release, truncate error", errno);
+        }
+        readOffset  = 0;
+        writeOffset = 0;
+        punchOffset = 0;
+        return;
+    }
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+    // give back the disk space of the data read, a window at a time,
+    // as the file only shrinks once all has been read
+    if ( readOffset - punchOffset >= windowSize ) {
+        unsigned long long  end = readOffset - readOffset % windowSize;
+
+        if ( fallocate( fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                        punchOffset, end - punchOffset) == -1 ) {
+            reportEvent( 4, "DiskSpool :: release, punch hole error", errno);
+        }
+        punchOffset = end;
+    }
+#endif
+}
+
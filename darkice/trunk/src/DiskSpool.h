@@ -0,0 +1,286 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : DiskSpool.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef DISK_SPOOL_H
+#define DISK_SPOOL_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#else
+#error need sys/uio.h
+#endif
+
+#include "Referable.h"
+#include "Reporter.h"
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A first-in first-out spool of data in a file on disk.
+ *  Data is appended to the end of the file, and read back from its
+ *  start through a memory mapped window. Once all data has been read,
+ *  the file is truncated. Until then, where supported, the disk space
+ *  of the data already read is given back by punching holes into the
+ *  file, so that it only takes about the space of the data pending.
+ *
+ *  The class is not thread-safe.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class DiskSpool : public virtual Referable, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The size of the memory mapped window to read through.
+         */
+        static const unsigned int   windowSize = 1024 * 1024;
+
+        /**
+         *  The maximum number of buffers append() takes at once.
+         */
+        static const unsigned int   maxVec = 8;
+
+        /**
+         *  The name of the spool file.
+         */
+        char                  * fileName;
+
+        /**
+         *  The maximum number of bytes to hold.
+         */
+        unsigned long long      maxSize;
+
+        /**
+         *  The spool file.
+         */
+        int                     fd;
+
+        /**
+         *  The file offset of the data not yet read.
+         */
+        unsigned long long      readOffset;
+
+        /**
+         *  The file offset of the end of the data.
+         */
+        unsigned long long      writeOffset;
+
+        /**
+         *  The file offset up to which the disk space of the data read
+         *  has been given back.
+         */
+        unsigned long long      punchOffset;
+
+        /**
+         *  The memory mapped window, or 0.
+         */
+        unsigned char         * map;
+
+        /**
+         *  The file offset the window starts at.
+         */
+        unsigned long long      mapOffset;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param fileName the name of the spool file.
+         *  @param maxSize the maximum number of bytes to hold.
+         *  @exception Exception
+         */
+        void
+        init (  const char            * fileName,
+                unsigned long long      maxSize )       throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                                  throw ( Exception );
+
+        /**
+         *  Unmap the window, if mapped.
+         */
+        void
+        unmap ( void )                                  throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        DiskSpool ( void )                              throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  spool file can not be shared.
+         *
+         *  @param spool the object to copy.
+         *  @exception Exception
+         */
+        inline
+        DiskSpool ( const DiskSpool   & spool )         throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor. Creates the spool file, or truncates it if it
+         *  exists.
+         *
+         *  @param fileName the name of the spool file.
+         *  @param maxSize the maximum number of bytes pending.
+         *  @exception Exception
+         */
+        inline
+        DiskSpool ( const char            * fileName,
+                    unsigned long long      maxSize )   throw ( Exception )
+        {
+            init( fileName, maxSize);
+        }
+
+        /**
+         *  Destructor. Removes the spool file.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~DiskSpool ( void )                             throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Get the name of the spool file.
+         *
+         *  @return the name of the spool file.
+         */
+        inline const char *
+        getFileName ( void ) const                      throw ()
+        {
+            return fileName;
+        }
+
+        /**
+         *  Get the maximum number of bytes the spool holds.
+         *
+         *  @return the maximum number of bytes to hold.
+         */
+        inline unsigned long long
+        getMaxSize ( void ) const                       throw ()
+        {
+            return maxSize;
+        }
+
+        /**
+         *  Get the number of bytes spooled but not yet read.
+         *
+         *  @return the number of bytes pending.
+         */
+        inline unsigned long long
+        getPending ( void ) const                       throw ()
+        {
+            return writeOffset - readOffset;
+        }
+
+        /**
+         *  Append data to the end of the spool. Either all the data
+         *  is appended, or none of it.
+         *
+         *  @param vec the buffers to append, in order.
+         *  @param count the number of buffers in vec.
+         *  @return true if the data was appended, false if it does not
+         *          fit, or could not be written.
+         */
+        bool
+        append (    const struct iovec    * vec,
+                    unsigned int            count )     throw ();
+
+        /**
+         *  Get the data at the start of the spool, without removing it.
+         *
+         *  @param len set to the number of bytes that can be read from
+         *         the returned pointer. May be less than getPending().
+         *  @return the start of the data, or 0 if there is none.
+         */
+        const unsigned char *
+        peek (  unsigned int          & len )           throw ();
+
+        /**
+         *  Remove data from the start of the spool.
+         *
+         *  @param len the number of bytes to remove, at most the length
+         *         returned by peek().
+         */
+        void
+        release (   unsigned int    len )               throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* DISK_SPOOL_H */
+
@@ -0,0 +1,102 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : EventHandler.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef EVENT_HANDLER_H
+#define EVENT_HANDLER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  Something that can be notified by an EventLoop when the file
+ *  descriptor it registered becomes ready.
+ *
+ *  @ref EventLoop
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class EventHandler
+{
+    public:
+
+        /**
+         *  Type for the kind of events a handler may be interested in,
+         *  or may be notified about. The values can be or-ed together.
+         */
+        enum Event { eventRead  = 1,
+                     eventWrite = 2,
+                     eventError = 4 };
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~EventHandler ( void )                          throw ( Exception )
+        {
+        }
+
+        /**
+         *  Called by the EventLoop, from the thread of the event loop,
+         *  when the registered file descriptor becomes ready.
+         *  Must not block.
+         *
+         *  @param events the events that occured, an or-ed combination
+         *         of the Event values.
+         */
+        virtual void
+        handleEvent (   unsigned int    events )        throw ()     = 0;
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* EVENT_HANDLER_H */
+
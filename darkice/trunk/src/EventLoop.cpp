@@ -0,0 +1,332 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : EventLoop.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_EVENT_LOOP
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#else
+#error need signal.h
+#endif
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+
+#include "Exception.h"
+#include "EventLoop.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+/*------------------------------------------------------------------------------
+ *  Convert EventHandler events to epoll events
+ *----------------------------------------------------------------------------*/
+static uint32_t
+toEpollEvents ( unsigned int    events )
+{
+    uint32_t    ev = 0;
+
+    if ( events & EventHandler::eventRead ) {
+        ev |= EPOLLIN;
+    }
+    if ( events & EventHandler::eventWrite ) {
+        ev |= EPOLLOUT;
+    }
+
+    return ev;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert epoll events to EventHandler events
+ *----------------------------------------------------------------------------*/
+static unsigned int
+fromEpollEvents ( uint32_t      ev )
+{
+    unsigned int    events = 0;
+
+    if ( ev & EPOLLIN ) {
+        events |= EventHandler::eventRead;
+    }
+    if ( ev & EPOLLOUT ) {
+        events |= EventHandler::eventWrite;
+    }
+    if ( ev & (EPOLLERR | EPOLLHUP) ) {
+        events |= EventHandler::eventError;
+    }
+
+    return events;
+}
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+EventLoop :: init ( void )                              throw ( Exception )
+{
+    struct epoll_event      ev;
+    pthread_mutexattr_t     attr;
+
+    running = false;
+    thread  = 0;
+
+    if ( (epollFd = epoll_create1( EPOLL_CLOEXEC)) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "epoll_create1 error", errno);
+    }
+
+    if ( (wakeFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ) {
+        ::close( epollFd);
+        throw Exception( __FILE__, __LINE__, "eventfd error", errno);
+    }
+
+    ev.events  = EPOLLIN;
+    ev.data.fd = wakeFd;
+    if ( epoll_ctl( epollFd, EPOLL_CTL_ADD, wakeFd, &ev) == -1 ) {
+        ::close( wakeFd);
+        ::close( epollFd);
+        throw Exception( __FILE__, __LINE__, "epoll_ctl error", errno);
+    }
+
+    // handlers may remove themselves while being dispatched
+    pthread_mutexattr_init( &attr);
+    pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init( &mutex, &attr);
+    pthread_mutexattr_destroy( &attr);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+EventLoop :: strip ( void )                             throw ( Exception )
+{
+    stop();
+
+    ::close( wakeFd);
+    ::close( epollFd);
+    pthread_mutex_destroy( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Register a file descriptor
+ *----------------------------------------------------------------------------*/
+void
+EventLoop :: add (  int                 fd,
+                    EventHandler      * handler,
+                    unsigned int        events )        throw ( Exception )
+{
+    struct epoll_event      ev;
+
+    ev.events  = toEpollEvents( events);
+    ev.data.fd = fd;
+
+    pthread_mutex_lock( &mutex);
+    if ( epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &ev) == -1 ) {
+        pthread_mutex_unlock( &mutex);
+        throw Exception( __FILE__, __LINE__, "epoll_ctl add error", errno);
+    }
+    handlers[fd] = handler;
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Change the events watched on a file descriptor
+ *----------------------------------------------------------------------------*/
+void
+EventLoop :: modify (   int             fd,
+                        unsigned int    events )        throw ( Exception )
+{
+    struct epoll_event      ev;
+
+    ev.events  = toEpollEvents( events);
+    ev.data.fd = fd;
+
+    // epoll_ctl is thread safe, no need to lock here
+    if ( epoll_ctl( epollFd, EPOLL_CTL_MOD, fd, &ev) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "epoll_ctl mod error", errno);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Unregister a file descriptor
+ *----------------------------------------------------------------------------*/
+void
+EventLoop :: remove (   int             fd )            throw ()
+{
+    pthread_mutex_lock( &mutex);
+    epoll_ctl( epollFd, EPOLL_CTL_DEL, fd, 0);
+    handlers.erase( fd);
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start the loop thread
+ *----------------------------------------------------------------------------*/
+void
+EventLoop :: start ( void )                             throw ( Exception )
+{
+    int     ret;
+
+    if ( isRunning() ) {
+        return;
+    }
+
+    __atomic_store_n( &running, true, __ATOMIC_RELEASE);
+    if ( (ret = pthread_create( &thread, 0, threadFunction, this)) ) {
+        __atomic_store_n( &running, false, __ATOMIC_RELEASE);
+        throw Exception( __FILE__, __LINE__, "pthread_create error", ret);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Stop the loop thread
+ *----------------------------------------------------------------------------*/
+void
+EventLoop :: stop ( void )                              throw ()
+{
+    uint64_t    one = 1;
+
+    if ( !isRunning() ) {
+        return;
+    }
+
+    // the loop thread reads the flag, once woken up
+    __atomic_store_n( &running, false, __ATOMIC_RELEASE);
+    if ( ::write( wakeFd, &one, sizeof(one)) == -1 ) {
+        reportEvent( 3, "EventLoop :: stop, can't wake loop", errno);
+    }
+    pthread_join( thread, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The loop itself
+ *----------------------------------------------------------------------------*/
+void
+EventLoop :: loop ( void )                              throw ()
+{
+    struct epoll_event      events[maxEvents];
+    sigset_t                sigset;
+    int                     n;
+    int                     i;
+
+    // mask out SIGUSR1, as we're expecting that signal for other reasons
+    sigemptyset( &sigset);
+    sigaddset( &sigset, SIGUSR1);
+
+    while ( isRunning() ) {
+        n = epoll_pwait( epollFd, events, maxEvents, -1, &sigset);
+
+        if ( n == -1 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            reportEvent( 1, "EventLoop :: loop, epoll_pwait error", errno);
+            break;
+        }
+
+        for ( i = 0; i < n; ++i ) {
+            int                                     fd = events[i].data.fd;
+            std::map<int, EventHandler*>::iterator  it;
+
+            if ( fd == wakeFd ) {
+                uint64_t    value;
+
+                while ( ::read( wakeFd, &value, sizeof(value)) > 0 );
+                continue;
+            }
+
+            // look the handler up again, as it may have been removed
+            // by an other handler dispatched from this same batch
+            pthread_mutex_lock( &mutex);
+            it = handlers.find( fd);
+            if ( it != handlers.end() ) {
+                it->second->handleEvent( fromEpollEvents( events[i].events));
+            }
+            pthread_mutex_unlock( &mutex);
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The thread function
+ *----------------------------------------------------------------------------*/
+void *
+EventLoop :: threadFunction ( void    * param )
+{
+    EventLoop     * eventLoop = (EventLoop*) param;
+
+    eventLoop->loop();
+
+    return 0;
+}
+
+
+#endif  /* HAVE_EVENT_LOOP */
+
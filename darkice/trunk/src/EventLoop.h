@@ -0,0 +1,270 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : EventLoop.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_EVENT_LOOP
+
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include <map>
+
+#include "Referable.h"
+#include "Reporter.h"
+#include "Exception.h"
+#include "EventHandler.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  An epoll based event loop, running in a thread of its own.
+ *  File descriptors are registered with an EventHandler, which is
+ *  notified from the thread of the loop when the descriptor becomes ready.
+ *  A single loop can drive any number of descriptors.
+ *
+ *  The network outputs only queue their data on their sockets, all
+ *  sending is done by the loops. The outputs of one loop are encoded
+ *  and queued by a single thread, see MultiThreadedConnector.
+ *
+ *  Handlers are called with the loop mutex held, thus after remove()
+ *  returns, the handler is guaranteed not to be called again.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class EventLoop : public virtual Referable, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The maximum number of events to process in one wakeup.
+         */
+        static const unsigned int       maxEvents = 64;
+
+        /**
+         *  The epoll file descriptor.
+         */
+        int                                 epollFd;
+
+        /**
+         *  An eventfd used to wake up the loop thread.
+         */
+        int                                 wakeFd;
+
+        /**
+         *  The thread running the loop.
+         */
+        pthread_t                           thread;
+
+        /**
+         *  Mutex protecting the handlers, and held while dispatching.
+         */
+        pthread_mutex_t                     mutex;
+
+        /**
+         *  Flag to show that the loop thread is running. Set from
+         *  other threads than the loop thread, thus accessed with
+         *  atomic operations only.
+         */
+        bool                                running;
+
+        /**
+         *  The handlers, by file descriptor.
+         */
+        std::map<int, EventHandler*>        handlers;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        init ( void )                                   throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                                  throw ( Exception );
+
+        /**
+         *  The body of the loop thread.
+         */
+        void
+        loop ( void )                                   throw ();
+
+        /**
+         *  The thread function.
+         *
+         *  @param param thread parameter, a pointer to the EventLoop.
+         *  @return nothing
+         */
+        static void *
+        threadFunction ( void     * param );
+
+
+    protected:
+
+        /**
+         *  Copy constructor. Always throws an Exception, as an
+         *  event loop can not be copied.
+         *
+         *  @param loop the object to copy.
+         *  @exception Exception
+         */
+        inline
+        EventLoop ( const EventLoop   & loop )          throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Default constructor.
+         *
+         *  @exception Exception
+         */
+        inline
+        EventLoop ( void )                              throw ( Exception )
+        {
+            init();
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~EventLoop ( void )                             throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Register a file descriptor with the loop.
+         *
+         *  @param fd the file descriptor to watch.
+         *  @param handler the handler to notify of the events on fd.
+         *  @param events the events to watch for, an or-ed combination
+         *         of EventHandler::Event values. Errors are always reported.
+         *  @exception Exception
+         */
+        void
+        add (   int                 fd,
+                EventHandler      * handler,
+                unsigned int        events )            throw ( Exception );
+
+        /**
+         *  Change the events watched for on a registered file descriptor.
+         *  May be called from any thread, including from a handler.
+         *
+         *  @param fd the file descriptor, previously added.
+         *  @param events the events to watch for, an or-ed combination
+         *         of EventHandler::Event values.
+         *  @exception Exception
+         */
+        void
+        modify (    int             fd,
+                    unsigned int    events )            throw ( Exception );
+
+        /**
+         *  Unregister a file descriptor from the loop.
+         *  When called from outside the loop thread, waits for a running
+         *  handler to return. Thus the caller must not hold any lock
+         *  the handler itself would take.
+         *
+         *  @param fd the file descriptor to remove.
+         */
+        void
+        remove (    int             fd )                throw ();
+
+        /**
+         *  Start the loop thread.
+         *
+         *  @exception Exception
+         */
+        void
+        start ( void )                                  throw ( Exception );
+
+        /**
+         *  Stop the loop thread, and wait for it to finish.
+         */
+        void
+        stop ( void )                                   throw ();
+
+        /**
+         *  Tell if the loop thread is running.
+         *
+         *  @return true if the loop thread is running, false otherwise.
+         */
+        inline bool
+        isRunning ( void ) const                        throw ()
+        {
+            return __atomic_load_n( &running, __ATOMIC_ACQUIRE);
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+#endif  /* HAVE_EVENT_LOOP */
+
+#endif  /* EVENT_LOOP_H */
+
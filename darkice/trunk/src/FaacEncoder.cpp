@@ -132,6 +132,15 @@ FaacEncoder :: open ( void )
         resampledOffsetSize = 0;
     }
 
+    // faac encodes as many channels as there are in the input
+    unsigned int    frameLen     = 0;
+    unsigned int    frameSamples = 0;
+    unsigned char * frame        = Util::adtsSilentFrame( getOutSampleRate(),
+                                                          getInChannel(),
+                                                          &frameLen,
+                                                          &frameSamples);
+    setSilentFrame( frame, frameLen, frameSamples);
+
     faacOpen = true;
 
     return true;
@@ -149,6 +158,8 @@ FaacEncoder :: write (  const void    * buf,
         return 0;
     }
 
+    endSilence();
+
     unsigned int    channels         = getInChannel();
     unsigned int    bitsPerSample    = getInBitsPerSample();
     unsigned int    sampleSize       = (bitsPerSample / 8) * channels;
@@ -205,6 +216,7 @@ FaacEncoder :: write (  const void    * buf,
                                         maxOutputBytes);
 #endif
             getSink()->write(faacBuf, outputBytes);
+            getSink()->markFrameEnd();
             processedSamples+=inputSamples/channels;
         }
 
@@ -233,6 +245,7 @@ FaacEncoder :: write (  const void    * buf,
                                         faacBuf,
                                         maxOutputBytes);
             getSink()->write(faacBuf, outputBytes);
+            getSink()->markFrameEnd();
 
             processedSamples += inSamples;
         }
@@ -244,6 +257,28 @@ FaacEncoder :: write (  const void    * buf,
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Write silence as pre-encoded silent frames
+ *----------------------------------------------------------------------------*/
+bool
+FaacEncoder :: writeSilence (   unsigned int    samples )
+                                                            throw ( Exception )
+{
+    if ( !isOpen() || !hasSilentFrame() ) {
+        return false;
+    }
+
+    if ( !isSilent() ) {
+        // faac can not be flushed without ending the stream, thus only
+        // the resampled input is let go, and the few samples held
+        // by faac come out when encoding goes on
+        resampledOffsetSize = 0;
+    }
+
+    return writeSilentFrames( samples);
+}
+
+
 /*------------------------------------------------------------------------------
  *  Flush the data from the encoder
  *----------------------------------------------------------------------------*/
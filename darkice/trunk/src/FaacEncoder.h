@@ -488,6 +488,16 @@ class FaacEncoder : public AudioEncoder, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        throw ( Exception );
 
+        /**
+         *  Write silence as pre-encoded silent AAC frames.
+         *
+         *  @param samples the number of input samples of silence.
+         *  @return true if the silence was written, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        writeSilence (  unsigned int    samples )   throw ( Exception );
+
         /**
          *  Flush all data that was written to the encoder to the underlying
          *  connection.
@@ -239,6 +239,20 @@ class FileSink : public Sink, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        throw ( Exception );
 
+        /**
+         *  Write data from several buffers to the FileSink,
+         *  with a single system call.
+         *
+         *  @param vec the buffers to write, in order.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes written (may be less than the
+         *          total length of the buffers).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeVec (     const struct iovec    * vec,
+                       unsigned int            count )  throw ( Exception );
+
         /**
          *  This is a no-op in this FileSink.
          *
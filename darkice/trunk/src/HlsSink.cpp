@@ -0,0 +1,531 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HlsSink.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+
+#include "Util.h"
+#include "Exception.h"
+#include "HlsSink.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The maximum length of the file names written
+ *----------------------------------------------------------------------------*/
+#define MAX_NAME_LEN        1024
+
+/*------------------------------------------------------------------------------
+ *  The owner of the ID3 PRIV frame holding the timestamp of a packed
+ *  audio segment, as given in RFC 8216
+ *----------------------------------------------------------------------------*/
+#define TIMESTAMP_OWNER     "com.apple.streaming.transportStreamTimestamp"
+
+
+/* ===============================================  local function prototypes */
+
+/*------------------------------------------------------------------------------
+ *  Write a number as an ID3v2 syncsafe integer, 7 bits in each byte
+ *----------------------------------------------------------------------------*/
+static void
+putSyncSafe (   unsigned char     * p,
+                unsigned int        value )
+{
+    p[0] = (value >> 21) & 0x7f;
+    p[1] = (value >> 14) & 0x7f;
+    p[2] = (value >>  7) & 0x7f;
+    p[3] =  value        & 0x7f;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write all of a buffer to a file
+ *----------------------------------------------------------------------------*/
+static bool
+writeAll (  int                     fd,
+            const unsigned char   * buf,
+            unsigned int            len )
+{
+    ssize_t     ret;
+
+    while ( len ) {
+        if ( (ret = ::write( fd, buf, len)) == -1 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return false;
+        }
+        buf += ret;
+        len -= ret;
+    }
+
+    return true;
+}
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+HlsSink :: init (   const char        * directory,
+                    const char        * baseName,
+                    Format              format,
+                    unsigned int        segmentDuration,
+                    unsigned int        listSize )      throw ( Exception )
+{
+    if ( !directory || !baseName || strchr( baseName, '/') ) {
+        throw Exception( __FILE__, __LINE__, "bad HLS file name", baseName);
+    }
+    if ( Util::strLen( directory) + Util::strLen( baseName)
+                                                    > MAX_NAME_LEN - 64 ) {
+        throw Exception( __FILE__, __LINE__, "HLS file name too long",
+                         baseName);
+    }
+    if ( segmentDuration == 0 || listSize == 0 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "bad HLS segment duration or playlist size");
+    }
+
+    this->directory       = Util::strDup( directory);
+    this->baseName        = Util::strDup( baseName);
+    this->format          = format;
+    this->segmentDuration = segmentDuration;
+    this->listSize        = listSize;
+
+    opened          = false;
+    fd              = -1;
+    sequence        = 0;
+    discontinuities = 0;
+    discontinuity   = false;
+    segmentStart    = 0.0;
+    segmentTime     = 0.0;
+    segmentBytes    = 0;
+    lastBytes       = 0;
+    inputLen        = 0;
+    input           = new unsigned char[inputSize];
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+HlsSink :: strip ( void )                               throw ( Exception )
+{
+    if ( isOpen() ) {
+        close();
+    }
+
+    delete[] directory;
+    delete[] baseName;
+    delete[] input;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the sink
+ *----------------------------------------------------------------------------*/
+bool
+HlsSink :: open ( void )                                throw ( Exception )
+{
+    if ( isOpen() ) {
+        return false;
+    }
+
+    if ( access( directory, W_OK) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "can't write HLS directory",
+                         directory, errno);
+    }
+
+    // a restarted stream goes on in the same playlist
+    discontinuity = !segments.empty();
+    segmentTime   = 0.0;
+    segmentBytes  = 0;
+    inputLen      = 0;
+    opened        = true;
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make the file name of a segment
+ *----------------------------------------------------------------------------*/
+void
+HlsSink :: segmentName (    char                * buf,
+                            unsigned int          len,
+                            unsigned long long    sequence,
+                            bool                  path ) const  throw ()
+{
+    snprintf( buf, len, "%s%s%s-%llu.%s",
+              path ? directory : "",
+              path ? "/" : "",
+              baseName,
+              sequence,
+              format == aac ? "aac" : "mp3");
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start a new segment
+ *----------------------------------------------------------------------------*/
+bool
+HlsSink :: startSegment ( void )                        throw ()
+{
+    char                name[MAX_NAME_LEN];
+    unsigned char       tag[73];
+    unsigned long long  timestamp;
+
+    snprintf( name, sizeof(name), "%s/.%s.tmp", directory, baseName);
+    if ( (fd = ::open( name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                       0644)) == -1 ) {
+        reportEvent( 2, "HlsSink :: can't create segment", name, errno);
+        return false;
+    }
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    // reserve about the size of the last segment, so that the segment
+    // is laid out in one piece, whatever the size of the writes
+    if ( lastBytes ) {
+        fallocate( fd, FALLOC_FL_KEEP_SIZE, 0, lastBytes + lastBytes / 8);
+    }
+#endif
+
+    // packed audio segments start with an ID3 tag holding the timestamp
+    // of their first frame, in 90 kHz units of the MPEG-2 system clock
+    timestamp = (unsigned long long) (segmentStart * 90000.0 + 0.5)
+              & 0x1ffffffffULL;
+
+    memcpy( tag, "ID3\x04\x00\x00", 6);
+    putSyncSafe( tag + 6, sizeof(tag) - 10);
+    memcpy( tag + 10, "PRIV", 4);
+    putSyncSafe( tag + 14, sizeof(tag) - 20);
+    tag[18] = 0;
+    tag[19] = 0;
+    memcpy( tag + 20, TIMESTAMP_OWNER, sizeof(TIMESTAMP_OWNER));
+    for ( unsigned int i = 0; i < 8; ++i ) {
+        tag[65 + i] = timestamp >> (56 - 8 * i);
+    }
+
+    segmentTime  = 0.0;
+    segmentBytes = 0;
+    writeSegment( tag, sizeof(tag));
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write data to the segment
+ *----------------------------------------------------------------------------*/
+void
+HlsSink :: writeSegment (   const unsigned char   * buf,
+                            unsigned int            len )   throw ()
+{
+    if ( fd == -1 || !len ) {
+        return;
+    }
+
+    if ( !writeAll( fd, buf, len) ) {
+        reportEvent( 2, "HlsSink :: segment write error", errno);
+        return;
+    }
+    segmentBytes += len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Finish the segment, and list it in the playlist
+ *----------------------------------------------------------------------------*/
+void
+HlsSink :: endSegment ( void )                          throw ()
+{
+    char        tmpName[MAX_NAME_LEN];
+    char        name[MAX_NAME_LEN];
+    Segment     segment;
+
+    if ( fd == -1 ) {
+        return;
+    }
+
+    // give back the space reserved but not used
+    if ( ftruncate( fd, segmentBytes) == -1 ) {
+        reportEvent( 4, "HlsSink :: truncate error", errno);
+    }
+    ::close( fd);
+    fd = -1;
+
+    snprintf( tmpName, sizeof(tmpName), "%s/.%s.tmp", directory, baseName);
+    segmentName( name, sizeof(name), sequence, true);
+    if ( rename( tmpName, name) == -1 ) {
+        reportEvent( 2, "HlsSink :: can't rename segment", name, errno);
+        unlink( tmpName);
+        return;
+    }
+
+    segment.sequence      = sequence++;
+    segment.duration      = segmentTime;
+    segment.discontinuity = discontinuity;
+    segments.push_back( segment);
+    discontinuity = false;
+    segmentStart += segmentTime;
+    lastBytes     = segmentBytes;
+
+    while ( segments.size() > listSize ) {
+        if ( segments.front().discontinuity ) {
+            ++discontinuities;
+        }
+        // players may still fetch segments just dropped from the
+        // playlist, thus only delete them a playlist later
+        if ( segments.front().sequence >= listSize ) {
+            segmentName( name, sizeof(name),
+                         segments.front().sequence - listSize, true);
+            unlink( name);
+        }
+        segments.pop_front();
+    }
+
+    writePlaylist( false);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write the playlist
+ *----------------------------------------------------------------------------*/
+void
+HlsSink :: writePlaylist (  bool    last )              throw ()
+{
+    char                                    tmpName[MAX_NAME_LEN];
+    char                                    name[MAX_NAME_LEN];
+    char                                    segName[MAX_NAME_LEN];
+    double                                  maxDuration = segmentDuration;
+    FILE                                  * f;
+    std::deque<Segment>::const_iterator     it;
+
+    if ( segments.empty() ) {
+        return;
+    }
+
+    // the durations rounded to the nearest second may not be longer
+    // than the target duration
+    for ( it = segments.begin(); it != segments.end(); ++it ) {
+        maxDuration = it->duration > maxDuration ? it->duration : maxDuration;
+    }
+
+    snprintf( tmpName, sizeof(tmpName), "%s/.%s.m3u8.tmp",
+              directory, baseName);
+    snprintf( name, sizeof(name), "%s/%s.m3u8", directory, baseName);
+
+    if ( !(f = fopen( tmpName, "w")) ) {
+        reportEvent( 2, "HlsSink :: can't create playlist", tmpName, errno);
+        return;
+    }
+
+    fprintf( f, "#EXTM3U\n"
+                "#EXT-X-VERSION:3\n"
+                "#EXT-X-TARGETDURATION:%u\n"
+                "#EXT-X-MEDIA-SEQUENCE:%llu\n",
+             (unsigned int) (maxDuration + 0.5),
+             segments.front().sequence);
+    if ( discontinuities ) {
+        fprintf( f, "#EXT-X-DISCONTINUITY-SEQUENCE:%llu\n", discontinuities);
+    }
+
+    for ( it = segments.begin(); it != segments.end(); ++it ) {
+        segmentName( segName, sizeof(segName), it->sequence, false);
+        fprintf( f, "%s#EXTINF:%.3f,\n%s\n",
+                 it->discontinuity ? "#EXT-X-DISCONTINUITY\n" : "",
+                 it->duration,
+                 segName);
+    }
+
+    if ( last ) {
+        fprintf( f, "#EXT-X-ENDLIST\n");
+    }
+
+    if ( fclose( f) == EOF ) {
+        reportEvent( 2, "HlsSink :: playlist write error", errno);
+        unlink( tmpName);
+        return;
+    }
+
+    if ( rename( tmpName, name) == -1 ) {
+        reportEvent( 2, "HlsSink :: can't rename playlist", name, errno);
+        unlink( tmpName);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write data to the sink
+ *----------------------------------------------------------------------------*/
+unsigned int
+HlsSink :: write (  const void    * buf,
+                    unsigned int    len )               throw ( Exception )
+{
+    const unsigned char   * b         = (const unsigned char *) buf;
+    unsigned int            headerLen = format == aac ? 7 : 4;
+    unsigned int            taken     = 0;
+    unsigned int            pos;
+    unsigned int            start;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    while ( taken < len ) {
+        unsigned int    l = len - taken;
+
+        l = l < inputSize - inputLen ? l : inputSize - inputLen;
+        memcpy( input + inputLen, b + taken, l);
+        inputLen += l;
+        taken    += l;
+
+        // write the whole frames, cutting segments at frame boundaries
+        pos   = 0;
+        start = 0;
+        while ( pos + headerLen <= inputLen ) {
+            unsigned int    samples;
+            unsigned int    sampleRate;
+            unsigned int    frameLen;
+
+            frameLen = format == aac
+                     ? Util::adtsFrameLength( input + pos,
+                                              &samples,
+                                              &sampleRate)
+                     : Util::mpegFrameLength( input + pos,
+                                              &samples,
+                                              &sampleRate);
+            if ( !frameLen ) {
+                // not at a frame header, skip to the next one
+                writeSegment( input + start, pos - start);
+                start = ++pos;
+                continue;
+            }
+            if ( pos + frameLen > inputLen ) {
+                break;
+            }
+
+            if ( fd != -1 && segmentTime >= segmentDuration ) {
+                writeSegment( input + start, pos - start);
+                start = pos;
+                endSegment();
+            }
+            if ( fd == -1 && !startSegment() ) {
+                // drop the frame, and try again at the next one
+                segmentStart += (double) samples / sampleRate;
+                pos          += frameLen;
+                start         = pos;
+                continue;
+            }
+
+            segmentTime += (double) samples / sampleRate;
+            pos         += frameLen;
+        }
+
+        writeSegment( input + start, pos - start);
+        memmove( input, input + pos, inputLen - pos);
+        inputLen -= pos;
+    }
+
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the sink
+ *----------------------------------------------------------------------------*/
+void
+HlsSink :: close ( void )                               throw ( Exception )
+{
+    if ( !isOpen() ) {
+        return;
+    }
+
+    if ( segmentTime > 0.0 ) {
+        endSegment();
+    } else if ( fd != -1 ) {
+        // nothing but the ID3 tag
+        char    tmpName[MAX_NAME_LEN];
+
+        ::close( fd);
+        fd = -1;
+        snprintf( tmpName, sizeof(tmpName), "%s/.%s.tmp", directory, baseName);
+        unlink( tmpName);
+    }
+
+    writePlaylist( true);
+    opened = false;
+}
+
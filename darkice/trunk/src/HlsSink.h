@@ -0,0 +1,420 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HlsSink.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef HLS_SINK_H
+#define HLS_SINK_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include <deque>
+
+#include "Reporter.h"
+#include "Sink.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  Cut the encoded stream into the segments of an HTTP Live Streaming
+ *  (HLS, RFC 8216) stream, in a directory served by a web server or
+ *  picked up by a CDN.
+ *
+ *  The segments are packed audio, mp3 or AAC in ADTS, each starting
+ *  with an ID3 tag holding its timestamp, as HLS asks for. Segments are
+ *  cut at frame boundaries, once they reach the segment duration.
+ *  A segment is written to a temporary file, and renamed to its final
+ *  name once complete, thus it is never seen half written. Likewise the
+ *  playlist, listing the most recent segments, is replaced atomically
+ *  each time a segment is added.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class HlsSink : public Sink, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The formats of the segments.
+         */
+        enum Format { mpa, aac };
+
+
+    private:
+
+        /**
+         *  The size of the buffer collecting the encoded data until
+         *  a whole frame is in. Holds the largest ADTS frame.
+         */
+        static const unsigned int   inputSize = 16384;
+
+        /**
+         *  A segment listed in the playlist.
+         */
+        struct Segment {
+            /**
+             *  The media sequence number of the segment.
+             */
+            unsigned long long      sequence;
+
+            /**
+             *  The duration of the segment, in seconds.
+             */
+            double                  duration;
+
+            /**
+             *  True if the segment does not continue the previous one,
+             *  as the stream was restarted.
+             */
+            bool                    discontinuity;
+        };
+
+        /**
+         *  The directory to write the segments and the playlist to.
+         */
+        char                  * directory;
+
+        /**
+         *  The name of the playlist and the segments, without extension.
+         */
+        char                  * baseName;
+
+        /**
+         *  The format of the segments.
+         */
+        Format                  format;
+
+        /**
+         *  The target duration of the segments, in seconds.
+         */
+        unsigned int            segmentDuration;
+
+        /**
+         *  The number of segments listed in the playlist.
+         */
+        unsigned int            listSize;
+
+        /**
+         *  Flag to show if the sink is open.
+         */
+        bool                    opened;
+
+        /**
+         *  The temporary file of the segment being written, or -1.
+         */
+        int                     fd;
+
+        /**
+         *  The media sequence number of the next segment.
+         */
+        unsigned long long      sequence;
+
+        /**
+         *  The segments in the playlist.
+         */
+        std::deque<Segment>     segments;
+
+        /**
+         *  The number of discontinuities that dropped off the start
+         *  of the playlist.
+         */
+        unsigned long long      discontinuities;
+
+        /**
+         *  True if the next segment is to be marked as a discontinuity.
+         */
+        bool                    discontinuity;
+
+        /**
+         *  The stream time at the start of the segment being written,
+         *  in seconds.
+         */
+        double                  segmentStart;
+
+        /**
+         *  The duration of the segment being written so far, in seconds.
+         */
+        double                  segmentTime;
+
+        /**
+         *  The number of bytes written to the segment being written.
+         */
+        unsigned long long      segmentBytes;
+
+        /**
+         *  The size of the last complete segment, to preallocate the
+         *  next one with.
+         */
+        unsigned long long      lastBytes;
+
+        /**
+         *  The encoded data not yet written.
+         */
+        unsigned char         * input;
+
+        /**
+         *  The number of bytes in input.
+         */
+        unsigned int            inputLen;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param directory the directory to write to.
+         *  @param baseName the name of the playlist and the segments.
+         *  @param format the format of the segments.
+         *  @param segmentDuration the target duration of the segments.
+         *  @param listSize the number of segments in the playlist.
+         *  @exception Exception
+         */
+        void
+        init (  const char        * directory,
+                const char        * baseName,
+                Format              format,
+                unsigned int        segmentDuration,
+                unsigned int        listSize )      throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Make the file name of a segment.
+         *
+         *  @param buf the buffer to write the name to.
+         *  @param len the size of buf.
+         *  @param sequence the media sequence number of the segment.
+         *  @param path include the directory in the name.
+         */
+        void
+        segmentName (   char                * buf,
+                        unsigned int          len,
+                        unsigned long long    sequence,
+                        bool                  path ) const  throw ();
+
+        /**
+         *  Start a new segment.
+         *
+         *  @return true if the segment file could be created.
+         */
+        bool
+        startSegment ( void )                       throw ();
+
+        /**
+         *  Write data to the segment being written.
+         *
+         *  @param buf the data to write.
+         *  @param len the number of bytes to write.
+         */
+        void
+        writeSegment (  const unsigned char   * buf,
+                        unsigned int            len )   throw ();
+
+        /**
+         *  Finish the segment being written, and list it in the playlist.
+         */
+        void
+        endSegment ( void )                         throw ();
+
+        /**
+         *  Write the playlist.
+         *
+         *  @param last true if the stream is over.
+         */
+        void
+        writePlaylist ( bool    last )              throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        HlsSink ( void )                            throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  segment files can not be shared.
+         *
+         *  @param sink the object to copy.
+         *  @exception Exception
+         */
+        inline
+        HlsSink (   const HlsSink     & sink )      throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param directory the directory to write the segments and
+         *         the playlist to.
+         *  @param baseName the name of the playlist and the segments,
+         *         without extension. The playlist is baseName.m3u8,
+         *         the segments baseName-<sequence>.mp3 or .aac
+         *  @param format the format of the segments.
+         *  @param segmentDuration the target duration of the segments,
+         *         in seconds.
+         *  @param listSize the number of segments in the playlist.
+         *  @exception Exception
+         */
+        inline
+        HlsSink (   const char        * directory,
+                    const char        * baseName,
+                    Format              format,
+                    unsigned int        segmentDuration = 6,
+                    unsigned int        listSize        = 6 )
+                                                    throw ( Exception )
+        {
+            init( directory, baseName, format, segmentDuration, listSize);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~HlsSink ( void )                           throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Start a new stream. The playlist goes on where it was,
+         *  with a discontinuity.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                               throw ( Exception );
+
+        /**
+         *  Check if the HlsSink is open.
+         *
+         *  @return true if the HlsSink is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                       throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Check if the HlsSink is ready to accept data.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the HlsSink is open, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canWrite (     unsigned int    sec,
+                       unsigned int    usec )       throw ( Exception )
+        {
+            return isOpen();
+        }
+
+        /**
+         *  Write encoded data to the HlsSink. All whole frames are
+         *  written to the segments.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes taken, len unless closed.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        write (        const void    * buf,
+                       unsigned int    len )        throw ( Exception );
+
+        /**
+         *  This is a no-op in this HlsSink, a segment is only listed
+         *  in the playlist once complete.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        flush ( void )                              throw ( Exception )
+        {
+        }
+
+        /**
+         *  This is a no-op in this HlsSink.
+         */
+        inline virtual void
+        cut ( void )                                throw ()
+        {
+        }
+
+        /**
+         *  Close the stream. The last segment is listed, and the
+         *  playlist is marked as ended.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                              throw ( Exception );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* HLS_SINK_H */
+
@@ -0,0 +1,411 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HttpListener.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_EVENT_LOOP
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#else
+#error need sys/socket.h
+#endif
+
+
+#include "Reporter.h"
+#include "HttpMount.h"
+#include "HttpServer.h"
+#include "HttpListener.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Constructor
+ *----------------------------------------------------------------------------*/
+HttpListener :: HttpListener (  HttpServer    * server,
+                                int             sockfd )
+                                                        throw ( Exception )
+{
+    this->server = server;
+    this->sockfd = sockfd;
+
+    state        = reading;
+    requestLen   = 0;
+    response     = 0;
+    responseLen  = 0;
+    responseSent = 0;
+    mount        = 0;
+    cursor       = 0;
+    generation   = 0;
+
+    server->getEventLoop()->add( sockfd, this, eventRead);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Destructor
+ *----------------------------------------------------------------------------*/
+HttpListener :: ~HttpListener ( void )                  throw ( Exception )
+{
+    delete[] response;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Handle the events of the connection
+ *----------------------------------------------------------------------------*/
+void
+HttpListener :: handleEvent (   unsigned int    events )    throw ()
+{
+    bool    ok;
+
+    if ( events & eventError ) {
+        ok = false;
+    } else if ( state == reading ) {
+        ok = readRequest();
+    } else if ( state == responding ) {
+        ok = sendResponse();
+    } else {
+        ok = sendStream();
+    }
+
+    if ( !ok ) {
+        finish();
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read the request
+ *----------------------------------------------------------------------------*/
+bool
+HttpListener :: readRequest ( void )                    throw ()
+{
+    int     ret;
+
+    ret = recv( sockfd, request + requestLen,
+                maxRequestSize - 1 - requestLen, MSG_DONTWAIT);
+    if ( ret == -1 ) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    if ( ret == 0 ) {
+        return false;
+    }
+
+    requestLen         += ret;
+    request[requestLen] = 0;
+
+    if ( strstr( request, "\r\n\r\n") || strstr( request, "\n\n") ) {
+        return handleRequest();
+    }
+    if ( requestLen == maxRequestSize - 1 ) {
+        respondError( "400 Bad Request");
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Handle the request
+ *----------------------------------------------------------------------------*/
+bool
+HttpListener :: handleRequest ( void )                  throw ()
+{
+    char            * path;
+    char            * end;
+    HttpMount       * m;
+    unsigned char   * header;
+    unsigned int      headerLen;
+    char              status[1024];
+    int               len;
+
+    if ( strncmp( request, "GET ", 4) ) {
+        respondError( "405 Method Not Allowed");
+        return true;
+    }
+
+    path = request + 4;
+    end  = path + strcspn( path, " ?\r\n");
+    *end = 0;
+
+    if ( !(m = server->getMount( path)) ) {
+        respondError( "404 Not Found");
+        return true;
+    }
+    if ( !m->attach( this, cursor, generation, header, headerLen) ) {
+        respondError( "503 Service Unavailable");
+        return true;
+    }
+    mount = m;
+
+    len = snprintf( status, sizeof(status),
+                    "HTTP/1.0 200 OK\r\n"
+                    "Content-Type: %s\r\n"
+                    "Cache-Control: no-cache\r\n"
+                    "Connection: close\r\n",
+                    mount->getContentType());
+    if ( mount->getName() && len < (int) sizeof(status) ) {
+        len += snprintf( status + len, sizeof(status) - len,
+                         "icy-name: %s\r\n", mount->getName());
+    }
+    if ( len > (int) sizeof(status) - 3 ) {
+        len = sizeof(status) - 3;
+    }
+    len += snprintf( status + len, sizeof(status) - len, "\r\n");
+
+    // the Ogg header pages go out with the response header
+    response    = new unsigned char[len + headerLen];
+    responseLen = len + headerLen;
+    memcpy( response, status, len);
+    if ( header ) {
+        memcpy( response + len, header, headerLen);
+        delete[] header;
+    }
+
+    Reporter::reportEvent( 4, "HTTP listener connected to",
+                           mount->getPath());
+
+    state = responding;
+    try {
+        server->getEventLoop()->modify( sockfd, eventWrite);
+    } catch ( Exception   & e ) {
+        return false;
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set up an error response
+ *----------------------------------------------------------------------------*/
+void
+HttpListener :: respondError (  const char    * status )    throw ()
+{
+    char    buf[256];
+    int     len;
+
+    len = snprintf( buf, sizeof(buf),
+                    "HTTP/1.0 %s\r\n"
+                    "Content-Type: text/plain\r\n"
+                    "Connection: close\r\n"
+                    "\r\n"
+                    "%s\r\n",
+                    status, status);
+
+    response    = new unsigned char[len];
+    responseLen = len;
+    memcpy( response, buf, len);
+
+    state = responding;
+    try {
+        server->getEventLoop()->modify( sockfd, eventWrite);
+    } catch ( Exception   & e ) {
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send the response
+ *----------------------------------------------------------------------------*/
+bool
+HttpListener :: sendResponse ( void )                   throw ()
+{
+    int     ret;
+
+    while ( responseSent < responseLen ) {
+        ret = send( sockfd, response + responseSent,
+                    responseLen - responseSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if ( ret == -1 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        responseSent += ret;
+    }
+
+    delete[] response;
+    response = 0;
+
+    if ( !mount ) {
+        // an error response, the connection is done
+        shutdown( sockfd, SHUT_WR);
+        return false;
+    }
+
+    state = streaming;
+    return sendStream();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send the stream data available
+ *----------------------------------------------------------------------------*/
+bool
+HttpListener :: sendStream ( void )                     throw ()
+{
+    EventLoop             * loop = server->getEventLoop();
+    unsigned int            sent = 0;
+    unsigned int            len;
+    const unsigned char   * data;
+    int                     ret;
+
+    try {
+        while ( sent < maxSendSize ) {
+            ret = mount->getData( cursor, generation, data);
+            if ( ret < 0 ) {
+                if ( mount->isCurrent( generation) ) {
+                    Reporter::reportEvent( 2,
+                                    "HTTP listener too slow, dropped from",
+                                    mount->getPath());
+                }
+                return false;
+            }
+
+            if ( ret == 0 ) {
+                // stop watching the socket until the encoder writes
+                loop->modify( sockfd, 0);
+                if ( mount->sleep( this, cursor, generation) ) {
+                    return true;
+                }
+                loop->modify( sockfd, eventWrite);
+                continue;
+            }
+
+            // send straight out of the ring buffer
+            len = ret;
+            len = len < maxSendSize - sent ? len : maxSendSize - sent;
+            ret = send( sockfd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if ( ret == -1 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+
+            // the encoder went on writing during the send, make sure
+            // it did not reach the data sent
+            if ( !mount->isKept( cursor, generation) ) {
+                if ( mount->isCurrent( generation) ) {
+                    Reporter::reportEvent( 2,
+                                    "HTTP listener too slow, dropped from",
+                                    mount->getPath());
+                }
+                return false;
+            }
+
+            cursor += ret;
+            sent   += ret;
+        }
+    } catch ( Exception   & e ) {
+        return false;
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wake up the connection
+ *----------------------------------------------------------------------------*/
+void
+HttpListener :: wake ( void )                           throw ()
+{
+    try {
+        server->getEventLoop()->modify( sockfd, eventWrite);
+    } catch ( Exception   & e ) {
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the connection
+ *----------------------------------------------------------------------------*/
+void
+HttpListener :: finish ( void )                         throw ()
+{
+    if ( mount ) {
+        mount->detach( this);
+    }
+
+    server->getEventLoop()->remove( sockfd);
+    ::close( sockfd);
+    server->removeListener( this);
+
+    delete this;
+}
+
+
+#endif  /* HAVE_EVENT_LOOP */
+
@@ -0,0 +1,283 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HttpListener.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef HTTP_LISTENER_H
+#define HTTP_LISTENER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_EVENT_LOOP
+
+#include "Exception.h"
+#include "EventHandler.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+class HttpServer;
+class HttpMount;
+
+/**
+ *  A client connection of the built-in HTTP server.
+ *
+ *  Reads the request of the client, then sends the response header,
+ *  and the stream of the mount point asked for. The stream is copied
+ *  out of the ring buffer of the mount a piece at a time, and sent from
+ *  the copy, as the encoder may write over the ring buffer while the
+ *  data is being sent. All work is done in the thread of the event
+ *  loop of the server, without ever blocking.
+ *
+ *  The object deletes itself when the connection is closed.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class HttpListener : public EventHandler
+{
+    private:
+
+        /**
+         *  The maximum size of a request.
+         */
+        static const unsigned int   maxRequestSize = 4096;
+
+        /**
+         *  The maximum number of bytes sent in one event, so that
+         *  a listener catching up does not hold up the others.
+         */
+        static const unsigned int   maxSendSize = 65536;
+
+        /**
+         *  The states of the connection.
+         */
+        enum State { reading, responding, streaming };
+
+        /**
+         *  The server the connection was accepted by.
+         */
+        HttpServer            * server;
+
+        /**
+         *  The socket of the connection.
+         */
+        int                     sockfd;
+
+        /**
+         *  The state of the connection.
+         */
+        State                   state;
+
+        /**
+         *  The request read so far.
+         */
+        char                    request[maxRequestSize];
+
+        /**
+         *  The number of bytes in request.
+         */
+        unsigned int            requestLen;
+
+        /**
+         *  The response header and the Ogg header pages to send,
+         *  before the stream.
+         */
+        unsigned char         * response;
+
+        /**
+         *  The number of bytes in response.
+         */
+        unsigned int            responseLen;
+
+        /**
+         *  The number of bytes of response sent.
+         */
+        unsigned int            responseSent;
+
+        /**
+         *  The mount point streamed, or 0.
+         */
+        HttpMount             * mount;
+
+        /**
+         *  The stream position of the next byte to send.
+         */
+        unsigned int            cursor;
+
+        /**
+         *  The generation of the stream sent.
+         */
+        unsigned int            generation;
+
+        /**
+         *  Read from the client, and handle the request once it is in.
+         *
+         *  @return false if the connection is to be closed.
+         */
+        bool
+        readRequest ( void )                        throw ();
+
+        /**
+         *  Handle the request read, and set up the response.
+         *
+         *  @return false if the connection is to be closed.
+         */
+        bool
+        handleRequest ( void )                      throw ();
+
+        /**
+         *  Set up an error response, after which the connection is closed.
+         *
+         *  @param status the status line, like "404 Not Found".
+         */
+        void
+        respondError (  const char    * status )    throw ();
+
+        /**
+         *  Send the rest of the response.
+         *
+         *  @return false if the connection is to be closed.
+         */
+        bool
+        sendResponse ( void )                       throw ();
+
+        /**
+         *  Send the stream data available.
+         *
+         *  @return false if the connection is to be closed.
+         */
+        bool
+        sendStream ( void )                         throw ();
+
+        /**
+         *  Close the connection, and delete the object.
+         */
+        void
+        finish ( void )                             throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        HttpListener ( void )                       throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  connection can not be shared.
+         *
+         *  @param listener the object to copy.
+         *  @exception Exception
+         */
+        inline
+        HttpListener ( const HttpListener  & listener )
+                                                    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Destructor. Use close() to get rid of the object.
+         *
+         *  @exception Exception
+         */
+        virtual
+        ~HttpListener ( void )                      throw ( Exception );
+
+
+    public:
+
+        /**
+         *  Constructor. Registers the connection with the event loop
+         *  of the server.
+         *
+         *  @param server the server the connection was accepted by.
+         *  @param sockfd the socket of the connection, non-blocking.
+         *  @exception Exception
+         */
+        HttpListener (  HttpServer    * server,
+                        int             sockfd )    throw ( Exception );
+
+        /**
+         *  Called by the event loop when the socket is ready.
+         *
+         *  @param events the events that occured.
+         */
+        virtual void
+        handleEvent (   unsigned int    events )    throw ();
+
+        /**
+         *  Start sending again, as new data is available, or the stream
+         *  is over. Called by the mount point, from any thread.
+         */
+        void
+        wake ( void )                               throw ();
+
+        /**
+         *  Close the connection, and delete the object.
+         *  Only to be called while the event loop does not run.
+         */
+        inline void
+        close ( void )                              throw ()
+        {
+            finish();
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+#endif  /* HAVE_EVENT_LOOP */
+
+#endif  /* HTTP_LISTENER_H */
+
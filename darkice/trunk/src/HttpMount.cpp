@@ -0,0 +1,502 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HttpMount.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_EVENT_LOOP
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+
+#include "Util.h"
+#include "Exception.h"
+#include "HttpListener.h"
+#include "HttpMount.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The size of the fixed part of an Ogg page header
+ *----------------------------------------------------------------------------*/
+#define OGG_HEADER_SIZE     27
+
+/*------------------------------------------------------------------------------
+ *  The Ogg page header flag of the first page of a logical stream
+ *----------------------------------------------------------------------------*/
+#define OGG_BOS             0x02
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+HttpMount :: init ( const char        * path,
+                    const char        * contentType,
+                    const char        * name,
+                    unsigned int        burstSize,
+                    unsigned int        maxLag,
+                    unsigned int        maxListeners )  throw ( Exception )
+{
+    if ( !path || *path != '/' ) {
+        throw Exception( __FILE__, __LINE__, "bad mount point", path);
+    }
+    if ( !contentType ) {
+        throw Exception( __FILE__, __LINE__, "no content type");
+    }
+    if ( !maxLag ) {
+        throw Exception( __FILE__, __LINE__, "maxLag is 0");
+    }
+    if ( maxLag < burstSize ) {
+        throw Exception( __FILE__, __LINE__,
+                         "maxLag smaller than burstSize", maxLag);
+    }
+
+    this->path         = Util::strDup( path);
+    this->contentType  = Util::strDup( contentType);
+    this->name         = name ? Util::strDup( name) : 0;
+    this->burstSize    = burstSize;
+    this->maxLag       = maxLag;
+    this->maxListeners = maxListeners;
+
+    ring        = new RingBuffer( maxLag + maxWriteSize);
+    header      = new unsigned char[maxHeaderSize];
+    headerLen   = 0;
+    noListeners = 0;
+    opened      = false;
+    generation  = 0;
+    firstFrame  = 0;
+    noFrames    = 0;
+    lastFrame   = 0;
+    headerEnd   = 0;
+
+    pthread_mutex_init( &mutex, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+HttpMount :: strip ( void )                             throw ( Exception )
+{
+    if ( isOpen() ) {
+        close();
+    }
+
+    pthread_mutex_destroy( &mutex);
+
+    delete ring;
+    delete[] header;
+    delete[] path;
+    delete[] contentType;
+    delete[] name;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the mount point
+ *----------------------------------------------------------------------------*/
+bool
+HttpMount :: open ( void )                              throw ( Exception )
+{
+    if ( isOpen() ) {
+        return false;
+    }
+
+    pthread_mutex_lock( &mutex);
+    firstFrame = 0;
+    noFrames   = 0;
+    lastFrame  = ring->getTail();
+    headerEnd  = lastFrame;
+    headerLen  = 0;
+    __atomic_store_n( &opened, true, __ATOMIC_RELEASE);
+    pthread_mutex_unlock( &mutex);
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Append data to the ring buffer
+ *----------------------------------------------------------------------------*/
+void
+HttpMount :: put (  const void        * buf,
+                    unsigned int        len )           throw ()
+{
+    const unsigned char   * b    = (const unsigned char *) buf;
+    unsigned int            room = ring->getFree();
+
+    // only the end of a write bigger than the buffer can be kept
+    if ( len > ring->getSize() ) {
+        b  += len - ring->getSize();
+        len = ring->getSize();
+    }
+
+    // listeners still reading the data dropped get disconnected
+    if ( room < len ) {
+        ring->release( len - room);
+    }
+
+    // each piece is committed before the next one is written, so
+    // that no write reaches the data within maxLag of the tail
+    while ( len ) {
+        unsigned int    l = len < maxWriteSize ? len : maxWriteSize;
+
+        ring->put( b, l);
+        b   += l;
+        len -= l;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wake up the listeners waiting for data
+ *----------------------------------------------------------------------------*/
+void
+HttpMount :: wakeListeners ( void )                     throw ()
+{
+    std::set<HttpListener*>::iterator   it;
+
+    for ( it = idle.begin(); it != idle.end(); ++it ) {
+        (*it)->wake();
+    }
+    idle.clear();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write data to the mount point
+ *----------------------------------------------------------------------------*/
+unsigned int
+HttpMount :: write (    const void    * buf,
+                        unsigned int    len )           throw ( Exception )
+{
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    put( buf, len);
+
+    pthread_mutex_lock( &mutex);
+    wakeListeners();
+    pthread_mutex_unlock( &mutex);
+
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write data from several buffers to the mount point
+ *----------------------------------------------------------------------------*/
+unsigned int
+HttpMount :: writeVec ( const struct iovec    * vec,
+                        unsigned int            count ) throw ( Exception )
+{
+    unsigned int    total = 0;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    for ( unsigned int i = 0; i < count; ++i ) {
+        put( vec[i].iov_base, vec[i].iov_len);
+        total += vec[i].iov_len;
+    }
+
+    pthread_mutex_lock( &mutex);
+    wakeListeners();
+    pthread_mutex_unlock( &mutex);
+
+    return total;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Keep the Ogg header pages written since the last frame boundary
+ *----------------------------------------------------------------------------*/
+void
+HttpMount :: scanHeader ( void )                        throw ()
+{
+    unsigned int            position = lastFrame;
+    unsigned int            len      = ring->getTail() - position;
+    const unsigned char   * p;
+
+    if ( len > ring->getUsed() ) {
+        // written over already
+        return;
+    }
+
+    p = ring->getPtrAt( position);
+
+    while ( len >= OGG_HEADER_SIZE && memcmp( p, "OggS", 4) == 0 ) {
+        unsigned int    segments = p[26];
+        unsigned int    pageLen  = OGG_HEADER_SIZE + segments;
+        bool            zero     = true;
+
+        if ( len < pageLen ) {
+            break;
+        }
+        for ( unsigned int i = 0; i < segments; ++i ) {
+            pageLen += p[OGG_HEADER_SIZE + i];
+        }
+        if ( len < pageLen ) {
+            break;
+        }
+
+        // a new stream starts, with new headers
+        if ( p[5] & OGG_BOS ) {
+            headerLen = 0;
+        }
+
+        // the header pages have a granule position of 0
+        for ( unsigned int i = 6; i < 14; ++i ) {
+            zero = zero && p[i] == 0;
+        }
+        if ( zero && headerLen + pageLen <= maxHeaderSize ) {
+            memcpy( header + headerLen, p, pageLen);
+            headerLen += pageLen;
+            headerEnd  = position + pageLen;
+        }
+
+        p        += pageLen;
+        position += pageLen;
+        len      -= pageLen;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Remember a frame boundary
+ *----------------------------------------------------------------------------*/
+void
+HttpMount :: markFrameEnd ( void )                      throw ( Exception )
+{
+    unsigned int    tail = ring->getTail();
+
+    if ( !isOpen() || tail == lastFrame ) {
+        return;
+    }
+
+    pthread_mutex_lock( &mutex);
+
+    scanHeader();
+
+    if ( noFrames == maxFrames ) {
+        firstFrame = (firstFrame + 1) % maxFrames;
+        --noFrames;
+    }
+    frames[(firstFrame + noFrames) % maxFrames] = tail;
+    ++noFrames;
+    lastFrame = tail;
+
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start serving a listener
+ *----------------------------------------------------------------------------*/
+bool
+HttpMount :: attach (   HttpListener      * listener,
+                        unsigned int      & cursor,
+                        unsigned int      & generation,
+                        unsigned char    *& header,
+                        unsigned int      & headerLen )     throw ()
+{
+    unsigned int    head;
+    unsigned int    tail;
+    unsigned int    used;
+    unsigned int    burstStart;
+
+    pthread_mutex_lock( &mutex);
+
+    if ( !opened || (maxListeners && noListeners >= maxListeners) ) {
+        pthread_mutex_unlock( &mutex);
+        return false;
+    }
+
+    head       = ring->getHead();
+    tail       = ring->getTail();
+    used       = tail - head;
+    burstStart = tail - (burstSize < used ? burstSize : used);
+
+    // start at the oldest frame boundary within the burst, after
+    // the header pages, or at the last boundary if there is none
+    cursor = tail - lastFrame <= used ? lastFrame : tail;
+    for ( unsigned int i = 0; i < noFrames; ++i ) {
+        unsigned int    frame = frames[(firstFrame + i) % maxFrames];
+
+        if ( tail - frame <= tail - burstStart
+          && (int) (frame - headerEnd) >= 0 ) {
+            cursor = frame;
+            break;
+        }
+    }
+
+    generation = this->generation;
+    header     = 0;
+    headerLen  = this->headerLen;
+    if ( headerLen ) {
+        header = new unsigned char[headerLen];
+        memcpy( header, this->header, headerLen);
+    }
+    ++noListeners;
+
+    pthread_mutex_unlock( &mutex);
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Stop serving a listener
+ *----------------------------------------------------------------------------*/
+void
+HttpMount :: detach (   HttpListener      * listener )      throw ()
+{
+    pthread_mutex_lock( &mutex);
+    idle.erase( listener);
+    --noListeners;
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Put a listener to sleep until there is more data
+ *----------------------------------------------------------------------------*/
+bool
+HttpMount :: sleep (    HttpListener      * listener,
+                        unsigned int        cursor,
+                        unsigned int        generation )    throw ()
+{
+    bool    ret = false;
+
+    pthread_mutex_lock( &mutex);
+    if ( opened && generation == this->generation
+      && ring->getTail() == cursor ) {
+        idle.insert( listener);
+        ret = true;
+    }
+    pthread_mutex_unlock( &mutex);
+
+    return ret;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Tell if the stream data from a position on is still kept
+ *----------------------------------------------------------------------------*/
+bool
+HttpMount :: isKept (   unsigned int        cursor,
+                        unsigned int        generation )    throw ()
+{
+    // the encoder writes at most maxWriteSize bytes at a time into the
+    // ring buffer of maxLag + maxWriteSize bytes, thus the data up to
+    // maxLag behind the tail is not being written over
+    return isCurrent( generation)
+        && ring->getTail() - cursor <= maxLag;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the stream data for a listener
+ *----------------------------------------------------------------------------*/
+int
+HttpMount :: getData (  unsigned int            cursor,
+                        unsigned int            generation,
+                        const unsigned char   *& data )     throw ()
+{
+    unsigned int    tail = ring->getTail();
+
+    if ( !isCurrent( generation) || tail - cursor > maxLag ) {
+        return -1;
+    }
+
+    // the ring buffer is mapped twice in a row, thus the data is
+    // contiguous even where it wraps around
+    data = ring->getPtrAt( cursor);
+
+    return tail - cursor;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Tell if a stream is still being served
+ *----------------------------------------------------------------------------*/
+bool
+HttpMount :: isCurrent (    unsigned int    generation )    throw ()
+{
+    return __atomic_load_n( &opened, __ATOMIC_ACQUIRE)
+        && __atomic_load_n( &this->generation, __ATOMIC_ACQUIRE)
+                                                        == generation;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the mount point
+ *----------------------------------------------------------------------------*/
+void
+HttpMount :: close ( void )                             throw ( Exception )
+{
+    if ( !isOpen() ) {
+        return;
+    }
+
+    pthread_mutex_lock( &mutex);
+    __atomic_store_n( &opened, false, __ATOMIC_RELEASE);
+    __atomic_store_n( &generation, generation + 1, __ATOMIC_RELEASE);
+    wakeListeners();
+    pthread_mutex_unlock( &mutex);
+}
+
+
+#endif  /* HAVE_EVENT_LOOP */
+
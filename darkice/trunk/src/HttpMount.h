@@ -0,0 +1,575 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HttpMount.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef HTTP_MOUNT_H
+#define HTTP_MOUNT_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_EVENT_LOOP
+
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include <set>
+
+#include "Reporter.h"
+#include "RingBuffer.h"
+#include "Sink.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+class HttpListener;
+
+/**
+ *  A mount point of the built-in HTTP server: an encoded stream,
+ *  served to any number of listeners.
+ *
+ *  The encoder writes into the mount like into any other Sink. The data
+ *  is kept in a single ring buffer, shared by all the listeners of the
+ *  mount, each sending from its own position in the stream. Thus the
+ *  stream is stored once, no matter how many listeners there are.
+ *  Listeners send straight out of the ring buffer, without taking any
+ *  lock. The ring buffer holds maxLag bytes plus the largest single
+ *  write, and the encoder writes in pieces of at most that size, thus
+ *  a write never touches the data within maxLag of the stream end.
+ *  Listeners check their lag before each send, and again after it,
+ *  to know that what they sent was not written over meanwhile.
+ *
+ *  New listeners get up to burstSize bytes of the recent stream at once,
+ *  starting at a frame boundary, so that players can start playing
+ *  right away. For Ogg streams, the header pages of the stream are kept
+ *  aside and sent first. Listeners that fall more than maxLag bytes
+ *  behind are disconnected, so a slow listener never holds up the
+ *  encoder or the other listeners.
+ *
+ *  Listeners that have sent everything wait for more data without
+ *  polling: they are woken up when the encoder writes.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class HttpMount : public Sink, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The number of frame boundaries remembered, to start
+         *  new listeners at.
+         */
+        static const unsigned int   maxFrames = 1024;
+
+        /**
+         *  The maximum size of the Ogg header pages kept.
+         */
+        static const unsigned int   maxHeaderSize = 65536;
+
+        /**
+         *  The largest piece of data written into the ring buffer at
+         *  once, bigger writes are split. The ring buffer has this
+         *  much room beyond maxLag.
+         */
+        static const unsigned int   maxWriteSize = 65536;
+
+        /**
+         *  The path of the mount point, like "/live.mp3".
+         */
+        char                  * path;
+
+        /**
+         *  The MIME type of the stream.
+         */
+        char                  * contentType;
+
+        /**
+         *  The name of the stream, or 0.
+         */
+        char                  * name;
+
+        /**
+         *  The number of bytes sent to new listeners at once.
+         */
+        unsigned int            burstSize;
+
+        /**
+         *  The number of bytes a listener may fall behind.
+         */
+        unsigned int            maxLag;
+
+        /**
+         *  The maximum number of listeners, 0 for no limit.
+         */
+        unsigned int            maxListeners;
+
+        /**
+         *  The number of listeners.
+         */
+        unsigned int            noListeners;
+
+        /**
+         *  The stream data.
+         */
+        RingBuffer            * ring;
+
+        /**
+         *  Flag to show if the mount is open. Read by the listeners
+         *  without locking.
+         */
+        bool                    opened;
+
+        /**
+         *  Incremented each time the mount is closed, so that the
+         *  listeners of the previous stream know to disconnect.
+         *  Read by the listeners without locking.
+         */
+        unsigned int            generation;
+
+        /**
+         *  The stream positions of the recent frame boundaries,
+         *  a circular list.
+         */
+        unsigned int            frames[maxFrames];
+
+        /**
+         *  The index of the oldest frame boundary in frames.
+         */
+        unsigned int            firstFrame;
+
+        /**
+         *  The number of frame boundaries in frames.
+         */
+        unsigned int            noFrames;
+
+        /**
+         *  The stream position of the last frame boundary.
+         */
+        unsigned int            lastFrame;
+
+        /**
+         *  The Ogg header pages of the stream.
+         */
+        unsigned char         * header;
+
+        /**
+         *  The number of bytes in header.
+         */
+        unsigned int            headerLen;
+
+        /**
+         *  The stream position after the last header page, where
+         *  listeners may start at the earliest.
+         */
+        unsigned int            headerEnd;
+
+        /**
+         *  The listeners waiting for data.
+         */
+        std::set<HttpListener*> idle;
+
+        /**
+         *  Mutex protecting the listeners waiting for data, the frame
+         *  boundaries and the header pages.
+         */
+        pthread_mutex_t         mutex;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param path the path of the mount point.
+         *  @param contentType the MIME type of the stream.
+         *  @param name the name of the stream, or 0.
+         *  @param burstSize the number of bytes sent to new listeners.
+         *  @param maxLag the number of bytes a listener may fall behind.
+         *  @param maxListeners the maximum number of listeners.
+         *  @exception Exception
+         */
+        void
+        init (  const char        * path,
+                const char        * contentType,
+                const char        * name,
+                unsigned int        burstSize,
+                unsigned int        maxLag,
+                unsigned int        maxListeners )  throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Append data to the ring buffer, at most maxWriteSize bytes
+         *  at a time, dropping the oldest data if there is no room.
+         *
+         *  @param buf the data to append.
+         *  @param len the number of bytes in buf.
+         */
+        void
+        put (   const void        * buf,
+                unsigned int        len )           throw ();
+
+        /**
+         *  Wake up the listeners waiting for data.
+         *  The mutex must be held.
+         */
+        void
+        wakeListeners ( void )                      throw ();
+
+        /**
+         *  Look for Ogg header pages among the data since the last
+         *  frame boundary, and keep them aside.
+         *  The mutex must be held.
+         */
+        void
+        scanHeader ( void )                         throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        HttpMount ( void )                          throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  listeners can not be shared.
+         *
+         *  @param mount the object to copy.
+         *  @exception Exception
+         */
+        inline
+        HttpMount ( const HttpMount   & mount )     throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param path the path of the mount point, starting with '/'.
+         *  @param contentType the MIME type of the stream.
+         *  @param name the name of the stream, or 0.
+         *  @param burstSize the number of bytes of the recent stream
+         *         sent to new listeners at once.
+         *  @param maxLag the number of bytes a listener may fall behind
+         *         before it is disconnected.
+         *  @param maxListeners the maximum number of listeners,
+         *         0 for no limit.
+         *  @exception Exception
+         */
+        inline
+        HttpMount ( const char        * path,
+                    const char        * contentType,
+                    const char        * name          = 0,
+                    unsigned int        burstSize     = 65536,
+                    unsigned int        maxLag        = 262144,
+                    unsigned int        maxListeners  = 0 )
+                                                    throw ( Exception )
+        {
+            init( path, contentType, name, burstSize, maxLag, maxListeners);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~HttpMount ( void )                         throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Get the path of the mount point.
+         *
+         *  @return the path of the mount point.
+         */
+        inline const char *
+        getPath ( void ) const                      throw ()
+        {
+            return path;
+        }
+
+        /**
+         *  Get the MIME type of the stream.
+         *
+         *  @return the MIME type of the stream.
+         */
+        inline const char *
+        getContentType ( void ) const               throw ()
+        {
+            return contentType;
+        }
+
+        /**
+         *  Get the name of the stream.
+         *
+         *  @return the name of the stream, or 0.
+         */
+        inline const char *
+        getName ( void ) const                      throw ()
+        {
+            return name;
+        }
+
+        /**
+         *  Get the number of bytes a listener may fall behind.
+         *
+         *  @return the number of bytes a listener may fall behind.
+         */
+        inline unsigned int
+        getMaxLag ( void ) const                    throw ()
+        {
+            return maxLag;
+        }
+
+        /**
+         *  Get the stream data from a position, for a listener to send
+         *  straight out of the ring buffer. Called from the event loop,
+         *  without locking.
+         *
+         *  @param cursor the stream position to send from.
+         *  @param generation the generation of the stream sent.
+         *  @param data set to the stream data at cursor.
+         *  @return the number of bytes at data, 0 if there is no data
+         *          after cursor, or -1 if the stream is not served
+         *          anymore, or the listener fell more than maxLag behind.
+         */
+        int
+        getData (   unsigned int            cursor,
+                    unsigned int            generation,
+                    const unsigned char   *& data )     throw ();
+
+        /**
+         *  Tell if the stream data from a position on is still in the
+         *  ring buffer, not written over. Called from the event loop,
+         *  without locking.
+         *
+         *  @param cursor the stream position.
+         *  @param generation the generation of the stream sent.
+         *  @return true if the stream is the current one, and cursor
+         *          is at most maxLag behind.
+         */
+        bool
+        isKept (    unsigned int        cursor,
+                    unsigned int        generation )    throw ();
+
+        /**
+         *  Start serving a listener. Called from the event loop.
+         *
+         *  @param listener the listener.
+         *  @param cursor set to the stream position to start sending at.
+         *  @param generation set to the generation of the stream.
+         *  @param header set to a copy of the Ogg header pages to send
+         *         first, or 0. To be freed by the caller with delete[].
+         *  @param headerLen set to the number of bytes in header.
+         *  @return false if the mount is not open, or is full.
+         */
+        bool
+        attach (    HttpListener      * listener,
+                    unsigned int      & cursor,
+                    unsigned int      & generation,
+                    unsigned char    *& header,
+                    unsigned int      & headerLen )     throw ();
+
+        /**
+         *  Stop serving a listener. Called from the event loop.
+         *
+         *  @param listener the listener, previously attached.
+         */
+        void
+        detach (    HttpListener      * listener )      throw ();
+
+        /**
+         *  Put a listener that has sent everything to sleep, until the
+         *  encoder writes more data. Called from the event loop.
+         *
+         *  @param listener the listener, previously attached.
+         *  @param cursor the stream position of the listener.
+         *  @param generation the generation of the stream the listener
+         *         is sending.
+         *  @return false if there is data to send already, or the
+         *          stream is over, thus the listener is not to sleep.
+         */
+        bool
+        sleep (     HttpListener      * listener,
+                    unsigned int        cursor,
+                    unsigned int        generation )    throw ();
+
+        /**
+         *  Tell if a stream is still being served.
+         *  Called from the event loop, without locking.
+         *
+         *  @param generation the generation of the stream.
+         *  @return true if the stream is the current one, and open.
+         */
+        bool
+        isCurrent ( unsigned int        generation )    throw ();
+
+        /**
+         *  Open the mount point, and start a new stream.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                               throw ( Exception );
+
+        /**
+         *  Check if the mount point is open.
+         *
+         *  @return true if the mount point is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                       throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Check if the mount point is ready to accept data.
+         *  Writing never blocks, as slow listeners are disconnected.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the mount point is open, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canWrite (     unsigned int    sec,
+                       unsigned int    usec )       throw ( Exception )
+        {
+            return isOpen();
+        }
+
+        /**
+         *  Write encoded data to the mount point.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes taken, len unless closed.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        write (        const void    * buf,
+                       unsigned int    len )        throw ( Exception );
+
+        /**
+         *  Write encoded data from several buffers to the mount point,
+         *  waking up the listeners only once.
+         *
+         *  @param vec the buffers to write, in order.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes taken, all unless closed.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeVec (     const struct iovec    * vec,
+                       unsigned int            count )
+                                                    throw ( Exception );
+
+        /**
+         *  Remember the end of the data written so far as a frame
+         *  boundary, where new listeners may start.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        markFrameEnd ( void )                       throw ( Exception );
+
+        /**
+         *  This is a no-op, as the data is available to the listeners
+         *  as soon as it is written.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        flush ( void )                              throw ( Exception )
+        {
+        }
+
+        /**
+         *  This is a no-op in this HttpMount.
+         */
+        inline virtual void
+        cut ( void )                                throw ()
+        {
+        }
+
+        /**
+         *  Close the mount point, disconnecting all the listeners.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                              throw ( Exception );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+#endif  /* HAVE_EVENT_LOOP */
+
+#endif  /* HTTP_MOUNT_H */
+
@@ -0,0 +1,312 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HttpServer.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_EVENT_LOOP
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#else
+#error need sys/socket.h
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#else
+#error need netinet/in.h
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#else
+#error need netdb.h
+#endif
+
+
+#include "Util.h"
+#include "HttpListener.h"
+#include "HttpServer.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The length of the queue of connections not yet accepted
+ *----------------------------------------------------------------------------*/
+#define LISTEN_BACKLOG      128
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: init (    EventLoop         * eventLoop,
+                        const char        * address,
+                        unsigned short      port )      throw ( Exception )
+{
+    if ( !eventLoop || !port ) {
+        throw Exception( __FILE__, __LINE__, "no HTTP server port");
+    }
+
+    this->eventLoop = eventLoop;
+    this->address   = address ? Util::strDup( address) : 0;
+    this->port      = port;
+
+    sockfd = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: strip ( void )                            throw ( Exception )
+{
+    close();
+
+    mounts.clear();
+    delete[] address;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Add a mount point
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: addMount (    HttpMount     * mount )     throw ( Exception )
+{
+    if ( mounts.count( mount->getPath()) ) {
+        throw Exception( __FILE__, __LINE__, "mount point used twice",
+                         mount->getPath());
+    }
+
+    mounts[mount->getPath()] = mount;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get a mount point
+ *----------------------------------------------------------------------------*/
+HttpMount *
+HttpServer :: getMount (    const char    * path ) const    throw ()
+{
+    std::map<std::string, Ref<HttpMount> >::const_iterator  it;
+
+    it = mounts.find( path);
+
+    return it == mounts.end() ? 0 : it->second.get();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Create a listening socket
+ *----------------------------------------------------------------------------*/
+int
+HttpServer :: listenOn (    const char    * host )      throw ( Exception )
+{
+    struct addrinfo     hints;
+    struct addrinfo   * result;
+    struct addrinfo   * ai;
+    char                service[8];
+    int                 fd   = -1;
+    int                 one  = 1;
+    int                 zero = 0;
+    int                 ret;
+
+    memset( &hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE | AI_NUMERICSERV;
+    snprintf( service, sizeof(service), "%u", port);
+
+    if ( (ret = getaddrinfo( host, service, &hints, &result)) ) {
+        throw Exception( __FILE__, __LINE__, gai_strerror( ret),
+                         host ? host : "");
+    }
+
+    // without an address, a single IPv6 socket takes IPv4 as well,
+    // thus try IPv6 first
+    for ( int pass = 0; pass < 2 && fd == -1; ++pass ) {
+        for ( ai = result; ai && fd == -1; ai = ai->ai_next ) {
+            if ( (ai->ai_family == AF_INET6) != (pass == 0) ) {
+                continue;
+            }
+
+            fd = socket( ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK
+                                                        | SOCK_CLOEXEC,
+                         ai->ai_protocol);
+            if ( fd == -1 ) {
+                continue;
+            }
+
+            setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if ( ai->ai_family == AF_INET6 && !host ) {
+                setsockopt( fd, IPPROTO_IPV6, IPV6_V6ONLY,
+                            &zero, sizeof(zero));
+            }
+
+            if ( bind( fd, ai->ai_addr, ai->ai_addrlen) == -1
+              || listen( fd, LISTEN_BACKLOG) == -1 ) {
+                ret = errno;
+                ::close( fd);
+                fd    = -1;
+                errno = ret;
+            }
+        }
+    }
+
+    ret = errno;
+    freeaddrinfo( result);
+    errno = ret;
+
+    return fd;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start listening
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: open ( void )                             throw ( Exception )
+{
+    int     fd;
+
+    if ( isOpen() ) {
+        return;
+    }
+
+    if ( (fd = listenOn( address)) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "can't listen on HTTP port",
+                         errno);
+    }
+
+    try {
+        eventLoop->add( fd, this, eventRead);
+    } catch ( Exception   & e ) {
+        ::close( fd);
+        throw;
+    }
+
+    sockfd = fd;
+
+    reportEvent( 2, "HTTP server listening on port", port);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Accept the pending connections
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: handleEvent ( unsigned int    events )    throw ()
+{
+    int     fd;
+
+    while ( (fd = accept4( sockfd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC))
+                                                                    != -1 ) {
+        try {
+            listeners.insert( new HttpListener( this, fd));
+        } catch ( Exception   & e ) {
+            ::close( fd);
+        }
+    }
+
+    if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) {
+        // most likely out of file descriptors, try again later
+        reportEvent( 3, "HTTP server accept error", errno);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Stop listening, and close all connections
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: close ( void )                            throw ()
+{
+    std::set<HttpListener*>     all( listeners);
+
+    if ( isOpen() ) {
+        eventLoop->remove( sockfd);
+        ::close( sockfd);
+        sockfd = 0;
+    }
+
+    // closing removes the listener from the set
+    for ( std::set<HttpListener*>::iterator it = all.begin();
+          it != all.end();
+          ++it ) {
+        (*it)->close();
+    }
+}
+
+
+#endif  /* HAVE_EVENT_LOOP */
+
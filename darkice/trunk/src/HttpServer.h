@@ -0,0 +1,289 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HttpServer.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_EVENT_LOOP
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "Referable.h"
+#include "Ref.h"
+#include "Reporter.h"
+#include "Exception.h"
+#include "EventHandler.h"
+#include "EventLoop.h"
+#include "HttpMount.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+class HttpListener;
+
+/**
+ *  A small HTTP server, serving the encoded streams to listeners
+ *  directly, without a streaming server in between.
+ *
+ *  The streams are made available as mount points, each fed by an
+ *  encoder. Connections are accepted and served from an event loop,
+ *  thus any number of listeners take no extra threads.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class HttpServer : public EventHandler,
+                   public virtual Referable,
+                   public virtual Reporter
+{
+    private:
+
+        /**
+         *  The address to listen on, or 0 for any.
+         */
+        char                                  * address;
+
+        /**
+         *  The port to listen on.
+         */
+        unsigned short                          port;
+
+        /**
+         *  The listening socket, or 0 if closed.
+         */
+        int                                     sockfd;
+
+        /**
+         *  The event loop serving the connections.
+         */
+        Ref<EventLoop>                          eventLoop;
+
+        /**
+         *  The mount points, by path.
+         */
+        std::map<std::string, Ref<HttpMount> >  mounts;
+
+        /**
+         *  The connections.
+         */
+        std::set<HttpListener*>                 listeners;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param eventLoop the event loop to serve the connections from.
+         *  @param address the address to listen on, or 0 for any.
+         *  @param port the port to listen on.
+         *  @exception Exception
+         */
+        void
+        init (  EventLoop         * eventLoop,
+                const char        * address,
+                unsigned short      port )          throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Create a listening socket.
+         *
+         *  @param host the address to listen on, or 0 for any.
+         *  @return the socket, or -1 if it could not be set up.
+         *  @exception Exception
+         */
+        int
+        listenOn (  const char    * host )          throw ( Exception );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        HttpServer ( void )                         throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  connections can not be shared.
+         *
+         *  @param server the object to copy.
+         *  @exception Exception
+         */
+        inline
+        HttpServer ( const HttpServer     & server )    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param eventLoop the event loop to serve the connections from.
+         *  @param address the address to listen on, or 0 for any,
+         *         IPv6 and IPv4 alike where possible.
+         *  @param port the port to listen on.
+         *  @exception Exception
+         */
+        inline
+        HttpServer (    EventLoop         * eventLoop,
+                        const char        * address,
+                        unsigned short      port )  throw ( Exception )
+        {
+            init( eventLoop, address, port);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~HttpServer ( void )                        throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Add a mount point. Only to be called before open().
+         *
+         *  @param mount the mount point.
+         *  @exception Exception if the path is taken already.
+         */
+        void
+        addMount (  HttpMount     * mount )         throw ( Exception );
+
+        /**
+         *  Get a mount point.
+         *
+         *  @param path the path of the mount point.
+         *  @return the mount point, or 0 if there is none at path.
+         */
+        HttpMount *
+        getMount (  const char    * path ) const    throw ();
+
+        /**
+         *  Get the event loop serving the connections.
+         *
+         *  @return the event loop.
+         */
+        inline EventLoop *
+        getEventLoop ( void ) const                 throw ()
+        {
+            return eventLoop.get();
+        }
+
+        /**
+         *  Forget a connection, once closed. Called by the connection.
+         *
+         *  @param listener the connection.
+         */
+        inline void
+        removeListener (    HttpListener  * listener )  throw ()
+        {
+            listeners.erase( listener);
+        }
+
+        /**
+         *  Start listening for connections.
+         *
+         *  @exception Exception
+         */
+        void
+        open ( void )                               throw ( Exception );
+
+        /**
+         *  Tell if the server is listening.
+         *
+         *  @return true if listening, false otherwise.
+         */
+        inline bool
+        isOpen ( void ) const                       throw ()
+        {
+            return sockfd != 0;
+        }
+
+        /**
+         *  Stop listening, and close all connections.
+         *  Only to be called while the event loop does not run.
+         */
+        void
+        close ( void )                              throw ();
+
+        /**
+         *  Accept the pending connections.
+         *
+         *  @param events the events that occured.
+         */
+        virtual void
+        handleEvent (   unsigned int    events )    throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+#endif  /* HAVE_EVENT_LOOP */
+
+#endif  /* HTTP_SERVER_H */
+
@@ -51,7 +51,7 @@
 #error need math.h
 #endif
 
-#include <regex>
+#include <string>
 
 #include "Exception.h"
 #include "Source.h"
@@ -72,15 +72,28 @@ static const char fileid[] = "$Id$";
 
 
 /*------------------------------------------------------------------------------
- *  Expected positive response from server begins like this.
+ *  The size of the buffer to read the response of the server into
  *----------------------------------------------------------------------------*/
-static const std::regex responseOK( "HTTP/1.[0-9] 200" );
-static const std::regex responseWrongPasswd( "HTTP/1.[0-9] 401" );
-static const std::regex responseForbidden( "HTTP/1.[0-9] 403" );
-static const unsigned int responseLen = Util::strLen( "HTTP/1.0 200" );
+#define RESPONSE_BUFFER_SIZE    1024
+
 
 /* ===============================================  local function prototypes */
 
+/*------------------------------------------------------------------------------
+ *  Add a header line to a request
+ *----------------------------------------------------------------------------*/
+static void
+addHeader ( std::string       & request,
+            const char        * lineEnd,
+            const char        * name,
+            const char        * value )
+{
+    request += lineEnd;
+    request += name;
+    request += ": ";
+    request += value;
+}
+
 
 /* =============================================================  module code */
 
@@ -90,12 +103,33 @@ static const unsigned int responseLen = Util::strLen( "HTTP/1.0 200" );
 void
 IceCast2 :: init (  StreamFormat            format,
                     const char            * mountPoint,
-                    const char            * description )
+                    const char            * description,
+                    Protocol                protocol,
+                    bool                    chunked )
                                                         throw ( Exception )
 {
+    if ( chunked && protocol != put ) {
+        throw Exception( __FILE__, __LINE__,
+                         "chunked transfer needs the put protocol");
+    }
+
     this->format         = format;
     this->mountPoint     = Util::strDup( mountPoint);
     this->description    = description    ? Util::strDup( description) : 0;
+    this->protocol       = protocol;
+    this->chunked        = chunked;
+    this->chunkHeadLen   = 0;
+    this->chunkLen       = 0;
+    this->chunkSent      = 0;
+    this->chunkOpen      = false;
+
+    try {
+        buildRequest();
+    } catch ( Exception   & e ) {
+        delete[] this->mountPoint;
+        delete[] this->description;
+        throw;
+    }
 }
 
 
@@ -109,62 +143,41 @@ IceCast2 :: strip ( void )                           throw ( Exception )
     if ( description ) {
         delete[] description;
     }
+    delete[] request;
 }
 
 
 /*------------------------------------------------------------------------------
- *  Log in to the IceCast2 server
+ *  Build the login request
  *----------------------------------------------------------------------------*/
-bool
-IceCast2 :: sendLogin ( void )                           throw ( Exception )
+void
+IceCast2 :: buildRequest ( void )                       throw ( Exception )
 {
-    Sink          * sink   = getSink();
-    Source        * source = getSocket();
-    const char    * str;
-    const int       buflen = 1024;  // some small buffer size
-    char            resp[buflen];   // a little buffer
-    unsigned int    len;
-    std::cmatch     cm;
-
-    if ( !source->isOpen() ) {
-        return false;
-    }
-    if ( !sink->isOpen() ) {
-        return false;
-    }
+    std::string     req;
+    const char    * lineEnd;
+    const char    * contentType;
+    char            num[32];
 
-    // send the request, a string like:
-    // "SOURCE <mountpoint> ICE/1.0"
-    str = "SOURCE /";
-    sink->write( str, strlen( str));
-    str = getMountPoint();
-    sink->write( str, strlen( str));
-    str = " HTTP/1.0";
-    sink->write( str, strlen( str));
-
-    // send the content type, Ogg Vorbis
-    str = "\nContent-type: ";
-    sink->write( str, strlen( str));
     switch ( format ) {
         case mp3:
         case mp2:
-            str = "audio/mpeg";
+            contentType = "audio/mpeg";
             break;
 
         case oggVorbis:
-            str = "application/ogg";
+            contentType = "application/ogg";
             break;
 
         case oggOpus:
-            str = "application/ogg";
+            contentType = "application/ogg";
             break;
 
         case aac:
-            str = "audio/aac";
+            contentType = "audio/aac";
             break;
 
         case aacp:
-            str = "audio/aacp";
+            contentType = "audio/aacp";
             break;
 
         default:
@@ -172,13 +185,31 @@ IceCast2 :: sendLogin ( void )                           throw ( Exception )
                              "unsupported stream format", format);
             break;
     }
-    sink->write( str, strlen( str));
 
-    // send the authentication info
-    str = "\nAuthorization: Basic ";
-    sink->write( str, strlen(str));
+    // the request line, a string like:
+    // "SOURCE /<mountpoint> HTTP/1.0" or "PUT /<mountpoint> HTTP/1.1"
+    if ( protocol == put ) {
+        // the headers of a real HTTP request
+        lineEnd = "\r\n";
+        req     = "PUT /";
+        req    += getMountPoint();
+        req    += " HTTP/1.1";
+        req    += lineEnd;
+        req    += "Host: ";
+        req    += Util::hostPort( getSocket()->getHost(),
+                                  getSocket()->getPort());
+    } else {
+        // the legacy dialect, as the servers out there know it
+        lineEnd = "\n";
+        req     = "SOURCE /";
+        req    += getMountPoint();
+        req    += " HTTP/1.0";
+    }
+
+    addHeader( req, lineEnd, "Content-type", contentType);
+
     {
-        // send source:<password> encoded as base64
+        // source:<password> encoded as base64
         const char  * source = "source:";
         const char  * pwd    = getPassword();
         char        * tmp    = new char[Util::strLen(source) +
@@ -187,88 +218,203 @@ IceCast2 :: sendLogin ( void )                           throw ( Exception )
         Util::strCat( tmp, pwd);
         char  * base64 = Util::base64Encode( tmp);
         delete[] tmp;
-        sink->write( base64, strlen(base64));
+        req += lineEnd;
+        req += "Authorization: Basic ";
+        req += base64;
         delete[] base64;
     }
 
-    // send user agent info
-    str = "\nUser-Agent: DarkIce/" VERSION " (http://code.google.com/p/darkice/)";
-    sink->write( str, strlen( str));
-
-    // send the ice- headers
-    str = "\nice-bitrate: ";
-    sink->write( str, strlen( str));
-    
-    sprintf( resp, "%d", getBitRate());
-    sink->write( resp, strlen( resp));
-
-    str = "\nice-public: ";
-    sink->write( str, strlen( str));
-    str = getIsPublic() ? "1" : "0";
-    sink->write( str, strlen( str));
+    addHeader( req, lineEnd, "User-Agent",
+               "DarkIce/" VERSION " (http://code.google.com/p/darkice/)");
 
+    // the ice- headers
+    sprintf( num, "%d", getBitRate());
+    addHeader( req, lineEnd, "ice-bitrate", num);
+    addHeader( req, lineEnd, "ice-public", getIsPublic() ? "1" : "0");
     if ( getName() ) {
-        str = "\nice-name: ";
-        sink->write( str, strlen( str));
-        str = getName();
-        sink->write( str, strlen( str));
+        addHeader( req, lineEnd, "ice-name", getName());
     }
-
     if ( getDescription() ) {
-        str = "\nice-description: ";
-        sink->write( str, strlen( str));
-        str = getDescription();
-        sink->write( str, strlen( str));
+        addHeader( req, lineEnd, "ice-description", getDescription());
     }
-
     if ( getUrl() ) {
-        str = "\nice-url: ";
-        sink->write( str, strlen( str));
-        str = getUrl();
-        sink->write( str, strlen( str));
+        addHeader( req, lineEnd, "ice-url", getUrl());
     }
-
     if ( getGenre() ) {
-        str = "\nice-genre: ";
-        sink->write( str, strlen( str));
-        str = getGenre();
-        sink->write( str, strlen( str));
+        addHeader( req, lineEnd, "ice-genre", getGenre());
     }
 
-    str = "\r\n\r\n";
-    sink->write( str, strlen( str));
-    sink->flush();
+    if ( protocol == put ) {
+        if ( chunked ) {
+            addHeader( req, lineEnd, "Transfer-Encoding", "chunked");
+        }
+        // have the server check the login before any data is sent
+        addHeader( req, lineEnd, "Expect", "100-continue");
+    }
+
+    req += "\r\n\r\n";
+
+    request    = Util::strDup( req.c_str());
+    requestLen = req.length();
+}
 
-    // read the response, expected response begins with responseOK
-    if ( (len = source->read( resp, buflen )) < responseLen ) {
-        return false; // short read, no need to continue
+
+/*------------------------------------------------------------------------------
+ *  Log in to the IceCast2 server
+ *----------------------------------------------------------------------------*/
+bool
+IceCast2 :: sendLogin ( void )                           throw ( Exception )
+{
+    Sink          * sink   = getSink();
+    Source        * source = getSocket();
+    char            resp[RESPONSE_BUFFER_SIZE];
+    unsigned int    len;
+    unsigned int    ret;
+    unsigned int    status;
+
+    if ( !source->isOpen() ) {
+        return false;
+    }
+    if ( !sink->isOpen() ) {
+        return false;
     }
-    resp[responseLen] = '\x00'; // end string, truncate to expected length
 
-    reportEvent(5,resp);
+    // send the request built up front, in one go
+    for ( len = 0; len < requestLen; len += ret ) {
+        if ( !(ret = sink->write( request + len, requestLen - len)) ) {
+            return false;
+        }
+    }
+    sink->flush();
 
-    if ( std::regex_match( resp, cm, responseWrongPasswd) ) {
-	throw Exception( __FILE__, __LINE__,
-                         "Icecast2 - wrong password");
+    // read the response, until the status line is complete
+    len = 0;
+    while ( len < sizeof(resp) - 1 ) {
+        if ( !(ret = source->read( resp + len, sizeof(resp) - 1 - len)) ) {
+            break;
+        }
+        len += ret;
+        if ( memchr( resp, '\n', len) ) {
+            break;
+        }
     }
+    resp[len] = '\x00';
 
-    if ( std::regex_match( resp, cm, responseForbidden) ) {
-	throw Exception( __FILE__, __LINE__,
-                         "Icecast2 - forbidden. Is the mountpoint occupied, or maximum sources reached?");
+    if ( !(status = Util::parseHttpStatus( resp, len)) ) {
+        return false; // short read, or no HTTP response at all
     }
 
-    if ( !std::regex_match( resp, cm, responseOK) ) {
-        // some unexpected response from server
-        throw Exception( __FILE__, __LINE__,
-                         "Icecast2 - Unexpected response from server");
+    reportEvent( 5, "Icecast2 response status", status);
+
+    switch ( status ) {
+        case 100:   // continue, as asked for with put
+        case 200:
+            break;
+
+        case 401:
+            throw Exception( __FILE__, __LINE__,
+                             "Icecast2 - wrong password");
+
+        case 403:
+            throw Exception( __FILE__, __LINE__,
+                             "Icecast2 - forbidden. Is the mountpoint "
+                             "occupied, or maximum sources reached?");
+
+        default:
+            // some unexpected response from server
+            throw Exception( __FILE__, __LINE__,
+                             "Icecast2 - Unexpected response from server",
+                             status);
     }
-    
+
     // suck anything that the other side has to say
-    while ( source->canRead( 0, 0) && 
-           (len = source->read( resp, buflen )));
-    
+    while ( source->canRead( 0, 0) &&
+           (len = source->read( resp, sizeof(resp) )));
+
+    // the stream data starts with a new chunk
+    chunkHeadLen = 0;
+    chunkLen     = 0;
+    chunkSent    = 0;
+    chunkOpen    = false;
+
     // all is well, we are connected
     return true;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Send stream data to the server
+ *----------------------------------------------------------------------------*/
+unsigned int
+IceCast2 :: sendData (  const struct iovec    * vec,
+                        unsigned int            count ) throw ( Exception )
+{
+    struct iovec    out[maxVec + 1];
+    unsigned int    n = 0;
+    unsigned int    len;
+    unsigned int    headLeft;
+    unsigned int    payload;
+    unsigned int    ret;
+
+    if ( !chunked ) {
+        return CastSink::sendData( vec, count);
+    }
+
+    count = count < maxVec ? count : maxVec;
+    if ( !(len = Util::vecLen( vec, count)) ) {
+        return 0;
+    }
+
+    if ( chunkSent == chunkHeadLen + chunkLen ) {
+        // the previous chunk is sent, start a new one with all the data,
+        // ending the previous one with the header of this one
+        chunkHeadLen = sprintf( chunkHead, "%s%x\r\n",
+                                chunkOpen ? "\r\n" : "", len);
+        chunkLen     = len;
+        chunkSent    = 0;
+        chunkOpen    = true;
+    }
+
+    // the rest of the chunk header, if any
+    headLeft = chunkSent < chunkHeadLen ? chunkHeadLen - chunkSent : 0;
+    if ( headLeft ) {
+        out[n].iov_base = chunkHead + chunkSent;
+        out[n].iov_len  = headLeft;
+        ++n;
+    }
+
+    // as much of the data as is left of the chunk, the data passed
+    // continues what was sent of the chunk so far
+    payload = chunkLen - (chunkSent + headLeft - chunkHeadLen);
+    payload = len < payload ? len : payload;
+    for ( len = 0; len < payload; ++vec ) {
+        out[n]         = *vec;
+        out[n].iov_len = vec->iov_len < payload - len ? vec->iov_len
+                                                      : payload - len;
+        len           += out[n].iov_len;
+        ++n;
+    }
+
+    ret        = getSink()->writeVec( out, n);
+    chunkSent += ret;
+
+    return ret > headLeft ? ret - headLeft : 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the connection
+ *----------------------------------------------------------------------------*/
+void
+IceCast2 :: close ( void )                              throw ( Exception )
+{
+    if ( chunked && isOpen() && chunkSent == chunkHeadLen + chunkLen ) {
+        // send the last chunk, if not in the middle of one
+        const char    * str = chunkOpen ? "\r\n0\r\n\r\n" : "0\r\n\r\n";
+
+        getSink()->write( str, strlen( str));
+    }
+
+    CastSink::close();
+}
+
@@ -65,9 +65,21 @@ class IceCast2 : public CastSink
          */
        enum StreamFormat { mp3, mp2, oggVorbis, oggOpus, aac, aacp };
 
+        /**
+         *  Type for specifying the protocol to log in with.
+         *  - source - the legacy "SOURCE /mount HTTP/1.0" request
+         *  - put - an HTTP/1.1 PUT request, as of IceCast 2.4
+         */
+        enum Protocol { source, put };
+
 
     private:
 
+        /**
+         *  The maximum number of buffers sent by sendData() at once.
+         */
+        static const unsigned int   maxVec = 8;
+
         /**
          *  The format of the stream.
          */
@@ -83,20 +95,82 @@ class IceCast2 : public CastSink
          */
         char              * description;
 
+        /**
+         *  The protocol to log in with.
+         */
+        Protocol            protocol;
+
+        /**
+         *  Send the stream data with chunked transfer encoding.
+         *  Only with the put protocol.
+         */
+        bool                chunked;
+
+        /**
+         *  The login request, built once, sent on each connect.
+         */
+        char              * request;
+
+        /**
+         *  The length of the login request.
+         */
+        unsigned int        requestLen;
+
+        /**
+         *  The header of the current chunk, including the line end
+         *  of the previous chunk, when sending chunked.
+         */
+        char                chunkHead[16];
+
+        /**
+         *  The length of chunkHead.
+         */
+        unsigned int        chunkHeadLen;
+
+        /**
+         *  The length of the stream data in the current chunk.
+         */
+        unsigned int        chunkLen;
+
+        /**
+         *  The number of bytes of the current chunk sent so far,
+         *  its header included.
+         */
+        unsigned int        chunkSent;
+
+        /**
+         *  True if a chunk has been sent since logging in, which is
+         *  still to be ended by a line end.
+         */
+        bool                chunkOpen;
+
         /**
          *  Initalize the object.
          *
          *  @param mountPoint mount point of the stream on the server.
          *  @param remoteDumpFile remote dump file (may be NULL).
          *  @param description description of the stream.
+         *  @param protocol the protocol to log in with.
+         *  @param chunked send the stream data with chunked transfer
+         *         encoding. Only with the put protocol.
          *  @exception Exception
          */
         void
         init (  StreamFormat            format,
                 const char            * mountPoint,
-                const char            * description )
+                const char            * description,
+                Protocol                protocol,
+                bool                    chunked )
                                                     throw ( Exception );
 
+        /**
+         *  Build the login request.
+         *
+         *  @exception Exception
+         */
+        void
+        buildRequest ( void )                       throw ( Exception );
+
         /**
          *  De-initalize the object.
          *
@@ -128,6 +202,19 @@ class IceCast2 : public CastSink
         virtual bool
         sendLogin ( void )              throw ( Exception );
 
+        /**
+         *  Send stream data to the server, in chunks if sending chunked.
+         *
+         *  @param vec the buffers to send, in order.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes of stream data sent (may be less
+         *          than the total length of the buffers).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        sendData (  const struct iovec    * vec,
+                    unsigned int            count )     throw ( Exception );
+
 
     public:
 
@@ -146,8 +233,9 @@ class IceCast2 : public CastSink
          *  @param isPublic is the stream public?
          *  @param streamDump an optional sink to dump the binary stream
          *                    data to.
-         *  @param bufferDuration duration of the BufferedSink buffer
-         *                        in seconds.
+         *  @param protocol the protocol to log in with.
+         *  @param chunked send the stream data with chunked transfer
+         *         encoding. Only with the put protocol.
          *  @exception Exception
          */
         inline
@@ -161,7 +249,9 @@ class IceCast2 : public CastSink
                     const char        * url            = 0,
                     const char        * genre          = 0,
                     bool                isPublic       = false,
-                    Sink              * streamDump     = 0 )
+                    Sink              * streamDump     = 0,
+                    Protocol            protocol       = source,
+                    bool                chunked        = false )
                                                         throw ( Exception )
               : CastSink( socket,
                           password,
@@ -172,7 +262,7 @@ class IceCast2 : public CastSink
                           isPublic,
                           streamDump )
         {
-            init( format, mountPoint, description);
+            init( format, mountPoint, description, protocol, chunked);
         }
 
         /**
@@ -186,7 +276,9 @@ class IceCast2 : public CastSink
         {
             init( cs.getFormat(),
                   cs.getMountPoint(),
-                  cs.getDescription() );
+                  cs.getDescription(),
+                  cs.getProtocol(),
+                  cs.isChunked() );
         }
 
         /**
@@ -215,7 +307,9 @@ class IceCast2 : public CastSink
                 CastSink::operator=( cs );
                 init( cs.getFormat(),
                       cs.getMountPoint(),
-                      cs.getDescription() );
+                      cs.getDescription(),
+                      cs.getProtocol(),
+                      cs.isChunked() );
             }
             return *this;
         }
@@ -253,6 +347,37 @@ class IceCast2 : public CastSink
             return description;
         }
 
+        /**
+         *  Get the protocol to log in with.
+         *
+         *  @return the protocol to log in with.
+         */
+        inline Protocol
+        getProtocol ( void ) const                  throw ()
+        {
+            return protocol;
+        }
+
+        /**
+         *  Tell if the stream data is sent with chunked transfer encoding.
+         *
+         *  @return true if the stream data is sent chunked.
+         */
+        inline bool
+        isChunked ( void ) const                    throw ()
+        {
+            return chunked;
+        }
+
+        /**
+         *  Close the connection. When sending chunked, the last chunk
+         *  is sent first, to end the stream cleanly.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                              throw ( Exception );
+
 };
 
 
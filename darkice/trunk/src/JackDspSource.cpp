@@ -86,6 +86,32 @@
 #include <stdio.h>
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#else
+#error need poll.h
+#endif
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <climits>
 
 #include "Util.h"
@@ -106,9 +132,126 @@ static const char fileid[] = "$Id$";
 
 /* ===============================================  local function prototypes */
 
+/*------------------------------------------------------------------------------
+ *  Convert a float sample to 16 bits, rounding to the nearest and saturating
+ *----------------------------------------------------------------------------*/
+static inline short
+floatToShort ( jack_default_audio_sample_t  sample );
+
+/*------------------------------------------------------------------------------
+ *  Convert a channel of float samples to 16 bits
+ *----------------------------------------------------------------------------*/
+static void
+convertMono ( const jack_default_audio_sample_t   * in,
+              short                               * out,
+              unsigned int                          n );
+
+/*------------------------------------------------------------------------------
+ *  Convert two channels of float samples to interleaved 16 bits
+ *----------------------------------------------------------------------------*/
+static void
+convertStereo ( const jack_default_audio_sample_t     * left,
+                const jack_default_audio_sample_t     * right,
+                short                                 * out,
+                unsigned int                            n );
+
 
 /* =============================================================  module code */
 
+/*------------------------------------------------------------------------------
+ *  Convert a float sample to 16 bits
+ *  clamp before rounding, as lrintf() is undefined out of the range of long,
+ *  and turn NaN into silence, the same way as convert4()
+ *----------------------------------------------------------------------------*/
+static inline short
+floatToShort ( jack_default_audio_sample_t  sample )
+{
+    float   v = sample * 32768.0f;
+
+    if ( v != v ) {
+        return 0;
+    }
+    v = v > 32767.0f ? 32767.0f : v < -32768.0f ? -32768.0f : v;
+
+    return (short) lrintf(v);
+}
+
+
+#ifdef __SSE2__
+/*------------------------------------------------------------------------------
+ *  Convert 4 float samples to 32 bit integers, rounding like lrintf()
+ *  the clamping keeps the conversion in range, packing saturates to 16 bits
+ *  NaN is masked to 0 first, as minps / maxps would pass it on or clamp it
+ *  depending on the operand order
+ *----------------------------------------------------------------------------*/
+static inline __m128i
+convert4 ( const jack_default_audio_sample_t  * in )
+{
+    __m128  v = _mm_mul_ps(_mm_loadu_ps(in), _mm_set1_ps(32768.0f));
+
+    v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+    v = _mm_min_ps(v, _mm_set1_ps(32767.0f));
+    v = _mm_max_ps(v, _mm_set1_ps(-32768.0f));
+
+    return _mm_cvtps_epi32(v);
+}
+#endif
+
+
+/*------------------------------------------------------------------------------
+ *  Convert a channel of float samples to 16 bits
+ *----------------------------------------------------------------------------*/
+static void
+convertMono ( const jack_default_audio_sample_t   * in,
+              short                               * out,
+              unsigned int                          n )
+{
+    unsigned int    i = 0;
+
+#ifdef __SSE2__
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((__m128i *) (out + i),
+                         _mm_packs_epi32(convert4(in + i),
+                                         convert4(in + i + 4)));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        out[i] = floatToShort(in[i]);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert two channels of float samples to interleaved 16 bits
+ *----------------------------------------------------------------------------*/
+static void
+convertStereo ( const jack_default_audio_sample_t     * left,
+                const jack_default_audio_sample_t     * right,
+                short                                 * out,
+                unsigned int                            n )
+{
+    unsigned int    i = 0;
+
+#ifdef __SSE2__
+    for (; i + 8 <= n; i += 8) {
+        __m128i l = _mm_packs_epi32(convert4(left + i), convert4(left + i + 4));
+        __m128i r = _mm_packs_epi32(convert4(right + i),
+                                    convert4(right + i + 4));
+
+        _mm_storeu_si128((__m128i *) (out + 2 * i), _mm_unpacklo_epi16(l, r));
+        _mm_storeu_si128((__m128i *) (out + 2 * i + 8),
+                         _mm_unpackhi_epi16(l, r));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        out[2 * i]     = floatToShort(left[i]);
+        out[2 * i + 1] = floatToShort(right[i]);
+    }
+}
+
+
 /*------------------------------------------------------------------------------
  *  Initialize the object
  *----------------------------------------------------------------------------*/
@@ -122,7 +265,9 @@ JackDspSource :: init ( const char* name )           throw ( Exception )
     rb[1]        = NULL;        // Right Ring Buffer
     client       = NULL;
     auto_connect = false;       // Default is to not auto connect the JACK ports
-    tmp_buffer   = NULL;        // Buffer big enough for one 'read' of audio
+    wakeFd[0]    = -1;          // Reader side of the wake up
+    wakeFd[1]    = -1;          // Process callback side of the wake up
+    wantBytes    = 0;
 
     // Auto connect the ports ?
     if ( Util::strEq( name, "jack_auto", 9) ) {
@@ -147,13 +292,6 @@ JackDspSource :: strip ( void )                      throw ( Exception )
     if ( isOpen() ) {
         close();
     }
-    
-    // Free the temporary buffer
-    if (tmp_buffer) {
-        free(tmp_buffer);
-        tmp_buffer = NULL;
-    }
-
 }
 
 /*------------------------------------------------------------------------------
@@ -279,6 +417,24 @@ JackDspSource :: open ( void )                       throw ( Exception )
     }
 
 
+    // Create the descriptors to wake up the reader through
+#ifdef HAVE_SYS_EVENTFD_H
+    if ((wakeFd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        throw Exception( __FILE__, __LINE__, "eventfd error", errno);
+    }
+    wakeFd[1] = wakeFd[0];
+#else
+    if (pipe(wakeFd) == -1) {
+        throw Exception( __FILE__, __LINE__, "pipe error", errno);
+    }
+    fcntl(wakeFd[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakeFd[1], F_SETFL, O_NONBLOCK);
+#endif
+    // wake up on the first audio, until the size of a read is known
+    __atomic_store_n(&wantBytes,
+                     sizeof(jack_default_audio_sample_t),
+                     __ATOMIC_SEQ_CST);
+
     // Set the callbacks
     jack_on_shutdown(client, JackDspSource::shutdown_callback, (void*)this);
     if (jack_set_process_callback(client,
@@ -301,42 +457,81 @@ JackDspSource :: open ( void )                       throw ( Exception )
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Get the number of bytes readable from every channel
+ *----------------------------------------------------------------------------*/
+size_t
+JackDspSource :: readSpace ( void ) const            throw ()
+{
+    size_t       space = jack_ringbuffer_read_space(rb[0]);
+    unsigned int c;
+
+    for (c = 1; c < getChannel(); c++) {
+        size_t readable = jack_ringbuffer_read_space(rb[c]);
+        if (readable < space) {
+            space = readable;
+        }
+    }
+
+    return space;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wake up the reader
+ *----------------------------------------------------------------------------*/
+void
+JackDspSource :: wake ( void )                       throw ()
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t    one = 1;
+#else
+    char        one = 1;
+#endif
+
+    // a full pipe or counter means the reader is woken up already
+    if (write(wakeFd[1], &one, sizeof(one)) == -1) {
+        return;
+    }
+}
+
+
 /*------------------------------------------------------------------------------
  *  Check whether read() would return anything
+ *  Waits for a block of the size of the last read to arrive
  *----------------------------------------------------------------------------*/
 bool
 JackDspSource :: canRead ( unsigned int   sec,
                            unsigned int   usec )    throw ( Exception )
 {
-    const unsigned int max_wait_time  = sec * 1000000;
-    const unsigned int wait_increment = 10000;
-    unsigned int       cur_wait       = 0;
+    unsigned long long  deadline;
+    unsigned long long  now;
+    struct pollfd       pfd;
+    char                drain[64];
+    int                 ret;
 
     if ( !isOpen() ) {
         return false;
     }
 
-    while (max_wait_time > cur_wait) {
-        bool canRead = true;
+    deadline   = Util::getMonotonicTime() + sec * 1000000ULL + usec;
+    pfd.fd     = wakeFd[0];
+    pfd.events = POLLIN;
 
-        for (unsigned int c = 0 ; c < getChannel() ; c++) {
-            if (jack_ringbuffer_read_space(rb[c]) <= 0) {
-                canRead = false;
-            }
+    while (readSpace() < __atomic_load_n(&wantBytes, __ATOMIC_SEQ_CST)) {
+        now = Util::getMonotonicTime();
+        if (now >= deadline) {
+            // no full block in time, but take what is there
+            return readSpace() > 0;
         }
 
-        if (canRead) {
-            return true;
+        ret = poll(&pfd, 1, (deadline - now + 999) / 1000);
+        if (ret == -1 && errno != EINTR) {
+            throw Exception( __FILE__, __LINE__, "poll error", errno);
         }
-
-        cur_wait += wait_increment;
-        usleep ( wait_increment );
-    }
-
-    usleep( usec );
-    for (unsigned int c = 0 ; c < getChannel() ; c++) {
-        if (jack_ringbuffer_read_space(rb[c]) <= 0) {
-            return false;
+        if (ret > 0) {
+            while (::read(wakeFd[0], drain, sizeof(drain)) > 0) {
+            }
         }
     }
 
@@ -346,69 +541,84 @@ JackDspSource :: canRead ( unsigned int   sec,
 
 /*------------------------------------------------------------------------------
  *  Read from the audio source
+ *  The samples are converted right from the ring buffers, without copying
  *----------------------------------------------------------------------------*/
 unsigned int
 JackDspSource :: read (   void          * buf,
                           unsigned int    len )     throw ( Exception )
 {
-    jack_nframes_t samples         = len / 2 / getChannel();
-    jack_nframes_t samples_read[2] = { 0, 0 };
-    short        * output          = (short*) buf;
-    unsigned int c, n;
+    jack_nframes_t          samples = len / 2 / getChannel();
+    short                 * output  = (short*) buf;
+    jack_ringbuffer_data_t  vec[2][2];
+    size_t                  bytes;
+    unsigned int            frames;
+    unsigned int            done;
+    unsigned int            n;
+    unsigned int            c;
 
     if ( !isOpen() ) {
         return 0;
     }
 
-
-    // Ensure the temporary buffer is big enough
-    tmp_buffer = (jack_default_audio_sample_t*)realloc(tmp_buffer,
-                             samples * sizeof( jack_default_audio_sample_t ) );
-    if (!tmp_buffer) {
-        throw Exception( __FILE__, __LINE__, "realloc on tmp_buffer failed");
-    }
+    // wait for blocks of this size from now on
+    __atomic_store_n(&wantBytes,
+                     samples * sizeof( jack_default_audio_sample_t ),
+                     __ATOMIC_SEQ_CST);
 
     // We must be sure to fetch as many data on both channels
-    int minBytesAvailable = samples * sizeof( jack_default_audio_sample_t );
+    bytes = readSpace();
+    if (bytes > samples * sizeof( jack_default_audio_sample_t )) {
+        bytes = samples * sizeof( jack_default_audio_sample_t );
+    }
+    frames = bytes / sizeof( jack_default_audio_sample_t );
 
-    for (c=0; c < getChannel(); c++) {
-        int readable = jack_ringbuffer_read_space(rb[c]);
-        if (readable < minBytesAvailable) {
-            minBytesAvailable = readable;
-        }
+    // the readable part of each ring buffer, in two pieces if it wraps
+    for (c = 0; c < getChannel(); c++) {
+        jack_ringbuffer_get_read_vector(rb[c], vec[c]);
     }
 
-    for (c=0; c < getChannel(); c++) {    
-        // Copy frames from ring buffer to temporary buffer
-        // and then convert samples to output buffer
-        int bytes_read = jack_ringbuffer_read(rb[c],
-                                             (char*)tmp_buffer,
-                              minBytesAvailable);
-        samples_read[c] = bytes_read / sizeof( jack_default_audio_sample_t );
-        
+    for (done = 0; done < frames; done += n) {
+        const jack_default_audio_sample_t * in[2];
+
+        // convert as far as all channels are contiguous
+        n = frames - done;
+        for (c = 0; c < getChannel(); c++) {
+            size_t  offset = done * sizeof( jack_default_audio_sample_t );
+            size_t  avail;
 
-        // Convert samples from float to short and put in output buffer
-        for(n=0; n<samples_read[c]; n++) {
-            int tmp = lrintf(tmp_buffer[n] * 32768.0f);
-            if (tmp > SHRT_MAX) {
-                output[n*getChannel()+c] = SHRT_MAX;
-            } else if (tmp < SHRT_MIN) {
-                output[n*getChannel()+c] = SHRT_MIN;
+            if (offset < vec[c][0].len) {
+                in[c] = (const jack_default_audio_sample_t *)
+                                                    (vec[c][0].buf + offset);
+                avail = vec[c][0].len - offset;
             } else {
-                output[n*getChannel()+c] = (short) tmp;
+                offset -= vec[c][0].len;
+                in[c] = (const jack_default_audio_sample_t *)
+                                                    (vec[c][1].buf + offset);
+                avail = vec[c][1].len - offset;
             }
+            if (avail / sizeof( jack_default_audio_sample_t ) < n) {
+                n = avail / sizeof( jack_default_audio_sample_t );
+            }
+        }
+        if (n == 0) {
+            frames = done;
+            break;
+        }
+
+        if (getChannel() == 2) {
+            convertStereo(in[0], in[1], output + 2 * done, n);
+        } else {
+            convertMono(in[0], output + done, n);
         }
     }
 
-    // Didn't get as many samples as we wanted ?
-    if (getChannel() == 2 && samples_read[0] != samples_read[1]) {
-        Reporter::reportEvent( 2,
-                              "Warning: Read a different number of samples "
-                              "for left and right channels");
+    for (c = 0; c < getChannel(); c++) {
+        jack_ringbuffer_read_advance(rb[c],
+                              frames * sizeof( jack_default_audio_sample_t ));
     }
 
     // Return the number of bytes put in the output buffer
-    return samples_read[0] * 2 * getChannel();
+    return frames * 2 * getChannel();
 }
 
 
@@ -424,6 +634,9 @@ JackDspSource :: close ( void )                  throw ( Exception )
         return;
     }
 
+    // stop the process callback before taking its buffers away
+    jack_deactivate( client );
+
     for(i = 0; i < getChannel(); i++) {
         // Close the port for channel
         if ( ports[i] ) {
@@ -444,6 +657,15 @@ JackDspSource :: close ( void )                  throw ( Exception )
         client = NULL;
     }
 
+    if (wakeFd[0] != -1) {
+        ::close(wakeFd[0]);
+        if (wakeFd[1] != wakeFd[0]) {
+            ::close(wakeFd[1]);
+        }
+        wakeFd[0] = -1;
+        wakeFd[1] = -1;
+    }
+
 }
 
 
@@ -458,12 +680,17 @@ JackDspSource :: process_callback( jack_nframes_t nframes, void *arg )
 {
     JackDspSource* self     = (JackDspSource*)arg;
     size_t         to_write = sizeof (jack_default_audio_sample_t) * nframes;
+    size_t         want;
+    size_t         before;
     unsigned int   c;
     
     // Wait until it is ready
     if (self->client == NULL) {
         return 0;
     }
+
+    want   = __atomic_load_n(&self->wantBytes, __ATOMIC_SEQ_CST);
+    before = self->readSpace();
     
     /* copy data to ringbuffer; one per channel */
     for (c=0; c < self->getChannel(); c++) {
@@ -486,6 +713,12 @@ JackDspSource :: process_callback( jack_nframes_t nframes, void *arg )
         }
     }
 
+    // wake up the reader only when a block has just become readable,
+    // not on every period
+    if (before < want && self->readSpace() >= want) {
+        self->wake();
+    }
+
     // Success
     return 0;
 }
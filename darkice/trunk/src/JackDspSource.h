@@ -61,6 +61,10 @@
 /**
  *  An audio input based on JACK
  *
+ *  The JACK process callback copies the audio into a ring buffer per
+ *  channel, and wakes up the reader through an eventfd (a pipe where
+ *  there is none) once a block of audio is there to be read.
+ *
  *  @author  $Author$
  *  @version $Revision$
  */
@@ -87,16 +91,39 @@ class JackDspSource : public AudioSource, public virtual Reporter
          */
         jack_client_t                * client;
 
-        /**
-         *  The jack audio sample buffer.
-         */
-        jack_default_audio_sample_t * tmp_buffer;
-        
          /**
          *  Automatically connect the jack ports ? (default is to not)
          */
         bool                auto_connect;
 
+        /**
+         *  The descriptors the process callback wakes up the reader
+         *  through, the read and the write end. They are the same
+         *  eventfd where supported.
+         */
+        int                 wakeFd[2];
+
+        /**
+         *  The number of bytes of a channel the reader waits for.
+         *  Read by the process callback, thus accessed atomically.
+         */
+        size_t              wantBytes;
+
+        /**
+         *  Get the number of bytes readable from every channel.
+         *
+         *  @return the number of bytes in the emptiest ring buffer.
+         */
+        size_t
+        readSpace ( void ) const                    throw ();
+
+        /**
+         *  Wake up the reader. Called from the process callback,
+         *  thus doesn't block.
+         */
+        void
+        wake ( void )                               throw ();
+
     protected:
 
         /**
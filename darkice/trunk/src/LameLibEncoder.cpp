@@ -265,6 +265,16 @@ LameLibEncoder :: open ( void )
 	if (getReportVerbosity() >= 3) {
  	   lame_print_config( lameGlobalFlags);
 	}
+
+    unsigned int    frameLen     = 0;
+    unsigned int    frameSamples = 0;
+    unsigned char * frame        = Util::mpegSilentFrame( 3,
+                                                          getOutSampleRate(),
+                                                          getOutChannel(),
+                                                          0,
+                                                          &frameLen,
+                                                          &frameSamples);
+    setSilentFrame( frame, frameLen, frameSamples);
 	
     return true;
 }
@@ -281,6 +291,9 @@ LameLibEncoder :: write (   const void    * buf,
         return 0;
     }
 
+    // the encoder was flushed as silence started, simply go on
+    endSilence();
+
     unsigned int    bitsPerSample = getInBitsPerSample();
     unsigned int    inChannels    = getInChannel();
 
@@ -332,6 +345,7 @@ LameLibEncoder :: write (   const void    * buf,
     }
 
     unsigned int    written = getSink()->write( mp3Buf, ret);
+    getSink()->markFrameEnd();
     delete[] mp3Buf;
     // just let go data that could not be written
     if ( written < (unsigned int) ret ) {
@@ -344,6 +358,35 @@ LameLibEncoder :: write (   const void    * buf,
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Write silence as pre-encoded silent frames
+ *----------------------------------------------------------------------------*/
+bool
+LameLibEncoder :: writeSilence (    unsigned int    samples )
+                                                            throw ( Exception )
+{
+    if ( !isOpen() || !hasSilentFrame() ) {
+        return false;
+    }
+
+    if ( !isSilent() ) {
+        // end the audio encoded so far, but keep the encoder going
+        unsigned int    mp3Size = 7200;
+        unsigned char * mp3Buf  = new unsigned char[mp3Size];
+        int             ret;
+
+        ret = lame_encode_flush_nogap( lameGlobalFlags, mp3Buf, mp3Size);
+        if ( ret > 0 ) {
+            getSink()->write( mp3Buf, ret);
+            getSink()->markFrameEnd();
+        }
+        delete[] mp3Buf;
+    }
+
+    return writeSilentFrames( samples);
+}
+
+
 /*------------------------------------------------------------------------------
  *  Flush the data from the encoder
  *----------------------------------------------------------------------------*/
@@ -363,6 +406,7 @@ LameLibEncoder :: flush ( void )
     ret = lame_encode_flush( lameGlobalFlags, mp3Buf, mp3Size );
 
     unsigned int    written = getSink()->write( mp3Buf, ret);
+    getSink()->markFrameEnd();
     delete[] mp3Buf;
 
     // just let go data that could not be written
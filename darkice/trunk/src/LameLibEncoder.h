@@ -409,6 +409,18 @@ class LameLibEncoder : public AudioEncoder, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        throw ( Exception );
 
+        /**
+         *  Write silence as pre-encoded silent mp3 frames. The audio
+         *  encoded so far is flushed first, thus the silent frames do
+         *  not depend on the bit reservoir of earlier frames.
+         *
+         *  @param samples the number of input samples of silence.
+         *  @return true if the silence was written, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        writeSilence (  unsigned int    samples )   throw ( Exception );
+
         /**
          *  Flush all data that was written to the encoder to the underlying
          *  connection.
@@ -0,0 +1,373 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : ListenerMonitor.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#else
+#error need stdlib.h
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#else
+#error need signal.h
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#else
+#error need time.h
+#endif
+
+#include <string>
+
+#include "Util.h"
+#include "ListenerMonitor.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The size of the buffer to read the listeners into
+ *----------------------------------------------------------------------------*/
+#define BUFFER_SIZE         16384
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+ListenerMonitor :: init ( void )                        throw ( Exception )
+{
+    pthread_condattr_t      attr;
+
+    running = false;
+
+    pthread_mutex_init( &mutex, 0);
+    // waited for with a timeout on the monotonic clock
+    pthread_condattr_init( &attr);
+    pthread_condattr_setclock( &attr, CLOCK_MONOTONIC);
+    pthread_cond_init( &cond, &attr);
+    pthread_condattr_destroy( &attr);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+ListenerMonitor :: strip ( void )                       throw ( Exception )
+{
+    stop();
+
+    outputs.clear();
+    pthread_cond_destroy( &cond);
+    pthread_mutex_destroy( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Add an output
+ *----------------------------------------------------------------------------*/
+void
+ListenerMonitor :: addOutput (  OnDemandSink      * sink,
+                                IceCast2          * server,
+                                TcpSocket         * admin,
+                                unsigned int        grace )
+                                                        throw ( Exception )
+{
+    Output      output;
+
+    if ( running ) {
+        throw Exception( __FILE__, __LINE__,
+                         "can't add output to a running listener monitor");
+    }
+    if ( !sink || !server || !admin ) {
+        throw Exception( __FILE__, __LINE__, "missing output to monitor");
+    }
+
+    output.sink      = sink;
+    output.server    = server;
+    output.admin     = admin;
+    output.grace     = grace;
+    output.idleSince = 0;
+    output.readable  = true;
+
+    outputs.push_back( output);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read the number of listeners of an output
+ *----------------------------------------------------------------------------*/
+int
+ListenerMonitor :: readListeners (  Output        & output )
+                                                        throw ( Exception )
+{
+    TcpSocket     * socket = output.admin.get();
+    std::string     req;
+    char            buf[BUFFER_SIZE];
+    char          * base64;
+    const char    * p;
+    unsigned int    len;
+    unsigned int    ret;
+
+    // the listeners of the mount point, which unlike /admin/stats
+    // Icecast serves to the source of the mount point as well
+    req  = "GET /admin/listclients?mount=/";
+    req += Util::urlEncode( output.server->getMountPoint());
+    req += " HTTP/1.0\r\nHost: ";
+    req += Util::hostPort( socket->getHost(), socket->getPort());
+    base64 = Util::base64Encode( (std::string( "source:")
+                                  + output.server->getPassword()).c_str());
+    req += "\r\nAuthorization: Basic ";
+    req += base64;
+    delete[] base64;
+    req += "\r\nUser-Agent: DarkIce/" VERSION
+           " (http://code.google.com/p/darkice/)\r\n\r\n";
+
+    if ( !socket->open() ) {
+        return -1;
+    }
+
+    try {
+        for ( len = 0; len < req.length(); len += ret ) {
+            if ( !(ret = socket->write( req.c_str() + len,
+                                        req.length() - len)) ) {
+                socket->close();
+                return -1;
+            }
+        }
+        socket->flush();
+
+        // the response ends when the server closes the connection
+        len = 0;
+        while ( len < sizeof(buf) - 1
+             && socket->canRead( responseTimeout, 0) ) {
+            if ( !(ret = socket->read( buf + len, sizeof(buf) - 1 - len)) ) {
+                break;
+            }
+            len += ret;
+        }
+        buf[len] = 0;
+    } catch ( Exception   & e ) {
+        socket->close();
+        throw;
+    }
+    socket->close();
+
+    if ( Util::parseHttpStatus( buf, len) != 200 ) {
+        return -1;
+    }
+
+    // <icestats><source mount="/..."><Listeners>N</Listeners>...
+    if ( !(p = strstr( buf, "<source ")) ) {
+        return -1;
+    }
+    while ( (p = strstr( p + 1, "isteners>"))
+         && (p[-2] != '<' || (p[-1] != 'L' && p[-1] != 'l')) ) {
+    }
+    if ( !p ) {
+        return -1;
+    }
+    p += strlen( "isteners>");
+    if ( *p < '0' || *p > '9' ) {
+        return -1;
+    }
+
+    return strtol( p, 0, 10);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Look at an output
+ *----------------------------------------------------------------------------*/
+void
+ListenerMonitor :: check (  Output                & output,
+                            unsigned long long      now )   throw ()
+{
+    OnDemandSink  * sink      = output.sink.get();
+    int             listeners = -1;
+
+    // the mount point exists only while connected
+    if ( output.server->isOpen() ) {
+        try {
+            listeners = readListeners( output);
+        } catch ( Exception   & e ) {
+            listeners = -1;
+        }
+    }
+
+    if ( listeners >= 0 ) {
+        output.readable = true;
+    } else if ( output.server->isOpen() && output.readable ) {
+        output.readable = false;
+        reportEvent( 2, "can't read the listeners of",
+                     output.server->getMountPoint());
+    }
+
+    if ( listeners != 0 ) {
+        output.idleSince = 0;
+        if ( sink->isSuspended() ) {
+            sink->setSuspended( false);
+            reportEvent( 3, "resumed encoding",
+                         output.server->getMountPoint(), listeners);
+        }
+        return;
+    }
+
+    if ( !output.idleSince ) {
+        output.idleSince = now;
+    } else if ( !sink->isSuspended()
+             && now - output.idleSince >= output.grace * 1000000ULL ) {
+        sink->setSuspended( true);
+        reportEvent( 3, "suspended encoding, no listeners on",
+                     output.server->getMountPoint());
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start the thread
+ *----------------------------------------------------------------------------*/
+void
+ListenerMonitor :: start ( void )                       throw ( Exception )
+{
+    int     ret;
+
+    if ( running || outputs.empty() ) {
+        return;
+    }
+
+    running = true;
+    if ( (ret = pthread_create( &thread, 0, threadFunction, this)) ) {
+        running = false;
+        throw Exception( __FILE__, __LINE__, "pthread_create error", ret);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Stop the thread
+ *----------------------------------------------------------------------------*/
+void
+ListenerMonitor :: stop ( void )                        throw ()
+{
+    pthread_mutex_lock( &mutex);
+    if ( !running ) {
+        pthread_mutex_unlock( &mutex);
+        return;
+    }
+    running = false;
+    pthread_cond_signal( &cond);
+    pthread_mutex_unlock( &mutex);
+
+    pthread_join( thread, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The body of the thread
+ *----------------------------------------------------------------------------*/
+void
+ListenerMonitor :: loop ( void )                        throw ()
+{
+    sigset_t                sigset;
+    struct timespec         ts;
+
+    // mask out SIGUSR1, as we're expecting that signal for other reasons
+    sigemptyset( &sigset);
+    sigaddset( &sigset, SIGUSR1);
+    pthread_sigmask( SIG_BLOCK, &sigset, 0);
+
+    pthread_mutex_lock( &mutex);
+    while ( running ) {
+        pthread_mutex_unlock( &mutex);
+
+        for ( std::vector<Output>::iterator it = outputs.begin();
+              it != outputs.end();
+              ++it ) {
+            check( *it, Util::getMonotonicTime());
+        }
+
+        pthread_mutex_lock( &mutex);
+        if ( running ) {
+            clock_gettime( CLOCK_MONOTONIC, &ts);
+            ts.tv_sec += pollInterval;
+            pthread_cond_timedwait( &cond, &mutex, &ts);
+        }
+    }
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The thread function
+ *----------------------------------------------------------------------------*/
+void *
+ListenerMonitor :: threadFunction ( void    * param )
+{
+    ListenerMonitor   * monitor = (ListenerMonitor*) param;
+
+    monitor->loop();
+
+    return 0;
+}
+
@@ -0,0 +1,297 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : ListenerMonitor.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef LISTENER_MONITOR_H
+#define LISTENER_MONITOR_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include <vector>
+
+#include "Referable.h"
+#include "Reporter.h"
+#include "Exception.h"
+#include "Ref.h"
+#include "OnDemandSink.h"
+#include "IceCast2.h"
+#include "TcpSocket.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  Suspend the encoding of the outputs no one listens to.
+ *
+ *  The number of listeners of each mount point is read from the admin
+ *  interface of the Icecast2 server every few seconds, with the
+ *  credentials of the source. Once a mount point has had no listeners
+ *  for a grace period, its encoder is suspended, keeping the connection
+ *  alive with silent frames. It is resumed as soon as a listener shows
+ *  up, thus the first listener hears silence until the next look.
+ *
+ *  If the number of listeners can not be read, the output is not
+ *  suspended.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class ListenerMonitor : public virtual Referable, public virtual Reporter
+{
+    private:
+
+        /**
+         *  An output to suspend when not listened to.
+         */
+        struct Output {
+            /**
+             *  The sink in front of the encoder of the output.
+             */
+            Ref<OnDemandSink>       sink;
+
+            /**
+             *  The server connection of the output.
+             */
+            Ref<IceCast2>           server;
+
+            /**
+             *  The socket to connect to the admin interface of the
+             *  server with.
+             */
+            Ref<TcpSocket>          admin;
+
+            /**
+             *  The seconds without listeners before suspending.
+             */
+            unsigned int            grace;
+
+            /**
+             *  The time since the output has had no listeners,
+             *  or 0 if it has some.
+             */
+            unsigned long long      idleSince;
+
+            /**
+             *  False once reading the listeners failed, to report
+             *  failures only once.
+             */
+            bool                    readable;
+        };
+
+        /**
+         *  The number of seconds between two looks at the listeners.
+         */
+        static const unsigned int   pollInterval = 2;
+
+        /**
+         *  The number of seconds to wait for the response of a server.
+         */
+        static const unsigned int   responseTimeout = 5;
+
+        /**
+         *  The outputs to monitor.
+         */
+        std::vector<Output>         outputs;
+
+        /**
+         *  The thread reading the listeners.
+         */
+        pthread_t                   thread;
+
+        /**
+         *  Mutex protecting the running flag.
+         */
+        pthread_mutex_t             mutex;
+
+        /**
+         *  Condition to wake up the thread with.
+         */
+        pthread_cond_t              cond;
+
+        /**
+         *  Flag to show that the thread is running.
+         */
+        bool                        running;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        init ( void )                               throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Read the number of listeners of an output from the server.
+         *
+         *  @param output the output to look at.
+         *  @return the number of listeners, or -1 if not known.
+         *  @exception Exception
+         */
+        int
+        readListeners ( Output            & output )    throw ( Exception );
+
+        /**
+         *  Look at an output, and suspend or resume it as needed.
+         *
+         *  @param output the output to look at.
+         *  @param now the current time.
+         */
+        void
+        check ( Output                    & output,
+                unsigned long long          now )   throw ();
+
+        /**
+         *  The body of the thread.
+         */
+        void
+        loop ( void )                               throw ();
+
+        /**
+         *  The thread function.
+         *
+         *  @param param thread parameter, a pointer to the ListenerMonitor.
+         *  @return nothing
+         */
+        static void *
+        threadFunction ( void     * param );
+
+
+    protected:
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  thread can not be copied.
+         *
+         *  @param monitor the object to copy.
+         *  @exception Exception
+         */
+        inline
+        ListenerMonitor (   const ListenerMonitor     & monitor )
+                                                    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Default constructor.
+         *
+         *  @exception Exception
+         */
+        inline
+        ListenerMonitor ( void )                    throw ( Exception )
+        {
+            init();
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~ListenerMonitor ( void )                   throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Add an output to suspend when not listened to.
+         *
+         *  @param sink the sink in front of the encoder of the output.
+         *  @param server the server connection of the output.
+         *  @param admin the socket to connect to the admin interface of
+         *         the server with, used by the monitor thread only.
+         *  @param grace the seconds without listeners before suspending.
+         *  @exception Exception
+         */
+        void
+        addOutput ( OnDemandSink      * sink,
+                    IceCast2          * server,
+                    TcpSocket         * admin,
+                    unsigned int        grace )     throw ( Exception );
+
+        /**
+         *  Start the thread reading the listeners, if there are
+         *  outputs to monitor.
+         *
+         *  @exception Exception
+         */
+        void
+        start ( void )                              throw ( Exception );
+
+        /**
+         *  Stop the thread, and wait for it to finish.
+         */
+        void
+        stop ( void )                               throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* LISTENER_MONITOR_H */
+
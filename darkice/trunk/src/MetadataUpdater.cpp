@@ -0,0 +1,508 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : MetadataUpdater.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#else
+#error need sys/stat.h
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#else
+#error need signal.h
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#else
+#error need time.h
+#endif
+
+
+#include "Util.h"
+#include "IceCast2.h"
+#include "ShoutCast.h"
+#include "ShoutCast2.h"
+#include "MetadataUpdater.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The size of the buffer to read the title file and the responses into
+ *----------------------------------------------------------------------------*/
+#define BUFFER_SIZE         1024
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+MetadataUpdater :: init (   const char        * file,
+                            unsigned int        interval )
+                                                        throw ( Exception )
+{
+    pthread_condattr_t      attr;
+
+    if ( interval == 0 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "metadataInterval must be positive");
+    }
+
+    this->file     = file ? Util::strDup( file) : 0;
+    this->interval = interval;
+
+    generation = 0;
+    fileTime   = 0;
+    fileSize   = -1;
+    running    = false;
+
+    pthread_mutex_init( &mutex, 0);
+    // waited for with a timeout on the monotonic clock
+    pthread_condattr_init( &attr);
+    pthread_condattr_setclock( &attr, CLOCK_MONOTONIC);
+    pthread_cond_init( &cond, &attr);
+    pthread_condattr_destroy( &attr);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+MetadataUpdater :: strip ( void )                       throw ( Exception )
+{
+    stop();
+
+    outputs.clear();
+    pthread_cond_destroy( &cond);
+    pthread_mutex_destroy( &mutex);
+    delete[] file;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Add an output
+ *----------------------------------------------------------------------------*/
+void
+MetadataUpdater :: addOutput (  AudioEncoder  * encoder,
+                                CastSink      * server,
+                                TcpSocket     * admin )     throw ( Exception )
+{
+    Output      output;
+
+    if ( running ) {
+        throw Exception( __FILE__, __LINE__,
+                         "can't add output to a running metadata updater");
+    }
+
+    output.encoder    = encoder;
+    output.server     = server;
+    output.admin      = admin;
+    output.generation = 0;
+    output.viaAdmin   = false;
+
+    outputs.push_back( output);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set a new title
+ *----------------------------------------------------------------------------*/
+void
+MetadataUpdater :: setTitle (   const char    * title )     throw ()
+{
+    bool    changed;
+
+    pthread_mutex_lock( &mutex);
+    changed = this->title != title;
+    if ( changed ) {
+        this->title = title;
+        ++generation;
+        pthread_cond_signal( &cond);
+    }
+    pthread_mutex_unlock( &mutex);
+
+    if ( changed ) {
+        reportEvent( 4, "title set to", title);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read the title from the file, if changed
+ *----------------------------------------------------------------------------*/
+void
+MetadataUpdater :: readFile ( void )                    throw ()
+{
+    struct stat     st;
+    char            buf[BUFFER_SIZE];
+    int             fd;
+    int             len;
+
+    if ( stat( file, &st) == -1 ) {
+        return;
+    }
+    if ( st.st_mtime == fileTime && st.st_size == fileSize ) {
+        return;
+    }
+    fileTime = st.st_mtime;
+    fileSize = st.st_size;
+
+    if ( (fd = ::open( file, O_RDONLY)) == -1 ) {
+        reportEvent( 2, "can't open metadata file", file);
+        return;
+    }
+    len = ::read( fd, buf, sizeof(buf) - 1);
+    ::close( fd);
+    if ( len <= 0 ) {
+        return;
+    }
+
+    // the title is the first line of the file
+    buf[len]                   = 0;
+    buf[strcspn( buf, "\r\n")] = 0;
+    if ( *buf ) {
+        setTitle( buf);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send the current title to the outputs not having it yet
+ *----------------------------------------------------------------------------*/
+bool
+MetadataUpdater :: update ( void )                      throw ()
+{
+    std::string     t;
+    unsigned int    g;
+    bool            sent = false;
+
+    pthread_mutex_lock( &mutex);
+    t = title;
+    g = generation;
+    pthread_mutex_unlock( &mutex);
+
+    if ( g == 0 ) {
+        return false;
+    }
+
+    for ( std::vector<Output>::iterator it = outputs.begin();
+          it != outputs.end();
+          ++it ) {
+        if ( it->generation == g ) {
+            continue;
+        }
+
+        sent = true;
+        try {
+            if ( updateOutput( *it, t.c_str()) ) {
+                it->generation = g;
+            }
+        } catch ( Exception   & e ) {
+            reportEvent( 3, "can't update title:", e.getDescription());
+        }
+    }
+
+    return sent;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send a title to an output
+ *----------------------------------------------------------------------------*/
+bool
+MetadataUpdater :: updateOutput (   Output        & output,
+                                    const char    * title )
+                                                        throw ( Exception )
+{
+    AudioEncoder  * encoder   = output.encoder.get();
+    CastSink      * server    = output.server.get();
+    ShoutCast2    * ultravox  = dynamic_cast<ShoutCast2*>( server);
+    IceCast2      * iceCast2  = dynamic_cast<IceCast2*>( server);
+    ShoutCast     * shoutCast = dynamic_cast<ShoutCast*>( server);
+    std::string     req;
+
+    // in band, if the protocol or the encoding allows
+    if ( ultravox ) {
+        ultravox->setTitle( title);
+        return true;
+    }
+    if ( encoder && encoder->setTitle( title) ) {
+        return true;
+    }
+
+    if ( !output.admin.get() || !(iceCast2 || shoutCast) ) {
+        // no way to send the title to this output
+        return true;
+    }
+    if ( !server->isOpen() ) {
+        // the mount point exists only while connected
+        return false;
+    }
+    output.viaAdmin = true;
+
+    if ( iceCast2 ) {
+        req  = "GET /admin/metadata?mode=updinfo&charset=UTF-8&mount=/";
+        req += Util::urlEncode( iceCast2->getMountPoint());
+        req += "&song=";
+        req += Util::urlEncode( title);
+        req += " HTTP/1.0\r\nHost: ";
+        req += Util::hostPort( output.admin->getHost(),
+                               output.admin->getPort());
+        {
+            // source:<password> encoded as base64
+            std::string     auth = "source:";
+            char          * base64;
+
+            auth   += server->getPassword();
+            base64  = Util::base64Encode( auth.c_str());
+            req    += "\r\nAuthorization: Basic ";
+            req    += base64;
+            delete[] base64;
+        }
+        req += "\r\nUser-Agent: DarkIce/" VERSION
+               " (http://code.google.com/p/darkice/)\r\n\r\n";
+    } else {
+        // the ShoutCast admin page wants to see a browser
+        req  = "GET /admin.cgi?mode=updinfo&pass=";
+        req += Util::urlEncode( server->getPassword());
+        req += "&song=";
+        req += Util::urlEncode( title);
+        req += " HTTP/1.0\r\n"
+               "User-Agent: DarkIce/" VERSION " (Mozilla compatible)\r\n\r\n";
+    }
+
+    return sendRequest( output.admin.get(), req);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send a request to the admin interface of a server
+ *----------------------------------------------------------------------------*/
+bool
+MetadataUpdater :: sendRequest (    TcpSocket         * socket,
+                                    const std::string & request )
+                                                        throw ( Exception )
+{
+    char            resp[BUFFER_SIZE];
+    unsigned int    len;
+    unsigned int    ret;
+    unsigned int    status;
+
+    if ( !socket->open() ) {
+        return false;
+    }
+
+    try {
+        for ( len = 0; len < request.length(); len += ret ) {
+            if ( !(ret = socket->write( request.c_str() + len,
+                                        request.length() - len)) ) {
+                socket->close();
+                return false;
+            }
+        }
+        socket->flush();
+
+        // read the response, until the status line is complete
+        len = 0;
+        while ( len < sizeof(resp) - 1
+             && socket->canRead( responseTimeout, 0) ) {
+            if ( !(ret = socket->read( resp + len, sizeof(resp) - 1 - len)) ) {
+                break;
+            }
+            len += ret;
+            if ( memchr( resp, '\n', len) ) {
+                break;
+            }
+        }
+        resp[len] = 0;
+    } catch ( Exception   & e ) {
+        socket->close();
+        throw;
+    }
+    socket->close();
+
+    status = Util::parseHttpStatus( resp, len);
+    if ( status != 200 ) {
+        reportEvent( 3, "title update refused by", socket->getHost(), status);
+        return false;
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start the thread
+ *----------------------------------------------------------------------------*/
+void
+MetadataUpdater :: start ( void )                       throw ( Exception )
+{
+    int     ret;
+
+    if ( running ) {
+        return;
+    }
+
+    running = true;
+    if ( (ret = pthread_create( &thread, 0, threadFunction, this)) ) {
+        running = false;
+        throw Exception( __FILE__, __LINE__, "pthread_create error", ret);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Stop the thread
+ *----------------------------------------------------------------------------*/
+void
+MetadataUpdater :: stop ( void )                        throw ()
+{
+    pthread_mutex_lock( &mutex);
+    if ( !running ) {
+        pthread_mutex_unlock( &mutex);
+        return;
+    }
+    running = false;
+    pthread_cond_signal( &cond);
+    pthread_mutex_unlock( &mutex);
+
+    pthread_join( thread, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The body of the thread
+ *----------------------------------------------------------------------------*/
+void
+MetadataUpdater :: loop ( void )                        throw ()
+{
+    sigset_t                sigset;
+    struct timespec         ts;
+    unsigned long long      now;
+    unsigned long long      next = 0;
+
+    // mask out SIGUSR1, as we're expecting that signal for other reasons
+    sigemptyset( &sigset);
+    sigaddset( &sigset, SIGUSR1);
+    pthread_sigmask( SIG_BLOCK, &sigset, 0);
+
+    pthread_mutex_lock( &mutex);
+    while ( running ) {
+        pthread_mutex_unlock( &mutex);
+
+        if ( file ) {
+            readFile();
+        }
+
+        // a server forgets the title when the connection drops,
+        // thus send it again once reconnected
+        for ( std::vector<Output>::iterator it = outputs.begin();
+              it != outputs.end();
+              ++it ) {
+            if ( it->viaAdmin && !it->server->isOpen() ) {
+                it->generation = 0;
+            }
+        }
+
+        now = Util::getMonotonicTime();
+        if ( now >= next && update() ) {
+            next = now + interval * 1000000ULL;
+        }
+
+        pthread_mutex_lock( &mutex);
+        if ( running ) {
+            // look at the file once a second
+            clock_gettime( CLOCK_MONOTONIC, &ts);
+            ts.tv_sec += 1;
+            pthread_cond_timedwait( &cond, &mutex, &ts);
+        }
+    }
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The thread function
+ *----------------------------------------------------------------------------*/
+void *
+MetadataUpdater :: threadFunction ( void    * param )
+{
+    MetadataUpdater   * updater = (MetadataUpdater*) param;
+
+    updater->loop();
+
+    return 0;
+}
+
@@ -0,0 +1,375 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : MetadataUpdater.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef METADATA_UPDATER_H
+#define METADATA_UPDATER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#else
+#error need sys/types.h
+#endif
+
+#include <string>
+#include <vector>
+
+#include "Referable.h"
+#include "Reporter.h"
+#include "Exception.h"
+#include "Ref.h"
+#include "AudioEncoder.h"
+#include "CastSink.h"
+#include "TcpSocket.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  Change the title of the streams while streaming, without reconnecting
+ *  to the servers.
+ *
+ *  The title is sent the best way each output allows: Ogg Vorbis and
+ *  Opus encoders chain a new logical stream with the title in its
+ *  comment header, ShoutCast DNAS 2 connections send it in band, and
+ *  for the rest the title is set through the admin interface of the
+ *  Icecast2 or ShoutCast server.
+ *
+ *  Updates are made from a thread of their own, thus a slow server
+ *  does not hold up encoding. Titles set in quick succession are
+ *  batched: at most one update goes out every interval seconds,
+ *  carrying the latest title to all outputs. An output that could
+ *  not be updated is tried again with the next update.
+ *
+ *  The title may be set with setTitle(), or be read from the first
+ *  line of a file, which is watched for changes.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class MetadataUpdater : public virtual Referable, public virtual Reporter
+{
+    private:
+
+        /**
+         *  An output to update the title of.
+         */
+        struct Output {
+            /**
+             *  The encoder of the output, or 0 if it has none.
+             */
+            Ref<AudioEncoder>       encoder;
+
+            /**
+             *  The server connection of the output, or 0.
+             */
+            Ref<CastSink>           server;
+
+            /**
+             *  The socket to connect to the admin interface of the
+             *  server with, or 0.
+             */
+            Ref<TcpSocket>          admin;
+
+            /**
+             *  The generation of the title last sent to the output.
+             */
+            unsigned int            generation;
+
+            /**
+             *  True if the title is sent through the admin interface.
+             */
+            bool                    viaAdmin;
+        };
+
+        /**
+         *  The number of seconds to wait for the response of a server
+         *  to an admin request.
+         */
+        static const unsigned int   responseTimeout = 5;
+
+        /**
+         *  The file to read the title from, or 0.
+         */
+        char                      * file;
+
+        /**
+         *  The minimum number of seconds between two updates.
+         */
+        unsigned int                interval;
+
+        /**
+         *  The outputs to update.
+         */
+        std::vector<Output>         outputs;
+
+        /**
+         *  The current title.
+         */
+        std::string                 title;
+
+        /**
+         *  The generation of the current title, increased with each
+         *  new title.
+         */
+        unsigned int                generation;
+
+        /**
+         *  The modification time of the file when last read.
+         */
+        time_t                      fileTime;
+
+        /**
+         *  The size of the file when last read.
+         */
+        off_t                       fileSize;
+
+        /**
+         *  The thread making the updates.
+         */
+        pthread_t                   thread;
+
+        /**
+         *  Mutex protecting the title, and the running flag.
+         */
+        pthread_mutex_t             mutex;
+
+        /**
+         *  Condition to wake up the thread with.
+         */
+        pthread_cond_t              cond;
+
+        /**
+         *  Flag to show that the thread is running.
+         */
+        bool                        running;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param file the file to read the title from, or 0.
+         *  @param interval the minimum seconds between two updates.
+         *  @exception Exception
+         */
+        void
+        init (  const char        * file,
+                unsigned int        interval )      throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Read the title from the file, if it changed since last read.
+         */
+        void
+        readFile ( void )                           throw ();
+
+        /**
+         *  Send the current title to the outputs not having it yet.
+         *
+         *  @return true if anything was sent, false otherwise.
+         */
+        bool
+        update ( void )                             throw ();
+
+        /**
+         *  Send a title to an output.
+         *
+         *  @param output the output to send to.
+         *  @param title the title to send.
+         *  @return true if the title was sent, false otherwise.
+         *  @exception Exception
+         */
+        bool
+        updateOutput (  Output            & output,
+                        const char        * title ) throw ( Exception );
+
+        /**
+         *  Send a request to the admin interface of a server.
+         *
+         *  @param socket the socket to the admin interface.
+         *  @param request the HTTP request to send.
+         *  @return true if the server accepted the request,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        bool
+        sendRequest (   TcpSocket         * socket,
+                        const std::string & request )   throw ( Exception );
+
+        /**
+         *  The body of the thread.
+         */
+        void
+        loop ( void )                               throw ();
+
+        /**
+         *  The thread function.
+         *
+         *  @param param thread parameter, a pointer to the MetadataUpdater.
+         *  @return nothing
+         */
+        static void *
+        threadFunction ( void     * param );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        MetadataUpdater ( void )                    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  thread can not be copied.
+         *
+         *  @param updater the object to copy.
+         *  @exception Exception
+         */
+        inline
+        MetadataUpdater (   const MetadataUpdater     & updater )
+                                                    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param file the file to read the title from, or 0 if the
+         *         title is only set with setTitle().
+         *  @param interval the minimum seconds between two updates.
+         *  @exception Exception
+         */
+        inline
+        MetadataUpdater (   const char        * file,
+                            unsigned int        interval = 5 )
+                                                    throw ( Exception )
+        {
+            init( file, interval);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~MetadataUpdater ( void )                   throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Add an output to update the title of.
+         *
+         *  @param encoder the encoder of the output, without the Sinks
+         *         put in front of it, or 0 if it has none.
+         *  @param server the server connection of the output, or 0.
+         *  @param admin the socket to connect to the admin interface of
+         *         the server with, or 0.
+         *  @exception Exception
+         */
+        void
+        addOutput ( AudioEncoder      * encoder,
+                    CastSink          * server,
+                    TcpSocket         * admin )     throw ( Exception );
+
+        /**
+         *  Set a new title. It goes out with the next update.
+         *  May be called from any thread.
+         *
+         *  @param title the new title.
+         */
+        void
+        setTitle (  const char        * title )     throw ();
+
+        /**
+         *  Start the thread making the updates.
+         *
+         *  @exception Exception
+         */
+        void
+        start ( void )                              throw ( Exception );
+
+        /**
+         *  Stop the thread, and wait for it to finish.
+         */
+        void
+        stop ( void )                               throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* METADATA_UPDATER_H */
+
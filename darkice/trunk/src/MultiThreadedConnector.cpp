@@ -72,6 +72,12 @@ MultiThreadedConnector :: init ( bool    reconnect )    throw ( Exception )
     pthread_mutex_init( &mutexProduce, 0);
     pthread_cond_init( &condProduce, 0);
     threads = 0;
+
+    // the sinks attached by the constructor of Connector
+    feeders = new unsigned int[numSinks];
+    for ( unsigned int  i = 0; i < numSinks; ++i ) {
+        feeders[i] = 0;
+    }
 }
 
 
@@ -85,6 +91,8 @@ MultiThreadedConnector :: strip ( void )                throw ( Exception )
         delete[] threads;
         threads = 0;
     }
+    delete[] feeders;
+    feeders = 0;
 
     pthread_cond_destroy( &condProduce);
     pthread_mutex_destroy( &mutexProduce);
@@ -110,6 +118,10 @@ MultiThreadedConnector :: MultiThreadedConnector (
     for ( unsigned int  i = 0; i < numSinks; ++i ) {
         threads[i] = connector.threads[i];
     }
+    feeders = new unsigned int[numSinks];
+    for ( unsigned int  i = 0; i < numSinks; ++i ) {
+        feeders[i] = connector.feeders[i];
+    }
 }
 
 
@@ -134,12 +146,75 @@ MultiThreadedConnector :: operator= ( const MultiThreadedConnector & connector )
         for ( unsigned int  i = 0; i < numSinks; ++i ) {
             threads[i] = connector.threads[i];
         }
+        delete[] feeders;
+        feeders = new unsigned int[numSinks];
+        for ( unsigned int  i = 0; i < numSinks; ++i ) {
+            feeders[i] = connector.feeders[i];
+        }
     }
 
     return *this;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Attach a sink, written from a thread of its own
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: attach (  Sink          * sink )
+                                                            throw ( Exception )
+{
+    attach( sink, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Attach a sink, written from the thread of a feeder
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: attach (  Sink          * sink,
+                                    unsigned int    feeder )
+                                                            throw ( Exception )
+{
+    unsigned int  * f;
+    unsigned int    u;
+
+    Connector::attach( sink);
+
+    f = new unsigned int[numSinks];
+    for ( u = 0; u + 1 < numSinks; ++u ) {
+        f[u] = feeders[u];
+    }
+    f[numSinks - 1] = feeder;
+
+    delete[] feeders;
+    feeders = f;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Detach a sink
+ *----------------------------------------------------------------------------*/
+bool
+MultiThreadedConnector :: detach (  Sink          * sink )
+                                                            throw ( Exception )
+{
+    unsigned int    u;
+
+    for ( u = 0; u < numSinks && sinks[u].get() != sink; ++u );
+
+    if ( !Connector::detach( sink) ) {
+        return false;
+    }
+
+    for ( ; u < numSinks; ++u ) {
+        feeders[u] = feeders[u + 1];
+    }
+
+    return true;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Open the source and all the sinks if needed
  *  Create the sink threads
@@ -169,12 +244,20 @@ MultiThreadedConnector :: open ( void )                     throw ( Exception )
     threads = new ThreadData[numSinks];
     for ( i = 0; i < numSinks; ++i ) {
         ThreadData    * threadData = threads + i;
+        unsigned int    first;
+
+        // the first sink of a feeder gets the thread of the feeder
+        for ( first = 0;
+              first < i && (!feeders[i] || feeders[first] != feeders[i]);
+              ++first );
 
         threadData->connector = this;
         threadData->ixSink    = i;
+        threadData->ixFeeder  = first;
         threadData->accepting = true;
         threadData->isDone    = true;
-        if ( pthread_create( &(threadData->thread),
+        if ( first == i
+          && pthread_create( &(threadData->thread),
                              &threadAttr,
                              ThreadData::threadFunction,
                              threadData ) ) {
@@ -193,7 +276,9 @@ MultiThreadedConnector :: open ( void )                     throw ( Exception )
         pthread_mutex_unlock( &mutexProduce);
 
         for ( j = 0; j < i; ++j ) {
-            pthread_join( threads[j].thread, 0);
+            if ( threads[j].ixFeeder == j ) {
+                pthread_join( threads[j].thread, 0);
+            }
         }
 
         delete[] threads;
@@ -217,6 +302,7 @@ MultiThreadedConnector :: transfer ( unsigned long       bytes,
                                                             throw ( Exception )
 {   
     unsigned int        b;
+    bool                inPlace;
 
     if ( numSinks == 0 ) {
         return 0;
@@ -226,8 +312,11 @@ MultiThreadedConnector :: transfer ( unsigned long       bytes,
         return 0;
     }
 
-    dataBuffer   = new unsigned char[bufSize];
+    // with sources that can, the sinks read the data in place
+    inPlace      = source->canReadInPlace();
+    dataBuffer   = inPlace ? 0 : new unsigned char[bufSize];
     dataSize     = 0;
+    dataSilent   = false;
 
     reportEvent( 6, "MultiThreadedConnector :: transfer, bytes", bytes);
 
@@ -236,7 +325,15 @@ MultiThreadedConnector :: transfer ( unsigned long       bytes,
             unsigned int        i;
 
             pthread_mutex_lock( &mutexProduce);
-            dataSize = source->read( dataBuffer, bufSize);
+            if ( inPlace ) {
+                const void    * p = 0;
+
+                dataSize = source->readInPlace( &p, bufSize);
+                data     = (const unsigned char *) p;
+            } else {
+                dataSize = source->read( dataBuffer, bufSize);
+                data     = dataBuffer;
+            }
             b       += dataSize;
 
             // check for EOF
@@ -246,6 +343,9 @@ MultiThreadedConnector :: transfer ( unsigned long       bytes,
                 break;
             }
 
+            dataSilent = silenceDetector.get()
+                      && silenceDetector->isSilent( data, dataSize);
+
             for ( i = 0; i < numSinks; ++i ) {
                 threads[i].isDone = false;
             }
@@ -262,6 +362,10 @@ MultiThreadedConnector :: transfer ( unsigned long       bytes,
                 pthread_cond_wait( &condProduce, &mutexProduce);
             }
             pthread_mutex_unlock( &mutexProduce);
+
+            if ( inPlace ) {
+                source->releaseInPlace( dataSize);
+            }
         } else {
             reportEvent( 3, "MultiThreadedConnector :: transfer, can't read");
             break;
@@ -273,6 +377,73 @@ MultiThreadedConnector :: transfer ( unsigned long       bytes,
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Write the presented data to a sink
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: writeSink ( unsigned int      ixSink )    throw ()
+{
+    ThreadData    * threadData = &threads[ixSink];
+    Sink          * sink       = sinks[ixSink].get();
+
+    if ( threadData->cut && !threadData->reopening ) {
+        sink->cut();
+        threadData->cut = false;
+    }
+
+    if ( threadData->accepting ) {
+        if ( sink->canWrite( 0, 0) ) {
+            try {
+                if ( dataSilent ) {
+                    sink->writeSilent( data, dataSize);
+                } else {
+                    sink->write( data, dataSize);
+                }
+            } catch ( Exception     & e ) {
+                // something wrong. don't accept more data, try to
+                // reopen the sink next time around
+                threadData->accepting = false;
+            }
+        } else {
+            reportEvent( 4,
+                        "MultiThreadedConnector :: sinkThread can't write ",
+                         ixSink);
+            // don't care if we can't write
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Reopen a sink that failed
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: reopenSink ( unsigned int     ixSink )    throw ()
+{
+    ThreadData    * threadData = &threads[ixSink];
+    Sink          * sink       = sinks[ixSink].get();
+    bool            accepting  = false;
+
+    reportEvent( 4,
+                 "MultiThreadedConnector :: sinkThread reconnecting ",
+                 ixSink);
+    try {
+        sink->close();
+        Util::sleep(1L, 0L);
+        sink->open();
+        sched_yield();
+        accepting = sink->isOpen();
+    } catch ( Exception   & e ) {
+        // don't care, just try and try again
+    }
+
+    pthread_mutex_lock( &mutexProduce);
+    threadData->accepting = accepting;
+    threadData->reopening = false;
+    pthread_mutex_unlock( &mutexProduce);
+}
+
+
 /*------------------------------------------------------------------------------
  *  The function for each thread.
  *  Read the presented data
@@ -281,7 +452,7 @@ void
 MultiThreadedConnector :: sinkThread( int       ixSink )
 {
     ThreadData    * threadData = &threads[ixSink];
-    Sink          * sink       = sinks[ixSink].get();
+    unsigned int    i;
 
     while ( running ) {
         // wait for some data to become available
@@ -294,46 +465,41 @@ MultiThreadedConnector :: sinkThread( int       ixSink )
             break;
         }
 
-        if ( threadData->cut) {
-            sink->cut();
-            threadData->cut = false;
-        }
+        // write the sinks of the feeder, one after the other
+        for ( i = ixSink; i < numSinks; ++i ) {
+            ThreadData    * fed = &threads[i];
+
+            if ( fed->ixFeeder != (unsigned int) ixSink ) {
+                continue;
+            }
 
-        if ( threadData->accepting ) {
-            if ( sink->canWrite( 0, 0) ) {
-                try {
-                    sink->write( dataBuffer, dataSize);
-                } catch ( Exception     & e ) {
-                    // something wrong. don't accept more data, try to
-                    // reopen the sink next time around
-                    threadData->accepting = false;
+            writeSink( i);
+            fed->isDone = true;
+
+            // reopen a failed sink of a feeder in a thread of its own,
+            // for the other sinks not to wait for it
+            if ( feeders[i] && !fed->accepting && !fed->reopening ) {
+                if ( !reconnect ) {
+                    running = false;
+                    continue;
                 }
-            } else {
-                reportEvent( 4,
-                            "MultiThreadedConnector :: sinkThread can't write ",
-                             ixSink);
-                // don't care if we can't write
+                if ( fed->reopenStarted ) {
+                    pthread_join( fed->reopenThread, 0);
+                }
+                fed->reopenStarted = !pthread_create( &fed->reopenThread,
+                                                      &threadAttr,
+                                                  ThreadData::reopenFunction,
+                                                      fed);
+                fed->reopening     = fed->reopenStarted;
             }
         }
-        threadData->isDone = true;
         pthread_cond_broadcast( &condProduce);
         pthread_mutex_unlock( &mutexProduce);
 
-        if ( !threadData->accepting ) {
+        if ( !feeders[ixSink] && !threadData->accepting ) {
             if ( reconnect ) {
-                reportEvent( 4,
-                           "MultiThreadedConnector :: sinkThread reconnecting ",
-                            ixSink);
                 // if we're not accepting, try to reopen the sink
-                try {
-                    sink->close();
-                    Util::sleep(1L, 0L);
-                    sink->open();
-                    sched_yield();
-                    threadData->accepting = sink->isOpen();
-                } catch ( Exception   & e ) {
-                    // don't care, just try and try again
-                }
+                reopenSink( ixSink);
             } else {
                 // if !reconnect, just stop the connector
                 running = false;
@@ -374,9 +540,17 @@ MultiThreadedConnector :: close ( void )                    throw ( Exception )
     pthread_cond_broadcast( &condProduce);
     pthread_mutex_unlock( &mutexProduce);
 
-    // wait for all the threads to finish
+    // wait for all the threads to finish, the feeders first, as they
+    // start the threads reopening sinks
+    for ( i = 0; i < numSinks; ++i ) {
+        if ( threads[i].ixFeeder == i ) {
+            pthread_join( threads[i].thread, 0);
+        }
+    }
     for ( i = 0; i < numSinks; ++i ) {
-        pthread_join( threads[i].thread, 0);
+        if ( threads[i].reopenStarted ) {
+            pthread_join( threads[i].reopenThread, 0);
+        }
     }
     pthread_attr_destroy( &threadAttr);
 
@@ -427,3 +601,17 @@ MultiThreadedConnector :: ThreadData :: threadFunction( void  * param )
     return 0;
 }
 
+
+/*------------------------------------------------------------------------------
+ *  The function of the thread reopening a sink
+ *----------------------------------------------------------------------------*/
+void *
+MultiThreadedConnector :: ThreadData :: reopenFunction( void  * param )
+{
+    ThreadData     * threadData = (ThreadData*) param;
+
+    threadData->connector->reopenSink( threadData->ixSink);
+
+    return 0;
+}
+
@@ -68,6 +68,12 @@
  *  Connects a source to one or more sinks, using a multi-threaded
  *  producer - consumer approach.
  *
+ *  Each sink is written from a thread of its own, but sinks attached
+ *  with the same feeder are written one after the other from a single
+ *  thread, as the network outputs driven by one event loop. A sink of
+ *  a feeder that fails is reopened in a thread of its own, not to hold
+ *  up the other sinks of the feeder.
+ *
  *  @author  $Author$
  *  @version $Revision$
  */
@@ -92,10 +98,31 @@ class MultiThreadedConnector : public virtual Connector
                 unsigned int                ixSink;
 
                 /**
-                 *  The POSIX thread itself.
+                 *  The index of the sink whose thread writes to this sink,
+                 *  ixSink if the sink has a thread of its own.
+                 */
+                unsigned int                ixFeeder;
+
+                /**
+                 *  The POSIX thread itself, if ixFeeder is ixSink.
                  */
                 pthread_t                   thread;
 
+                /**
+                 *  The thread reopening the sink of a feeder.
+                 */
+                pthread_t                   reopenThread;
+
+                /**
+                 *  Marks if reopenThread was started, and is to be joined.
+                 */
+                bool                        reopenStarted;
+
+                /**
+                 *  Marks if reopenThread is still reopening the sink.
+                 */
+                bool                        reopening;
+
                 /**
                  *  Marks if the thread is accepting data.
                  */
@@ -121,7 +148,11 @@ class MultiThreadedConnector : public virtual Connector
                 {
                     this->connector = 0;
                     this->ixSink    = 0;
+                    this->ixFeeder  = 0;
                     this->thread    = 0;
+                    this->reopenThread  = 0;
+                    this->reopenStarted = false;
+                    this->reopening     = false;
                     this->accepting = false;
                     this->isDone    = false;
                     this->cut       = false;
@@ -136,6 +167,16 @@ class MultiThreadedConnector : public virtual Connector
                  */
                 static void *
                 threadFunction( void      * param );
+
+                /**
+                 *  The function of the thread reopening a sink.
+                 *
+                 *  @param param thread parameter, a pointer to a
+                 *               ThreadData
+                 *  @return nothing
+                 */
+                static void *
+                reopenFunction( void      * param );
         };
         
         /**
@@ -158,6 +199,11 @@ class MultiThreadedConnector : public virtual Connector
          */
         ThreadData            * threads;
 
+        /**
+         *  The feeder of each sink attached, 0 for a thread of its own.
+         */
+        unsigned int          * feeders;
+
         /**
          *  Signal if we're running or not, so the threads no if to stop.
          */
@@ -174,11 +220,22 @@ class MultiThreadedConnector : public virtual Connector
          */
         unsigned char         * dataBuffer;
 
+        /**
+         *  The information presented to each thread, in dataBuffer or
+         *  in place in the source.
+         */
+        const unsigned char   * data;
+
         /**
          *  The amount of information presented to each thread.
          */
         unsigned int            dataSize;
 
+        /**
+         *  Flag to show that the information presented is silent.
+         */
+        bool                    dataSilent;
+
         /**
          *  Initialize the object.
          *
@@ -198,6 +255,22 @@ class MultiThreadedConnector : public virtual Connector
         void
         strip ( void )                              throw ( Exception );
 
+        /**
+         *  Write the data presented to a sink, with mutexProduce held.
+         *
+         *  @param ixSink the index of the sink to write to.
+         */
+        void
+        writeSink ( unsigned int    ixSink )        throw ();
+
+        /**
+         *  Reopen a sink that failed, in the thread calling.
+         *
+         *  @param ixSink the index of the sink to reopen.
+         */
+        void
+        reopenSink ( unsigned int   ixSink )        throw ();
+
     protected:
 
         /**
@@ -211,6 +284,17 @@ class MultiThreadedConnector : public virtual Connector
             throw Exception( __FILE__, __LINE__);
         }
 
+        /**
+         *  Detach an already attached Sink from the Source of this
+         *  Connector.
+         *
+         *  @param sink the Sink to detach.
+         *  @return true if the detachment was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        detach (    Sink          * sink )              throw ( Exception );
+
 
     public:
 
@@ -283,6 +367,30 @@ class MultiThreadedConnector : public virtual Connector
         operator= ( const MultiThreadedConnector &   connector )
                                                             throw ( Exception );
 
+        /**
+         *  Attach a Sink to the Source of this Connector, written from
+         *  a thread of its own.
+         *
+         *  @param sink the Sink to attach.
+         *  @exception Exception
+         */
+        virtual void
+        attach (    Sink          * sink )              throw ( Exception );
+
+        /**
+         *  Attach a Sink to the Source of this Connector, written from
+         *  the thread of a feeder. The writes to the sink should not
+         *  block, as other sinks wait for them.
+         *
+         *  @param sink the Sink to attach.
+         *  @param feeder the feeder, shared by the sinks written from
+         *         the same thread, or 0 for a thread of its own.
+         *  @exception Exception
+         */
+        void
+        attach (    Sink          * sink,
+                    unsigned int    feeder )            throw ( Exception );
+
         /**
          *  Open the connector. Opens the Source and the Sinks if necessary.
          *
@@ -341,7 +449,8 @@ class MultiThreadedConnector : public virtual Connector
          *  This is the worker function for each thread.
          *  This function has to return fast
          *
-         *  @param ixSink the index of the sink this thread works on.
+         *  @param ixSink the index of the sink this thread works on,
+         *         and of the first sink of its feeder.
          */
         void
         sinkThread( int     ixSink );
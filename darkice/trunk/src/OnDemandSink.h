@@ -0,0 +1,309 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : OnDemandSink.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef ON_DEMAND_SINK_H
+#define ON_DEMAND_SINK_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include "Ref.h"
+#include "Sink.h"
+#include "AudioEncoder.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A Sink in front of an audio encoder, that stops encoding while the
+ *  output is suspended, as no one listens to it. The connection to the
+ *  server is kept alive meanwhile by the encoder writing pre-encoded
+ *  silent frames, at the pace of the input. Encoding goes on with the
+ *  first write after the output is resumed.
+ *
+ *  The output is suspended and resumed from an other thread, see
+ *  ListenerMonitor.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class OnDemandSink : public Sink
+{
+    private:
+
+        /**
+         *  The encoder to suspend.
+         */
+        Ref<AudioEncoder>       encoder;
+
+        /**
+         *  The sink to write through while not suspended, the encoder
+         *  or a Sink in front of it.
+         */
+        Ref<Sink>               sink;
+
+        /**
+         *  True while the output is suspended.
+         */
+        bool                    suspended;
+
+        /**
+         *  Mutex protecting the suspended flag.
+         */
+        pthread_mutex_t         mutex;
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        OnDemandSink ( void )                       throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  mutex can not be copied.
+         *
+         *  @param sink the object to copy.
+         *  @exception Exception
+         */
+        inline
+        OnDemandSink (  const OnDemandSink    & sink )  throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param encoder the encoder to suspend.
+         *  @param sink the sink to write through while not suspended,
+         *         the encoder or a Sink in front of it.
+         *  @exception Exception
+         */
+        inline
+        OnDemandSink (  AudioEncoder  * encoder,
+                        Sink          * sink )      throw ( Exception )
+        {
+            this->encoder = encoder;
+            this->sink    = sink;
+            suspended     = false;
+            pthread_mutex_init( &mutex, 0);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~OnDemandSink ( void )                      throw ( Exception )
+        {
+            pthread_mutex_destroy( &mutex);
+        }
+
+        /**
+         *  Suspend or resume encoding. May be called from any thread.
+         *
+         *  @param suspended true to suspend, false to resume.
+         */
+        inline void
+        setSuspended (  bool    suspended )         throw ()
+        {
+            pthread_mutex_lock( &mutex);
+            this->suspended = suspended;
+            pthread_mutex_unlock( &mutex);
+        }
+
+        /**
+         *  Tell if encoding is suspended.
+         *
+         *  @return true if suspended, false otherwise.
+         */
+        inline bool
+        isSuspended ( void )                        throw ()
+        {
+            bool    ret;
+
+            pthread_mutex_lock( &mutex);
+            ret = suspended;
+            pthread_mutex_unlock( &mutex);
+
+            return ret;
+        }
+
+        /**
+         *  Open the underlying sink.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        open ( void )                               throw ( Exception )
+        {
+            return sink->open();
+        }
+
+        /**
+         *  Check if the underlying sink is open.
+         *
+         *  @return true if the underlying sink is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                       throw ()
+        {
+            return sink->isOpen();
+        }
+
+        /**
+         *  Check if the underlying sink is ready to accept data.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the underlying sink is ready, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canWrite (     unsigned int    sec,
+                       unsigned int    usec )       throw ( Exception )
+        {
+            return sink->canWrite( sec, usec);
+        }
+
+        /**
+         *  Write audio to the encoder, or only account for it with
+         *  silent frames while suspended.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written (may be less than len).
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        write (        const void    * buf,
+                       unsigned int    len )        throw ( Exception )
+        {
+            if ( isSuspended() ) {
+                return encoder->writeSilent( buf, len);
+            }
+
+            return sink->write( buf, len);
+        }
+
+        /**
+         *  Write audio known to be silent to the encoder.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written (may be less than len).
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        writeSilent (  const void    * buf,
+                       unsigned int    len )        throw ( Exception )
+        {
+            if ( isSuspended() ) {
+                return encoder->writeSilent( buf, len);
+            }
+
+            return sink->writeSilent( buf, len);
+        }
+
+        /**
+         *  Flush the underlying sink.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        flush ( void )                              throw ( Exception )
+        {
+            sink->flush();
+        }
+
+        /**
+         *  Cut the underlying sink.
+         */
+        inline virtual void
+        cut ( void )                                throw ()
+        {
+            sink->cut();
+        }
+
+        /**
+         *  Close the underlying sink.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        close ( void )                              throw ( Exception )
+        {
+            sink->close();
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* ON_DEMAND_SINK_H */
+
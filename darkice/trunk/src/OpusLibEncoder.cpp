@@ -72,6 +72,7 @@ OpusLibEncoder :: init ( unsigned int     outMaxBitrate )
                                                             throw ( Exception )
 {
     this->outMaxBitrate = outMaxBitrate;
+    this->expectedLoss  = 0;
 
     if ( getInBitsPerSample() != 16 && getInBitsPerSample() != 8 ) {
         throw Exception( __FILE__, __LINE__,
@@ -140,7 +141,9 @@ OpusLibEncoder :: init ( unsigned int     outMaxBitrate )
 #endif
     }
 
-    encoderOpen = false;
+    encoderOpen  = false;
+    streamSerial = 0;
+    chainPending = false;
 }
 
 
@@ -151,8 +154,6 @@ bool
 OpusLibEncoder :: open ( void )
                                                             throw ( Exception )
 {
-    int     ret;
-
     if ( isOpen() ) {
         close();
     }
@@ -181,6 +182,10 @@ OpusLibEncoder :: open ( void )
 
     opus_encoder_ctl(opusEncoder, OPUS_SET_COMPLEXITY(10));
     opus_encoder_ctl(opusEncoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+    if ( expectedLoss ) {
+        opus_encoder_ctl(opusEncoder, OPUS_SET_INBAND_FEC(1));
+        opus_encoder_ctl(opusEncoder, OPUS_SET_PACKET_LOSS_PERC(expectedLoss));
+    }
 
     switch ( getOutBitrateMode() ) {
 
@@ -215,7 +220,42 @@ OpusLibEncoder :: open ( void )
                 break;
     }
 
-    if ( (ret = ogg_stream_init( &oggStreamState, 0)) ) {
+    streamSerial = 0;
+    chainPending = false;
+    // the first logical stream carries the title set so far
+    takeTitleChange();
+    openStream();
+
+    // initialize the resampling coverter if needed
+    if ( converter ) {
+#ifdef HAVE_SRC_LIB
+        converterData.input_frames   = 4096/((getInBitsPerSample() / 8) * getInChannel());
+        converterData.data_in        = new float[converterData.input_frames*getInChannel()];
+        converterData.output_frames  = (int) (converterData.input_frames * resampleRatio + 1);
+        converterData.data_out       = new float[getInChannel() * converterData.output_frames];
+        converterData.src_ratio      = resampleRatio;
+        converterData.end_of_input   = 0;
+#else
+        converter->initialize( resampleRatio, getInChannel());
+#endif
+    }
+
+    encoderOpen = true;
+    reconnectError = false;
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start a new logical stream
+ *----------------------------------------------------------------------------*/
+void
+OpusLibEncoder :: openStream ( void )                   throw ( Exception )
+{
+    int     ret;
+
+    if ( (ret = ogg_stream_init( &oggStreamState, streamSerial)) ) {
         throw Exception( __FILE__, __LINE__, "ogg stream init error", ret);
     }
 
@@ -236,21 +276,29 @@ OpusLibEncoder :: open ( void )
     char titlestr[7] = "TITLE=";
     OpusCommentHeader::Tags tags[1];
     char name[40];
+    char* title = copyTitle();
     CastSink* sink = dynamic_cast<CastSink*>(getSink().get());
-    if( sink && sink->getName() ) {
+    const char* tagName = name;
+    if( title ) {
+        // the title set while encoding takes precedence over the name
+        tagName = title;
+    }
+    else if( sink && sink->getName() ) {
         strncpy(name, (char*)sink->getName(), 39);
         name[39] = 0;
     }
     else {
         strncpy(name, "Darkice Stream", 39);
     }
-    tags[0].tag_len = strlen(titlestr) + strlen(name);
+    tags[0].tag_len = strlen(titlestr) + strlen(tagName);
     tags[0].tag_str = (char*) malloc( tags[0].tag_len + 1 );
     if( tags[0].tag_str == NULL ) {
+        delete[] title;
         throw Exception( __FILE__, __LINE__, "malloc failed");
     }
     strncpy( tags[0].tag_str, titlestr, tags[0].tag_len);
-    strncat( tags[0].tag_str, name, tags[0].tag_len);
+    strncat( tags[0].tag_str, tagName, tags[0].tag_len);
+    delete[] title;
 
     OpusCommentHeader commentHeader;
     strncpy(commentHeader.magic, "OpusTags", 8);
@@ -293,30 +341,75 @@ OpusLibEncoder :: open ( void )
 
     ogg_page oggPage;
     while ( ogg_stream_flush( &oggStreamState, &oggPage) ) {
-        getSink()->write( oggPage.header, oggPage.header_len);
-        getSink()->write( oggPage.body, oggPage.body_len);
+        struct iovec    vec[2];
+
+        // write the page header and body with a single call
+        vec[0].iov_base = oggPage.header;
+        vec[0].iov_len  = oggPage.header_len;
+        vec[1].iov_base = oggPage.body;
+        vec[1].iov_len  = oggPage.body_len;
+        getSink()->writeVec( vec, 2);
+        getSink()->markFrameEnd();
     }
 
     free(tags[0].tag_str);
     free(headerData);
     free(commentData);
+}
 
-    // initialize the resampling coverter if needed
-    if ( converter ) {
-#ifdef HAVE_SRC_LIB
-        converterData.input_frames   = 4096/((getInBitsPerSample() / 8) * getInChannel());
-        converterData.data_in        = new float[converterData.input_frames*getInChannel()];
-        converterData.output_frames  = (int) (converterData.input_frames * resampleRatio + 1);
-        converterData.data_out       = new float[getInChannel() * converterData.output_frames];
-        converterData.src_ratio      = resampleRatio;
-        converterData.end_of_input   = 0;
-#else
-        converter->initialize( resampleRatio, getInChannel());
-#endif
+
+/*------------------------------------------------------------------------------
+ *  Change the bit rate of the output
+ *----------------------------------------------------------------------------*/
+bool
+OpusLibEncoder :: setOutBitrate ( unsigned int    bitrate )
+                                                            throw ( Exception )
+{
+    if ( !bitrate ) {
+        return false;
     }
 
-    encoderOpen = true;
-    reconnectError = false;
+    if ( isOpen() ) {
+        int     ret = opus_encoder_ctl( opusEncoder,
+                                        OPUS_SET_BITRATE(bitrate * 1000));
+        if ( ret != OPUS_OK ) {
+            reportEvent( 2, "can't change opus bitrate", bitrate, ret);
+            return false;
+        }
+    }
+
+    storeOutBitrate( bitrate);
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set the packet loss to prepare for with forward error correction
+ *----------------------------------------------------------------------------*/
+bool
+OpusLibEncoder :: setExpectedLoss ( unsigned int    expectedLoss )
+                                                            throw ( Exception )
+{
+    if ( expectedLoss > 100 ) {
+        return false;
+    }
+
+    if ( isOpen() ) {
+        int     ret = opus_encoder_ctl( opusEncoder,
+                                        OPUS_SET_INBAND_FEC(expectedLoss ? 1
+                                                                         : 0));
+        if ( ret == OPUS_OK ) {
+            ret = opus_encoder_ctl( opusEncoder,
+                                    OPUS_SET_PACKET_LOSS_PERC(expectedLoss));
+        }
+        if ( ret != OPUS_OK ) {
+            reportEvent( 2, "can't set opus packet loss", expectedLoss, ret);
+            return false;
+        }
+    }
+
+    this->expectedLoss = expectedLoss;
 
     return true;
 }
@@ -333,6 +426,15 @@ OpusLibEncoder :: write ( const void    * buf,
         return 0;
     }
 
+    if ( takeTitleChange() ) {
+        chainPending = true;
+    }
+
+    if ( endSilence() ) {
+        // start afresh, not from the audio before the silence
+        opus_encoder_ctl( opusEncoder, OPUS_RESET_STATE);
+    }
+
     unsigned int    channels      = getInChannel();
     unsigned int    bitsPerSample = getInBitsPerSample();
     unsigned int    sampleSize = (bitsPerSample / 8) * channels;
@@ -466,6 +568,45 @@ OpusLibEncoder :: write ( const void    * buf,
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Write silence as silent packets
+ *----------------------------------------------------------------------------*/
+bool
+OpusLibEncoder :: writeSilence (    unsigned int    samples )
+                                                            throw ( Exception )
+{
+    if ( !isOpen() || reconnectError ) {
+        return false;
+    }
+
+    if ( takeTitleChange() ) {
+        chainPending = true;
+    }
+
+    if ( !isSilent() ) {
+        // let go of the input not encoded yet
+        internalBufferLength = 0;
+    }
+
+    // a CELT fullband 20 ms frame, with the silence flag set
+    unsigned char   packet[3] = { 0xf8, 0xff, 0xfe };
+    unsigned int    frames    = countSilentFrames( samples,
+                                                   960,
+                                                   getOutSampleRate());
+
+    if ( getOutChannel() == 2 ) {
+        packet[0] |= 0x04;
+    }
+
+    while ( frames-- ) {
+        oggGranulePosition += 960;
+        opusBlocksOut( sizeof( packet), packet);
+    }
+
+    return true;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Flush the data from the encoder
  *----------------------------------------------------------------------------*/
@@ -510,6 +651,12 @@ OpusLibEncoder :: opusBlocksOut ( int bytes,
 {
     ogg_packet      oggPacket;
     ogg_page        oggPage;
+    // a new title ends the logical stream with this packet
+    bool            chain = chainPending && !eos;
+
+    if ( chain ) {
+        eos = true;
+    }
 
     oggPacket.packet = data;
     oggPacket.bytes = bytes;
@@ -522,10 +669,15 @@ OpusLibEncoder :: opusBlocksOut ( int bytes,
     if( ogg_stream_packetin( &oggStreamState, &oggPacket) == 0) {
         while( ogg_stream_pageout( &oggStreamState, &oggPage) ||
             ( eos && ogg_stream_flush( &oggStreamState, &oggPage) ) ) {
-            int    written;
+            int             written;
+            struct iovec    vec[2];
 
-            written  = getSink()->write(oggPage.header, oggPage.header_len);
-            written += getSink()->write( oggPage.body, oggPage.body_len);
+            vec[0].iov_base = oggPage.header;
+            vec[0].iov_len  = oggPage.header_len;
+            vec[1].iov_base = oggPage.body;
+            vec[1].iov_len  = oggPage.body_len;
+            written = getSink()->writeVec( vec, 2);
+            getSink()->markFrameEnd();
 
             if ( written < oggPage.header_len + oggPage.body_len ) {
                 reconnectError = true;
@@ -538,6 +690,15 @@ OpusLibEncoder :: opusBlocksOut ( int bytes,
     } else {
         throw Exception( __FILE__, __LINE__, "internal ogg error");
     }
+
+    if ( chain ) {
+        // chain a new logical stream, with the new title
+        chainPending = false;
+        ogg_stream_clear( &oggStreamState);
+        ++streamSerial;
+        openStream();
+        reportEvent( 3, "opus stream chained");
+    }
 }
 
 
@@ -218,6 +218,18 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
         ogg_int64_t                     oggGranulePosition;
         ogg_int64_t                     oggPacketNumber;
 
+        /**
+         *  The serial number of the current logical Ogg stream.
+         */
+        int                             streamSerial;
+
+        /**
+         *  Set when the title was changed, and the current logical
+         *  stream is to be ended with the next packet, and a new one
+         *  started with the new title.
+         */
+        bool                            chainPending;
+
         unsigned char*                  internalBuffer;
         int                             internalBufferLength;
         bool                            reconnectError;
@@ -227,6 +239,12 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
          */
         unsigned int                    outMaxBitrate;
 
+        /**
+         *  The packet loss to prepare for with in-band forward error
+         *  correction, in percent. If 0, no forward error correction.
+         */
+        unsigned int                    expectedLoss;
+
         /**
          *  Resample ratio
          */
@@ -270,6 +288,15 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
             }
         }
 
+        /**
+         *  Start a new logical Ogg stream, sending its headers to the
+         *  underlying sink.
+         *
+         *  @exception Exception
+         */
+        void
+        openStream ( void )                             throw ( Exception );
+
         /**
          *  Send pending Opus blocks to the underlying stream
          */
@@ -395,6 +422,7 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
                 throw Exception(__FILE__, __LINE__, "don't copy open encoders");
             }
             init( encoder.getOutMaxBitrate() );
+            expectedLoss = encoder.expectedLoss;
         }
 
         /**
@@ -501,6 +529,48 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
             return encoderOpen;
         }
 
+        /**
+         *  Change the bit rate of the output while encoding.
+         *  Takes effect from the next Opus frame on.
+         *
+         *  @param bitrate the new bit rate of the output (kbits/sec).
+         *  @return true if the bit rate was changed, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        setOutBitrate ( unsigned int    bitrate )   throw ( Exception );
+
+        /**
+         *  Set the packet loss to prepare for with the in-band forward
+         *  error correction of Opus, which lets a receiver restore a
+         *  lost packet from the next one. Takes effect from the next
+         *  Opus frame on.
+         *
+         *  @param expectedLoss the packet loss in percent,
+         *         0 to turn forward error correction off.
+         *  @return true if it was set, false otherwise.
+         *  @exception Exception
+         */
+        bool
+        setExpectedLoss ( unsigned int  expectedLoss )  throw ( Exception );
+
+        /**
+         *  Change the title of the stream while encoding. The current
+         *  logical stream is ended with the next Opus packet, and a new
+         *  one is chained after it, with the new title in its comment
+         *  header.
+         *
+         *  @param title the new title.
+         *  @return true, as the title is always sent in the stream.
+         *  @exception Exception
+         */
+        inline virtual bool
+        setTitle (  const char    * title )         throw ( Exception )
+        {
+            storeTitle( title);
+            return true;
+        }
+
         /**
          *  Check if the encoder is ready to accept data.
          *
@@ -536,6 +606,16 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        throw ( Exception );
 
+        /**
+         *  Write silence as silent 20 ms Opus packets, without encoding.
+         *
+         *  @param samples the number of input samples of silence.
+         *  @return true if the silence was written, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        writeSilence (  unsigned int    samples )   throw ( Exception );
+
         /**
          *  Flush all data that was written to the encoder to the underlying
          *  connection.
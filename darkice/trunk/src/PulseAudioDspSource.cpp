@@ -44,6 +44,30 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#else
+#error need time.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
 #include "Util.h"
 #include "Exception.h"
 #include "PulseAudioDspSource.h"
@@ -59,6 +83,17 @@
  *----------------------------------------------------------------------------*/
 static const char fileid[] = "$Id$";
 
+/*------------------------------------------------------------------------------
+ *  The seconds of audio the ring buffer holds, on top of the maximum
+ *  length of the server buffer
+ *----------------------------------------------------------------------------*/
+#define RING_SECONDS        2
+
+/*------------------------------------------------------------------------------
+ *  The seconds to wait for audio in read() before giving up
+ *----------------------------------------------------------------------------*/
+#define READ_TIMEOUT        5
+
 
 /* ===============================================  local function prototypes */
 
@@ -72,6 +107,7 @@ static const char fileid[] = "$Id$";
 void
 PulseAudioDspSource :: init (  const char      * paSourceName )    throw ( Exception )
 {
+    pthread_condattr_t      attr;
 
     if (paSourceName == NULL)
     {
@@ -90,7 +126,22 @@ PulseAudioDspSource :: init (  const char      * paSourceName )    throw ( Excep
     ss.channels = getChannel();
     ss.rate = getSampleRate();
 
-    running = 0;
+    fragTime          = 0;
+    maxTime           = 0;
+    mainloop          = 0;
+    context           = 0;
+    stream            = 0;
+    ring              = 0;
+    failed            = false;
+    dropped           = 0;
+    lastLatencyReport = 0;
+
+    pthread_mutex_init( &mutex, 0);
+    // waited for with a timeout on the monotonic clock
+    pthread_condattr_init( &attr);
+    pthread_condattr_setclock( &attr, CLOCK_MONOTONIC);
+    pthread_cond_init( &cond, &attr);
+    pthread_condattr_destroy( &attr);
     
     //Supported for some bits per sample, both Big and Little endian
     if (isBigEndian())
@@ -142,11 +193,11 @@ PulseAudioDspSource :: init (  const char      * paSourceName )    throw ( Excep
 void
 PulseAudioDspSource :: strip ( void )                      throw ( Exception )
 {
-    if ( isOpen() ) {
-        close();
-    }
+    close();
 
     delete[] sourceName;
+    pthread_cond_destroy( &cond);
+    pthread_mutex_destroy( &mutex);
 }
 
 
@@ -156,22 +207,288 @@ PulseAudioDspSource :: strip ( void )                      throw ( Exception )
 bool
 PulseAudioDspSource :: open ( void )                       throw ( Exception )
 {
-  
-    char         client_name[255];
+    char                    client_name[255];
+    pa_buffer_attr          attr;
+    const pa_buffer_attr  * actual;
+    int                     flags;
+    int                     err;
+
+    if ( isOpen() ) {
+        return false;
+    }
+    if ( ss.format == PA_SAMPLE_INVALID ) {
+        throw Exception( __FILE__, __LINE__, "unsupported bits per sample",
+                         getBitsPerSample());
+    }
 
     //to identify each darkice on pulseaudio server
     snprintf(client_name, 255, "darkice-%d", getpid());
 
-    if (!(s = pa_simple_new(NULL, client_name, PA_STREAM_RECORD, sourceName, "darkice record", &ss, NULL, NULL, &error))) {
-        throw Exception( __FILE__, __LINE__, ": pa_simple_new() failed: %s\n", pa_strerror(error));
+    ring = new RingBuffer( pa_usec_to_bytes( RING_SECONDS * 1000000ULL
+                                             + maxTime, &ss));
+    failed  = false;
+    dropped = 0;
+
+    if ( !(mainloop = pa_threaded_mainloop_new()) ) {
+        close();
+        throw Exception( __FILE__, __LINE__, "pa_threaded_mainloop_new error");
+    }
+    if ( !(context = pa_context_new( pa_threaded_mainloop_get_api( mainloop),
+                                     client_name)) ) {
+        close();
+        throw Exception( __FILE__, __LINE__, "pa_context_new error");
+    }
+    pa_context_set_state_callback( context, contextStateCallback, this);
+
+    if ( pa_context_connect( context, 0, PA_CONTEXT_NOFLAGS, 0) < 0
+      || pa_threaded_mainloop_start( mainloop) < 0 ) {
+        err = pa_context_errno( context);
+        close();
+        throw Exception( __FILE__, __LINE__,
+                         "can't connect to PulseAudio server",
+                         pa_strerror( err));
+    }
+
+    pa_threaded_mainloop_lock( mainloop);
+
+    if ( !waitForContext() ) {
+        err = pa_context_errno( context);
+        pa_threaded_mainloop_unlock( mainloop);
+        close();
+        throw Exception( __FILE__, __LINE__,
+                         "can't connect to PulseAudio server",
+                         pa_strerror( err));
+    }
+
+    if ( !(stream = pa_stream_new( context, "darkice record", &ss, 0)) ) {
+        err = pa_context_errno( context);
+        pa_threaded_mainloop_unlock( mainloop);
+        close();
+        throw Exception( __FILE__, __LINE__, "pa_stream_new error",
+                         pa_strerror( err));
+    }
+    pa_stream_set_state_callback( stream, streamStateCallback, this);
+    pa_stream_set_read_callback( stream, streamReadCallback, this);
+
+    // the server picks what is not asked for, the fragment size being
+    // the latency of the source only if the latency is adjusted
+    attr.maxlength = maxTime  ? pa_usec_to_bytes( maxTime, &ss)
+                              : (uint32_t) -1;
+    attr.fragsize  = fragTime ? pa_usec_to_bytes( fragTime, &ss)
+                              : (uint32_t) -1;
+    attr.tlength   = (uint32_t) -1;
+    attr.prebuf    = (uint32_t) -1;
+    attr.minreq    = (uint32_t) -1;
+    flags          = PA_STREAM_INTERPOLATE_TIMING
+                   | PA_STREAM_AUTO_TIMING_UPDATE;
+    if ( fragTime ) {
+        flags |= PA_STREAM_ADJUST_LATENCY;
+    }
+
+    if ( pa_stream_connect_record( stream, sourceName, &attr,
+                                   (pa_stream_flags_t) flags) < 0
+      || !waitForStream() ) {
+        err = pa_context_errno( context);
+        pa_threaded_mainloop_unlock( mainloop);
+        close();
+        throw Exception( __FILE__, __LINE__,
+                         "can't record from PulseAudio source",
+                         sourceName ? sourceName : "default",
+                         pa_strerror( err));
+    }
+
+    reportEvent( 2, "recording from PulseAudio source",
+                 pa_stream_get_device_name( stream));
+    if ( (actual = pa_stream_get_buffer_attr( stream)) ) {
+        reportEvent( 2, "PulseAudio fragment size, usec",
+                     pa_bytes_to_usec( actual->fragsize, &ss));
+        reportEvent( 2, "PulseAudio maximum length, usec",
+                     pa_bytes_to_usec( actual->maxlength, &ss));
     }
 
-    running = 1;
-  
+    pa_threaded_mainloop_unlock( mainloop);
+
+    lastLatencyReport = 0;
+
     return true;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Wait until the connection to the server is ready
+ *----------------------------------------------------------------------------*/
+bool
+PulseAudioDspSource :: waitForContext ( void )             throw ()
+{
+    for (;;) {
+        switch ( pa_context_get_state( context) ) {
+            case PA_CONTEXT_READY:
+                return true;
+
+            case PA_CONTEXT_FAILED:
+            case PA_CONTEXT_TERMINATED:
+                return false;
+
+            default:
+                pa_threaded_mainloop_wait( mainloop);
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wait until the stream is ready
+ *----------------------------------------------------------------------------*/
+bool
+PulseAudioDspSource :: waitForStream ( void )              throw ()
+{
+    for (;;) {
+        switch ( pa_stream_get_state( stream) ) {
+            case PA_STREAM_READY:
+                return true;
+
+            case PA_STREAM_FAILED:
+            case PA_STREAM_TERMINATED:
+                return false;
+
+            default:
+                pa_threaded_mainloop_wait( mainloop);
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Note that the stream failed
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: fail ( void )                       throw ()
+{
+    pthread_mutex_lock( &mutex);
+    failed = true;
+    pthread_cond_signal( &cond);
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  State changes of the connection to the server
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: contextStateCallback (  pa_context    * c,
+                                                void          * userdata )
+{
+    PulseAudioDspSource   * source = (PulseAudioDspSource*) userdata;
+
+    switch ( pa_context_get_state( c) ) {
+        case PA_CONTEXT_FAILED:
+        case PA_CONTEXT_TERMINATED:
+            source->fail();
+            // fall through
+        case PA_CONTEXT_READY:
+            pa_threaded_mainloop_signal( source->mainloop, 0);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  State changes of the stream
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: streamStateCallback (   pa_stream     * s,
+                                                void          * userdata )
+{
+    PulseAudioDspSource   * source = (PulseAudioDspSource*) userdata;
+
+    switch ( pa_stream_get_state( s) ) {
+        case PA_STREAM_FAILED:
+        case PA_STREAM_TERMINATED:
+            source->fail();
+            // fall through
+        case PA_STREAM_READY:
+            pa_threaded_mainloop_signal( source->mainloop, 0);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Audio recorded by the stream
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: streamReadCallback (    pa_stream     * s,
+                                                size_t          nbytes,
+                                                void          * userdata )
+{
+    ((PulseAudioDspSource*) userdata)->takeAudio();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Take the audio recorded into the ring buffer
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: takeAudio ( void )                  throw ()
+{
+    const void    * data;
+    size_t          len;
+    unsigned int    frameSize = pa_frame_size( &ss);
+    unsigned int    room;
+    unsigned int    ret;
+    bool            taken = false;
+
+    while ( pa_stream_readable_size( stream) > 0 ) {
+        if ( pa_stream_peek( stream, &data, &len) < 0 ) {
+            fail();
+            return;
+        }
+        if ( !len ) {
+            break;
+        }
+
+        // only store whole frames, so that the reader stays aligned
+        room  = ring->getFree();
+        room -= room % frameSize;
+        ret   = len < room ? len : room;
+        if ( data ) {
+            ring->put( data, ret);
+        } else {
+            // a hole in the recording, fill it with silence
+            memset( ring->getWritePtr(),
+                    ss.format == PA_SAMPLE_U8 ? 0x80 : 0,
+                    ret);
+            ring->commit( ret);
+        }
+        pa_stream_drop( stream);
+
+        // the reader does not keep up, report once it does again
+        if ( ret < len ) {
+            if ( !dropped ) {
+                reportEvent( 1, "PulseAudio ring buffer full, dropping audio");
+            }
+            dropped += len - ret;
+        } else if ( dropped ) {
+            reportEvent( 1, "PulseAudio audio dropped, bytes", dropped);
+            dropped = 0;
+        }
+        taken = taken || ret > 0;
+    }
+
+    if ( taken ) {
+        pthread_mutex_lock( &mutex);
+        pthread_cond_signal( &cond);
+        pthread_mutex_unlock( &mutex);
+    }
+}
+
+
 /*------------------------------------------------------------------------------
  *  Check whether read() would return anything
  *----------------------------------------------------------------------------*/
@@ -179,27 +496,38 @@ bool
 PulseAudioDspSource :: canRead ( unsigned int    sec,
                            unsigned int    usec )    throw ( Exception )
 {
-  
-  /** Strange have to remove this, need to investigate... */
-  /*  if ( !isOpen() ) {
+    struct timespec     ts;
+    bool                ready;
+    bool                broken;
+
+    if ( !isOpen() ) {
         return false;
-      }
-  */
-
-    if (running == 0) {
-      char         client_name[255];
-      
-      //to identify each darkice on pulseaudio server
-      snprintf(client_name, 255, "darkice-%d", getpid());
-      
-      if (!(s = pa_simple_new(NULL, client_name, PA_STREAM_RECORD, sourceName, "darkice record", &ss, NULL, NULL, &error))) {
-        throw Exception( __FILE__, __LINE__, ": pa_simple_new() failed: %s\n", pa_strerror(error));
-      }
-      
-      running = 1;
-    }
-
-    return true; 
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &ts);
+    ts.tv_sec  += sec + usec / 1000000;
+    ts.tv_nsec += (usec % 1000000) * 1000;
+    if ( ts.tv_nsec >= 1000000000 ) {
+        ts.tv_sec  += 1;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock( &mutex);
+    while ( !failed && ring->getUsed() < pa_frame_size( &ss) ) {
+        if ( pthread_cond_timedwait( &cond, &mutex, &ts) == ETIMEDOUT ) {
+            break;
+        }
+    }
+    broken = failed;
+    ready  = ring->getUsed() >= pa_frame_size( &ss);
+    pthread_mutex_unlock( &mutex);
+
+    if ( broken ) {
+        throw Exception( __FILE__, __LINE__, "PulseAudio stream failed",
+                         pa_strerror( pa_context_errno( context)));
+    }
+
+    return ready;
 }
 
 
@@ -210,13 +538,78 @@ unsigned int
 PulseAudioDspSource :: read (    void          * buf,
                            unsigned int    len )     throw ( Exception )
 {
-    int ret;
-    
-    ret = pa_simple_read(s, buf, len, &error);
-    if ( ret < 0) {
-        throw Exception(__FILE__, __LINE__, ": pa_simple_read() failed: %s\n", pa_strerror(error));
+    unsigned int    frameSize;
+    unsigned int    n;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    frameSize = pa_frame_size( &ss);
+    if ( ring->getUsed() < frameSize && !canRead( READ_TIMEOUT, 0) ) {
+        throw Exception( __FILE__, __LINE__,
+                         "no audio recorded from PulseAudio source",
+                         sourceName ? sourceName : "default");
+    }
+
+    n  = ring->getUsed();
+    n  = n < len ? n : len;
+    n -= n % frameSize;
+    memcpy( buf, ring->getReadPtr(), n);
+    ring->release( n);
+
+    reportLatency();
+
+    return n;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The measured latency of the source
+ *----------------------------------------------------------------------------*/
+unsigned long long
+PulseAudioDspSource :: getLatency ( void )                 throw ()
+{
+    pa_usec_t       usec;
+    int             negative;
+    bool            known;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    // the time from recording on the server until the stream is read
+    pa_threaded_mainloop_lock( mainloop);
+    known = pa_stream_get_latency( stream, &usec, &negative) == 0;
+    pa_threaded_mainloop_unlock( mainloop);
+
+    if ( !known ) {
+        return 0;
+    }
+
+    return (negative ? 0 : usec) + pa_bytes_to_usec( ring->getUsed(), &ss);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Report the latency every now and then
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: reportLatency ( void )              throw ()
+{
+    unsigned long long      now = Util::getMonotonicTime();
+    unsigned long long      latency;
+
+    if ( lastLatencyReport
+      && now - lastLatencyReport < latencyInterval * 1000000ULL ) {
+        return;
+    }
+
+    // no timing information right after opening
+    if ( (latency = getLatency()) ) {
+        reportEvent( 3, "PulseAudio source latency, usec", latency);
+        lastLatencyReport = now;
     }
-    return len;
 }
 
 
@@ -226,12 +619,27 @@ PulseAudioDspSource :: read (    void          * buf,
 void
 PulseAudioDspSource :: close ( void )                  throw ( Exception )
 {
-    if ( !isOpen() ) {
-        return;
+    // once the main loop is stopped, no callback runs
+    if ( mainloop ) {
+        pa_threaded_mainloop_stop( mainloop);
+    }
+    if ( stream ) {
+        pa_stream_disconnect( stream);
+        pa_stream_unref( stream);
+        stream = 0;
+    }
+    if ( context ) {
+        pa_context_disconnect( context);
+        pa_context_unref( context);
+        context = 0;
+    }
+    if ( mainloop ) {
+        pa_threaded_mainloop_free( mainloop);
+        mainloop = 0;
     }
 
-    pa_simple_free(s);
-    running = 0;
+    delete ring;
+    ring = 0;
 }
 
 #endif // HAVE_PULSEAUDIO_LIB
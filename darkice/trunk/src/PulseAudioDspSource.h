@@ -44,14 +44,21 @@
 #include "config.h"
 #endif
 
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
 #include "Reporter.h"
 #include "AudioSource.h"
+#include "RingBuffer.h"
 
 #ifdef HAVE_PULSEAUDIO_LIB
 
-#include <pulse/simple.h>
-#include <pulse/error.h>
-#include <pulse/gccmacro.h>
+#include <pulse/pulseaudio.h>
 #else
 #error configure for PULSEAUDIO 
 #endif
@@ -65,6 +72,16 @@
 /**
  *  An audio input based on the PULSEAUDIO sound system 
  *
+ *  The audio is recorded by a stream driven by a threaded main loop
+ *  of the PulseAudio client library. The read callback of the stream
+ *  copies the fragments the server sends into a ring buffer, which
+ *  read() takes them from.
+ *
+ *  The fragment size sets the latency of the source, and with it how
+ *  often the server sends audio, the maximum length sets how much
+ *  audio the server holds for us before dropping some. Both are left
+ *  to the server unless set.
+ *
  *  @author  $Author$
  *  @version $Revision$
  */
@@ -73,269 +90,166 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
     private:
 
         /**
-         *  Name of the capture PCM stream.
+         *  The number of seconds between two reports of the latency.
          */
-        char *sourceName;
+        static const unsigned int   latencyInterval = 60;
 
         /**
-         *  Handle for PulseAudio 
+         *  Name of the capture PCM stream.
          */
-        pa_simple *s ;
+        char *sourceName;
 
         /**
          * format definitions for pulseaudio
           */
         pa_sample_spec ss;
 
-	int running;
-        int error;
-
-    protected:
-
         /**
-         *  Default constructor. Always throws an Exception.
-         *
-         *  @exception Exception
+         *  The fragment size asked for, in microseconds,
+         *  0 for the server default.
          */
-        inline
-        PulseAudioDspSource ( void )                       throw ( Exception )
-        {
-            throw Exception( __FILE__, __LINE__);
-        }
+        unsigned int                fragTime;
 
         /**
-         *  Initialize the object
-         *
-         *  @param name the PCM to open.
-         *  @exception Exception
+         *  The maximum length of the server buffer asked for,
+         *  in microseconds, 0 for the server default.
          */
-        void
-        init (  const char    * name )              throw ( Exception );
+        unsigned int                maxTime;
 
         /**
-         *  De-iitialize the object
-         *
-         *  @exception Exception
+         *  The main loop running the stream, in its own thread.
          */
-        void
-        strip ( void )                              throw ( Exception );
+        pa_threaded_mainloop      * mainloop;
 
+        /**
+         *  The connection to the server.
+         */
+        pa_context                * context;
 
-    public:
+        /**
+         *  The record stream.
+         */
+        pa_stream                 * stream;
 
         /**
-         *  Constructor.
-         *
-         *  @param name the PCM (e.g. "hwplug:0,0").
-         *  @param sampleRate samples per second (e.g. 44100 for 44.1kHz).
-         *  @param bitsPerSample bits per sample (e.g. 16 bits).
-         *  @param channel number of channels of the audio source
-         *                 (e.g. 1 for mono, 2 for stereo, etc.).
-         *  @exception Exception
+         *  The audio recorded and not read yet.
          */
-        inline
-        PulseAudioDspSource (  const char    * paSourceName,
-                         int             sampleRate    = 44100,
-                         int             bitsPerSample = 16,
-                         int             channel       = 2 )
-                                                        throw ( Exception )
-                    : AudioSource( sampleRate, bitsPerSample, channel)
-        {
-            init( paSourceName);
-        }
+        RingBuffer                * ring;
 
         /**
-         *  Copy Constructor.
-         *
-         *  @param ds the object to copy.
-         *  @exception Exception
+         *  Mutex for the condition below.
          */
-        inline
-        PulseAudioDspSource (  const PulseAudioDspSource &    ds )    throw ( Exception )
-                    : AudioSource( ds )
-        {
-            init( ds.sourceName);
-        }
+        pthread_mutex_t             mutex;
 
         /**
-         *  Destructor.
-         *
-         *  @exception Exception
+         *  Condition signalled when audio is put into the ring buffer,
+         *  or the stream fails.
          */
-        inline virtual
-        ~PulseAudioDspSource ( void )                          throw ( Exception )
-        {
-            strip();
-        }
+        pthread_cond_t              cond;
 
         /**
-         *  Assignment operator.
-         *
-         *  @param ds the object to assign to this one.
-         *  @return a reference to this object.
-         *  @exception Exception
+         *  True once the stream or the connection failed.
+         *  Protected by the mutex.
          */
-        inline virtual PulseAudioDspSource &
-        operator= (     const PulseAudioDspSource &     ds )   throw ( Exception )
-        {
-            if ( this != &ds ) {
-                strip();
-                AudioSource::operator=( ds);
-                init( ds.sourceName);
-            }
-            return *this;
-        }
+        bool                        failed;
 
         /**
-         *  Open the PulseAudioDspSource.
-         *
-         *  @return true if opening was successful, false otherwise
-         *  @exception Exception
+         *  The number of bytes dropped as the ring buffer was full,
+         *  since the last report. Only used by the main loop thread.
          */
-        virtual bool
-        open ( void )                                   throw ( Exception );
+        unsigned long long          dropped;
 
         /**
-         *  Check if the PulseAudioDspSource is open.
-         *
-         *  @return true if the PulseAudioDspSource is open, false otherwise.
+         *  The time of the last report of the latency.
          */
-        inline virtual bool
-        isOpen ( void ) const                           throw ()
-        {
-            return s==NULL;
-        }
+        unsigned long long          lastLatencyReport;
 
         /**
-         *  Check if the PulseAudioDspSource can be read from.
+         *  Initialize the object
          *
-         *  @param sec the maximum seconds to block.
-         *  @param usec micro seconds to block after the full seconds.
-         *  @return true if the PulseAudioDspSource is ready to be read from,
-         *          false otherwise.
+         *  @param name the PCM to open.
          *  @exception Exception
          */
-        virtual bool
-        canRead (               unsigned int    sec,
-                                unsigned int    usec )  throw ( Exception );
+        void
+        init (  const char    * name )              throw ( Exception );
 
         /**
-         *  Read from the PulseAudioDspSource.
+         *  De-iitialize the object
          *
-         *  @param buf the buffer to read into.
-         *  @param len the number of bytes to read into buf
-         *  @return the number of bytes read (may be less than len).
          *  @exception Exception
          */
-        virtual unsigned int
-        read (                  void          * buf,
-                                unsigned int    len )   throw ( Exception );
+        void
+        strip ( void )                              throw ( Exception );
 
         /**
-         *  Close the PulseAudioDspSource.
+         *  Wait in the main loop until the connection to the server is
+         *  ready. Called with the main loop locked.
          *
-         *  @exception Exception
+         *  @return true if ready, false if the connection failed.
          */
-        virtual void
-        close ( void )                                  throw ( Exception );
-
-};
-
-/* ================================================= external data structures */
-
-/* ====================================================== function prototypes */
+        bool
+        waitForContext ( void )                     throw ();
 
-#endif  /* PULSEAUDIO_SOURCE_H */
-/*------------------------------------------------------------------------------
-
-   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
-
-   Copyright (c) 2004 
-   LS Informationstechnik (LIKE)
-   University of Erlangen Nuremberg
-   All rights reserved.
-
-   Tyrell DarkIce
-
-   File     : PulseAudioDspSource.h
-   Version  : $Revision$
-   Author   : $Author$
-   Location : $HeadURL$
-   
-   Copyright notice:
-
-    This program is free software; you can redistribute it and/or
-    modify it under the terms of the GNU General Public License  
-    as published by the Free Software Foundation; either version 2
-    of the License, or (at your option) any later version.
-   
-    This program is distributed in the hope that it will be useful,
-    but WITHOUT ANY WARRANTY; without even the implied warranty of 
-    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
-    GNU General Public License for more details.
-   
-    You should have received a copy of the GNU General Public License
-    along with this program; if not, write to the Free Software
-    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
-
-------------------------------------------------------------------------------*/
-#ifndef PULSEAUDIO_SOURCE_H
-#define PULSEAUDIO_SOURCE_H
-
-#ifndef __cplusplus
-#error This is a C++ include file
-#endif
-
-/* ============================================================ include files */
-
-#ifdef HAVE_CONFIG_H
-#include "config.h"
-#endif
-
-#include "Reporter.h"
-#include "AudioSource.h"
-
-#ifdef HAVE_PULSEAUDIO_LIB
-
-#include <pulse/simple.h>
-#include <pulse/error.h>
-#include <pulse/gccmacro.h>
-#else
-#error configure for PULSEAUDIO 
-#endif
-
-/* ================================================================ constants */
-
-/* =================================================================== macros */
+        /**
+         *  Wait in the main loop until the stream is ready.
+         *  Called with the main loop locked.
+         *
+         *  @return true if ready, false if the stream failed.
+         */
+        bool
+        waitForStream ( void )                      throw ();
 
-/* =============================================================== data types */
+        /**
+         *  Take the audio recorded by the stream into the ring buffer.
+         *  Called from the main loop thread.
+         */
+        void
+        takeAudio ( void )                          throw ();
 
-/**
- *  An audio input based on the PULSEAUDIO sound system 
- *
- *  @author  $Author$
- *  @version $Revision$
- */
-class PulseAudioDspSource : public AudioSource, public virtual Reporter
-{
-    private:
+        /**
+         *  Note that the stream or the connection failed, and wake up
+         *  the reader. Called from the main loop thread.
+         */
+        void
+        fail ( void )                               throw ();
 
         /**
-         *  Name of the capture PCM stream.
+         *  Report the latency, if it has not been reported for a while.
          */
-        char *sourceName;
+        void
+        reportLatency ( void )                      throw ();
 
         /**
-         *  Handle for PulseAudio 
+         *  Callback for state changes of the connection to the server.
+         *
+         *  @param c the connection.
+         *  @param userdata the PulseAudioDspSource.
          */
-        pa_simple *s ;
+        static void
+        contextStateCallback (  pa_context    * c,
+                                void          * userdata );
 
         /**
-         * format definitions for pulseaudio
-          */
-        pa_sample_spec ss;
+         *  Callback for state changes of the stream.
+         *
+         *  @param s the stream.
+         *  @param userdata the PulseAudioDspSource.
+         */
+        static void
+        streamStateCallback (   pa_stream     * s,
+                                void          * userdata );
 
-        int error;
+        /**
+         *  Callback for audio recorded by the stream.
+         *
+         *  @param s the stream.
+         *  @param nbytes the number of bytes recorded.
+         *  @param userdata the PulseAudioDspSource.
+         */
+        static void
+        streamReadCallback (    pa_stream     * s,
+                                size_t          nbytes,
+                                void          * userdata );
 
     protected:
 
@@ -350,23 +264,6 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
             throw Exception( __FILE__, __LINE__);
         }
 
-        /**
-         *  Initialize the object
-         *
-         *  @param name the PCM to open.
-         *  @exception Exception
-         */
-        void
-        init (  const char    * name )              throw ( Exception );
-
-        /**
-         *  De-iitialize the object
-         *
-         *  @exception Exception
-         */
-        void
-        strip ( void )                              throw ( Exception );
-
 
     public:
 
@@ -402,6 +299,8 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
                     : AudioSource( ds )
         {
             init( ds.sourceName);
+            fragTime = ds.fragTime;
+            maxTime  = ds.maxTime;
         }
 
         /**
@@ -429,6 +328,8 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
                 strip();
                 AudioSource::operator=( ds);
                 init( ds.sourceName);
+                fragTime = ds.fragTime;
+                maxTime  = ds.maxTime;
             }
             return *this;
         }
@@ -450,7 +351,7 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
         inline virtual bool
         isOpen ( void ) const                           throw ()
         {
-            return s==NULL;
+            return stream != 0;
         }
 
         /**
@@ -486,6 +387,64 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
         virtual void
         close ( void )                                  throw ( Exception );
 
+        /**
+         *  Set the fragment size to ask the server for, which is the
+         *  latency of the source. Takes effect on the next open().
+         *
+         *  @param time the fragment size in microseconds,
+         *         0 for the server default.
+         */
+        inline virtual void
+        setFragTime( unsigned int time ) {
+            fragTime = time;
+        }
+
+        /**
+         *  Returns the fragment size asked for.
+         *
+         *  @return the fragment size in microseconds,
+         *          0 for the server default.
+         */
+        inline virtual unsigned int
+        getFragTime( void ) const
+        {
+            return fragTime;
+        }
+
+        /**
+         *  Set the maximum length of the server buffer to ask for.
+         *  Takes effect on the next open().
+         *
+         *  @param time the maximum length in microseconds,
+         *         0 for the server default.
+         */
+        inline virtual void
+        setMaxTime( unsigned int time ) {
+            maxTime = time;
+        }
+
+        /**
+         *  Returns the maximum length of the server buffer asked for.
+         *
+         *  @return the maximum length in microseconds,
+         *          0 for the server default.
+         */
+        inline virtual unsigned int
+        getMaxTime( void ) const
+        {
+            return maxTime;
+        }
+
+        /**
+         *  Returns the measured latency of the source: the time the
+         *  audio spends on the server and in the ring buffer, before
+         *  it is read.
+         *
+         *  @return the latency in microseconds, or 0 if not known.
+         */
+        unsigned long long
+        getLatency ( void )                             throw ();
+
 };
 
 /* ================================================= external data structures */
@@ -0,0 +1,248 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : RelaySink.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef RELAY_SINK_H
+#define RELAY_SINK_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Ref.h"
+#include "Sink.h"
+#include "RelaySource.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  Take the place of the encoder of an output when relaying an encoded
+ *  stream. The frames read from the RelaySource are passed on as they
+ *  are, marking the end of each write as a frame boundary.
+ *  For an Ogg stream, the header pages are sent again each time the
+ *  output is opened, as a server needs them to start a stream.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class RelaySink : public Sink
+{
+    private:
+
+        /**
+         *  The source relayed.
+         */
+        Ref<RelaySource>        source;
+
+        /**
+         *  The sink to pass the stream on to.
+         */
+        Ref<Sink>               sink;
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        RelaySink ( void )                          throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param source the source relayed.
+         *  @param sink the sink to pass the stream on to.
+         *  @exception Exception
+         */
+        inline
+        RelaySink (     RelaySource   * source,
+                        Sink          * sink )      throw ( Exception )
+        {
+            this->source = source;
+            this->sink   = sink;
+        }
+
+        /**
+         *  Copy constructor.
+         *
+         *  @param rs the RelaySink to copy.
+         *  @exception Exception
+         */
+        inline
+        RelaySink (     const RelaySink   & rs )    throw ( Exception )
+                    : Sink( rs )
+        {
+            source = rs.source;
+            sink   = rs.sink;
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~RelaySink ( void )                         throw ( Exception )
+        {
+        }
+
+        /**
+         *  Open the underlying sink, and start it with the Ogg header
+         *  pages of the stream, if any.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        open ( void )                               throw ( Exception )
+        {
+            unsigned char     * header;
+            unsigned int        len;
+
+            if ( !sink->open() ) {
+                return false;
+            }
+
+            if ( (header = source->getHeader( len)) ) {
+                try {
+                    sink->write( header, len);
+                    sink->markFrameEnd();
+                } catch ( Exception   & e ) {
+                    delete[] header;
+                    throw;
+                }
+                delete[] header;
+            }
+
+            return true;
+        }
+
+        /**
+         *  Check if the RelaySink is open.
+         *
+         *  @return true if the underlying sink is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                       throw ()
+        {
+            return sink->isOpen();
+        }
+
+        /**
+         *  Check if the RelaySink is ready to accept data.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the underlying sink is ready, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canWrite (     unsigned int    sec,
+                       unsigned int    usec )       throw ( Exception )
+        {
+            return sink->canWrite( sec, usec);
+        }
+
+        /**
+         *  Pass whole frames on to the underlying sink.
+         *
+         *  @param buf the frames to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written.
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        write (        const void    * buf,
+                       unsigned int    len )        throw ( Exception )
+        {
+            unsigned int    ret = sink->write( buf, len);
+
+            sink->markFrameEnd();
+            return ret;
+        }
+
+        /**
+         *  Flush the underlying sink.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        flush ( void )                              throw ( Exception )
+        {
+            sink->flush();
+        }
+
+        /**
+         *  Cut the underlying sink.
+         */
+        inline virtual void
+        cut ( void )                                throw ()
+        {
+            sink->cut();
+        }
+
+        /**
+         *  Close the underlying sink.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        close ( void )                              throw ( Exception )
+        {
+            sink->close();
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* RELAY_SINK_H */
+
@@ -0,0 +1,788 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : RelaySource.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_STRINGS_H
+#include <strings.h>
+#else
+#error need strings.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+
+#include "Util.h"
+#include "Exception.h"
+#include "RelaySource.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The size of the fixed part of an Ogg page header
+ *----------------------------------------------------------------------------*/
+#define OGG_HEADER_SIZE     27
+
+/*------------------------------------------------------------------------------
+ *  The Ogg page header flag of the first page of a logical stream
+ *----------------------------------------------------------------------------*/
+#define OGG_BOS             0x02
+
+/*------------------------------------------------------------------------------
+ *  The bytes needed to tell the length of an MPEG audio and an ADTS frame
+ *----------------------------------------------------------------------------*/
+#define MPA_HEADER_SIZE     4
+#define ADTS_HEADER_SIZE    7
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+RelaySource :: init (   const char        * location )  throw ( Exception )
+{
+    this->location = Util::strDup( location);
+
+    outputFormat = 0;
+    giveUpTime   = 0;
+    request   = 0;
+    fd        = -1;
+    opened    = false;
+    input     = new unsigned char[inputSize];
+    inputLen  = 0;
+    header    = new unsigned char[maxHeaderSize];
+    headerLen = 0;
+
+    pthread_mutex_init( &mutex, 0);
+
+    if ( Util::strEq( location, "http://", 7) ) {
+        const char    * authority = location + 7;
+        const char    * path      = strchr( authority, '/');
+        unsigned int    len       = path ? path - authority
+                                         : Util::strLen( authority);
+        char          * host      = new char[len + 1];
+        char          * colon;
+        unsigned int    port      = 80;
+
+        memcpy( host, authority, len);
+        host[len] = 0;
+
+        // the port follows the last colon, but not one in [IPv6]
+        if ( (colon = strrchr( host, ':')) && !strchr( colon, ']') ) {
+            port   = Util::strToL( colon + 1);
+            *colon = 0;
+        }
+        if ( host[0] == '[' && (colon = strchr( host, ']')) ) {
+            *colon = 0;
+            memmove( host, host + 1, colon - host);
+        }
+
+        len     = Util::strLen( path ? path : "/") + len + 256;
+        request = new char[len];
+        snprintf( request, len,
+                  "GET %s HTTP/1.0\r\n"
+                  "Host: %.*s\r\n"
+                  "User-Agent: DarkIce/" VERSION
+                                " (http://code.google.com/p/darkice/)\r\n"
+                  "Accept: */*\r\n"
+                  "\r\n",
+                  path ? path : "/",
+                  (int) (path ? path - authority : Util::strLen( authority)),
+                  authority);
+
+        try {
+            socket = new TcpSocket( host, port);
+        } catch ( Exception   & e ) {
+            delete[] host;
+            strip();
+            throw;
+        }
+        delete[] host;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+RelaySource :: strip ( void )                           throw ( Exception )
+{
+    close();
+
+    socket = 0;
+    pthread_mutex_destroy( &mutex);
+
+    delete[] header;
+    delete[] input;
+    delete[] request;
+    delete[] location;
+    delete[] outputFormat;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the source
+ *----------------------------------------------------------------------------*/
+bool
+RelaySource :: open ( void )                            throw ( Exception )
+{
+    if ( isOpen() ) {
+        return false;
+    }
+
+    inputLen    = 0;
+    format      = unknown;
+    eof         = false;
+    skipped     = 0;
+    streamTime  = 0.0;
+    granule     = 0;
+    granuleRate = getSampleRate();
+
+    pthread_mutex_lock( &mutex);
+    headerLen   = 0;
+    pthread_mutex_unlock( &mutex);
+
+    if ( request ) {
+        if ( !connect() ) {
+            return false;
+        }
+    } else if ( (fd = ::open( location, O_RDONLY)) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "can't open relay file",
+                         location, errno);
+    }
+
+    startTime = Util::getMonotonicTime();
+    opened    = true;
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Connect to the HTTP server, and read the response header
+ *----------------------------------------------------------------------------*/
+bool
+RelaySource :: connect ( void )                         throw ()
+{
+    unsigned int    len    = Util::strLen( request);
+    unsigned int    status = 0;
+    unsigned int    ret;
+    char          * body   = 0;
+
+    inputLen = 0;
+
+    try {
+        socket->open();
+
+        if ( socket->write( request, len) != len ) {
+            throw Exception( __FILE__, __LINE__, "can't send request");
+        }
+
+        // the response header ends with an empty line
+        while ( !body ) {
+            if ( inputLen == inputSize - 1
+              || !socket->canRead( stallTimeout, 0) ) {
+                throw Exception( __FILE__, __LINE__, "no response");
+            }
+            ret = socket->read( input + inputLen, inputSize - 1 - inputLen);
+            if ( ret == 0 || ret > inputSize - 1 - inputLen ) {
+                throw Exception( __FILE__, __LINE__, "connection closed");
+            }
+            inputLen       += ret;
+            input[inputLen] = 0;
+
+            if ( (body = strstr( (char *) input, "\r\n\r\n")) ) {
+                body += 4;
+            } else if ( (body = strstr( (char *) input, "\n\n")) ) {
+                body += 2;
+            }
+        }
+
+        // a ShoutCast server answers with "ICY 200 OK"
+        if ( Util::strEq( (char *) input, "ICY 200", 7) ) {
+            status = 200;
+        } else {
+            status = Util::parseHttpStatus( (char *) input, inputLen);
+        }
+        if ( status != 200 ) {
+            throw Exception( __FILE__, __LINE__, "HTTP status", status);
+        }
+        if ( !isOutputContentType( (char *) input, body) ) {
+            throw Exception( __FILE__, __LINE__,
+                             "content type not that of the outputs: ",
+                             outputFormat);
+        }
+    } catch ( Exception   & e ) {
+        reportEvent( 2, "can't get relayed stream", location, e.getDescription());
+        socket->close();
+        inputLen = 0;
+        return false;
+    }
+
+    // keep the start of the stream, if it came with the header
+    inputLen -= body - (char *) input;
+    memmove( input, body, inputLen);
+
+    reportEvent( 3, "relaying stream", location);
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read more data
+ *----------------------------------------------------------------------------*/
+bool
+RelaySource :: fill ( void )                            throw ( Exception )
+{
+    unsigned int        room = inputSize - inputLen;
+    unsigned int        ret;
+    unsigned long long  lost;
+    long                wait;
+    int                 r;
+
+    if ( !request ) {
+        while ( (r = ::read( fd, input + inputLen, room)) == -1
+             && errno == EINTR ) {
+        }
+        if ( r == -1 ) {
+            throw Exception( __FILE__, __LINE__, "relay file read error",
+                             errno);
+        }
+        inputLen += r;
+        return r != 0;
+    }
+
+    try {
+        if ( socket->canRead( stallTimeout, 0) ) {
+            ret = socket->read( input + inputLen, room);
+            if ( ret && ret <= room ) {
+                inputLen += ret;
+                return true;
+            }
+        }
+    } catch ( Exception   & e ) {
+    }
+
+    // the connection is lost, get the stream again, and find the frames
+    // from scratch, for as long as it takes, unless asked to end the
+    // stream after a while
+    reportEvent( 2, "relayed stream lost, reconnecting", location);
+    socket->close();
+    lost = Util::getMonotonicTime();
+    for ( wait = 1L; !connect(); wait = wait * 2 < maxReconnectWait
+                                        ? wait * 2 : maxReconnectWait ) {
+        if ( giveUpTime
+          && Util::getMonotonicTime() - lost >= giveUpTime * 1000000ULL ) {
+            reportEvent( 1, "relayed stream lost, giving up", location);
+            return false;
+        }
+        Util::sleep( wait, 0L);
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Look for a frame
+ *----------------------------------------------------------------------------*/
+int
+RelaySource :: frameLength (    const unsigned char   * p,
+                                unsigned int            len,
+                                Format                  format,
+                                double                * duration ) const
+                                                                    throw ()
+{
+    unsigned int    frameLen = 0;
+    unsigned int    samples;
+    unsigned int    rate;
+
+    switch ( format ) {
+        case ogg:
+            if ( len < OGG_HEADER_SIZE ) {
+                return memcmp( p, "OggS", len < 4 ? len : 4) ? -1 : 0;
+            }
+            // capture pattern, version 0, and no unknown flags
+            if ( memcmp( p, "OggS", 4) || p[4] != 0 || (p[5] & ~0x07) ) {
+                return -1;
+            }
+            frameLen = OGG_HEADER_SIZE + p[26];
+            if ( len < frameLen ) {
+                return 0;
+            }
+            for ( unsigned int i = 0; i < p[26]; ++i ) {
+                frameLen += p[OGG_HEADER_SIZE + i];
+            }
+            break;
+
+        case mpa:
+            if ( len < MPA_HEADER_SIZE ) {
+                return p[0] == 0xff ? 0 : -1;
+            }
+            if ( !(frameLen = Util::mpegFrameLength( p, &samples, &rate)) ) {
+                return -1;
+            }
+            *duration = samples * 1000000.0 / rate;
+            break;
+
+        case adts:
+            if ( len < ADTS_HEADER_SIZE ) {
+                return p[0] == 0xff ? 0 : -1;
+            }
+            if ( !(frameLen = Util::adtsFrameLength( p, &samples, &rate)) ) {
+                return -1;
+            }
+            *duration = samples * 1000000.0 / rate;
+            break;
+
+        default:
+            return -1;
+    }
+
+    return len < frameLen ? 0 : frameLen;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set the format of the outputs
+ *----------------------------------------------------------------------------*/
+void
+RelaySource :: setOutputFormat (    const char    * format )
+                                                        throw ( Exception )
+{
+    if ( !format ) {
+        return;
+    }
+    if ( outputFormat ) {
+        if ( !Util::strEq( outputFormat, format) ) {
+            throw Exception( __FILE__, __LINE__,
+                             "the outputs of a relayed stream differ "
+                             "in format: ", format);
+        }
+        return;
+    }
+
+    outputFormat = Util::strDup( format);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the format of the frames of the outputs
+ *----------------------------------------------------------------------------*/
+RelaySource :: Format
+RelaySource :: getOutputFrameFormat ( void ) const      throw ()
+{
+    if ( !outputFormat ) {
+        return unknown;
+    }
+    if ( Util::strEq( outputFormat, "mp3")
+      || Util::strEq( outputFormat, "mp2") ) {
+        return mpa;
+    }
+    if ( Util::strEq( outputFormat, "aac")
+      || Util::strEq( outputFormat, "aacp") ) {
+        return adts;
+    }
+    if ( Util::strEq( outputFormat, "vorbis")
+      || Util::strEq( outputFormat, "opus") ) {
+        return ogg;
+    }
+    return unknown;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Tell if the content type fits the outputs
+ *----------------------------------------------------------------------------*/
+bool
+RelaySource :: isOutputContentType (    const char    * header,
+                                        const char    * end ) const
+                                                                throw ()
+{
+    const char    * p      = header;
+    Format          wanted = getOutputFrameFormat();
+    Format          type;
+
+    if ( wanted == unknown ) {
+        return true;
+    }
+
+    while ( (p = strchr( p, '\n')) && ++p < end ) {
+        if ( strncasecmp( p, "Content-Type:", 13) == 0 ) {
+            break;
+        }
+    }
+    if ( !p || p >= end ) {
+        // not told, the frames tell
+        return true;
+    }
+
+    for ( p += 13; *p == ' ' || *p == '\t'; ++p ) {
+    }
+    if ( strncasecmp( p, "audio/mpeg", 10) == 0 ) {
+        type = mpa;
+    } else if ( strncasecmp( p, "audio/aac", 9) == 0
+             || strncasecmp( p, "audio/x-aac", 11) == 0 ) {
+        type = adts;
+    } else if ( strncasecmp( p, "application/ogg", 15) == 0
+             || strncasecmp( p, "audio/ogg", 9) == 0 ) {
+        type = ogg;
+    } else {
+        return true;
+    }
+
+    return type == wanted;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Tell if a frame fits the outputs
+ *----------------------------------------------------------------------------*/
+bool
+RelaySource :: isOutputFormat ( const unsigned char   * p,
+                                unsigned int            len,
+                                Format                  format ) const
+                                                                throw ()
+{
+    const unsigned char   * payload;
+    unsigned int            payloadLen;
+
+    if ( !outputFormat ) {
+        return true;
+    }
+    if ( format != getOutputFrameFormat() ) {
+        return false;
+    }
+
+    switch ( format ) {
+        case mpa:
+            // the layer bits are 01 for layer III, 10 for layer II
+            return ((p[1] >> 1) & 0x03)
+                        == (Util::strEq( outputFormat, "mp3") ? 1 : 2);
+
+        case ogg:
+            // only the first page of a stream tells the codec
+            if ( !(p[5] & OGG_BOS) ) {
+                return true;
+            }
+            payload    = p + OGG_HEADER_SIZE + p[26];
+            payloadLen = len - OGG_HEADER_SIZE - p[26];
+            if ( Util::strEq( outputFormat, "opus") ) {
+                return payloadLen >= 8 && memcmp( payload, "OpusHead", 8) == 0;
+            }
+            return payloadLen >= 7 && memcmp( payload, "\x01vorbis", 7) == 0;
+
+        default:
+            return true;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Note an Ogg page passed on
+ *----------------------------------------------------------------------------*/
+double
+RelaySource :: oggPage (    const unsigned char   * p,
+                            unsigned int            len )   throw ()
+{
+    const unsigned char   * payload    = p + OGG_HEADER_SIZE + p[26];
+    unsigned int            payloadLen = len - OGG_HEADER_SIZE - p[26];
+    unsigned long long      position   = 0;
+    double                  duration   = 0.0;
+
+    for ( unsigned int i = 13; i >= 6; --i ) {
+        position = (position << 8) | p[i];
+    }
+
+    // a new stream starts, with new headers, and the granule positions
+    // counting at its own rate
+    if ( p[5] & OGG_BOS ) {
+        pthread_mutex_lock( &mutex);
+        headerLen = 0;
+        pthread_mutex_unlock( &mutex);
+
+        granule     = 0;
+        granuleRate = getSampleRate();
+        if ( payloadLen >= 16 && memcmp( payload, "\x01vorbis", 7) == 0 ) {
+            granuleRate = payload[12] | (payload[13] << 8)
+                        | (payload[14] << 16) | (payload[15] << 24);
+        } else if ( payloadLen >= 8 && memcmp( payload, "OpusHead", 8) == 0 ) {
+            granuleRate = 48000;
+        }
+    }
+
+    // the header pages have a granule position of 0
+    if ( position == 0 ) {
+        pthread_mutex_lock( &mutex);
+        if ( headerLen + len <= maxHeaderSize ) {
+            memcpy( header + headerLen, p, len);
+            headerLen += len;
+        }
+        pthread_mutex_unlock( &mutex);
+        return 0.0;
+    }
+
+    // no packet ends on the page
+    if ( position == ~0ULL ) {
+        return 0.0;
+    }
+
+    if ( position > granule && granuleRate ) {
+        duration = (position - granule) * 1000000.0 / granuleRate;
+    }
+    granule = position;
+
+    return duration;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read whole frames
+ *----------------------------------------------------------------------------*/
+unsigned int
+RelaySource :: read (   void          * buf,
+                        unsigned int    len )           throw ( Exception )
+{
+    static const Format     formats[] = { ogg, mpa, adts };
+    unsigned char         * out       = (unsigned char *) buf;
+    unsigned int            outLen    = 0;
+    unsigned int            pos       = 0;
+    double                  time      = 0.0;
+    unsigned long long      now;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    while ( outLen == 0 ) {
+        while ( pos < inputLen ) {
+            Format          f        = format;
+            double          duration = 0.0;
+            unsigned int    rest     = inputLen - pos;
+            int             n        = -1;
+
+            if ( format == unknown ) {
+                for ( unsigned int i = 0; i < 3 && n == -1; ++i ) {
+                    f = formats[i];
+                    n = frameLength( input + pos, rest, f, &duration);
+                }
+            } else {
+                n = frameLength( input + pos, rest, f, &duration);
+            }
+
+            // take a frame header only if the next frame starts where it
+            // says, as the sync words of MPEG audio and ADTS are easily
+            // found in other data
+            if ( n > 0 && f != ogg ) {
+                unsigned int    headerSize = f == mpa ? MPA_HEADER_SIZE
+                                                      : ADTS_HEADER_SIZE;
+                double          d;
+
+                if ( rest - n < headerSize ) {
+                    n = eof ? n : 0;
+                } else if ( frameLength( input + pos + n, headerSize, f, &d)
+                                                                    == -1 ) {
+                    n = -1;
+                }
+            }
+
+            if ( n == 0 ) {
+                if ( !eof ) {
+                    break;
+                }
+                // a frame cut short by the end of the file
+                n = -1;
+            }
+
+            if ( n == -1 ) {
+                ++pos;
+                ++skipped;
+                continue;
+            }
+
+            // a stream in an other format than the outputs send would go
+            // out under the wrong type
+            if ( (f != format || (f == ogg && (input[pos + 5] & OGG_BOS)))
+              && !isOutputFormat( input + pos, n, f) ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "relayed stream not in the format of "
+                                 "the outputs: ", outputFormat);
+            }
+
+            if ( f != format ) {
+                format = f;
+                reportEvent( 3, "relayed stream format",
+                             f == ogg ? "Ogg" : f == mpa ? "MPEG audio"
+                                                         : "AAC in ADTS");
+            }
+            if ( skipped ) {
+                reportEvent( 3, "bytes skipped to find a frame", skipped);
+                skipped = 0;
+            }
+
+            if ( outLen + n > len ) {
+                if ( outLen ) {
+                    break;
+                }
+                reportEvent( 2, "relayed frame too large, dropped", n);
+                pos += n;
+                continue;
+            }
+
+            memcpy( out + outLen, input + pos, n);
+            if ( f == ogg ) {
+                duration = oggPage( input + pos, n);
+            }
+            outLen += n;
+            pos    += n;
+            time   += duration;
+
+            // a file is passed on a frame at a time, to pace it
+            if ( !request && time > 0.0 ) {
+                break;
+            }
+        }
+
+        inputLen -= pos;
+        memmove( input, input + pos, inputLen);
+        pos = 0;
+
+        if ( outLen == 0 ) {
+            if ( eof ) {
+                inputLen = 0;
+                return 0;
+            }
+            eof = !fill();
+        }
+    }
+
+    // a file is read at the pace of playing it, a frame is passed on
+    // when its time has come
+    if ( !request ) {
+        now = Util::getMonotonicTime();
+        if ( startTime + streamTime > now ) {
+            unsigned long long  wait = startTime + streamTime - now;
+
+            Util::sleep( wait / 1000000, (wait % 1000000) * 1000);
+        }
+        streamTime += time;
+    }
+
+    return outLen;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get a copy of the Ogg header pages
+ *----------------------------------------------------------------------------*/
+unsigned char *
+RelaySource :: getHeader (  unsigned int  & len )       throw ()
+{
+    unsigned char     * copy = 0;
+
+    pthread_mutex_lock( &mutex);
+    len = headerLen;
+    if ( len ) {
+        copy = new unsigned char[len];
+        memcpy( copy, header, len);
+    }
+    pthread_mutex_unlock( &mutex);
+
+    return copy;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the source
+ *----------------------------------------------------------------------------*/
+void
+RelaySource :: close ( void )                           throw ( Exception )
+{
+    if ( !isOpen() ) {
+        return;
+    }
+
+    if ( request ) {
+        socket->close();
+    } else {
+        ::close( fd);
+        fd = -1;
+    }
+
+    opened = false;
+}
+
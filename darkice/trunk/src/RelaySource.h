@@ -0,0 +1,500 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : RelaySource.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef RELAY_SOURCE_H
+#define RELAY_SOURCE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include "Ref.h"
+#include "Reporter.h"
+#include "TcpSocket.h"
+#include "AudioSource.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  An input reading an already encoded stream, to relay it without
+ *  re-encoding. The stream is pulled from an HTTP (Icecast or
+ *  ShoutCast) server, or read from a local file at its own pace.
+ *
+ *  The data is not decoded, only the frame boundaries are looked for:
+ *  MPEG audio frames, AAC frames in ADTS, or Ogg pages. Each read()
+ *  returns whole frames only, thus the outputs can cut the stream
+ *  cleanly, and anything that is not a frame is skipped until the
+ *  stream is in sync again. The sample rate and channels of the
+ *  AudioSource are only nominal, to size the buffers with.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class RelaySource : public AudioSource, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The largest frame, that of an Ogg page. Reading with a
+         *  buffer this large always returns at least one frame.
+         */
+        static const unsigned int   maxFrameSize = 65307;
+
+
+    private:
+
+        /**
+         *  The formats of the encoded stream.
+         */
+        enum Format { unknown, mpa, adts, ogg };
+
+        /**
+         *  The size of the buffer holding the data read, but not yet
+         *  passed on as whole frames.
+         */
+        static const unsigned int   inputSize = 2 * maxFrameSize;
+
+        /**
+         *  The largest set of Ogg header pages kept.
+         */
+        static const unsigned int   maxHeaderSize = 65536;
+
+        /**
+         *  The seconds without data after which the HTTP connection
+         *  is given up, and opened again.
+         */
+        static const unsigned int   stallTimeout = 10;
+
+        /**
+         *  The longest wait between two tries to open a lost HTTP
+         *  connection again, in seconds. The wait starts at 1 second,
+         *  and doubles with each try.
+         */
+        static const unsigned int   maxReconnectWait = 30;
+
+        /**
+         *  The seconds a lost HTTP connection is tried to be opened
+         *  again before the stream is given up and ends, or 0 to
+         *  never give up.
+         */
+        unsigned int            giveUpTime;
+
+        /**
+         *  The HTTP URL or the file name to read from.
+         */
+        char                  * location;
+
+        /**
+         *  The format the outputs send the stream as, like "mp3",
+         *  or 0 if not known.
+         */
+        char                  * outputFormat;
+
+        /**
+         *  The HTTP request to send, or 0 when reading from a file.
+         */
+        char                  * request;
+
+        /**
+         *  The connection to the HTTP server.
+         */
+        Ref<TcpSocket>          socket;
+
+        /**
+         *  The file read from, or -1.
+         */
+        int                     fd;
+
+        /**
+         *  Flag to show if the RelaySource is open.
+         */
+        bool                    opened;
+
+        /**
+         *  The format of the stream, once found.
+         */
+        Format                  format;
+
+        /**
+         *  True if the file was read to its end.
+         */
+        bool                    eof;
+
+        /**
+         *  The bytes skipped while looking for a frame.
+         */
+        unsigned long           skipped;
+
+        /**
+         *  The data read, but not yet passed on.
+         */
+        unsigned char         * input;
+
+        /**
+         *  The number of bytes in input.
+         */
+        unsigned int            inputLen;
+
+        /**
+         *  The monotonic time the file started to be read at, in
+         *  microseconds.
+         */
+        unsigned long long      startTime;
+
+        /**
+         *  The duration of the frames passed on, in microseconds.
+         */
+        double                  streamTime;
+
+        /**
+         *  The granule position of the last Ogg page with one.
+         */
+        unsigned long long      granule;
+
+        /**
+         *  The rate of the Ogg granule positions.
+         */
+        unsigned int            granuleRate;
+
+        /**
+         *  The Ogg header pages of the stream.
+         */
+        unsigned char         * header;
+
+        /**
+         *  The number of bytes in header.
+         */
+        unsigned int            headerLen;
+
+        /**
+         *  The mutex guarding the header pages, as the outputs copy
+         *  them from their own threads.
+         */
+        pthread_mutex_t         mutex;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param location the HTTP URL or file name to read from.
+         *  @exception Exception
+         */
+        void
+        init (  const char        * location )      throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Connect to the HTTP server, and read the response header.
+         *
+         *  @return true if the server sends the stream.
+         */
+        bool
+        connect ( void )                            throw ();
+
+        /**
+         *  Read more data into input. Reconnects to the HTTP server
+         *  if the connection is lost.
+         *
+         *  @return false at the end of the file, or once the HTTP
+         *          connection could not be opened again.
+         *  @exception Exception
+         */
+        bool
+        fill ( void )                               throw ( Exception );
+
+        /**
+         *  Look for a frame at the start of some data.
+         *
+         *  @param p the data.
+         *  @param len the number of bytes in p.
+         *  @param format the format of the frame.
+         *  @param duration set to the duration of the frame, in
+         *         microseconds, for the MPEG and ADTS formats.
+         *  @return the length of the frame, 0 if more data is needed
+         *          to tell, -1 if p does not start with a frame.
+         */
+        int
+        frameLength (   const unsigned char   * p,
+                        unsigned int            len,
+                        Format                  format,
+                        double                * duration ) const throw ();
+
+        /**
+         *  Get the format of the frames the outputs send.
+         *
+         *  @return the format, unknown if any.
+         */
+        Format
+        getOutputFrameFormat ( void ) const         throw ();
+
+        /**
+         *  Tell if the Content-Type in an HTTP response header fits
+         *  the format of the outputs.
+         *
+         *  @param header the response header.
+         *  @param end the end of the response header.
+         *  @return false if the content type is known, and not that of
+         *          the format of the outputs, true otherwise.
+         */
+        bool
+        isOutputContentType (   const char    * header,
+                                const char    * end ) const throw ();
+
+        /**
+         *  Tell if a frame is of the format the outputs send: the
+         *  layer of MPEG audio, and the codec of the first page of an
+         *  Ogg stream are looked at too.
+         *
+         *  @param p the frame.
+         *  @param len the length of the frame.
+         *  @param format the format of the frame.
+         *  @return true if the frame fits the outputs.
+         */
+        bool
+        isOutputFormat (    const unsigned char   * p,
+                            unsigned int            len,
+                            Format                  format ) const
+                                                                throw ();
+
+        /**
+         *  Note an Ogg page passed on: keep the header pages, and
+         *  find its duration from the granule positions.
+         *
+         *  @param p the page.
+         *  @param len the length of the page.
+         *  @return the duration of the page, in microseconds.
+         */
+        double
+        oggPage (       const unsigned char   * p,
+                        unsigned int            len )   throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        RelaySource ( void )                        throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  connection can not be shared.
+         *
+         *  @param rs the object to copy.
+         *  @exception Exception
+         */
+        inline
+        RelaySource (   const RelaySource     & rs )    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param location an http:// URL to pull the stream from,
+         *         or the name of a file to read it from.
+         *  @param sampleRate the nominal sample rate of the stream.
+         *  @param bitsPerSample the nominal bits per sample.
+         *  @param channel the nominal number of channels.
+         *  @exception Exception
+         */
+        inline
+        RelaySource (   const char    * location,
+                        int             sampleRate    = 44100,
+                        int             bitsPerSample = 16,
+                        int             channel       = 2 )
+                                                        throw ( Exception )
+                    : AudioSource( sampleRate, bitsPerSample, channel)
+        {
+            init( location);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~RelaySource ( void )                           throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Open the RelaySource: connect to the HTTP server, or open
+         *  the file.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                                   throw ( Exception );
+
+        /**
+         *  Check if the RelaySource is open.
+         *
+         *  @return true if the RelaySource is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Check if the RelaySource can be read from. As a lost HTTP
+         *  connection is opened again by read(), this is true while
+         *  the RelaySource is open, until the end of the file, or until
+         *  the HTTP connection is given up.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the RelaySource can be read, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canRead (               unsigned int    sec,
+                                unsigned int    usec )  throw ( Exception )
+        {
+            return isOpen() && (!eof || inputLen);
+        }
+
+        /**
+         *  Set the format the outputs send the stream as. A stream in
+         *  an other format is not relayed. All outputs have to send
+         *  the same format.
+         *
+         *  @param format the format, like "mp3", "mp2", "vorbis",
+         *         "opus", "aac" or "aacp".
+         *  @exception Exception if an other format was set before.
+         */
+        void
+        setOutputFormat (       const char    * format )
+                                                        throw ( Exception );
+
+        /**
+         *  Set how long a lost HTTP connection is tried to be opened
+         *  again, before the stream ends.
+         *
+         *  @param seconds the time to try for, or 0 to never give up.
+         */
+        inline void
+        setGiveUpTime (         unsigned int    seconds )   throw ()
+        {
+            giveUpTime = seconds;
+        }
+
+        /**
+         *  Get how long a lost HTTP connection is tried to be opened
+         *  again, before the stream ends.
+         *
+         *  @return the time to try for, in seconds, or 0 for ever.
+         */
+        inline unsigned int
+        getGiveUpTime ( void ) const                    throw ()
+        {
+            return giveUpTime;
+        }
+
+        /**
+         *  Read whole frames from the RelaySource. Blocks until at
+         *  least one frame is in, or when reading a file, until the
+         *  time to play it has come.
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the size of buf, maxFrameSize is always enough
+         *         for a frame.
+         *  @return the number of bytes read, 0 at the end of the file.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        read (                  void          * buf,
+                                unsigned int    len )   throw ( Exception );
+
+        /**
+         *  Get a copy of the Ogg header pages of the stream, to start
+         *  a new connection with.
+         *
+         *  @param len set to the length of the header pages.
+         *  @return the header pages, to be deleted with delete[],
+         *          or 0 if there are none.
+         */
+        unsigned char *
+        getHeader (             unsigned int  & len )   throw ();
+
+        /**
+         *  Close the RelaySource.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                                  throw ( Exception );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* RELAY_SOURCE_H */
+
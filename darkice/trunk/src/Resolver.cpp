@@ -0,0 +1,389 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : Resolver.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#else
+#error need time.h
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#else
+#error need netinet/in.h
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#else
+#error need netdb.h
+#endif
+
+
+#include "Util.h"
+#include "Exception.h"
+#include "Resolver.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+Resolver :: init (  unsigned int    cacheTime )         throw ( Exception )
+{
+    pthread_condattr_t      attr;
+    int                     ret;
+
+    this->cacheTime = cacheTime;
+    this->running   = true;
+
+    pthread_mutex_init( &mutex, 0);
+    pthread_cond_init( &condRequest, 0);
+    // the results are waited for with a timeout on the monotonic clock
+    pthread_condattr_init( &attr);
+    pthread_condattr_setclock( &attr, CLOCK_MONOTONIC);
+    pthread_cond_init( &condResult, &attr);
+    pthread_condattr_destroy( &attr);
+
+    if ( (ret = pthread_create( &thread, 0, threadFunction, this)) ) {
+        pthread_cond_destroy( &condResult);
+        pthread_cond_destroy( &condRequest);
+        pthread_mutex_destroy( &mutex);
+        throw Exception( __FILE__, __LINE__, "pthread_create error", ret);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+Resolver :: strip ( void )                              throw ( Exception )
+{
+    pthread_mutex_lock( &mutex);
+    running = false;
+    pthread_cond_broadcast( &condRequest);
+    pthread_mutex_unlock( &mutex);
+
+    pthread_join( thread, 0);
+
+    pthread_cond_destroy( &condResult);
+    pthread_cond_destroy( &condRequest);
+    pthread_mutex_destroy( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Copy addresses, setting the port
+ *----------------------------------------------------------------------------*/
+unsigned int
+Resolver :: copyAddresses ( const Address     * from,
+                            unsigned int        noFrom,
+                            unsigned short      port,
+                            Address           * to,
+                            unsigned int        maxTo )     throw ()
+{
+    unsigned int    i;
+
+    for ( i = 0; i < noFrom && i < maxTo; ++i ) {
+        to[i] = from[i];
+
+        switch ( to[i].addr.ss_family ) {
+            case AF_INET:
+                ((struct sockaddr_in *) &to[i].addr)->sin_port = htons( port);
+                break;
+
+            case AF_INET6:
+                ((struct sockaddr_in6 *) &to[i].addr)->sin6_port = htons(port);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return i;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Look up a host name, without the cache
+ *----------------------------------------------------------------------------*/
+unsigned int
+Resolver :: lookup (    const char        * host,
+                        unsigned short      port,
+                        Address           * addresses,
+                        unsigned int        maxAddresses )  throw ()
+{
+#ifdef HAVE_GETADDRINFO
+    struct addrinfo     hints;
+    struct addrinfo   * result;
+    struct addrinfo   * ai;
+    Address             first[Resolver::maxAddresses];
+    Address             other[Resolver::maxAddresses];
+    unsigned int        noFirst = 0;
+    unsigned int        noOther = 0;
+    unsigned int        n;
+    unsigned int        i;
+    unsigned int        j;
+    int                 family  = AF_UNSPEC;
+    int                 ret;
+
+    memset( &hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_ADDRCONFIG;
+
+    if ( (ret = getaddrinfo( host, 0, &hints, &result)) ) {
+        reportEvent( 3, "can't resolve host", host, gai_strerror( ret));
+        return 0;
+    }
+
+    // split the addresses by family, keeping the order within a family
+    for ( ai = result; ai; ai = ai->ai_next ) {
+        Address   * addr;
+
+        if ( ai->ai_addrlen > sizeof(struct sockaddr_storage) ) {
+            continue;
+        }
+        if ( family == AF_UNSPEC ) {
+            family = ai->ai_family;
+        }
+        if ( ai->ai_family == family ) {
+            if ( noFirst == Resolver::maxAddresses ) {
+                continue;
+            }
+            addr = &first[noFirst++];
+        } else {
+            if ( noOther == Resolver::maxAddresses ) {
+                continue;
+            }
+            addr = &other[noOther++];
+        }
+        memset( &addr->addr, 0, sizeof(addr->addr));
+        memcpy( &addr->addr, ai->ai_addr, ai->ai_addrlen);
+        addr->len = ai->ai_addrlen;
+    }
+    freeaddrinfo( result);
+
+    // and interleave them, starting with the preferred family
+    for ( n = 0, i = 0, j = 0;
+          n < maxAddresses && (i < noFirst || j < noOther); ) {
+        if ( i < noFirst ) {
+            n += copyAddresses( &first[i++], 1, port, &addresses[n], 1);
+        }
+        if ( j < noOther && n < maxAddresses ) {
+            n += copyAddresses( &other[j++], 1, port, &addresses[n], 1);
+        }
+    }
+
+    return n;
+#else
+    struct hostent        * pHostEntry;
+    struct sockaddr_in    * addr;
+    unsigned int            n;
+
+    if ( !(pHostEntry = gethostbyname( host)) ) {
+        reportEvent( 3, "can't resolve host", host);
+        return 0;
+    }
+
+    for ( n = 0; n < maxAddresses && pHostEntry->h_addr_list[n]; ++n ) {
+        addr = (struct sockaddr_in *) &addresses[n].addr;
+        memset( &addresses[n].addr, 0, sizeof(addresses[n].addr));
+        addr->sin_family   = AF_INET;
+        addr->sin_port     = htons( port);
+        memcpy( &addr->sin_addr, pHostEntry->h_addr_list[n],
+                sizeof(addr->sin_addr));
+        addresses[n].len   = sizeof(struct sockaddr_in);
+    }
+
+    return n;
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Resolve a host name, using the cache
+ *----------------------------------------------------------------------------*/
+unsigned int
+Resolver :: resolve (   const char        * host,
+                        unsigned short      port,
+                        Address           * addresses,
+                        unsigned int        maxAddresses,
+                        unsigned int        timeout )       throw ()
+{
+    unsigned long long      now = Util::getMonotonicTime();
+    struct timespec         deadline;
+    unsigned int            n;
+
+    pthread_mutex_lock( &mutex);
+
+    Entry     & entry = cache[host];
+
+    if ( entry.noAddresses > 0 && (now < entry.expires || cacheTime > 0) ) {
+        if ( now >= entry.expires && !entry.pending ) {
+            // expired, but still good enough while we look it up again
+            entry.pending = true;
+            pthread_cond_signal( &condRequest);
+        }
+        n = copyAddresses( entry.addresses, entry.noAddresses, port,
+                           addresses, maxAddresses);
+        pthread_mutex_unlock( &mutex);
+
+        return n;
+    }
+
+    if ( !entry.pending ) {
+        entry.pending = true;
+        pthread_cond_signal( &condRequest);
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec  += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if ( deadline.tv_nsec >= 1000000000L ) {
+        deadline.tv_sec  += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while ( entry.pending ) {
+        if ( pthread_cond_timedwait( &condResult, &mutex, &deadline)
+                                                            == ETIMEDOUT ) {
+            reportEvent( 3, "timeout resolving host", host);
+            break;
+        }
+    }
+
+    // if the lookup failed, the expired addresses are better than nothing
+    n = copyAddresses( entry.addresses, entry.noAddresses, port,
+                       addresses, maxAddresses);
+    pthread_mutex_unlock( &mutex);
+
+    return n;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The lookup thread
+ *----------------------------------------------------------------------------*/
+void
+Resolver :: resolverThread ( void )                         throw ()
+{
+    std::map<std::string, Entry>::iterator  it;
+    Address                                 result[maxAddresses];
+    unsigned int                            n;
+
+    pthread_mutex_lock( &mutex);
+
+    while ( running ) {
+        for ( it = cache.begin(); it != cache.end() && !it->second.pending;
+              ++it );
+
+        if ( it == cache.end() ) {
+            pthread_cond_wait( &condRequest, &mutex);
+            continue;
+        }
+
+        // look the host up without holding the lock
+        std::string     host = it->first;
+
+        pthread_mutex_unlock( &mutex);
+        n = lookup( host.c_str(), 0, result, maxAddresses);
+        pthread_mutex_lock( &mutex);
+
+        Entry     & entry = cache[host];
+
+        if ( n > 0 ) {
+            memcpy( entry.addresses, result, n * sizeof(Address));
+            entry.noAddresses = n;
+            entry.expires     = Util::getMonotonicTime()
+                              + cacheTime * 1000000ULL;
+            reportEvent( 5, "resolved host", host.c_str(), n, "addresses");
+        } else if ( entry.noAddresses > 0 ) {
+            // keep the old addresses, but don't retry the lookup right away
+            entry.expires     = Util::getMonotonicTime()
+                              + retryTime * 1000000ULL;
+        }
+        entry.pending = false;
+
+        pthread_cond_broadcast( &condResult);
+    }
+
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The thread function
+ *----------------------------------------------------------------------------*/
+void *
+Resolver :: threadFunction ( void     * param )
+{
+    Resolver      * resolver = (Resolver*) param;
+
+    resolver->resolverThread();
+
+    return 0;
+}
+
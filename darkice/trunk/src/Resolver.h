@@ -0,0 +1,311 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : Resolver.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#else
+#error need sys/types.h
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#else
+#error need sys/socket.h
+#endif
+
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include <map>
+#include <string>
+
+#include "Referable.h"
+#include "Reporter.h"
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A host name resolver with a cache of the resolved addresses.
+ *  Lookups are done in a background thread, so that a caller can give
+ *  up on a slow name server after a timeout. Cached addresses are
+ *  returned right away. Once they expire, they are still returned
+ *  while a fresh lookup is done in the background.
+ *
+ *  The addresses of a host are ordered so that the address families
+ *  alternate, as suggested by RFC 8305 (Happy Eyeballs).
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class Resolver : public virtual Referable, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The maximum number of addresses kept for a host.
+         */
+        static const unsigned int   maxAddresses = 16;
+
+        /**
+         *  Type describing a resolved address.
+         */
+        typedef struct {
+            struct sockaddr_storage     addr;
+            socklen_t                   len;
+        } Address;
+
+
+    private:
+
+        /**
+         *  The number of seconds to wait before retrying a failed lookup
+         *  of a host which still has expired addresses cached.
+         */
+        static const unsigned int   retryTime = 10;
+
+        /**
+         *  Type describing a cached host.
+         */
+        typedef struct {
+            Address                 addresses[maxAddresses];
+            unsigned int            noAddresses;
+            unsigned long long      expires;
+            bool                    pending;
+        } Entry;
+
+        /**
+         *  The number of seconds to keep resolved addresses for.
+         */
+        unsigned int                    cacheTime;
+
+        /**
+         *  The cached hosts, by host name.
+         */
+        std::map<std::string, Entry>    cache;
+
+        /**
+         *  Mutex protecting the cache.
+         */
+        pthread_mutex_t                 mutex;
+
+        /**
+         *  Condition signalled when a lookup is requested.
+         */
+        pthread_cond_t                  condRequest;
+
+        /**
+         *  Condition signalled when a lookup is done.
+         */
+        pthread_cond_t                  condResult;
+
+        /**
+         *  The thread doing the lookups.
+         */
+        pthread_t                       thread;
+
+        /**
+         *  Flag to show that the lookup thread should be running.
+         */
+        bool                            running;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param cacheTime the number of seconds to cache addresses for.
+         *  @exception Exception
+         */
+        void
+        init (  unsigned int    cacheTime )             throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                                  throw ( Exception );
+
+        /**
+         *  The body of the lookup thread.
+         */
+        void
+        resolverThread ( void )                         throw ();
+
+        /**
+         *  The thread function.
+         *
+         *  @param param thread parameter, a pointer to the Resolver.
+         *  @return nothing
+         */
+        static void *
+        threadFunction ( void     * param );
+
+        /**
+         *  Copy addresses, setting the port in each of them.
+         *
+         *  @param from the addresses to copy.
+         *  @param noFrom the number of addresses in from.
+         *  @param port the port to set.
+         *  @param to the buffer to copy the addresses to.
+         *  @param maxTo the number of addresses that fit into to.
+         *  @return the number of addresses copied.
+         */
+        static unsigned int
+        copyAddresses ( const Address     * from,
+                        unsigned int        noFrom,
+                        unsigned short      port,
+                        Address           * to,
+                        unsigned int        maxTo )     throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        Resolver ( void )                               throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as a
+         *  resolver can not be copied.
+         *
+         *  @param resolver the object to copy.
+         *  @exception Exception
+         */
+        inline
+        Resolver ( const Resolver     & resolver )      throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param cacheTime the number of seconds to cache addresses for.
+         *         If 0, a fresh lookup is waited for each time, and
+         *         the cached addresses are only used if it fails.
+         *  @exception Exception
+         */
+        inline
+        Resolver (  unsigned int    cacheTime )         throw ( Exception )
+        {
+            init( cacheTime);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~Resolver ( void )                              throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Resolve a host name, using the cache if possible.
+         *
+         *  @param host the host name to resolve.
+         *  @param port the port to put into the resolved addresses.
+         *  @param addresses the buffer to put the addresses into.
+         *  @param maxAddresses the number of addresses that fit into
+         *         the buffer.
+         *  @param timeout the number of milliseconds to wait for a lookup.
+         *  @return the number of addresses found, 0 if the host could not
+         *          be resolved in time.
+         */
+        unsigned int
+        resolve (   const char        * host,
+                    unsigned short      port,
+                    Address           * addresses,
+                    unsigned int        maxAddresses,
+                    unsigned int        timeout )       throw ();
+
+        /**
+         *  Look up a host name right away, without using the cache.
+         *  Blocks until the lookup is done.
+         *
+         *  @param host the host name to resolve.
+         *  @param port the port to put into the resolved addresses.
+         *  @param addresses the buffer to put the addresses into.
+         *  @param maxAddresses the number of addresses that fit into
+         *         the buffer.
+         *  @return the number of addresses found, 0 on error.
+         */
+        static unsigned int
+        lookup (    const char        * host,
+                    unsigned short      port,
+                    Address           * addresses,
+                    unsigned int        maxAddresses )  throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* RESOLVER_H */
+
@@ -0,0 +1,195 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : RingBuffer.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#else
+#error need stdlib.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#else
+#error need sys/mman.h
+#endif
+
+
+#include "Exception.h"
+#include "RingBuffer.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+/*------------------------------------------------------------------------------
+ *  Create an anonymous file of the specified size
+ *----------------------------------------------------------------------------*/
+static int
+createBackingFile ( unsigned int    size )
+{
+    int     fd;
+
+#ifdef HAVE_MEMFD_CREATE
+    fd = memfd_create( "darkice-ring", MFD_CLOEXEC);
+#else
+    char    name[] = "/tmp/darkice-ring-XXXXXX";
+
+    if ( (fd = mkstemp( name)) != -1 ) {
+        unlink( name);
+    }
+#endif
+
+    if ( fd != -1 && ftruncate( fd, size) == -1 ) {
+        int     error = errno;
+
+        ::close( fd);
+        errno = error;
+        fd    = -1;
+    }
+
+    return fd;
+}
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+RingBuffer :: init (    unsigned int    size )          throw ( Exception )
+{
+    unsigned int    pageSize = sysconf( _SC_PAGESIZE);
+    void          * p;
+    int             fd;
+
+    // both mappings together have to fit the sizes used below
+    if ( !size || size > 0x40000000U ) {
+        throw Exception( __FILE__, __LINE__, "bad ring buffer size", size);
+    }
+
+    // round up to a power of two, at least a page
+    this->size = pageSize;
+    while ( this->size < size ) {
+        this->size <<= 1;
+    }
+    head = 0;
+    tail = 0;
+
+    if ( (fd = createBackingFile( this->size)) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "can't create ring buffer file",
+                         errno);
+    }
+
+    // reserve the address space for both mappings, then map the
+    // same file twice over it, one after the other
+    p = mmap( 0, 2 * this->size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+              -1, 0);
+    if ( p == MAP_FAILED ) {
+        ::close( fd);
+        throw Exception( __FILE__, __LINE__, "mmap error", errno);
+    }
+    buffer = (unsigned char *) p;
+
+    if ( mmap( buffer, this->size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+      || mmap( buffer + this->size, this->size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ) {
+        int     error = errno;
+
+        munmap( buffer, 2 * this->size);
+        ::close( fd);
+        throw Exception( __FILE__, __LINE__, "mmap error", error);
+    }
+
+    // the mappings keep the file alive
+    ::close( fd);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+RingBuffer :: strip ( void )                            throw ( Exception )
+{
+    munmap( buffer, 2 * size);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Copy data into the buffer
+ *----------------------------------------------------------------------------*/
+unsigned int
+RingBuffer :: put ( const void    * buf,
+                    unsigned int    len )               throw ()
+{
+    unsigned int    room = getFree();
+
+    len = len < room ? len : room;
+    memcpy( getWritePtr(), buf, len);
+    commit( len);
+
+    return len;
+}
+
@@ -0,0 +1,317 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : RingBuffer.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A byte ring buffer, mapped twice back to back into memory.
+ *  Thus both the data stored and the free space are always contiguous,
+ *  no matter where they wrap around: the readable region can be handed
+ *  to send() or write() in one piece, and the writable region can be
+ *  filled with a single memcpy().
+ *
+ *  The buffer is safe to share between a single producer thread,
+ *  calling getWritePtr(), commit() and put(), and a single consumer
+ *  thread, calling getReadPtr() and release(), without locking.
+ *  All other calls may be made from either thread.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class RingBuffer
+{
+    private:
+
+        /**
+         *  The start of the two mappings.
+         */
+        unsigned char         * buffer;
+
+        /**
+         *  The size of the buffer, a power of two, and a multiple
+         *  of the page size.
+         */
+        unsigned int            size;
+
+        /**
+         *  The stream position of the start of the data. Only ever
+         *  increases, and is taken modulo size when accessing the buffer.
+         *  Only modified by the consumer.
+         */
+        unsigned int            head;
+
+        /**
+         *  The stream position of the end of the data.
+         *  Only modified by the producer.
+         */
+        unsigned int            tail;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param size the minimum size of the buffer.
+         *  @exception Exception
+         */
+        void
+        init (  unsigned int    size )                  throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                                  throw ( Exception );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        RingBuffer ( void )                             throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  mappings can not be shared.
+         *
+         *  @param ring the object to copy.
+         *  @exception Exception
+         */
+        inline
+        RingBuffer ( const RingBuffer     & ring )      throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param size the minimum size of the buffer, at most 1 GiB.
+         *         It is rounded up to a power of two, and to at least
+         *         a page.
+         *  @exception Exception
+         */
+        inline
+        RingBuffer (    unsigned int    size )          throw ( Exception )
+        {
+            init( size);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~RingBuffer ( void )                            throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Get the size of the buffer.
+         *
+         *  @return the size of the buffer in bytes.
+         */
+        inline unsigned int
+        getSize ( void ) const                          throw ()
+        {
+            return size;
+        }
+
+        /**
+         *  Get the number of bytes stored.
+         *
+         *  @return the number of bytes that can be read.
+         */
+        inline unsigned int
+        getUsed ( void ) const                          throw ()
+        {
+            return __atomic_load_n( &tail, __ATOMIC_ACQUIRE)
+                 - __atomic_load_n( &head, __ATOMIC_ACQUIRE);
+        }
+
+        /**
+         *  Get the free space.
+         *
+         *  @return the number of bytes that can be written.
+         */
+        inline unsigned int
+        getFree ( void ) const                          throw ()
+        {
+            return size - getUsed();
+        }
+
+        /**
+         *  Get where to write the next data to. getFree() bytes can be
+         *  written here contiguously. Producer only.
+         *
+         *  @return the start of the free space.
+         */
+        inline unsigned char *
+        getWritePtr ( void ) const                      throw ()
+        {
+            return buffer + (tail & (size - 1));
+        }
+
+        /**
+         *  Make data written to getWritePtr() available to the consumer.
+         *  Producer only.
+         *
+         *  @param len the number of bytes written, at most getFree().
+         */
+        inline void
+        commit (    unsigned int    len )               throw ()
+        {
+            __atomic_store_n( &tail, tail + len, __ATOMIC_RELEASE);
+        }
+
+        /**
+         *  Copy data into the buffer, as much as fits. Producer only.
+         *
+         *  @param buf the data to copy.
+         *  @param len the number of bytes in buf.
+         *  @return the number of bytes copied.
+         */
+        unsigned int
+        put (   const void    * buf,
+                unsigned int    len )                   throw ();
+
+        /**
+         *  Get where to read the data from. getUsed() bytes can be
+         *  read here contiguously. Consumer only.
+         *
+         *  @return the start of the data.
+         */
+        inline unsigned char *
+        getReadPtr ( void ) const                       throw ()
+        {
+            return buffer + (head & (size - 1));
+        }
+
+        /**
+         *  Remove data from the start of the buffer. Consumer only.
+         *
+         *  @param len the number of bytes to remove, at most getUsed().
+         */
+        inline void
+        release (   unsigned int    len )               throw ()
+        {
+            __atomic_store_n( &head, head + len, __ATOMIC_RELEASE);
+        }
+
+        /**
+         *  Get the stream position of the start of the data.
+         *  Positions wrap around at 2^32, compare them by difference.
+         *
+         *  @return the stream position of the first byte stored.
+         */
+        inline unsigned int
+        getHead ( void ) const                          throw ()
+        {
+            return __atomic_load_n( &head, __ATOMIC_ACQUIRE);
+        }
+
+        /**
+         *  Get the stream position of the end of the data.
+         *
+         *  @return the stream position after the last byte stored.
+         */
+        inline unsigned int
+        getTail ( void ) const                          throw ()
+        {
+            return __atomic_load_n( &tail, __ATOMIC_ACQUIRE);
+        }
+
+        /**
+         *  Get where the data at a stream position is. The data up to
+         *  getTail() can be read from here contiguously. Lets several
+         *  readers follow the stream, each at its own position, while
+         *  the producer releases the oldest data as it needs room.
+         *
+         *  @param position a stream position between getHead()
+         *         and getTail().
+         *  @return the data at the position.
+         */
+        inline unsigned char *
+        getPtrAt (  unsigned int    position ) const    throw ()
+        {
+            return buffer + (position & (size - 1));
+        }
+
+        /**
+         *  Remove all data from the buffer. Consumer only.
+         */
+        inline void
+        clear ( void )                                  throw ()
+        {
+            __atomic_store_n( &head,
+                              __atomic_load_n( &tail, __ATOMIC_ACQUIRE),
+                              __ATOMIC_RELEASE);
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* RING_BUFFER_H */
+
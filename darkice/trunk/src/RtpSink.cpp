@@ -0,0 +1,676 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : RtpSink.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#else
+#error need netinet/in.h
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#else
+#error need netdb.h
+#endif
+
+
+#include "Util.h"
+#include "Exception.h"
+#include "RtpSink.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The static RTP payload type of MPEG audio, and its clock rate
+ *----------------------------------------------------------------------------*/
+#define MPA_PAYLOAD_TYPE    14
+#define MPA_CLOCK_RATE      90000
+
+
+/* ===============================================  local function prototypes */
+
+/*------------------------------------------------------------------------------
+ *  Get the duration of an Opus packet from its table of contents,
+ *  in 48 kHz samples, as described in RFC 6716. Return 0 if not valid
+ *----------------------------------------------------------------------------*/
+static unsigned int
+opusDuration (  const unsigned char   * p,
+                unsigned int            len )
+{
+    static const unsigned short silk[4]  = { 480, 960, 1920, 2880 };
+    static const unsigned short celt[4]  = { 120, 240,  480,  960 };
+    unsigned int                config   = p[0] >> 3;
+    unsigned int                frameLen;
+    unsigned int                frames;
+
+    if ( config < 12 ) {
+        frameLen = silk[config & 0x03];
+    } else if ( config < 16 ) {
+        frameLen = config & 0x01 ? 960 : 480;
+    } else {
+        frameLen = celt[config & 0x03];
+    }
+
+    switch ( p[0] & 0x03 ) {
+        case 0:
+            frames = 1;
+            break;
+
+        case 1:
+        case 2:
+            frames = 2;
+            break;
+
+        default:
+            if ( len < 2 ) {
+                return 0;
+            }
+            frames = p[1] & 0x3f;
+            break;
+    }
+
+    // no packet is longer than 120 ms
+    return frames * frameLen <= 5760 ? frames * frameLen : 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Mix a seed into a random looking number, for the initial RTP values
+ *----------------------------------------------------------------------------*/
+static unsigned int
+mixBits (   unsigned long long    & seed )
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+
+    return (seed * 2685821657736338717ULL) >> 32;
+}
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: init (   const char        * host,
+                    unsigned short      port,
+                    Payload             payload,
+                    unsigned int        payloadType,
+                    unsigned int        ttl,
+                    const char        * sdpFile )       throw ( Exception )
+{
+    if ( !host || !port ) {
+        throw Exception( __FILE__, __LINE__, "no RTP destination");
+    }
+    if ( payloadType > 127 ) {
+        throw Exception( __FILE__, __LINE__, "bad RTP payload type",
+                         payloadType);
+    }
+
+    this->host        = Util::strDup( host);
+    this->port        = port;
+    this->payload     = payload;
+    this->payloadType = payload == mpa ? MPA_PAYLOAD_TYPE : payloadType;
+    this->ttl         = ttl;
+    this->sdpFile     = sdpFile ? Util::strDup( sdpFile) : 0;
+
+    sockfd    = 0;
+    inputLen  = 0;
+    noPackets = 0;
+    fill      = 0;
+    oversize  = false;
+    dropped   = 0;
+    input     = new unsigned char[inputSize];
+    packets   = new unsigned char[maxBatch * maxPacketSize];
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: strip ( void )                               throw ( Exception )
+{
+    if ( isOpen() ) {
+        close();
+    }
+
+    delete[] host;
+    delete[] sdpFile;
+    delete[] input;
+    delete[] packets;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the socket
+ *----------------------------------------------------------------------------*/
+bool
+RtpSink :: open ( void )                                throw ( Exception )
+{
+    Resolver::Address       address;
+    unsigned long long      seed;
+    int                     hops = ttl;
+    int                     fd;
+
+    if ( isOpen() ) {
+        return false;
+    }
+
+    if ( !Resolver::lookup( host, port, &address, 1) ) {
+        throw Exception( __FILE__, __LINE__, "can't resolve", host);
+    }
+
+    if ( (fd = socket( address.addr.ss_family, SOCK_DGRAM, 0)) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "socket error", errno);
+    }
+
+    // only applies if sending to a multicast group
+    if ( ttl && (address.addr.ss_family == AF_INET6
+                 ? setsockopt( fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
+                               &hops, sizeof(hops))
+                 : setsockopt( fd, IPPROTO_IP, IP_MULTICAST_TTL,
+                               &hops, sizeof(hops))) == -1 ) {
+        ::close( fd);
+        throw Exception( __FILE__, __LINE__, "can't set multicast ttl",
+                         errno);
+    }
+
+    if ( connect( fd, (const struct sockaddr *) &address.addr,
+                  address.len) == -1 ) {
+        ::close( fd);
+        throw Exception( __FILE__, __LINE__, "connect error", errno);
+    }
+
+    // RFC 3550 asks for random initial values
+    seed          = Util::getMonotonicTime() ^ ((unsigned long long) getpid()
+                                                << 32)
+                  ^ (unsigned long) this;
+    ssrc          = mixBits( seed);
+    sequence      = mixBits( seed);
+    baseTimestamp = mixBits( seed);
+    position      = 0;
+    mpaSamples    = 0;
+    mpaSampleRate = 0;
+    marker        = true;
+    inputLen      = 0;
+    noPackets     = 0;
+    fill          = 0;
+    oversize      = false;
+
+    if ( sdpFile ) {
+        try {
+            writeSdp( address.addr.ss_family);
+        } catch ( Exception   & e ) {
+            ::close( fd);
+            throw;
+        }
+    }
+
+    sockfd = fd;
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write the session description file
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: writeSdp (   int     family )                throw ( Exception )
+{
+    Resolver::Address       address;
+    char                    addr[NI_MAXHOST];
+    const char            * ipVersion = family == AF_INET6 ? "IP6" : "IP4";
+    bool                    multicast;
+    FILE                  * f;
+
+    // describe the numeric address, the receivers may not resolve the name
+    if ( !Resolver::lookup( host, port, &address, 1)
+      || getnameinfo( (const struct sockaddr *) &address.addr, address.len,
+                      addr, sizeof(addr), 0, 0, NI_NUMERICHOST) ) {
+        throw Exception( __FILE__, __LINE__, "can't resolve", host);
+    }
+
+    if ( family == AF_INET6 ) {
+        multicast = IN6_IS_ADDR_MULTICAST(
+                &((const struct sockaddr_in6 *) &address.addr)->sin6_addr);
+    } else {
+        multicast = IN_MULTICAST( ntohl(
+                ((const struct sockaddr_in *) &address.addr)->sin_addr.s_addr));
+    }
+
+    if ( !(f = fopen( sdpFile, "w")) ) {
+        throw Exception( __FILE__, __LINE__, "can't open SDP file: ",
+                         sdpFile, errno);
+    }
+
+    fprintf( f, "v=0\r\n");
+    fprintf( f, "o=- %u 0 IN %s %s\r\n", ssrc, ipVersion, addr);
+    fprintf( f, "s=DarkIce\r\n");
+    if ( multicast && family != AF_INET6 ) {
+        // IPv4 multicast addresses carry the ttl in SDP
+        fprintf( f, "c=IN %s %s/%u\r\n", ipVersion, addr, ttl ? ttl : 1);
+    } else {
+        fprintf( f, "c=IN %s %s\r\n", ipVersion, addr);
+    }
+    fprintf( f, "t=0 0\r\n");
+    fprintf( f, "m=audio %u RTP/AVP %u\r\n", port, payloadType);
+    if ( payload == mpa ) {
+        fprintf( f, "a=rtpmap:%u MPA/%u\r\n", payloadType, MPA_CLOCK_RATE);
+    } else {
+        fprintf( f, "a=rtpmap:%u opus/48000/2\r\n", payloadType);
+    }
+
+    if ( fclose( f) ) {
+        throw Exception( __FILE__, __LINE__, "can't write SDP file: ",
+                         sdpFile, errno);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write encoded data to the sink
+ *----------------------------------------------------------------------------*/
+unsigned int
+RtpSink :: write (  const void    * buf,
+                    unsigned int    len )               throw ( Exception )
+{
+    const unsigned char   * b    = (const unsigned char *) buf;
+    unsigned int            left = len;
+    unsigned int            used;
+    unsigned int            n;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    while ( left ) {
+        n         = left < inputSize - inputLen ? left : inputSize - inputLen;
+        memcpy( input + inputLen, b, n);
+        inputLen += n;
+        b        += n;
+        left     -= n;
+
+        used = payload == mpa ? packMpa() : packOpus();
+        if ( used ) {
+            memmove( input, input + used, inputLen - used);
+            inputLen -= used;
+        } else if ( inputLen == inputSize ) {
+            reportEvent( 3, "RtpSink :: write, no frame found, skipping",
+                            inputLen, "bytes");
+            inputLen = 0;
+            fill     = 0;
+            oversize = false;
+            marker   = true;
+        }
+    }
+
+    sendPackets();
+
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make packets of the whole MPEG audio frames in the input
+ *----------------------------------------------------------------------------*/
+unsigned int
+RtpSink :: packMpa ( void )                             throw ()
+{
+    const unsigned int  maxPayload = maxPacketSize - headerSize
+                                                   - mpaHeaderSize;
+    unsigned int        pos        = 0;
+    unsigned int        frameLen;
+    unsigned int        samples;
+    unsigned int        sampleRate;
+    unsigned int        offset;
+    unsigned int        n;
+    unsigned char     * p;
+
+    while ( inputLen - pos >= 4 ) {
+        if ( !(frameLen = Util::mpegFrameLength( input + pos, &samples,
+                                                 &sampleRate)) ) {
+            // not at a frame header, look for the next one
+            ++pos;
+            continue;
+        }
+        if ( inputLen - pos < frameLen ) {
+            break;
+        }
+
+        if ( fill && fill + frameLen > maxPayload ) {
+            endPacket( mpaHeaderSize);
+        }
+        if ( sampleRate != mpaSampleRate ) {
+            // count from here on at the new rate
+            if ( mpaSampleRate ) {
+                position += mpaSamples * MPA_CLOCK_RATE / mpaSampleRate;
+            }
+            mpaSamples    = 0;
+            mpaSampleRate = sampleRate;
+        }
+
+        // fragment the frame if it does not fit into a packet by itself,
+        // all fragments are sent with the timestamp of the frame
+        for ( offset = 0; offset < frameLen; offset += n ) {
+            p = getPacket( noPackets) + headerSize;
+            if ( !fill ) {
+                fillPosition = position
+                             + mpaSamples * MPA_CLOCK_RATE / sampleRate;
+                p[0] = 0;
+                p[1] = 0;
+                p[2] = offset >> 8;
+                p[3] = offset & 0xff;
+            }
+
+            n = frameLen - offset < maxPayload - fill ? frameLen - offset
+                                                      : maxPayload - fill;
+            memcpy( p + mpaHeaderSize + fill, input + pos + offset, n);
+            fill += n;
+
+            if ( offset + n < frameLen ) {
+                endPacket( mpaHeaderSize);
+            }
+        }
+
+        mpaSamples += samples;
+        pos        += frameLen;
+    }
+
+    // don't hold back frames until the next write
+    endPacket( mpaHeaderSize);
+
+    return pos;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make packets of the Opus packets in the whole Ogg pages in the input
+ *----------------------------------------------------------------------------*/
+unsigned int
+RtpSink :: packOpus ( void )                            throw ()
+{
+    const unsigned int      maxPayload = maxPacketSize - headerSize;
+    unsigned int            pos        = 0;
+    unsigned int            segments;
+    unsigned int            bodyLen;
+    unsigned int            lace;
+    unsigned int            i;
+    const unsigned char   * page;
+    const unsigned char   * body;
+
+    while ( inputLen - pos >= 27 ) {
+        page = input + pos;
+        if ( memcmp( page, "OggS", 4) ) {
+            // not at a page header, look for the next one
+            ++pos;
+            continue;
+        }
+
+        segments = page[26];
+        if ( inputLen - pos < 27 + segments ) {
+            break;
+        }
+        for ( bodyLen = 0, i = 0; i < segments; ++i ) {
+            bodyLen += page[27 + i];
+        }
+        if ( inputLen - pos < 27 + segments + bodyLen ) {
+            break;
+        }
+
+        if ( !(page[5] & 0x01) && (fill || oversize) ) {
+            // the rest of the packet went missing
+            fill     = 0;
+            oversize = false;
+        } else if ( (page[5] & 0x01) && !fill && !oversize ) {
+            // the start of the packet went missing, drop the rest of it
+            oversize = true;
+        }
+
+        body = page + 27 + segments;
+        for ( i = 0; i < segments; ++i ) {
+            lace = page[27 + i];
+            if ( !oversize ) {
+                if ( fill + lace > maxPayload ) {
+                    oversize = true;
+                } else {
+                    memcpy( getPacket( noPackets) + headerSize + fill,
+                            body, lace);
+                    fill += lace;
+                }
+            }
+            body += lace;
+
+            if ( lace < 255 ) {
+                endOpusPacket();
+            }
+        }
+
+        pos += 27 + segments + bodyLen;
+    }
+
+    return pos;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Finish the packet of a complete Opus packet
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: endOpusPacket ( void )                       throw ()
+{
+    const unsigned char   * data = getPacket( noPackets) + headerSize;
+    unsigned int            duration;
+
+    if ( fill >= 8 && (!memcmp( data, "OpusHead", 8)
+                    || !memcmp( data, "OpusTags", 8)) ) {
+        // the Ogg headers are of no use to RTP receivers
+        fill = 0;
+        return;
+    }
+
+    duration = fill ? opusDuration( data, fill) : 0;
+    if ( oversize || !duration ) {
+        reportEvent( 4, "RtpSink :: dropped an Opus packet of", fill,
+                        "bytes");
+        ++dropped;
+        position += duration;
+        fill      = 0;
+        oversize  = false;
+        marker    = true;
+        return;
+    }
+
+    fillPosition  = position;
+    position     += duration;
+    endPacket( 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Finish the packet being filled
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: endPacket (  unsigned int    headerLen )     throw ()
+{
+    unsigned char     * p         = getPacket( noPackets);
+    unsigned int        timestamp = baseTimestamp + (unsigned int) fillPosition;
+
+    if ( !fill ) {
+        return;
+    }
+
+    p[0]  = 0x80;       // version 2, no padding, extension or CSRCs
+    p[1]  = (marker ? 0x80 : 0) | payloadType;
+    p[2]  = sequence >> 8;
+    p[3]  = sequence & 0xff;
+    p[4]  = timestamp >> 24;
+    p[5]  = (timestamp >> 16) & 0xff;
+    p[6]  = (timestamp >> 8) & 0xff;
+    p[7]  = timestamp & 0xff;
+    p[8]  = ssrc >> 24;
+    p[9]  = (ssrc >> 16) & 0xff;
+    p[10] = (ssrc >> 8) & 0xff;
+    p[11] = ssrc & 0xff;
+
+    packetLens[noPackets++] = headerSize + headerLen + fill;
+    ++sequence;
+    marker = false;
+    fill   = 0;
+
+    if ( noPackets == maxBatch ) {
+        sendPackets();
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send the finished packets
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: sendPackets ( void )                         throw ()
+{
+    unsigned int        sent = 0;
+    int                 ret;
+
+    if ( !noPackets ) {
+        return;
+    }
+
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr      msgs[maxBatch];
+    struct iovec        vecs[maxBatch];
+
+    memset( msgs, 0, noPackets * sizeof(struct mmsghdr));
+    for ( unsigned int i = 0; i < noPackets; ++i ) {
+        vecs[i].iov_base            = getPacket( i);
+        vecs[i].iov_len             = packetLens[i];
+        msgs[i].msg_hdr.msg_iov     = &vecs[i];
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+#endif
+
+    while ( sent < noPackets ) {
+#ifdef HAVE_SENDMMSG
+        ret = sendmmsg( sockfd, msgs + sent, noPackets - sent, MSG_DONTWAIT);
+#else
+        ret = send( sockfd, getPacket( sent), packetLens[sent], MSG_DONTWAIT);
+        ret = ret == -1 ? -1 : 1;
+#endif
+        if ( ret >= 0 ) {
+            sent += ret;
+            continue;
+        }
+        if ( errno == EINTR ) {
+            continue;
+        }
+        if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+            // late packets are useless, don't wait for the kernel
+            reportEvent( 4, "RtpSink :: send buffer full, dropped",
+                            noPackets - sent, "packets");
+            dropped += noPackets - sent;
+            break;
+        }
+        // e.g. no receiver listening on a unicast address yet
+        if ( errno != ECONNREFUSED ) {
+            reportEvent( 4, "RtpSink :: send error", errno);
+        }
+        ++dropped;
+        ++sent;
+    }
+
+    // an Opus packet may be half collected in the slot after the last one
+    if ( fill ) {
+        memmove( getPacket( 0), getPacket( noPackets), headerSize + fill);
+    }
+    noPackets = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the socket
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: close ( void )                               throw ( Exception )
+{
+    if ( !isOpen() ) {
+        return;
+    }
+
+    sendPackets();
+    ::close( sockfd);
+    sockfd = 0;
+
+    if ( dropped ) {
+        reportEvent( 3, "RtpSink :: packets dropped:", dropped);
+    }
+}
+
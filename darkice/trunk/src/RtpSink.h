@@ -0,0 +1,505 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : RtpSink.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef RTP_SINK_H
+#define RTP_SINK_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#else
+#error need sys/socket.h
+#endif
+
+
+#include "Reporter.h"
+#include "Resolver.h"
+#include "Sink.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  Send the encoded stream as RTP packets over UDP, to a unicast
+ *  address or a multicast group.
+ *
+ *  The encoded stream written to the sink is cut up into packets:
+ *  MPEG audio (mp3 or mp2) is sent as described in RFC 2250, several
+ *  whole frames per packet, and fragmented if a frame does not fit.
+ *  Ogg Opus is unpacked from its Ogg pages, and each Opus packet is
+ *  sent in an RTP packet of its own, as described in RFC 7587.
+ *
+ *  The packets made of the data of a write are sent with a single
+ *  system call where possible (sendmmsg). Packets the kernel can not
+ *  take right away are dropped, as late packets are of no use to the
+ *  receivers anyway.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class RtpSink : public Sink, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The payload formats.
+         */
+        enum Payload { mpa, opus };
+
+
+    private:
+
+        /**
+         *  The maximum size of a packet, including the RTP header,
+         *  so that it fits into a single ethernet frame.
+         */
+        static const unsigned int   maxPacketSize = 1400;
+
+        /**
+         *  The size of the RTP header.
+         */
+        static const unsigned int   headerSize = 12;
+
+        /**
+         *  The size of the RFC 2250 MPEG audio header.
+         */
+        static const unsigned int   mpaHeaderSize = 4;
+
+        /**
+         *  The maximum number of packets sent with one system call.
+         */
+        static const unsigned int   maxBatch = 32;
+
+        /**
+         *  The size of the buffer collecting the encoded data until
+         *  a whole frame or Ogg page is in.
+         */
+        static const unsigned int   inputSize = 65536 + 512;
+
+        /**
+         *  The host name or address to send to.
+         */
+        char                  * host;
+
+        /**
+         *  The port to send to.
+         */
+        unsigned short          port;
+
+        /**
+         *  The payload format.
+         */
+        Payload                 payload;
+
+        /**
+         *  The RTP payload type.
+         */
+        unsigned int            payloadType;
+
+        /**
+         *  The time to live of multicast packets, 0 for the default.
+         */
+        unsigned int            ttl;
+
+        /**
+         *  The file to write the session description to, or 0.
+         */
+        char                  * sdpFile;
+
+        /**
+         *  The UDP socket, or 0 if closed.
+         */
+        int                     sockfd;
+
+        /**
+         *  The RTP sequence number of the next packet.
+         */
+        unsigned short          sequence;
+
+        /**
+         *  The RTP timestamp of the start of the stream.
+         */
+        unsigned int            baseTimestamp;
+
+        /**
+         *  The position in the stream of the next data, in units of
+         *  the RTP clock.
+         */
+        unsigned long long      position;
+
+        /**
+         *  The number of MPEG audio samples sent since position was
+         *  last set. The position of a frame is computed from it, as the
+         *  duration of an MPEG audio frame is not a whole number of RTP
+         *  clock ticks.
+         */
+        unsigned long long      mpaSamples;
+
+        /**
+         *  The sample rate of the MPEG audio samples counted.
+         */
+        unsigned int            mpaSampleRate;
+
+        /**
+         *  The synchronization source identifier.
+         */
+        unsigned int            ssrc;
+
+        /**
+         *  Set the marker bit on the next packet.
+         */
+        bool                    marker;
+
+        /**
+         *  The encoded data not yet made into packets.
+         */
+        unsigned char         * input;
+
+        /**
+         *  The number of bytes in input.
+         */
+        unsigned int            inputLen;
+
+        /**
+         *  The buffer of the packets to send.
+         */
+        unsigned char         * packets;
+
+        /**
+         *  The lengths of the packets in the buffer.
+         */
+        unsigned int            packetLens[maxBatch];
+
+        /**
+         *  The number of complete packets in the buffer.
+         */
+        unsigned int            noPackets;
+
+        /**
+         *  The number of payload bytes in the packet being filled,
+         *  after the header.
+         */
+        unsigned int            fill;
+
+        /**
+         *  The position in the stream of the packet being filled.
+         */
+        unsigned long long      fillPosition;
+
+        /**
+         *  True if the Opus packet being collected from the Ogg pages
+         *  is too big, and is to be dropped.
+         */
+        bool                    oversize;
+
+        /**
+         *  The number of packets dropped so far.
+         */
+        unsigned long long      dropped;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param host the host name or address to send to.
+         *  @param port the port to send to.
+         *  @param payload the payload format.
+         *  @param payloadType the RTP payload type.
+         *  @param ttl the time to live of multicast packets.
+         *  @param sdpFile the file to write the session description to.
+         *  @exception Exception
+         */
+        void
+        init (  const char        * host,
+                unsigned short      port,
+                Payload             payload,
+                unsigned int        payloadType,
+                unsigned int        ttl,
+                const char        * sdpFile )       throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Get the start of a packet in the buffer.
+         *
+         *  @param i the index of the packet.
+         *  @return the start of the RTP header of the packet.
+         */
+        inline unsigned char *
+        getPacket ( unsigned int    i ) const       throw ()
+        {
+            return packets + i * maxPacketSize;
+        }
+
+        /**
+         *  Finish the packet being filled, if it has any payload,
+         *  and send the packets if the buffer is full.
+         *
+         *  @param headerLen the length of the payload specific header.
+         */
+        void
+        endPacket ( unsigned int    headerLen )     throw ();
+
+        /**
+         *  Send the finished packets.
+         */
+        void
+        sendPackets ( void )                        throw ();
+
+        /**
+         *  Make packets of the whole MPEG audio frames in the input.
+         *
+         *  @return the number of bytes of input used up.
+         */
+        unsigned int
+        packMpa ( void )                            throw ();
+
+        /**
+         *  Make packets of the Opus packets in the whole Ogg pages
+         *  in the input.
+         *
+         *  @return the number of bytes of input used up.
+         */
+        unsigned int
+        packOpus ( void )                           throw ();
+
+        /**
+         *  Finish the packet of a complete Opus packet.
+         */
+        void
+        endOpusPacket ( void )                      throw ();
+
+        /**
+         *  Write the session description file.
+         *
+         *  @param family the address family of the destination.
+         *  @exception Exception
+         */
+        void
+        writeSdp (  int     family )                throw ( Exception );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        RtpSink ( void )                            throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  stream state can not be shared.
+         *
+         *  @param sink the object to copy.
+         *  @exception Exception
+         */
+        inline
+        RtpSink (   const RtpSink     & sink )      throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param host the host name or address to send to, may be
+         *         a multicast group.
+         *  @param port the port to send to.
+         *  @param payload the payload format.
+         *  @param payloadType the RTP payload type. Ignored for MPEG
+         *         audio, which has the static payload type 14.
+         *  @param ttl the time to live of multicast packets,
+         *         0 for the system default.
+         *  @param sdpFile the file to write the session description
+         *         to when opened, or 0 not to write one.
+         *  @exception Exception
+         */
+        inline
+        RtpSink (   const char        * host,
+                    unsigned short      port,
+                    Payload             payload,
+                    unsigned int        payloadType = 96,
+                    unsigned int        ttl         = 0,
+                    const char        * sdpFile     = 0 )
+                                                    throw ( Exception )
+        {
+            init( host, port, payload, payloadType, ttl, sdpFile);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~RtpSink ( void )                           throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Get the payload format.
+         *
+         *  @return the payload format.
+         */
+        inline Payload
+        getPayload ( void ) const                   throw ()
+        {
+            return payload;
+        }
+
+        /**
+         *  Get the number of packets dropped so far, as the kernel
+         *  could not take them.
+         *
+         *  @return the number of packets dropped.
+         */
+        inline unsigned long long
+        getDropped ( void ) const                   throw ()
+        {
+            return dropped;
+        }
+
+        /**
+         *  Open the socket.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                               throw ( Exception );
+
+        /**
+         *  Check if the RtpSink is open.
+         *
+         *  @return true if the RtpSink is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                       throw ()
+        {
+            return sockfd != 0;
+        }
+
+        /**
+         *  Check if the RtpSink is ready to accept data.
+         *  Packets that can not be sent are dropped, so this never
+         *  blocks.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the RtpSink is open, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canWrite (     unsigned int    sec,
+                       unsigned int    usec )       throw ( Exception )
+        {
+            return isOpen();
+        }
+
+        /**
+         *  Write encoded data to the RtpSink. The packets made of all
+         *  whole frames in the data so far are sent.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes taken, len unless closed.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        write (        const void    * buf,
+                       unsigned int    len )        throw ( Exception );
+
+        /**
+         *  This is a no-op in this RtpSink, as all packets ready are
+         *  sent on each write.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        flush ( void )                              throw ( Exception )
+        {
+        }
+
+        /**
+         *  This is a no-op in this RtpSink.
+         */
+        inline virtual void
+        cut ( void )                                throw ()
+        {
+        }
+
+        /**
+         *  Close the socket.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                              throw ( Exception );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* RTP_SINK_H */
+
@@ -0,0 +1,499 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : ShoutCast2.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $Source$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#include <string>
+
+
+#include "Exception.h"
+#include "Source.h"
+#include "Sink.h"
+#include "Util.h"
+#include "ShoutCast2.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The first byte of each Ultravox message
+ *----------------------------------------------------------------------------*/
+#define UVOX_SYNC               0x5a
+
+/*------------------------------------------------------------------------------
+ *  The Ultravox message types used
+ *----------------------------------------------------------------------------*/
+#define UVOX_AUTHENTICATE       0x1001
+#define UVOX_SETUP              0x1002
+#define UVOX_PAYLOAD_SIZE       0x1003
+#define UVOX_STANDBY            0x1004
+#define UVOX_TERMINATE          0x1005
+#define UVOX_BUFFER_SIZE        0x1006
+#define UVOX_CIPHER             0x1009
+#define UVOX_MIME_TYPE          0x1040
+#define UVOX_ICY_NAME           0x1100
+#define UVOX_ICY_GENRE          0x1101
+#define UVOX_ICY_URL            0x1102
+#define UVOX_ICY_PUBLIC         0x1103
+#define UVOX_XML_METADATA       0x3901
+#define UVOX_MP3_DATA           0x7000
+
+/*------------------------------------------------------------------------------
+ *  The size of the buffer for the answers of the server
+ *----------------------------------------------------------------------------*/
+#define ANSWER_SIZE             256
+
+/*------------------------------------------------------------------------------
+ *  The seconds of the stream the server is asked to buffer
+ *----------------------------------------------------------------------------*/
+#define BUFFER_SECS             8
+
+
+/* ===============================================  local function prototypes */
+
+/*------------------------------------------------------------------------------
+ *  Encrypt a string with XTEA, as the Ultravox login asks for
+ *----------------------------------------------------------------------------*/
+static std::string
+xteaEncrypt (   const char    * str,
+                const char    * key );
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Encrypt a string with XTEA, the key and the string padded with zeros,
+ *  and the result in hex
+ *----------------------------------------------------------------------------*/
+static std::string
+xteaEncrypt (   const char    * str,
+                const char    * key )
+{
+    unsigned int        k[4] = { 0, 0, 0, 0 };
+    unsigned int        keyLen = Util::strLen( key);
+    unsigned int        len    = Util::strLen( str);
+    std::string         result;
+    char                hex[17];
+
+    for ( unsigned int i = 0; i < 16 && i < keyLen; ++i ) {
+        k[i / 4] |= (unsigned char) key[i] << (24 - 8 * (i % 4));
+    }
+
+    for ( unsigned int block = 0; block < len || block == 0; block += 8 ) {
+        unsigned int    v[2] = { 0, 0 };
+        unsigned int    sum  = 0;
+
+        for ( unsigned int i = 0; i < 8 && block + i < len; ++i ) {
+            v[i / 4] |= (unsigned char) str[block + i] << (24 - 8 * (i % 4));
+        }
+
+        for ( unsigned int round = 0; round < 32; ++round ) {
+            v[0] += (((v[1] << 4) ^ (v[1] >> 5)) + v[1]) ^ (sum + k[sum & 3]);
+            sum  += 0x9e3779b9;
+            v[1] += (((v[0] << 4) ^ (v[0] >> 5)) + v[0])
+                  ^ (sum + k[(sum >> 11) & 3]);
+        }
+
+        snprintf( hex, sizeof(hex), "%08x%08x", v[0], v[1]);
+        result += hex;
+    }
+
+    return result;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+ShoutCast2 :: init (    const char            * user,
+                        unsigned int            streamId )
+                                                        throw ( Exception )
+{
+    this->user     = user ? Util::strDup( user) : 0;
+    this->streamId = streamId;
+
+    headLen         = 0;
+    payloadLen      = 0;
+    sent            = 0;
+    messageOpen     = false;
+    metadataLen     = 0;
+    metadataPending = false;
+    metadataId      = 0;
+
+    pthread_mutex_init( &mutex, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+ShoutCast2 :: strip ( void )                            throw ( Exception )
+{
+    pthread_mutex_destroy( &mutex);
+
+    delete[] user;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write the header of an Ultravox message
+ *----------------------------------------------------------------------------*/
+unsigned int
+ShoutCast2 :: makeHeader (  unsigned char         * buf,
+                            unsigned int            type,
+                            unsigned int            len )   throw ()
+{
+    buf[0] = UVOX_SYNC;
+    buf[1] = 0;                 // no quality of service flags
+    buf[2] = type >> 8;
+    buf[3] = type & 0xff;
+    buf[4] = len >> 8;
+    buf[5] = len & 0xff;
+
+    return headerSize;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send a login message, and read the answer to it
+ *----------------------------------------------------------------------------*/
+bool
+ShoutCast2 :: exchange (    unsigned int            type,
+                            const char            * payload,
+                            char                  * answer,
+                            unsigned int            size )  throw ( Exception )
+{
+    Sink          * sink   = getSink();
+    Source        * source = getSocket();
+    unsigned char   buf[headerSize + maxPayload + 1];
+    unsigned int    len    = Util::strLen( payload);
+    unsigned int    done;
+    unsigned int    ret;
+
+    if ( len > maxPayload ) {
+        len = maxPayload;
+    }
+    makeHeader( buf, type, len);
+    memcpy( buf + headerSize, payload, len);
+    buf[headerSize + len] = 0;
+    len += headerSize + 1;
+
+    for ( done = 0; done < len; done += ret ) {
+        if ( !(ret = sink->write( buf + done, len - done)) ) {
+            return false;
+        }
+    }
+    sink->flush();
+
+    // the header of the answer, then its payload and ending byte
+    for ( done = 0; done < headerSize; done += ret ) {
+        if ( !(ret = source->read( buf + done, headerSize - done)) ) {
+            return false;
+        }
+    }
+    if ( buf[0] != UVOX_SYNC || (unsigned int) (buf[2] << 8 | buf[3]) != type ) {
+        reportEvent( 3, "ShoutCast2 - unexpected answer to message", type);
+        return false;
+    }
+
+    len = (buf[4] << 8 | buf[5]) + 1;
+    for ( done = 0; done < len; done += ret ) {
+        if ( !(ret = source->read( buf + done, len - done)) ) {
+            return false;
+        }
+    }
+
+    len = len - 1 < size - 1 ? len - 1 : size - 1;
+    memcpy( answer, buf, len);
+    answer[len] = 0;
+
+    reportEvent( 8, "ShoutCast2 server answer: ", answer);
+
+    return Util::strEq( answer, "ACK", 3);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Log in to the ShoutCast server using the Ultravox 2.1 protocol
+ *----------------------------------------------------------------------------*/
+bool
+ShoutCast2 :: sendLogin ( void )                        throw ( Exception )
+{
+    char            answer[ANSWER_SIZE];
+    char            str[ANSWER_SIZE];
+    std::string     auth;
+
+    if ( !getSocket()->isOpen() ) {
+        return false;
+    }
+
+    // the server answers with the key to encrypt the login with
+    if ( !exchange( UVOX_CIPHER, "2.1", answer, sizeof(answer)) ) {
+        return false;
+    }
+
+    snprintf( str, sizeof(str), "2.1:%u:", streamId);
+    auth  = str;
+    auth += xteaEncrypt( user ? user : "", answer + 4);
+    auth += ":";
+    auth += xteaEncrypt( getPassword(), answer + 4);
+
+    if ( !exchange( UVOX_AUTHENTICATE, auth.c_str(), answer, sizeof(answer)) ) {
+        throw Exception( __FILE__, __LINE__,
+                         "ShoutCast2 - login refused, wrong password "
+                         "or stream ID?", answer);
+    }
+
+    if ( !exchange( UVOX_MIME_TYPE, "audio/mpeg", answer, sizeof(answer)) ) {
+        return false;
+    }
+
+    snprintf( str, sizeof(str), "%u:%u",
+              getBitRate() * 1000, getBitRate() * 1000);
+    if ( !exchange( UVOX_SETUP, str, answer, sizeof(answer)) ) {
+        return false;
+    }
+
+    snprintf( str, sizeof(str), "%u:0", getBitRate() * BUFFER_SECS / 8);
+    if ( !exchange( UVOX_BUFFER_SIZE, str, answer, sizeof(answer)) ) {
+        return false;
+    }
+
+    snprintf( str, sizeof(str), "%u:0", maxPayload);
+    if ( !exchange( UVOX_PAYLOAD_SIZE, str, answer, sizeof(answer)) ) {
+        return false;
+    }
+
+    // the stream details are optional, a server may turn them down
+    if ( getName() ) {
+        exchange( UVOX_ICY_NAME, getName(), answer, sizeof(answer));
+    }
+    if ( getGenre() ) {
+        exchange( UVOX_ICY_GENRE, getGenre(), answer, sizeof(answer));
+    }
+    if ( getUrl() ) {
+        exchange( UVOX_ICY_URL, getUrl(), answer, sizeof(answer));
+    }
+    exchange( UVOX_ICY_PUBLIC, getIsPublic() ? "1" : "0",
+              answer, sizeof(answer));
+
+    if ( !exchange( UVOX_STANDBY, "", answer, sizeof(answer)) ) {
+        return false;
+    }
+
+    // the stream data starts with a new message, after the last title
+    headLen     = 0;
+    payloadLen  = 0;
+    sent        = 0;
+    messageOpen = false;
+
+    pthread_mutex_lock( &mutex);
+    metadataPending = metadataLen != 0;
+    pthread_mutex_unlock( &mutex);
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send stream data to the server
+ *----------------------------------------------------------------------------*/
+unsigned int
+ShoutCast2 :: sendData (    const struct iovec    * vec,
+                            unsigned int            count ) throw ( Exception )
+{
+    struct iovec    out[maxVec + 1];
+    unsigned int    n = 0;
+    unsigned int    len;
+    unsigned int    headLeft;
+    unsigned int    payload;
+    unsigned int    ret;
+
+    if ( count > maxVec ) {
+        count = maxVec;
+    }
+    if ( !(len = Util::vecLen( vec, count)) ) {
+        return 0;
+    }
+
+    if ( sent == headLen + payloadLen ) {
+        // the previous message is sent, start a new one with as much of
+        // the data as fits, after the byte ending the previous one, and
+        // the title if it changed
+        headLen = 0;
+        if ( messageOpen ) {
+            head[headLen++] = 0;
+        }
+
+        pthread_mutex_lock( &mutex);
+        if ( metadataPending ) {
+            memcpy( head + headLen, metadata, metadataLen);
+            headLen        += metadataLen;
+            metadataPending = false;
+        }
+        pthread_mutex_unlock( &mutex);
+
+        payloadLen   = len;
+        if ( payloadLen > maxPayload ) {
+            payloadLen = maxPayload;
+        }
+        headLen     += makeHeader( head + headLen, UVOX_MP3_DATA, payloadLen);
+        sent         = 0;
+        messageOpen  = true;
+    }
+
+    // the rest of the bytes before the payload, if any
+    headLeft = sent < headLen ? headLen - sent : 0;
+    if ( headLeft ) {
+        out[n].iov_base = head + sent;
+        out[n].iov_len  = headLeft;
+        ++n;
+    }
+
+    // as much of the data as is left of the message, the data passed
+    // continues what was sent of the message so far
+    payload = payloadLen - (sent + headLeft - headLen);
+    payload = len < payload ? len : payload;
+    for ( len = 0; len < payload; ++vec ) {
+        out[n]         = *vec;
+        out[n].iov_len = vec->iov_len < payload - len ? vec->iov_len
+                                                      : payload - len;
+        len           += out[n].iov_len;
+        ++n;
+    }
+
+    ret   = getSink()->writeVec( out, n);
+    sent += ret;
+
+    return ret > headLeft ? ret - headLeft : 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Change the title of the stream
+ *----------------------------------------------------------------------------*/
+void
+ShoutCast2 :: setTitle (    const char    * title )     throw ()
+{
+    std::string     xml;
+    unsigned char   ids[headerSize];
+    unsigned int    len;
+
+    xml = "<?xml version=\"1.0\" encoding=\"UTF-8\" ?><metadata><TIT2>";
+    for ( const char * p = title; *p; ++p ) {
+        switch ( *p ) {
+            case '&':   xml += "&amp;";     break;
+            case '<':   xml += "&lt;";      break;
+            case '>':   xml += "&gt;";      break;
+            case '"':   xml += "&quot;";    break;
+            case '\'':  xml += "&apos;";    break;
+            default:    xml += *p;          break;
+        }
+    }
+    xml += "</TIT2></metadata>";
+
+    len = xml.length();
+    if ( len > maxPayload - sizeof(ids) ) {
+        len = maxPayload - sizeof(ids);
+    }
+
+    pthread_mutex_lock( &mutex);
+
+    // the metadata ID, and the whole of it in a single message of one
+    metadataId = (metadataId + 1) & 0xffff;
+    ids[0] = metadataId >> 8;
+    ids[1] = metadataId & 0xff;
+    ids[2] = 0;
+    ids[3] = 1;
+    ids[4] = 0;
+    ids[5] = 1;
+
+    metadataLen  = makeHeader( metadata, UVOX_XML_METADATA, sizeof(ids) + len);
+    memcpy( metadata + metadataLen, ids, sizeof(ids));
+    metadataLen += sizeof(ids);
+    memcpy( metadata + metadataLen, xml.c_str(), len);
+    metadataLen += len;
+    metadata[metadataLen++] = 0;
+
+    metadataPending = true;
+
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the connection
+ *----------------------------------------------------------------------------*/
+void
+ShoutCast2 :: close ( void )                            throw ( Exception )
+{
+    if ( isOpen() && sent == headLen + payloadLen ) {
+        // end the last message, and the stream
+        unsigned char   buf[1 + headerSize + 1];
+        unsigned int    len = 0;
+
+        if ( messageOpen ) {
+            buf[len++] = 0;
+        }
+        len       += makeHeader( buf + len, UVOX_TERMINATE, 0);
+        buf[len++] = 0;
+
+        getSink()->write( buf, len);
+        messageOpen = false;
+    }
+
+    CastSink::close();
+}
+
@@ -0,0 +1,348 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : ShoutCast2.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef SHOUT_CAST2_H
+#define SHOUT_CAST2_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include "Sink.h"
+#include "TcpSocket.h"
+#include "CastSink.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  Class representing output to a ShoutCast DNAS 2 server, with the
+ *  Ultravox 2.1 source protocol.
+ *
+ *  The stream is sent as Ultravox messages, each with a small header
+ *  telling its type and length. The login is a series of messages, each
+ *  acknowledged by the server: the password is sent encrypted, with the
+ *  ID of the stream to feed, as a DNAS 2 server may host several streams.
+ *  Title updates are sent as metadata messages between the data messages,
+ *  on the same connection.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class ShoutCast2 : public CastSink
+{
+    private:
+
+        /**
+         *  The largest payload of an Ultravox message.
+         */
+        static const unsigned int   maxPayload = 16377;
+
+        /**
+         *  The size of the header of an Ultravox message.
+         */
+        static const unsigned int   headerSize = 6;
+
+        /**
+         *  The maximum number of buffers sent by sendData() at once.
+         */
+        static const unsigned int   maxVec = 16;
+
+        /**
+         *  The user name to log in with, or 0.
+         */
+        char                  * user;
+
+        /**
+         *  The ID of the stream fed on the server.
+         */
+        unsigned int            streamId;
+
+        /**
+         *  The bytes sent before the payload of the data message being
+         *  sent: the end of the previous message, a metadata message if
+         *  there is one to send, and the header of the data message.
+         */
+        unsigned char           head[1 + headerSize + maxPayload + 1
+                                       + headerSize];
+
+        /**
+         *  The number of bytes in head.
+         */
+        unsigned int            headLen;
+
+        /**
+         *  The payload length of the data message being sent.
+         */
+        unsigned int            payloadLen;
+
+        /**
+         *  The number of bytes of head and the payload sent so far.
+         */
+        unsigned int            sent;
+
+        /**
+         *  True if a data message was sent, but not the byte ending it.
+         */
+        bool                    messageOpen;
+
+        /**
+         *  The metadata message with the last title, with its ending byte.
+         */
+        unsigned char           metadata[headerSize + maxPayload + 1];
+
+        /**
+         *  The number of bytes in metadata, 0 if there is no title.
+         */
+        unsigned int            metadataLen;
+
+        /**
+         *  True if the metadata message is still to be sent. The last
+         *  one is sent again after logging in again.
+         */
+        bool                    metadataPending;
+
+        /**
+         *  The ID of the last metadata message.
+         */
+        unsigned int            metadataId;
+
+        /**
+         *  The mutex guarding the metadata, as it is updated from
+         *  another thread than the one sending the stream.
+         */
+        pthread_mutex_t         mutex;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param user the user name to log in with, or 0.
+         *  @param streamId the ID of the stream fed on the server.
+         *  @exception Exception
+         */
+        void
+        init (  const char            * user,
+                unsigned int            streamId )
+                                                    throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Write the header of an Ultravox message.
+         *
+         *  @param buf the buffer to write the header to, headerSize long.
+         *  @param type the class and type of the message.
+         *  @param len the length of the payload.
+         *  @return the length of the header.
+         */
+        static unsigned int
+        makeHeader (    unsigned char         * buf,
+                        unsigned int            type,
+                        unsigned int            len )   throw ();
+
+        /**
+         *  Send a login message, and read the server's answer to it.
+         *
+         *  @param type the class and type of the message.
+         *  @param payload the payload of the message, a string.
+         *  @param answer the buffer to read the payload of the answer to.
+         *  @param size the size of answer.
+         *  @return true if the server acknowledged the message.
+         *  @exception Exception
+         */
+        bool
+        exchange (      unsigned int            type,
+                        const char            * payload,
+                        char                  * answer,
+                        unsigned int            size )  throw ( Exception );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        ShoutCast2 ( void )                         throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the state
+         *  of the connection can not be shared.
+         *
+         *  @param cs the object to copy.
+         *  @exception Exception
+         */
+        inline
+        ShoutCast2 (    const ShoutCast2  & cs )    throw ( Exception )
+                : CastSink( cs )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Log in to the ShoutCast server using the Ultravox 2.1 protocol.
+         *
+         *  @return true if login was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        sendLogin ( void )                          throw ( Exception );
+
+        /**
+         *  Send stream data to the server, as Ultravox data messages,
+         *  preceded by the metadata message waiting, if any.
+         *
+         *  @param vec the buffers to send.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes of the stream data sent.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        sendData (  const struct iovec    * vec,
+                    unsigned int            count )     throw ( Exception );
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param socket socket connection to the server.
+         *  @param password password to the server.
+         *  @param user the user name to log in with, or 0 for none.
+         *  @param streamId the ID of the stream to feed on the server.
+         *  @param bitRate bitrate of the stream (e.g. mp3 bitrate).
+         *  @param name name of the stream.
+         *  @param url URL associated with the stream.
+         *  @param genre genre of the stream.
+         *  @param isPublic is the stream public?
+         *  @param streamDump an optional sink to dump the binary stream
+         *                    data to.
+         *  @exception Exception
+         */
+        inline
+        ShoutCast2 (    TcpSocket         * socket,
+                        const char        * password,
+                        const char        * user,
+                        unsigned int        streamId,
+                        unsigned int        bitRate,
+                        const char        * name           = 0,
+                        const char        * url            = 0,
+                        const char        * genre          = 0,
+                        bool                isPublic       = false,
+                        Sink              * streamDump     = 0 )
+                                                        throw ( Exception )
+              : CastSink( socket,
+                          password,
+                          bitRate,
+                          name,
+                          url,
+                          genre,
+                          isPublic,
+                          streamDump )
+        {
+            init( user, streamId);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~ShoutCast2( void )                         throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Get the ID of the stream fed on the server.
+         *
+         *  @return the ID of the stream.
+         */
+        inline unsigned int
+        getStreamId ( void ) const                  throw ()
+        {
+            return streamId;
+        }
+
+        /**
+         *  Change the title of the stream. It is sent in band, before
+         *  the next data message.
+         *
+         *  @param title the new title.
+         */
+        void
+        setTitle (  const char    * title )         throw ();
+
+        /**
+         *  Close the connection, telling the server that the stream
+         *  is over if not in the middle of a message.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                              throw ( Exception );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* SHOUT_CAST2_H */
+
@@ -0,0 +1,215 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SilenceDetector.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#else
+#error need math.h
+#endif
+
+#include "SilenceDetector.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+SilenceDetector :: init (   const AudioSource     * source,
+                            double                  level,
+                            unsigned int            hold )
+                                                        throw ( Exception )
+{
+    if ( !source || !source->getSampleSize() ) {
+        throw Exception( __FILE__, __LINE__, "no source to detect silence in");
+    }
+    if ( level > 0.0 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "silence level above full scale");
+    }
+
+    bitsPerSample = source->getBitsPerSample();
+    sampleSize    = source->getSampleSize();
+#ifdef WORDS_BIGENDIAN
+    swap          = !source->isBigEndian();
+#else
+    swap          = source->isBigEndian();
+#endif
+    zero8         = source->isSigned8() ? 0 : 0x80;
+    threshold     = bitsPerSample > 16 ? 0
+                  : (int) (pow( 10.0, level / 20.0)
+                           * (1 << (bitsPerSample - 1)));
+    sampleRate    = source->getSampleRate();
+    holdSamples   = (unsigned long long) hold * sampleRate;
+    runSamples    = 0;
+    silent        = false;
+    this->level   = level;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Tell if 16 bit samples are all silent
+ *  the inner loops have no branches, so that they are vectorized
+ *----------------------------------------------------------------------------*/
+bool
+SilenceDetector :: isQuiet16 ( const short        * samples,
+                               unsigned int         count ) const   throw ()
+{
+    unsigned int    i;
+    unsigned int    j;
+    unsigned int    n;
+
+    for ( i = 0; i < count; i += n ) {
+        short   lo = 0;
+        short   hi = 0;
+
+        n = count - i < blockSamples ? count - i : blockSamples;
+
+        if ( swap ) {
+            for ( j = i; j < i + n; ++j ) {
+                unsigned short  u = samples[j];
+                short           v = (short) ((u << 8) | (u >> 8));
+
+                lo = v < lo ? v : lo;
+                hi = v > hi ? v : hi;
+            }
+        } else {
+            for ( j = i; j < i + n; ++j ) {
+                short           v = samples[j];
+
+                lo = v < lo ? v : lo;
+                hi = v > hi ? v : hi;
+            }
+        }
+
+        if ( hi > threshold || lo < -threshold ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Tell if 8 bit samples are all silent
+ *----------------------------------------------------------------------------*/
+bool
+SilenceDetector :: isQuiet8 (  const unsigned char  * samples,
+                               unsigned int           count ) const throw ()
+{
+    unsigned int    i;
+    unsigned int    j;
+    unsigned int    n;
+
+    for ( i = 0; i < count; i += n ) {
+        signed char     lo = 0;
+        signed char     hi = 0;
+
+        n = count - i < blockSamples ? count - i : blockSamples;
+
+        for ( j = i; j < i + n; ++j ) {
+            signed char     v = (signed char) (samples[j] ^ zero8);
+
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+
+        if ( hi > threshold || lo < -threshold ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Scan a buffer read from the source
+ *----------------------------------------------------------------------------*/
+bool
+SilenceDetector :: isSilent (   const void        * buf,
+                                unsigned int        len )       throw ()
+{
+    bool    quiet;
+
+    switch ( bitsPerSample ) {
+        case 8:
+            quiet = isQuiet8( (const unsigned char *) buf, len);
+            break;
+
+        case 16:
+            quiet = isQuiet16( (const short *) buf, len / 2);
+            break;
+
+        default:
+            quiet = false;
+            break;
+    }
+
+    if ( !quiet ) {
+        if ( silent ) {
+            silent = false;
+            reportEvent( 3, "end of silence, encoding again after seconds",
+                         runSamples / sampleRate);
+        }
+        runSamples = 0;
+        return false;
+    }
+
+    runSamples += len / sampleSize;
+    if ( !silent && runSamples >= holdSamples ) {
+        silent = true;
+        reportEvent( 3, "silence below dBFS, writing silent frames", level);
+    }
+
+    return silent;
+}
+
@@ -0,0 +1,248 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SilenceDetector.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef SILENCE_DETECTOR_H
+#define SILENCE_DETECTOR_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Referable.h"
+#include "Reporter.h"
+#include "Exception.h"
+#include "AudioSource.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  Detect runs of silence in the audio read from an AudioSource.
+ *
+ *  The peak of each buffer read is compared to a level, anything not
+ *  above it counts as silence. Once the silence lasts for a hold time,
+ *  the buffers are reported silent, so that the encoders write
+ *  pre-encoded silent frames instead of encoding them, up until the
+ *  first buffer with a peak above the level. The hold time keeps short
+ *  pauses in the program encoded as they are.
+ *
+ *  The peak is found in blocks of a fixed number of samples, which the
+ *  compiler turns into vector instructions, and the scan stops at the
+ *  first block that is not silent.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class SilenceDetector : public virtual Referable, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The number of samples in a block scanned at once.
+         */
+        static const unsigned int   blockSamples = 64;
+
+        /**
+         *  Number of bits per sample of the input, 8 or 16.
+         */
+        unsigned int                bitsPerSample;
+
+        /**
+         *  The number of bytes of a sample for all channels.
+         */
+        unsigned int                sampleSize;
+
+        /**
+         *  The sample rate of the input.
+         */
+        unsigned int                sampleRate;
+
+        /**
+         *  True if the input has to be byte swapped to scan it.
+         */
+        bool                        swap;
+
+        /**
+         *  The value of a silent 8 bit sample: 0x80 if the input is
+         *  unsigned, 0 if it is signed.
+         */
+        unsigned char               zero8;
+
+        /**
+         *  The highest sample value still counted as silence.
+         */
+        int                         threshold;
+
+        /**
+         *  The number of samples a run of silence has to last before
+         *  it is reported.
+         */
+        unsigned long long          holdSamples;
+
+        /**
+         *  The number of samples in the current run of silence.
+         */
+        unsigned long long          runSamples;
+
+        /**
+         *  True while the buffers are reported silent.
+         */
+        bool                        silent;
+
+        /**
+         *  The level of silence, in dBFS, to report.
+         */
+        double                      level;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param source the source of the audio scanned.
+         *  @param level the level of silence, in dBFS.
+         *  @param hold the seconds of silence before it is reported.
+         *  @exception Exception
+         */
+        void
+        init (  const AudioSource     * source,
+                double                  level,
+                unsigned int            hold )      throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        inline void
+        strip ( void )                              throw ( Exception )
+        {
+        }
+
+        /**
+         *  Tell if 16 bit samples are all silent.
+         *
+         *  @param samples the samples.
+         *  @param count the number of samples.
+         *  @return true if no sample is above the threshold.
+         */
+        bool
+        isQuiet16 ( const short           * samples,
+                    unsigned int            count ) const   throw ();
+
+        /**
+         *  Tell if 8 bit samples are all silent, that is if they stay
+         *  within the threshold around the zero point of the source.
+         *
+         *  @param samples the samples.
+         *  @param count the number of samples.
+         *  @return true if the samples are within the threshold.
+         */
+        bool
+        isQuiet8 (  const unsigned char   * samples,
+                    unsigned int            count ) const   throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        SilenceDetector ( void )                    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param source the source of the audio scanned. Only 8 and 16
+         *         bits per sample are scanned, other audio is never
+         *         silent.
+         *  @param level the level of silence, in dBFS. The default only
+         *         takes the lowest bit toggling as silence.
+         *  @param hold the seconds of silence before it is reported.
+         *  @exception Exception
+         */
+        inline
+        SilenceDetector (   const AudioSource     * source,
+                            double                  level = -90.0,
+                            unsigned int            hold  = 5 )
+                                                    throw ( Exception )
+        {
+            init( source, level, hold);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~SilenceDetector ( void )                   throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Scan a buffer read from the source, and tell if it is part of
+         *  a run of silence long enough to write silent frames for.
+         *
+         *  @param buf the audio read.
+         *  @param len the number of bytes in buf.
+         *  @return true if the buffer is silent, and the silence has
+         *          lasted for the hold time, false otherwise.
+         */
+        bool
+        isSilent (  const void        * buf,
+                    unsigned int        len )       throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* SILENCE_DETECTOR_H */
+
@@ -36,6 +36,16 @@
 
 /* ============================================================ include files */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#else
+#error need sys/uio.h
+#endif
+
 #include "Referable.h"
 #include "Exception.h"
 
@@ -147,6 +157,66 @@ class Sink : public virtual Referable
         write (                 const void    * buf,
                                 unsigned int    len )   throw ( Exception ) = 0;
 
+        /**
+         *  Write data from several buffers to the Sink, in one go if
+         *  the Sink supports it. The default implementation calls write()
+         *  for each buffer, and stops at the first short write.
+         *
+         *  @param vec the buffers to write, in order.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes written (may be less than the
+         *          total length of the buffers).
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        writeVec (              const struct iovec    * vec,
+                                unsigned int            count )
+                                                        throw ( Exception )
+        {
+            unsigned int    total = 0;
+            unsigned int    len;
+
+            for ( unsigned int i = 0; i < count; ++i ) {
+                len    = write( vec[i].iov_base, vec[i].iov_len);
+                total += len;
+                if ( len < vec[i].iov_len ) {
+                    break;
+                }
+            }
+
+            return total;
+        }
+
+        /**
+         *  Write audio known to be silent to the Sink. Sinks that can,
+         *  such as audio encoders, write the silence some cheaper way.
+         *  The default implementation calls write().
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written (may be less than len).
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        writeSilent (           const void    * buf,
+                                unsigned int    len )   throw ( Exception )
+        {
+            return write( buf, len);
+        }
+
+        /**
+         *  Tell the Sink that the data written so far ends a complete
+         *  encoded frame (or Ogg page). Sinks that may have to throw away
+         *  data use this to drop whole frames only, thus keeping the
+         *  stream decodable. The default implementation does nothing.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        markFrameEnd ( void )                           throw ( Exception )
+        {
+        }
+
         /**
          *  Flush all data that was written to the Sink to the underlying
          *  construct.
@@ -183,6 +183,17 @@ class SolarisDspSource : public AudioSource, public virtual Reporter
 #endif
         }
 
+        /**
+         *  Tell if 8 bit data from this source is signed or unsigned.
+         *
+         *  @return true, as 8 bit linear samples are signed
+         */
+        virtual inline bool
+        isSigned8 ( void ) const            throw ()
+        {
+            return true;
+        }
+
         /**
          *  Open the SolarisDspSource.
          *  This does not put the Solaris DSP device into recording mode.
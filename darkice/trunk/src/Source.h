@@ -150,6 +150,47 @@ class Source : public virtual Referable
         read (     void          * buf,
                    unsigned int    len )        throw ( Exception )     = 0;
 
+        /**
+         *  Tell if the Source can hand out its data in place, without
+         *  copying it into a buffer, see readInPlace().
+         *
+         *  @return true if readInPlace() is supported, false otherwise.
+         */
+        inline virtual bool
+        canReadInPlace ( void ) const           throw ()
+        {
+            return false;
+        }
+
+        /**
+         *  Read from the Source without copying: get a pointer to the
+         *  data where the Source holds it. The data stays valid, and no
+         *  more may be read, until releaseInPlace() is called.
+         *  The default implementation reads nothing.
+         *
+         *  @param buf set to point to the data read.
+         *  @param len the maximum number of bytes to read.
+         *  @return the number of bytes read (may be less than len).
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        readInPlace (   const void   ** buf,
+                        unsigned int    len )   throw ( Exception )
+        {
+            return 0;
+        }
+
+        /**
+         *  Give back data read with readInPlace(), once done with it.
+         *
+         *  @param len the number of bytes read by readInPlace().
+         *  @exception Exception
+         */
+        inline virtual void
+        releaseInPlace ( unsigned int   len )   throw ( Exception )
+        {
+        }
+
         /**
          *  Close the Source.
          *
@@ -63,10 +63,10 @@
 #error need netinet/in.h
 #endif
 
-#ifdef HAVE_NETDB_H
-#include <netdb.h>
+#ifdef HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
 #else
-#error need netdb.h
+#error need netinet/tcp.h
 #endif
 
 #ifdef HAVE_UNISTD_H
@@ -87,6 +87,24 @@
 #error need signal.h
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#else
+#error need poll.h
+#endif
+
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#else
+#error need sys/ioctl.h
+#endif
+
 
 #include "Util.h"
 #include "Exception.h"
@@ -103,6 +121,15 @@
  *----------------------------------------------------------------------------*/
 static const char fileid[] = "$Id$";
 
+/*------------------------------------------------------------------------------
+ *  The flags to use with send()
+ *----------------------------------------------------------------------------*/
+#ifdef HAVE_MSG_NOSIGNAL
+#define SEND_FLAGS      MSG_NOSIGNAL
+#else
+#define SEND_FLAGS      0
+#endif
+
 
 /* ===============================================  local function prototypes */
 
@@ -116,9 +143,26 @@ void
 TcpSocket :: init (   const char    * host,
                       unsigned short  port )          throw ( Exception )
 {
-    this->host   = Util::strDup( host);
-    this->port   = port;
-    this->sockfd = 0;
+    this->host              = Util::strDup( host);
+    this->port              = port;
+    this->sockfd            = 0;
+    this->connectTimeout    = defaultConnectTimeout;
+    this->sendBufferSize    = 0;
+    this->notSentLowat      = 0;
+    this->noDelay           = false;
+    this->userTimeout       = 0;
+    this->keepAliveIdle     = 0;
+    this->keepAliveInterval = 0;
+    this->keepAliveCount    = 0;
+    this->corked            = false;
+    this->pacingRate        = 0;
+    this->pacingBurst       = 0;
+    this->pacer             = 0;
+    this->sendQueue  = 0;
+    this->sendError  = 0;
+    this->writeArmed = false;
+
+    pthread_mutex_init( &mutex, 0);
 }
 
 
@@ -133,6 +177,9 @@ TcpSocket :: strip ( void)                           throw ( Exception )
     }
 
     delete[] host;
+    delete sendQueue;
+    delete pacer;
+    pthread_mutex_destroy( &mutex);
 }
 
 
@@ -192,66 +239,327 @@ TcpSocket :: operator= (  const TcpSocket &    ss )   throw ( Exception )
 bool
 TcpSocket :: open ( void )                       throw ( Exception )
 {
-    int                     optval;
-    socklen_t               optlen;
-#ifdef HAVE_ADDRINFO
-    struct addrinfo         hints
-    struct addrinfo       * ptr;
-    struct sockaddr_storage addr;
-    char                    portstr[6];
-#else
-    struct sockaddr_in      addr;
-    struct hostent        * pHostEntry;
-#endif
- 
+    Resolver::Address       addresses[Resolver::maxAddresses];
+    unsigned int            noAddresses;
+    int                     flags;
+
     if ( isOpen() ) {
         return false;
     }
 
-#ifdef HAVE_ADDRINFO
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_family = AF_ANY;
-    snprintf(portstr, sizeof(portstr), "%d", port);
+    if ( resolver.get() ) {
+        noAddresses = resolver->resolve( host,
+                                         port,
+                                         addresses,
+                                         Resolver::maxAddresses,
+                                         connectTimeout * 1000);
+    } else {
+        noAddresses = Resolver::lookup( host,
+                                        port,
+                                        addresses,
+                                        Resolver::maxAddresses);
+    }
+    if ( noAddresses == 0 ) {
+        throw Exception( __FILE__, __LINE__, "can't resolve host: ", host);
+    }
+
+    sockfd = connectAny( addresses, noAddresses);
+    corked = false;
 
-    if (getaddrinfo(host , portstr, &hints, &ptr)) {
+    setOptions();
+
+    try {
+        startSession();
+    } catch ( Exception   & e ) {
+        ::close( sockfd);
         sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "getaddrinfo error", errno);
+        throw;
     }
-    memcpy ( addr, ptr->ai_addr, ptr->ai_addrlen);
-    freeaddrinfo(ptr);
-#else
-    if ( !(pHostEntry = gethostbyname( host)) ) {
-        sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "gethostbyname error", errno);
+
+    if ( !isAsync() ) {
+        // the socket was connected in non-blocking mode, switch back
+        if ( (flags = fcntl( sockfd, F_GETFL, 0)) == -1
+          || fcntl( sockfd, F_SETFL, flags & ~O_NONBLOCK) == -1 ) {
+            ::close( sockfd);
+            sockfd = 0;
+            throw Exception( __FILE__, __LINE__, "fcntl error", errno);
+        }
+
+        return true;
     }
-    
-    memset( &addr, 0, sizeof(addr));
-    addr.sin_family      = AF_INET;
-    addr.sin_port        = htons(port);
-    addr.sin_addr.s_addr = *((long*) pHostEntry->h_addr_list[0]);
-#endif
 
-    if ( (sockfd = socket( AF_INET, SOCK_STREAM,  IPPROTO_TCP)) == -1 ) {
+#ifdef HAVE_EVENT_LOOP
+    if ( !sendQueue ) {
+        sendQueue = new RingBuffer( sendQueueSize);
+    }
+    sendQueue->clear();
+    sendError  = 0;
+    writeArmed = false;
+
+    try {
+        eventLoop->add( sockfd, this, 0);
+    } catch ( Exception   & e ) {
+        ::close( sockfd);
         sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "socket error", errno);
+        throw;
     }
+#endif
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set the configured options on the connected socket
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: setOptions ( void )                    throw ()
+{
+    int         optval;
+    socklen_t   optlen = sizeof(optval);
 
     // set TCP keep-alive
     optval = 1;
-    optlen = sizeof(optval);
     if (setsockopt(sockfd, SOL_SOCKET, SO_KEEPALIVE, &optval, optlen) == -1) {  
         reportEvent(5, "can't set TCP socket keep-alive mode", errno);
     }
 
-    // connect
-    if ( connect( sockfd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ) {
-        ::close( sockfd);
-        sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "connect error", errno);
+    if ( sendBufferSize ) {
+        optval = sendBufferSize;
+        if ( setsockopt( sockfd, SOL_SOCKET, SO_SNDBUF, &optval, optlen)
+                                                                    == -1 ) {
+            reportEvent( 3, "can't set TCP socket send buffer size", errno);
+        }
     }
 
-    return true;
+    if ( noDelay ) {
+        optval = 1;
+        if ( setsockopt( sockfd, IPPROTO_TCP, TCP_NODELAY, &optval, optlen)
+                                                                    == -1 ) {
+            reportEvent( 3, "can't set TCP_NODELAY", errno);
+        }
+    }
+
+    if ( notSentLowat ) {
+#ifdef TCP_NOTSENT_LOWAT
+        optval = notSentLowat;
+        if ( setsockopt( sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+                         &optval, optlen) == -1 ) {
+            reportEvent( 3, "can't set TCP_NOTSENT_LOWAT", errno);
+        }
+#else
+        reportEvent( 3, "TCP_NOTSENT_LOWAT not supported, ignored");
+#endif
+    }
+
+    if ( userTimeout ) {
+#ifdef TCP_USER_TIMEOUT
+        optval = userTimeout;
+        if ( setsockopt( sockfd, IPPROTO_TCP, TCP_USER_TIMEOUT,
+                         &optval, optlen) == -1 ) {
+            reportEvent( 3, "can't set TCP_USER_TIMEOUT", errno);
+        }
+#else
+        reportEvent( 3, "TCP_USER_TIMEOUT not supported, ignored");
+#endif
+    }
+
+#if defined( TCP_KEEPIDLE ) && defined( TCP_KEEPINTVL ) && defined( TCP_KEEPCNT )
+    if ( keepAliveIdle ) {
+        optval = keepAliveIdle;
+        if ( setsockopt( sockfd, IPPROTO_TCP, TCP_KEEPIDLE, &optval, optlen)
+                                                                    == -1 ) {
+            reportEvent( 3, "can't set TCP_KEEPIDLE", errno);
+        }
+    }
+    if ( keepAliveInterval ) {
+        optval = keepAliveInterval;
+        if ( setsockopt( sockfd, IPPROTO_TCP, TCP_KEEPINTVL, &optval, optlen)
+                                                                    == -1 ) {
+            reportEvent( 3, "can't set TCP_KEEPINTVL", errno);
+        }
+    }
+    if ( keepAliveCount ) {
+        optval = keepAliveCount;
+        if ( setsockopt( sockfd, IPPROTO_TCP, TCP_KEEPCNT, &optval, optlen)
+                                                                    == -1 ) {
+            reportEvent( 3, "can't set TCP_KEEPCNT", errno);
+        }
+    }
+#else
+    if ( keepAliveIdle || keepAliveInterval || keepAliveCount ) {
+        reportEvent( 3, "keep-alive parameters not supported, ignored");
+    }
+#endif
+
+    delete pacer;
+    pacer = 0;
+    if ( pacingRate ) {
+#ifdef SO_MAX_PACING_RATE
+        unsigned int    rate = pacingRate;
+
+        if ( setsockopt( sockfd, SOL_SOCKET, SO_MAX_PACING_RATE,
+                         &rate, sizeof(rate)) == 0 ) {
+            return;
+        }
+        reportEvent( 3, "can't set SO_MAX_PACING_RATE, pacing in user space",
+                     errno);
+#endif
+        pacer = new TokenBucket( pacingRate, pacingBurst);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Cork or uncork the socket
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: setCork (  bool    cork )              throw ()
+{
+    int     optval = cork ? 1 : 0;
+
+    if ( !isOpen() || isAsync() ) {
+        // the event loop sends what was queued in one go anyway
+        return;
+    }
+
+#if defined( TCP_CORK )
+    if ( setsockopt( sockfd, IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval))
+                                                                    == -1 ) {
+        reportEvent( 5, "can't set TCP_CORK", errno);
+        return;
+    }
+#elif defined( TCP_NOPUSH )
+    if ( setsockopt( sockfd, IPPROTO_TCP, TCP_NOPUSH, &optval, sizeof(optval))
+                                                                    == -1 ) {
+        reportEvent( 5, "can't set TCP_NOPUSH", errno);
+        return;
+    }
+#else
+    return;
+#endif
+
+    corked = cork;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Connect to one of the addresses.
+ *  A new attempt is started every connectAttemptDelay milliseconds, or
+ *  right away when an attempt fails, while the earlier attempts are
+ *  still allowed to complete. The first to succeed wins.
+ *----------------------------------------------------------------------------*/
+int
+TcpSocket :: connectAny (   const Resolver::Address   * addresses,
+                            unsigned int                noAddresses )
+                                                        throw ( Exception )
+{
+    struct pollfd           fds[Resolver::maxAddresses];
+    unsigned int            noFds     = 0;
+    unsigned int            next      = 0;
+    unsigned long long      now       = Util::getMonotonicTime();
+    unsigned long long      deadline  = now + connectTimeout * 1000000ULL;
+    unsigned long long      nextStart = now;
+    unsigned long long      wait;
+    int                     fd        = -1;
+    int                     error     = ETIMEDOUT;
+    int                     flags;
+    int                     ret;
+    unsigned int            i;
+
+    while ( fd == -1 && now < deadline ) {
+        // start the next attempt, if it is time
+        if ( next < noAddresses && (now >= nextStart || noFds == 0) ) {
+            const Resolver::Address   * addr = &addresses[next++];
+            int                         s;
+
+            if ( (s = socket( addr->addr.ss_family, SOCK_STREAM, IPPROTO_TCP))
+                                                                    == -1 ) {
+                error = errno;
+                continue;
+            }
+            if ( (flags = fcntl( s, F_GETFL, 0)) == -1
+              || fcntl( s, F_SETFL, flags | O_NONBLOCK) == -1 ) {
+                error = errno;
+                ::close( s);
+                continue;
+            }
+            if ( connect( s, (const struct sockaddr *) &addr->addr, addr->len)
+                                                                    == 0 ) {
+                fd = s;
+                break;
+            }
+            if ( errno != EINPROGRESS ) {
+                error = errno;
+                ::close( s);
+                continue;
+            }
+
+            fds[noFds].fd      = s;
+            fds[noFds].events  = POLLOUT;
+            fds[noFds].revents = 0;
+            ++noFds;
+            nextStart = now + connectAttemptDelay * 1000ULL;
+        }
+
+        if ( noFds == 0 ) {
+            if ( next == noAddresses ) {
+                // all attempts failed
+                break;
+            }
+            continue;
+        }
+
+        wait = deadline - now;
+        if ( next < noAddresses && nextStart - now < wait ) {
+            wait = nextStart - now;
+        }
+
+        ret = poll( fds, noFds, (wait + 999) / 1000);
+        if ( ret == -1 && errno != EINTR ) {
+            error = errno;
+            break;
+        }
+
+        for ( i = 0; ret > 0 && i < noFds; ) {
+            int         err    = 0;
+            socklen_t   errlen = sizeof(err);
+
+            if ( !fds[i].revents ) {
+                ++i;
+                continue;
+            }
+
+            if ( getsockopt( fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &errlen)
+                                                                    == -1 ) {
+                err = errno;
+            }
+            if ( err == 0 ) {
+                fd          = fds[i].fd;
+                fds[i]      = fds[--noFds];
+                break;
+            }
+
+            // a failed attempt lets the next one start right away
+            error     = err;
+            ::close( fds[i].fd);
+            fds[i]    = fds[--noFds];
+            nextStart = now;
+        }
+
+        now = Util::getMonotonicTime();
+    }
+
+    // close the attempts that lost the race
+    for ( i = 0; i < noFds; ++i ) {
+        ::close( fds[i].fd);
+    }
+
+    if ( fd == -1 ) {
+        throw Exception( __FILE__, __LINE__, "connect error", error);
+    }
+
+    return fd;
 }
 
 
@@ -306,10 +614,22 @@ TcpSocket :: read (     void          * buf,
         return 0;
     }
 
-    ret = recv( sockfd, buf, len, 0);
+    ret = recvData( buf, len);
+
+    if ( ret == -1 && errno == EAGAIN && isAsync() ) {
+        // non-blocking socket, wait for the data to arrive
+        if ( !canRead( readTimeout, 0) ) {
+            return 0;
+        }
+        ret = recvData( buf, len);
+    }
 
     if ( ret == -1 ) {
         switch (errno) {
+            case EAGAIN:
+                ret = 0;
+                break;
+
             case ECONNRESET:
                 // re-open the socket if it has been reset by the peer
                 close();
@@ -344,6 +664,17 @@ TcpSocket :: canWrite (    unsigned int    sec,
         return false;
     }
 
+    if ( pacer && !pacer->getAvailable() ) {
+        // don't wait for the tokens, write() is paced anyway
+        return false;
+    }
+
+    if ( isAsync() ) {
+        // let write() report a pending error
+        return __atomic_load_n( &sendError, __ATOMIC_ACQUIRE)
+            || sendQueue->getFree() > 0;
+    }
+
     FD_ZERO( &fdset);
     FD_SET( sockfd, &fdset);
 
@@ -373,30 +704,250 @@ unsigned int
 TcpSocket :: write (    const void    * buf,
                         unsigned int    len )       throw ( Exception )
 {
-    int         ret;
+    struct iovec    vec;
+
+    vec.iov_base = (void *) buf;
+    vec.iov_len  = len;
+
+    return writeVec( &vec, 1);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write several buffers to the socket
+ *----------------------------------------------------------------------------*/
+unsigned int
+TcpSocket :: writeVec ( const struct iovec    * vec,
+                        unsigned int            count )     throw ( Exception )
+{
+    struct iovec    paced[maxPacedVec];
+    int             ret;
 
     if ( !isOpen() ) {
         return 0;
     }
 
-#ifdef HAVE_MSG_NOSIGNAL
-    ret = send( sockfd, buf, len, MSG_NOSIGNAL);
+    if ( pacer ) {
+        // only send as much as the token bucket allows
+        unsigned int    tokens = pacer->getAvailable();
+        unsigned int    i;
+
+        if ( !tokens ) {
+            return 0;
+        }
+        count = count < maxPacedVec ? count : maxPacedVec;
+        memcpy( paced, vec, count * sizeof(struct iovec));
+        for ( i = 0; i < count; ++i ) {
+            if ( paced[i].iov_len >= tokens ) {
+                paced[i].iov_len = tokens;
+                count            = i + 1;
+                break;
+            }
+            tokens -= paced[i].iov_len;
+        }
+        vec = paced;
+    }
+
+    if ( !isAsync() ) {
+        ret = sendVec( vec, count);
+
+        if ( ret == -1 ) {
+            if ( errno == EAGAIN ) {
+                ret = 0;
+            } else {
+                ::close( sockfd);
+                sockfd = 0;
+                reportEvent(4,"TcpSocket :: write, send error", errno);
+                throw Exception( __FILE__, __LINE__, "send error", errno);
+            }
+        }
+
+        if ( pacer ) {
+            pacer->consume( ret);
+        }
+
+        return ret;
+    }
+
+#ifdef HAVE_EVENT_LOOP
+    unsigned int            sent  = 0;
+    unsigned int            want;
+    unsigned int            n;
+    unsigned int            i;
+    int                     error;
+
+    error = __atomic_load_n( &sendError, __ATOMIC_ACQUIRE);
+    if ( error ) {
+        close();
+        reportEvent(4,"TcpSocket :: write, send error", error);
+        throw Exception( __FILE__, __LINE__, "send error", error);
+    }
+
+    // only queue the data, all sending is done by the event loop
+    for ( i = 0; i < count; ++i ) {
+        want  = vec[i].iov_len;
+        n     = sendQueue->put( vec[i].iov_base, want);
+        sent += n;
+        if ( n < want ) {
+            break;
+        }
+    }
+
+    if ( sent ) {
+        armWrite();
+    }
+
+    if ( pacer ) {
+        pacer->consume( sent);
+    }
+
+    return sent;
 #else
-    ret = send( sockfd, buf, len, 0);
+    return 0;
 #endif
+}
 
-    if ( ret == -1 ) {
-        if ( errno == EAGAIN ) {
-            ret = 0;
-        } else {
-            ::close( sockfd);
-            sockfd = 0;
-            reportEvent(4,"TcpSocket :: write, send error", errno);
-            throw Exception( __FILE__, __LINE__, "send error", errno);
+
+/*------------------------------------------------------------------------------
+ *  Get the number of bytes in the send queue
+ *----------------------------------------------------------------------------*/
+unsigned int
+TcpSocket :: getQueuedBytes ( void )                throw ()
+{
+    return sendQueue ? sendQueue->getUsed() : 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the number of bytes not yet acknowledged by the peer
+ *----------------------------------------------------------------------------*/
+unsigned int
+TcpSocket :: getBacklog ( void )                    throw ()
+{
+    unsigned int    backlog = getQueuedBytes();
+
+#ifdef TIOCOUTQ
+    int             kernel  = 0;
+
+    // for sockets, this is SIOCOUTQ: the data not yet acknowledged
+    if ( sockfd && ioctl( sockfd, TIOCOUTQ, &kernel) == 0 && kernel > 0 ) {
+        backlog += kernel;
+    }
+#endif
+
+    return backlog;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make the event loop watch for writability
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: armWrite ( void )                      throw ()
+{
+#ifdef HAVE_EVENT_LOOP
+    // order the data just queued before reading the flag,
+    // drainQueue() does the same the other way around
+    __atomic_thread_fence( __ATOMIC_SEQ_CST);
+    if ( __atomic_load_n( &writeArmed, __ATOMIC_RELAXED) ) {
+        return;
+    }
+
+    pthread_mutex_lock( &mutex);
+    if ( !writeArmed && !sendError ) {
+        try {
+            eventLoop->modify( sockfd, EventHandler::eventWrite);
+            __atomic_store_n( &writeArmed, true, __ATOMIC_RELAXED);
+        } catch ( Exception   & e ) {
+            __atomic_store_n( &sendError, e.getCode() ? e.getCode() : EBADF,
+                              __ATOMIC_RELEASE);
         }
     }
+    pthread_mutex_unlock( &mutex);
+#endif
+}
 
-    return ret;
+
+/*------------------------------------------------------------------------------
+ *  Record an error from the event loop, and stop watching the socket
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: setSendError ( int     error )         throw ()
+{
+#ifdef HAVE_EVENT_LOOP
+    pthread_mutex_lock( &mutex);
+    __atomic_store_n( &sendError, error, __ATOMIC_RELEASE);
+    __atomic_store_n( &writeArmed, false, __ATOMIC_RELAXED);
+    pthread_mutex_unlock( &mutex);
+
+    eventLoop->remove( sockfd);
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Flush the send queue to the kernel, as much as it takes
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: drainQueue ( void )                    throw ()
+{
+#ifdef HAVE_EVENT_LOOP
+    struct iovec    vec;
+    int             ret;
+
+    // the queued data is contiguous, even if it wraps around
+    while ( (vec.iov_len = sendQueue->getUsed()) ) {
+        vec.iov_base = sendQueue->getReadPtr();
+        ret          = sendVec( &vec, 1);
+        if ( ret == -1 ) {
+            if ( errno != EAGAIN ) {
+                setSendError( errno);
+            }
+            return;
+        }
+        sendQueue->release( ret);
+    }
+
+    pthread_mutex_lock( &mutex);
+    if ( writeArmed ) {
+        try {
+            eventLoop->modify( sockfd, 0);
+        } catch ( Exception   & e ) {
+        }
+        __atomic_store_n( &writeArmed, false, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock( &mutex);
+
+    // write() may have queued more while the flag was still set
+    __atomic_thread_fence( __ATOMIC_SEQ_CST);
+    if ( sendQueue->getUsed() ) {
+        armWrite();
+    }
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Handle an event from the event loop
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: handleEvent (  unsigned int    events )    throw ()
+{
+#ifdef HAVE_EVENT_LOOP
+    if ( !isOpen() || __atomic_load_n( &sendError, __ATOMIC_ACQUIRE) ) {
+        return;
+    }
+
+    if ( events & EventHandler::eventError ) {
+        int         error  = 0;
+        socklen_t   errlen = sizeof(error);
+
+        getsockopt( sockfd, SOL_SOCKET, SO_ERROR, &error, &errlen);
+        setSendError( error ? error : EPIPE);
+    } else if ( events & EventHandler::eventWrite ) {
+        drainQueue();
+    }
+#endif
 }
 
 
@@ -411,8 +962,54 @@ TcpSocket :: close ( void )                          throw ( Exception )
     }
 
     flush();
+
+#ifdef HAVE_EVENT_LOOP
+    if ( isAsync() ) {
+        // unregister first, without holding the mutex, as the loop
+        // may be dispatching to this socket right now
+        eventLoop->remove( sockfd);
+
+        endSession();
+        ::close( sockfd);
+        sockfd     = 0;
+        sendQueue->clear();
+        writeArmed = false;
+
+        return;
+    }
+#endif
+
+    endSession();
     ::close( sockfd);
     sockfd = 0;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Send data over the connection
+ *----------------------------------------------------------------------------*/
+int
+TcpSocket :: sendVec (  const struct iovec    * vec,
+                        unsigned int            count )     throw ()
+{
+    struct msghdr   msg;
+
+    memset( &msg, 0, sizeof(msg));
+    msg.msg_iov    = (struct iovec *) vec;
+    msg.msg_iovlen = count;
+
+    return sendmsg( sockfd, &msg, SEND_FLAGS);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Receive data from the connection
+ *----------------------------------------------------------------------------*/
+int
+TcpSocket :: recvData ( void          * buf,
+                        unsigned int    len )               throw ()
+{
+    return recv( sockfd, buf, len, 0);
+}
+
+
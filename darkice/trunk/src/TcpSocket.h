@@ -36,9 +36,25 @@
 
 /* ============================================================ include files */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include "Ref.h"
 #include "Source.h"
 #include "Sink.h"
 #include "Reporter.h"
+#include "EventHandler.h"
+#include "EventLoop.h"
+#include "Resolver.h"
+#include "RingBuffer.h"
+#include "TokenBucket.h"
 
 
 /* ================================================================ constants */
@@ -50,15 +66,52 @@
 /* =============================================================== data types */
 
 /**
- *  A TCP network socket
+ *  A TCP network socket.
+ *
+ *  When an EventLoop is set, the socket is put into non-blocking mode
+ *  after connecting. Data written is put into a send queue, which is
+ *  flushed from the thread of the event loop as the socket becomes
+ *  writable, thus all sending happens in the event loop. Errors found
+ *  while flushing are reported by the next call to write().
  *
  *  @author  $Author$
  *  @version $Revision$
  */
-class TcpSocket : public Source, public Sink, public virtual Reporter
+class TcpSocket : public Source,
+                  public Sink,
+                  public EventHandler,
+                  public virtual Reporter
 {
     private:
 
+        /**
+         *  The size of the send queue, used with an event loop.
+         */
+        static const unsigned int   sendQueueSize = 64 * 1024;
+
+        /**
+         *  The number of seconds to wait for data in read(),
+         *  when in non-blocking mode.
+         */
+        static const unsigned int   readTimeout = 10;
+
+        /**
+         *  The maximum number of buffers sent by one writeVec() call,
+         *  when pacing in user space.
+         */
+        static const unsigned int   maxPacedVec = 8;
+
+        /**
+         *  The default number of seconds to wait for a connection.
+         */
+        static const unsigned int   defaultConnectTimeout = 5;
+
+        /**
+         *  The number of milliseconds to wait for a connection attempt
+         *  to one address before trying the next address in parallel.
+         */
+        static const unsigned int   connectAttemptDelay = 250;
+
         /**
          *  Name of the host this socket connects to.
          */
@@ -73,7 +126,159 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
          *  Low-level socket descriptor.
          */
         int                 sockfd;
-        
+
+        /**
+         *  The resolver used to look up the host, if any.
+         */
+        Ref<Resolver>       resolver;
+
+        /**
+         *  The number of seconds to wait for the host to be resolved
+         *  and for a connection to be made.
+         */
+        unsigned int        connectTimeout;
+
+        /**
+         *  The size of the kernel send buffer (SO_SNDBUF), 0 for default.
+         */
+        unsigned int        sendBufferSize;
+
+        /**
+         *  The amount of unsent data in the kernel above which the socket
+         *  is not reported writable (TCP_NOTSENT_LOWAT), 0 for default.
+         */
+        unsigned int        notSentLowat;
+
+        /**
+         *  Flag to disable the Nagle algorithm (TCP_NODELAY).
+         */
+        bool                noDelay;
+
+        /**
+         *  The number of milliseconds sent data may stay unacknowledged
+         *  before the connection is dropped (TCP_USER_TIMEOUT),
+         *  0 for default.
+         */
+        unsigned int        userTimeout;
+
+        /**
+         *  The number of seconds of idle time before keep-alive probes
+         *  are sent (TCP_KEEPIDLE), 0 for default.
+         */
+        unsigned int        keepAliveIdle;
+
+        /**
+         *  The number of seconds between keep-alive probes
+         *  (TCP_KEEPINTVL), 0 for default.
+         */
+        unsigned int        keepAliveInterval;
+
+        /**
+         *  The number of unanswered keep-alive probes before the
+         *  connection is dropped (TCP_KEEPCNT), 0 for default.
+         */
+        unsigned int        keepAliveCount;
+
+        /**
+         *  Flag to show that the socket is corked.
+         */
+        bool                corked;
+
+        /**
+         *  The rate to pace the sending at, in bytes per second,
+         *  or 0 not to pace.
+         */
+        unsigned int        pacingRate;
+
+        /**
+         *  The largest burst to send at once when pacing in user space,
+         *  in bytes.
+         */
+        unsigned int        pacingBurst;
+
+        /**
+         *  The token bucket pacing in user space, if the kernel can't
+         *  do the pacing.
+         */
+        TokenBucket       * pacer;
+
+#ifdef HAVE_EVENT_LOOP
+        /**
+         *  The event loop driving this socket, if any.
+         */
+        Ref<EventLoop>      eventLoop;
+#endif
+
+        /**
+         *  Mutex serializing the changes of the events watched by the
+         *  event loop, shared with the event loop.
+         */
+        pthread_mutex_t     mutex;
+
+        /**
+         *  The send queue, data not yet accepted by the kernel.
+         *  Filled by write(), and emptied from the thread of the event
+         *  loop, without locking. Only allocated when used with an
+         *  event loop.
+         */
+        RingBuffer        * sendQueue;
+
+        /**
+         *  The error encountered while flushing the send queue, or 0.
+         */
+        int                 sendError;
+
+        /**
+         *  Flag to show that the event loop watches for writability.
+         */
+        bool                writeArmed;
+
+        /**
+         *  Make the event loop watch for writability, unless it does
+         *  so already.
+         */
+        void
+        armWrite ( void )                               throw ();
+
+        /**
+         *  Record an error encountered from the thread of the event loop,
+         *  and stop watching the socket. write() will report the error.
+         *
+         *  @param error the error code.
+         */
+        void
+        setSendError (  int     error )                 throw ();
+
+        /**
+         *  Send as much of the send queue as the socket accepts,
+         *  and stop watching for writability once it is empty.
+         *  Called from the thread of the event loop.
+         */
+        void
+        drainQueue ( void )                             throw ();
+
+        /**
+         *  Connect to one of the addresses of the host, in non-blocking
+         *  mode. Attempts to the different addresses overlap, in the
+         *  manner of RFC 8305 (Happy Eyeballs).
+         *
+         *  @param addresses the addresses to try, in order of preference.
+         *  @param noAddresses the number of addresses.
+         *  @return the connected socket, in non-blocking mode.
+         *  @exception Exception if no connection could be made in time.
+         */
+        int
+        connectAny (    const Resolver::Address   * addresses,
+                        unsigned int                noAddresses )
+                                                        throw ( Exception );
+
+        /**
+         *  Set the socket options configured for this socket
+         *  on the connected socket.
+         */
+        void
+        setOptions ( void )                             throw ();
+
         /**
          *  Initialize the object.
          *
@@ -108,6 +313,94 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
         }
 
 
+        /**
+         *  Tell if the socket is driven by an event loop.
+         *
+         *  @return true if the socket is driven by an event loop,
+         *          false otherwise.
+         */
+        inline bool
+        isAsync ( void ) const                          throw ()
+        {
+#ifdef HAVE_EVENT_LOOP
+            return eventLoop.get() != 0;
+#else
+            return false;
+#endif
+        }
+
+        /**
+         *  Get the low-level socket descriptor.
+         *
+         *  @return the socket descriptor, 0 if not connected.
+         */
+        inline int
+        getSockfd ( void ) const                        throw ()
+        {
+            return sockfd;
+        }
+
+        /**
+         *  Get the number of seconds to wait for a connection.
+         *
+         *  @return the connection timeout, in seconds.
+         */
+        inline unsigned int
+        getConnectTimeout ( void ) const                throw ()
+        {
+            return connectTimeout;
+        }
+
+        /**
+         *  Start a session over the connection just made, before any
+         *  data is sent. The socket is in non-blocking mode when called.
+         *  The default implementation does nothing, subclasses that
+         *  wrap the connection, like TlsSocket, do their handshake here.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        startSession ( void )                           throw ( Exception )
+        {
+        }
+
+        /**
+         *  End the session over the connection, right before it is
+         *  closed. The default implementation does nothing.
+         */
+        inline virtual void
+        endSession ( void )                             throw ()
+        {
+        }
+
+        /**
+         *  Send data over the connection. All data sent by the socket
+         *  goes through here, possibly from the thread of the event loop.
+         *  The default implementation calls sendmsg().
+         *
+         *  @param vec the buffers to send, in order.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes sent, or -1 with errno set,
+         *          like sendmsg().
+         */
+        virtual int
+        sendVec (   const struct iovec    * vec,
+                    unsigned int            count )     throw ();
+
+        /**
+         *  Receive data from the connection. All data read by the socket
+         *  goes through here. The default implementation calls recv().
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the size of buf.
+         *  @return the number of bytes read, 0 at the end of the stream,
+         *          or -1 with errno set, like recv().
+         */
+        virtual int
+        recvData (  void          * buf,
+                    unsigned int    len )               throw ();
+
+
     public:
 
         /**
@@ -150,7 +443,7 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
          *  @return a reference to this TcpSocket.
          *  @exception Exception
          */
-        inline virtual TcpSocket &
+        virtual TcpSocket &
         operator= ( const TcpSocket &    ss )        throw ( Exception );
 
         /**
@@ -175,6 +468,178 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
             return port;
         }
 
+        /**
+         *  Set the resolver to look up the host with. Without a resolver,
+         *  the host is looked up each time the socket is opened.
+         *
+         *  @param resolver the resolver, or 0 to look up directly.
+         */
+        inline void
+        setResolver (   Resolver      * resolver )      throw ()
+        {
+            this->resolver = resolver;
+        }
+
+        /**
+         *  Set the number of seconds to wait for the host to be resolved
+         *  and for a connection to be made.
+         *
+         *  @param timeout the timeout, in seconds, must be at least 1.
+         */
+        inline void
+        setConnectTimeout ( unsigned int    timeout )   throw ()
+        {
+            this->connectTimeout = timeout ? timeout : 1;
+        }
+
+        /**
+         *  Set the size of the kernel send buffer.
+         *  Takes effect the next time the socket is opened.
+         *
+         *  @param size the size in bytes, 0 for the system default.
+         */
+        inline void
+        setSendBufferSize ( unsigned int    size )      throw ()
+        {
+            this->sendBufferSize = size;
+        }
+
+        /**
+         *  Set the amount of unsent data in the kernel above which the
+         *  socket is not reported writable. Keeps the data queued in the
+         *  kernel low, so that it stays in our own buffers instead.
+         *  Takes effect the next time the socket is opened.
+         *
+         *  @param lowat the limit in bytes, 0 for the system default.
+         */
+        inline void
+        setNotSentLowat (   unsigned int    lowat )     throw ()
+        {
+            this->notSentLowat = lowat;
+        }
+
+        /**
+         *  Set whether to disable the Nagle algorithm.
+         *  Takes effect the next time the socket is opened.
+         *
+         *  @param noDelay true to send small writes right away.
+         */
+        inline void
+        setNoDelay (    bool            noDelay )       throw ()
+        {
+            this->noDelay = noDelay;
+        }
+
+        /**
+         *  Set how long sent data may stay unacknowledged before the
+         *  connection is dropped.
+         *  Takes effect the next time the socket is opened.
+         *
+         *  @param timeout the timeout in milliseconds,
+         *         0 for the system default.
+         */
+        inline void
+        setUserTimeout (    unsigned int    timeout )   throw ()
+        {
+            this->userTimeout = timeout;
+        }
+
+        /**
+         *  Set the keep-alive parameters of the connection.
+         *  Takes effect the next time the socket is opened.
+         *
+         *  @param idle the number of idle seconds before the first probe,
+         *         0 for the system default.
+         *  @param interval the number of seconds between probes,
+         *         0 for the system default.
+         *  @param count the number of unanswered probes before the
+         *         connection is dropped, 0 for the system default.
+         */
+        inline void
+        setKeepAlive (  unsigned int    idle,
+                        unsigned int    interval,
+                        unsigned int    count )         throw ()
+        {
+            this->keepAliveIdle     = idle;
+            this->keepAliveInterval = interval;
+            this->keepAliveCount    = count;
+        }
+
+        /**
+         *  Pace the sending to a maximum rate. The kernel is asked to do
+         *  the pacing (SO_MAX_PACING_RATE). Where it can't, write()
+         *  only accepts as much as a token bucket allows.
+         *  Takes effect the next time the socket is opened.
+         *
+         *  @param rate the maximum rate, in bytes per second,
+         *         0 not to pace.
+         *  @param burst the largest burst to send at once when pacing
+         *         in user space, in bytes.
+         */
+        inline void
+        setPacing ( unsigned int    rate,
+                    unsigned int    burst )             throw ()
+        {
+            this->pacingRate  = rate;
+            this->pacingBurst = burst;
+        }
+
+        /**
+         *  Cork or uncork the socket. While corked, partial segments
+         *  are held back by the kernel, so that a series of small writes
+         *  goes out in as few segments as possible. Uncorking sends
+         *  whatever was held back. No effect with an event loop, which
+         *  sends all that was queued at once.
+         *
+         *  @param cork true to cork, false to uncork.
+         */
+        void
+        setCork (       bool            cork )          throw ();
+
+#ifdef HAVE_EVENT_LOOP
+        /**
+         *  Set the event loop to drive this socket. Takes effect
+         *  the next time the socket is opened.
+         *
+         *  @param eventLoop the event loop, or 0 for a blocking socket.
+         */
+        inline void
+        setEventLoop ( EventLoop      * eventLoop )     throw ()
+        {
+            this->eventLoop = eventLoop;
+        }
+
+        /**
+         *  Get the event loop driving this socket.
+         *
+         *  @return the event loop, or 0 for a blocking socket.
+         */
+        inline EventLoop *
+        getEventLoop ( void ) const                     throw ()
+        {
+            return eventLoop.get();
+        }
+#endif
+
+        /**
+         *  Get the number of bytes waiting in the send queue.
+         *
+         *  @return the number of bytes not yet handed to the kernel.
+         */
+        unsigned int
+        getQueuedBytes ( void )                         throw ();
+
+        /**
+         *  Get the number of bytes written but not yet received by the
+         *  peer: the bytes in the send queue, plus the bytes in the
+         *  kernel socket buffer not yet acknowledged, where the system
+         *  tells.
+         *
+         *  @return the number of bytes not yet received by the peer.
+         */
+        unsigned int
+        getBacklog ( void )                             throw ();
+
         /**
          *  Open the TcpSocket.
          *
@@ -225,6 +690,8 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
         /**
          *  Check if the TcpSocket is ready to accept data.
          *  Blocks until the specified time for data to be available.
+         *  When driven by an event loop, does not block, but tells if
+         *  there is room in the send queue.
          *
          *  @param sec the maximum seconds to block.
          *  @param usec micro seconds to block after the full seconds.
@@ -238,6 +705,8 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
 
         /**
          *  Write data to the TcpSocket.
+         *  When driven by an event loop, data the kernel does not accept
+         *  right away is queued, up to the size of the send queue.
          *
          *  @param buf the data to write.
          *  @param len number of bytes to write from buf.
@@ -248,15 +717,35 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        throw ( Exception );
 
+        /**
+         *  Write data from several buffers to the TcpSocket, with a
+         *  single system call. Queues what the kernel does not accept
+         *  right away, as write() does.
+         *
+         *  @param vec the buffers to write, in order.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes written (may be less than the
+         *          total length of the buffers).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeVec (     const struct iovec    * vec,
+                       unsigned int            count )  throw ( Exception );
+
         /**
          *  Flush all data that was written to the TcpSocket to the underlying
-         *  connection.
+         *  connection. If the socket is corked, sends what the kernel
+         *  held back, but leaves the socket corked.
          *
          *  @exception Exception
          */
         inline virtual void
         flush ( void )                              throw ( Exception )
         {
+            if ( corked ) {
+                setCork( false);
+                setCork( true);
+            }
         }
 
         /**
@@ -278,6 +767,14 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
          */
         virtual void
         close ( void )                              throw ( Exception );
+
+        /**
+         *  Handle an event from the event loop: flush the send queue.
+         *
+         *  @param events the events that occured.
+         */
+        virtual void
+        handleEvent (   unsigned int    events )    throw ();
 };
 
 
@@ -0,0 +1,404 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : TlsSocket.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// compile only if configured for OpenSSL
+#ifdef HAVE_OPENSSL_LIB
+
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#else
+#error need poll.h
+#endif
+
+#include <openssl/err.h>
+
+
+#include "Util.h"
+#include "Exception.h"
+#include "TlsSocket.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+TlsSocket :: init ( const char            * caFile,
+                    bool                    verify )    throw ( Exception )
+{
+    this->ssl       = 0;
+    this->session   = 0;
+    this->verify    = verify;
+    this->kernelTls = false;
+
+    if ( !(ctx = SSL_CTX_new( TLS_client_method())) ) {
+        throw Exception( __FILE__, __LINE__, "can't create TLS context");
+    }
+
+    SSL_CTX_set_min_proto_version( ctx, TLS1_2_VERSION);
+    // the data sent may move in the send queue between retries
+    SSL_CTX_set_mode( ctx, SSL_MODE_ENABLE_PARTIAL_WRITE
+                         | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options( ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+    // keep the sessions received ourselves, for resuming
+    SSL_CTX_set_session_cache_mode( ctx, SSL_SESS_CACHE_CLIENT
+                                       | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb( ctx, newSession);
+
+    if ( verify ) {
+        SSL_CTX_set_verify( ctx, SSL_VERIFY_PEER, 0);
+        if ( caFile ? !SSL_CTX_load_verify_locations( ctx, caFile, 0)
+                    : !SSL_CTX_set_default_verify_paths( ctx) ) {
+            SSL_CTX_free( ctx);
+            throw Exception( __FILE__, __LINE__,
+                             "can't load the certificate authorities: ",
+                             caFile ? caFile : "system default");
+        }
+    }
+
+    record = new unsigned char[maxRecordSize];
+    pthread_mutex_init( &sslMutex, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+TlsSocket :: strip ( void )                             throw ( Exception )
+{
+    // close here, as the base class can't end the session any more
+    if ( isOpen() ) {
+        close();
+    }
+
+    if ( session ) {
+        SSL_SESSION_free( session);
+    }
+    SSL_CTX_free( ctx);
+    delete[] record;
+    pthread_mutex_destroy( &sslMutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Keep a session received, to resume it on the next connection
+ *----------------------------------------------------------------------------*/
+int
+TlsSocket :: newSession (   SSL           * ssl,
+                            SSL_SESSION   * session )   throw ()
+{
+    TlsSocket     * socket = (TlsSocket *) SSL_get_app_data( ssl);
+
+    if ( socket->session ) {
+        SSL_SESSION_free( socket->session);
+    }
+    socket->session = session;
+
+    return 1;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Do the TLS handshake
+ *----------------------------------------------------------------------------*/
+void
+TlsSocket :: startSession ( void )                      throw ( Exception )
+{
+    unsigned long long  deadline;
+    unsigned long long  now;
+    struct pollfd       pfd;
+    int                 ret;
+
+    // done before the event loop watches the socket, thus unlocked
+    if ( !(ssl = SSL_new( ctx)) ) {
+        throw Exception( __FILE__, __LINE__, "can't create TLS connection");
+    }
+
+    SSL_set_app_data( ssl, this);
+    SSL_set_fd( ssl, getSockfd());
+    SSL_set_tlsext_host_name( ssl, getHost());
+    if ( verify ) {
+        SSL_set1_host( ssl, getHost());
+    }
+    if ( session ) {
+        SSL_set_session( ssl, session);
+    }
+
+    // the socket is non-blocking, wait for the handshake to go on
+    deadline = Util::getMonotonicTime()
+             + getConnectTimeout() * 1000000ULL;
+    while ( (ret = SSL_connect( ssl)) != 1 ) {
+        switch ( SSL_get_error( ssl, ret) ) {
+            case SSL_ERROR_WANT_READ:
+                pfd.events = POLLIN;
+                break;
+
+            case SSL_ERROR_WANT_WRITE:
+                pfd.events = POLLOUT;
+                break;
+
+            default: {
+                char    error[256];
+
+                ERR_error_string_n( ERR_get_error(), error, sizeof(error));
+                SSL_free( ssl);
+                ssl = 0;
+                throw Exception( __FILE__, __LINE__,
+                                 "TLS handshake error: ", error);
+            }
+        }
+
+        now     = Util::getMonotonicTime();
+        pfd.fd  = getSockfd();
+        if ( now >= deadline
+          || poll( &pfd, 1, (deadline - now) / 1000 + 1) <= 0 ) {
+            SSL_free( ssl);
+            ssl = 0;
+            throw Exception( __FILE__, __LINE__, "TLS handshake timeout");
+        }
+    }
+
+    kernelTls = false;
+#ifdef BIO_get_ktls_send
+    kernelTls = BIO_get_ktls_send( SSL_get_wbio( ssl));
+#endif
+
+    reportEvent( 4, "TLS connection, session resumed:",
+                    SSL_session_reused( ssl) ? "yes" : "no",
+                    "kernel TLS:", kernelTls ? "yes" : "no");
+}
+
+
+/*------------------------------------------------------------------------------
+ *  End the TLS session
+ *----------------------------------------------------------------------------*/
+void
+TlsSocket :: endSession ( void )                        throw ()
+{
+    pthread_mutex_lock( &sslMutex);
+    if ( ssl ) {
+        char    buf[256];
+        int     flags;
+
+        // the socket is closed right after, never wait for the server
+        if ( (flags = fcntl( getSockfd(), F_GETFL, 0)) != -1 ) {
+            fcntl( getSockfd(), F_SETFL, flags | O_NONBLOCK);
+        }
+        // take in what the server sent since the handshake: the session
+        // tickets to resume with, and closing with unread data would
+        // reset the connection, losing the end of the stream
+        while ( SSL_read( ssl, buf, sizeof(buf)) > 0 ) {
+        }
+        SSL_shutdown( ssl);
+        ERR_clear_error();
+        SSL_free( ssl);
+        ssl = 0;
+    }
+    kernelTls = false;
+    pthread_mutex_unlock( &sslMutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Turn the result of an OpenSSL call into that of a system call
+ *----------------------------------------------------------------------------*/
+int
+TlsSocket :: mapResult (    int     ret )               throw ()
+{
+    if ( ret > 0 ) {
+        return ret;
+    }
+
+    switch ( SSL_get_error( ssl, ret) ) {
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            break;
+
+        case SSL_ERROR_SYSCALL:
+            // errno is set by the system call, or the peer just left
+            if ( !errno ) {
+                errno = ECONNRESET;
+            }
+            break;
+
+        default:
+            errno = EPROTO;
+            break;
+    }
+
+    return -1;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send data over the TLS connection
+ *----------------------------------------------------------------------------*/
+int
+TlsSocket :: sendVec (  const struct iovec    * vec,
+                        unsigned int            count )     throw ()
+{
+    const void    * buf;
+    unsigned int    len;
+    int             ret;
+
+    if ( kernelTls ) {
+        // the kernel makes the records
+        return TcpSocket::sendVec( vec, count);
+    }
+
+    pthread_mutex_lock( &sslMutex);
+    if ( !ssl ) {
+        pthread_mutex_unlock( &sslMutex);
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    if ( count == 1 ) {
+        buf = vec->iov_base;
+        len = vec->iov_len;
+    } else {
+        // collect the pieces into a single record
+        for ( len = 0; count && len < maxRecordSize; ++vec, --count ) {
+            unsigned int    n = vec->iov_len < maxRecordSize - len
+                              ? vec->iov_len : maxRecordSize - len;
+
+            memcpy( record + len, vec->iov_base, n);
+            len += n;
+        }
+        buf = record;
+    }
+
+    if ( !len ) {
+        pthread_mutex_unlock( &sslMutex);
+        return 0;
+    }
+
+    errno = 0;
+    ret   = mapResult( SSL_write( ssl, buf, len));
+    pthread_mutex_unlock( &sslMutex);
+
+    return ret;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Receive data from the TLS connection
+ *----------------------------------------------------------------------------*/
+int
+TlsSocket :: recvData ( void          * buf,
+                        unsigned int    len )               throw ()
+{
+    int     ret;
+
+    pthread_mutex_lock( &sslMutex);
+    if ( !ssl ) {
+        pthread_mutex_unlock( &sslMutex);
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    errno = 0;
+    ret   = mapResult( SSL_read( ssl, buf, len));
+    pthread_mutex_unlock( &sslMutex);
+
+    return ret;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Check if there is something to read
+ *----------------------------------------------------------------------------*/
+bool
+TlsSocket :: canRead (  unsigned int    sec,
+                        unsigned int    usec )          throw ( Exception )
+{
+    bool    pending;
+
+    pthread_mutex_lock( &sslMutex);
+    pending = ssl && SSL_pending( ssl) > 0;
+    pthread_mutex_unlock( &sslMutex);
+
+    if ( pending ) {
+        return true;
+    }
+
+    return TcpSocket::canRead( sec, usec);
+}
+
+
+#endif // HAVE_OPENSSL_LIB
+
@@ -0,0 +1,336 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : TlsSocket.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef TLS_SOCKET_H
+#define TLS_SOCKET_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_OPENSSL_LIB
+#include <openssl/ssl.h>
+#else
+#error configure for OpenSSL
+#endif
+
+
+#include "Exception.h"
+#include "TcpSocket.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A TCP network socket, with TLS on top.
+ *
+ *  Where the kernel supports it, the TLS records are encrypted by the
+ *  kernel (kTLS) once the handshake is done, and the data is sent the
+ *  same way as with a plain TcpSocket. Otherwise the data is encrypted
+ *  by OpenSSL in user space.
+ *
+ *  The session is kept after the connection is closed, and offered
+ *  to the server when reconnecting, to make the handshake faster.
+ *
+ *  The send queue may be flushed from the thread of an event loop,
+ *  while the thread of the output writes or reads, thus the calls to
+ *  OpenSSL are serialized with a mutex of their own.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class TlsSocket : public TcpSocket
+{
+    private:
+
+        /**
+         *  The maximum number of bytes encrypted by OpenSSL at once,
+         *  the size of a TLS record.
+         */
+        static const unsigned int   maxRecordSize = 16384;
+
+        /**
+         *  The TLS context.
+         */
+        SSL_CTX               * ctx;
+
+        /**
+         *  The TLS connection, while connected.
+         */
+        SSL                   * ssl;
+
+        /**
+         *  The session of the last connection, to resume, or 0.
+         */
+        SSL_SESSION           * session;
+
+        /**
+         *  Check the certificate of the server.
+         */
+        bool                    verify;
+
+        /**
+         *  True if the data is encrypted by the kernel.
+         */
+        bool                    kernelTls;
+
+        /**
+         *  The buffer to collect the data to encrypt in user space,
+         *  if sent in several pieces.
+         */
+        unsigned char         * record;
+
+        /**
+         *  Mutex serializing the use of the TLS connection and of
+         *  record, which the event loop and the output use from
+         *  their own threads. Not the mutex of TcpSocket, as that is
+         *  held while calling the event loop.
+         */
+        pthread_mutex_t         sslMutex;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param caFile the file of the certificate authorities to
+         *         check the server certificate with, or 0 to use the
+         *         default ones of the system.
+         *  @param verify check the certificate of the server.
+         *  @exception Exception
+         */
+        void
+        init (  const char            * caFile,
+                bool                    verify )        throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                                  throw ( Exception );
+
+        /**
+         *  Called by OpenSSL when a session to resume is received.
+         *
+         *  @param ssl the connection the session was received on.
+         *  @param session the session received.
+         *  @return 1, to keep the session.
+         */
+        static int
+        newSession (    SSL           * ssl,
+                        SSL_SESSION   * session )       throw ();
+
+        /**
+         *  Turn the result of an OpenSSL call into the result of a
+         *  system call.
+         *
+         *  @param ret the value returned by the OpenSSL call.
+         *  @return ret if not an error, otherwise -1 with errno set.
+         */
+        int
+        mapResult ( int     ret )                       throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        TlsSocket ( void )                              throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  TLS connection can not be shared.
+         *
+         *  @param ss the object to copy.
+         *  @exception Exception
+         */
+        inline
+        TlsSocket ( const TlsSocket   & ss )            throw ( Exception )
+                : TcpSocket( ss )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Assignment operator. Always throws an Exception, as the
+         *  TLS connection can not be shared.
+         *
+         *  @param ss the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline TlsSocket &
+        operator= ( const TlsSocket   & ss )            throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Assignment from a TcpSocket. Always throws an Exception, as
+         *  the TLS connection can not be shared.
+         *
+         *  @param ss the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual TcpSocket &
+        operator= ( const TcpSocket   & ss )            throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Do the TLS handshake.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        startSession ( void )                           throw ( Exception );
+
+        /**
+         *  Send the TLS close notification, and free the connection.
+         */
+        virtual void
+        endSession ( void )                             throw ();
+
+        /**
+         *  Send data over the TLS connection.
+         *
+         *  @param vec the buffers to send, in order.
+         *  @param count the number of buffers in vec.
+         *  @return the number of bytes sent, or -1 with errno set.
+         */
+        virtual int
+        sendVec (   const struct iovec    * vec,
+                    unsigned int            count )     throw ();
+
+        /**
+         *  Receive data from the TLS connection.
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the size of buf.
+         *  @return the number of bytes read, 0 at the end of the stream,
+         *          or -1 with errno set.
+         */
+        virtual int
+        recvData (  void          * buf,
+                    unsigned int    len )               throw ();
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param host the name of the host to connect to, also the
+         *         name the certificate of the server is checked for.
+         *  @param port the port to connect to.
+         *  @param caFile the file of the certificate authorities to
+         *         check the server certificate with, or 0 to use the
+         *         default ones of the system.
+         *  @param verify check the certificate of the server.
+         *  @exception Exception
+         */
+        inline
+        TlsSocket ( const char        * host,
+                    unsigned short      port,
+                    const char        * caFile = 0,
+                    bool                verify = true )
+                                                        throw ( Exception )
+                : TcpSocket( host, port )
+        {
+            init( caFile, verify);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~TlsSocket ( void )                             throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Check if there is something to read on the connection.
+         *  Data already decrypted counts, too.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if there is something to read, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        canRead (   unsigned int    sec,
+                    unsigned int    usec )              throw ( Exception );
+
+        /**
+         *  Tell if the data is encrypted by the kernel on the
+         *  current connection.
+         *
+         *  @return true if kTLS is used for sending.
+         */
+        inline bool
+        isKernelTls ( void ) const                      throw ()
+        {
+            return kernelTls;
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* TLS_SOCKET_H */
+
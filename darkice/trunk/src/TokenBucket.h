@@ -0,0 +1,188 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : TokenBucket.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Exception.h"
+#include "Util.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A token bucket, to limit the rate data is sent at.
+ *  Tokens, one per byte, flow into the bucket at a constant rate, up to
+ *  the size of the bucket. Sending data takes tokens out of the bucket.
+ *  Thus data may be sent in bursts of at most the bucket size, while
+ *  on the long run no faster than the rate.
+ *
+ *  The class is not thread-safe.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class TokenBucket
+{
+    private:
+
+        /**
+         *  The rate of the tokens, in bytes per second.
+         */
+        unsigned int            rate;
+
+        /**
+         *  The size of the bucket, in bytes.
+         */
+        unsigned int            burst;
+
+        /**
+         *  The number of tokens in the bucket.
+         */
+        unsigned int            tokens;
+
+        /**
+         *  The time the bucket was last filled up to, in microseconds.
+         */
+        unsigned long long      filled;
+
+        /**
+         *  Add the tokens that flowed in since the last time.
+         */
+        inline void
+        fill ( void )                                   throw ()
+        {
+            unsigned long long  now   = Util::getMonotonicTime();
+            unsigned long long  added = (now - filled) * rate / 1000000ULL;
+
+            if ( tokens + added >= burst ) {
+                tokens = burst;
+                filled = now;
+            } else {
+                tokens += added;
+                // keep the fraction of the token not added yet
+                filled += added * 1000000ULL / rate;
+            }
+        }
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        TokenBucket ( void )                            throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor. The bucket starts out full.
+         *
+         *  @param rate the rate of the tokens, in bytes per second.
+         *  @param burst the size of the bucket, in bytes.
+         *  @exception Exception
+         */
+        inline
+        TokenBucket (   unsigned int    rate,
+                        unsigned int    burst )         throw ( Exception )
+        {
+            if ( !rate || !burst ) {
+                throw Exception( __FILE__, __LINE__, "bad token bucket");
+            }
+
+            this->rate   = rate;
+            this->burst  = burst;
+            this->tokens = burst;
+            this->filled = Util::getMonotonicTime();
+        }
+
+        /**
+         *  Get the rate of the tokens.
+         *
+         *  @return the rate, in bytes per second.
+         */
+        inline unsigned int
+        getRate ( void ) const                          throw ()
+        {
+            return rate;
+        }
+
+        /**
+         *  Get the number of bytes that may be sent right now.
+         *
+         *  @return the number of tokens in the bucket.
+         */
+        inline unsigned int
+        getAvailable ( void )                           throw ()
+        {
+            fill();
+            return tokens;
+        }
+
+        /**
+         *  Take tokens out of the bucket, for data sent.
+         *
+         *  @param len the number of bytes sent, at most getAvailable().
+         */
+        inline void
+        consume (   unsigned int    len )               throw ()
+        {
+            tokens -= len < tokens ? len : tokens;
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* TOKEN_BUCKET_H */
+
@@ -172,6 +172,16 @@ TwoLameLibEncoder :: open ( void )
 	if (getReportVerbosity() >= 3) {
     	twolame_print_config( twolame_opts);
 	}
+
+    unsigned int    frameLen     = 0;
+    unsigned int    frameSamples = 0;
+    unsigned char * frame        = Util::mpegSilentFrame( 2,
+                                                          getOutSampleRate(),
+                                                          getOutChannel(),
+                                                          0,
+                                                          &frameLen,
+                                                          &frameSamples);
+    setSilentFrame( frame, frameLen, frameSamples);
 	
     return true;
 }
@@ -188,6 +198,9 @@ TwoLameLibEncoder :: write (   const void    * buf,
         return 0;
     }
 
+    // the encoder was flushed as silence started, simply go on
+    endSilence();
+
     unsigned int    bitsPerSample = getInBitsPerSample();
     unsigned int    inChannels    = getInChannel();
 
@@ -239,6 +252,7 @@ TwoLameLibEncoder :: write (   const void    * buf,
     }
 
     unsigned int    written = getSink()->write( mp2Buf, ret);
+    getSink()->markFrameEnd();
     delete[] mp2Buf;
     // just let go data that could not be written
     if ( written < (unsigned int) ret ) {
@@ -251,6 +265,35 @@ TwoLameLibEncoder :: write (   const void    * buf,
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Write silence as pre-encoded silent frames
+ *----------------------------------------------------------------------------*/
+bool
+TwoLameLibEncoder :: writeSilence ( unsigned int    samples )
+                                                            throw ( Exception )
+{
+    if ( !isOpen() || !hasSilentFrame() ) {
+        return false;
+    }
+
+    if ( !isSilent() ) {
+        // end the audio encoded so far, layer 2 frames stand on their own
+        unsigned int    mp2Size = 7200;
+        unsigned char * mp2Buf  = new unsigned char[mp2Size];
+        int             ret;
+
+        ret = twolame_encode_flush( twolame_opts, mp2Buf, mp2Size);
+        if ( ret > 0 ) {
+            getSink()->write( mp2Buf, ret);
+            getSink()->markFrameEnd();
+        }
+        delete[] mp2Buf;
+    }
+
+    return writeSilentFrames( samples);
+}
+
+
 /*------------------------------------------------------------------------------
  *  Flush the data from the encoder
  *----------------------------------------------------------------------------*/
@@ -270,6 +313,7 @@ TwoLameLibEncoder :: flush ( void )
     ret = twolame_encode_flush( twolame_opts, mp2Buf, mp2Size );
 
     unsigned int    written = getSink()->write( mp2Buf, ret);
+    getSink()->markFrameEnd();
     delete[] mp2Buf;
 
     // just let go data that could not be written
@@ -338,6 +338,17 @@ class TwoLameLibEncoder : public AudioEncoder, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        throw ( Exception );
 
+        /**
+         *  Write silence as pre-encoded silent mp2 frames. The audio
+         *  encoded so far is flushed first.
+         *
+         *  @param samples the number of input samples of silence.
+         *  @return true if the silence was written, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        writeSilence (  unsigned int    samples )   throw ( Exception );
+
         /**
          *  Flush all data that was written to the encoder to the underlying
          *  connection.
@@ -39,6 +39,12 @@
 #error need errno.h
 #endif
 
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #else
@@ -104,6 +110,31 @@
  *----------------------------------------------------------------------------*/
 static const char fileid[] = "$Id$";
 
+/*------------------------------------------------------------------------------
+ *  The bitrates of MPEG audio frames, in kbps, by MPEG 1 layer I, II, III,
+ *  and MPEG 2 (and 2.5) layer I, layer II and III
+ *----------------------------------------------------------------------------*/
+static const unsigned short mpaBitrates[5][15] = {
+    { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+    { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+    { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 },
+    { 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256 },
+    { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 }
+};
+
+/*------------------------------------------------------------------------------
+ *  The sample rates of MPEG 1 audio frames
+ *----------------------------------------------------------------------------*/
+static const unsigned int   mpaSampleRates[3] = { 44100, 48000, 32000 };
+
+/*------------------------------------------------------------------------------
+ *  The sample rates of AAC, by the sampling frequency index of ADTS
+ *----------------------------------------------------------------------------*/
+static const unsigned int   adtsSampleRates[13] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000,
+    22050, 16000, 12000, 11025,  8000,  7350
+};
+
 
 /* ===============================================  local function prototypes */
 
@@ -234,6 +265,58 @@ Util :: base64Encode( const char  * str )               throw ( Exception )
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Encode a string for use in the query part of a URL
+ *----------------------------------------------------------------------------*/
+std::string
+Util :: urlEncode ( const char    * str )               throw ()
+{
+    static const char   hex[] = "0123456789ABCDEF";
+    std::string         s;
+
+    for ( ; *str; ++str ) {
+        unsigned char   c = *str;
+
+        if ( (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+          || (c >= '0' && c <= '9')
+          || c == '-' || c == '_' || c == '.' || c == '~' ) {
+            s += c;
+        } else {
+            s += '%';
+            s += hex[c >> 4];
+            s += hex[c & 0x0f];
+        }
+    }
+
+    return s;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Format a host and a port for the Host header
+ *----------------------------------------------------------------------------*/
+std::string
+Util :: hostPort (  const char        * host,
+                    unsigned int        port )          throw ()
+{
+    std::string     s;
+    char            num[16];
+
+    // an IPv6 address, its colons would be taken for the port
+    if ( strchr( host, ':') ) {
+        s  = "[";
+        s += host;
+        s += "]";
+    } else {
+        s  = host;
+    }
+    snprintf( num, sizeof(num), ":%u", port);
+    s += num;
+
+    return s;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Check whether two strings are equal
  *----------------------------------------------------------------------------*/
@@ -538,3 +621,288 @@ Util :: sleep   (   long            sec,
 
     pselect( 0, NULL, NULL, NULL, &timespec, &sigset);
 }
+
+
+/*------------------------------------------------------------------------------
+ *  Get the monotonic time in microseconds
+ *----------------------------------------------------------------------------*/
+unsigned long long
+Util :: getMonotonicTime ( void )                           throw ()
+{
+    struct timespec     timespec;
+
+    clock_gettime( CLOCK_MONOTONIC, &timespec);
+
+    return (unsigned long long) timespec.tv_sec * 1000000ULL
+         + timespec.tv_nsec / 1000;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Skip some bytes at the start of a list of buffers
+ *----------------------------------------------------------------------------*/
+struct iovec *
+Util :: skipVec (   struct iovec      * vec,
+                    unsigned int      & count,
+                    unsigned int        len )               throw ()
+{
+    while ( count > 0 && len >= vec->iov_len ) {
+        len -= vec->iov_len;
+        ++vec;
+        --count;
+    }
+
+    if ( count > 0 ) {
+        vec->iov_base = (unsigned char *) vec->iov_base + len;
+        vec->iov_len -= len;
+    }
+
+    return vec;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the total length of a list of buffers
+ *----------------------------------------------------------------------------*/
+unsigned int
+Util :: vecLen (    const struct iovec    * vec,
+                    unsigned int            count )         throw ()
+{
+    unsigned int    len = 0;
+
+    while ( count-- ) {
+        len += (vec++)->iov_len;
+    }
+
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Parse the status line of an HTTP response
+ *----------------------------------------------------------------------------*/
+unsigned int
+Util :: parseHttpStatus (   const char    * buf,
+                            unsigned int    len )           throw ()
+{
+    unsigned int    status = 0;
+
+    // "HTTP/x.y NNN", the reason phrase is not looked at
+    if ( len < 12 || strncmp( buf, "HTTP/", 5)
+      || buf[5] < '0' || buf[5] > '9' || buf[6] != '.'
+      || buf[7] < '0' || buf[7] > '9' || buf[8] != ' ' ) {
+        return 0;
+    }
+
+    for ( unsigned int i = 9; i < 12; ++i ) {
+        if ( buf[i] < '0' || buf[i] > '9' ) {
+            return 0;
+        }
+        status = status * 10 + buf[i] - '0';
+    }
+
+    // the status code is followed by a space, or the end of the line
+    if ( len > 12 && buf[12] != ' ' && buf[12] != '\r' && buf[12] != '\n' ) {
+        return 0;
+    }
+
+    return status < 100 ? 0 : status;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Decode the header of an MPEG audio frame
+ *----------------------------------------------------------------------------*/
+unsigned int
+Util :: mpegFrameLength (   const unsigned char   * p,
+                            unsigned int          * samples,
+                            unsigned int          * sampleRate )    throw ()
+{
+    unsigned int    version = (p[1] >> 3) & 0x03;   // 3: MPEG 1
+    unsigned int    layer   = 4 - ((p[1] >> 1) & 0x03);
+    unsigned int    index   = p[2] >> 4;
+    unsigned int    rate    = (p[2] >> 2) & 0x03;
+    unsigned int    padding = (p[2] >> 1) & 0x01;
+    unsigned int    bitrate;
+
+    if ( p[0] != 0xff || (p[1] & 0xe0) != 0xe0 || version == 1
+      || layer == 4 || index == 0 || index == 15 || rate == 3 ) {
+        return 0;
+    }
+
+    if ( version == 3 ) {
+        bitrate     = mpaBitrates[layer - 1][index] * 1000;
+        *sampleRate = mpaSampleRates[rate];
+    } else {
+        bitrate     = mpaBitrates[layer == 1 ? 3 : 4][index] * 1000;
+        *sampleRate = mpaSampleRates[rate] >> (version == 2 ? 1 : 2);
+    }
+
+    if ( layer == 1 ) {
+        *samples = 384;
+        return (12 * bitrate / *sampleRate + padding) * 4;
+    }
+    if ( layer == 3 && version != 3 ) {
+        *samples = 576;
+        return 72 * bitrate / *sampleRate + padding;
+    }
+    *samples = 1152;
+    return 144 * bitrate / *sampleRate + padding;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Decode the header of an AAC frame in ADTS
+ *----------------------------------------------------------------------------*/
+unsigned int
+Util :: adtsFrameLength (   const unsigned char   * p,
+                            unsigned int          * samples,
+                            unsigned int          * sampleRate )    throw ()
+{
+    unsigned int    index  = (p[2] >> 2) & 0x0f;
+    unsigned int    length = ((p[3] & 0x03) << 11) | (p[4] << 3) | (p[5] >> 5);
+
+    // sync word, and layer 0
+    if ( p[0] != 0xff || (p[1] & 0xf6) != 0xf0 || index > 12
+      || length < 7 ) {
+        return 0;
+    }
+
+    *sampleRate = adtsSampleRates[index];
+    *samples    = 1024 * ((p[6] & 0x03) + 1);
+
+    return length;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make a silent MPEG audio frame
+ *----------------------------------------------------------------------------*/
+unsigned char *
+Util :: mpegSilentFrame (   unsigned int            layer,
+                            unsigned int            sampleRate,
+                            unsigned int            channels,
+                            unsigned int            bitrate,
+                            unsigned int          * len,
+                            unsigned int          * samples )
+                                                        throw ( Exception )
+{
+    unsigned int    version = 3;                    // 3: MPEG 1
+    unsigned int    rate;
+    unsigned int    index;
+    unsigned int    table;
+    unsigned char * frame;
+
+    if ( layer != 2 && layer != 3 ) {
+        return 0;
+    }
+
+    for ( rate = 0; rate < 3; ++rate ) {
+        if ( sampleRate == mpaSampleRates[rate] ) {
+            version = 3;
+            break;
+        } else if ( sampleRate == mpaSampleRates[rate] >> 1 ) {
+            version = 2;
+            break;
+        } else if ( sampleRate == mpaSampleRates[rate] >> 2 ) {
+            version = 0;
+            break;
+        }
+    }
+    if ( rate == 3 ) {
+        return 0;
+    }
+
+    table = version == 3 ? layer - 1 : 4;
+    if ( bitrate == 0 ) {
+        // in MPEG 1 layer 2, the lowest bit rates are mono only
+        index = version == 3 && layer == 2 && channels > 1 ? 4 : 1;
+    } else {
+        for ( index = 1; index < 15; ++index ) {
+            if ( mpaBitrates[table][index] == bitrate ) {
+                break;
+            }
+        }
+        if ( index == 15 ) {
+            return 0;
+        }
+    }
+    bitrate = mpaBitrates[table][index] * 1000;
+
+    if ( layer == 3 && version != 3 ) {
+        *samples = 576;
+        *len     = 72 * bitrate / sampleRate;
+    } else {
+        *samples = 1152;
+        *len     = 144 * bitrate / sampleRate;
+    }
+
+    // no CRC, no padding, stereo or single channel mode
+    frame = new unsigned char[*len];
+    memset( frame, 0, *len);
+    frame[0] = 0xff;
+    frame[1] = 0xe0 | (version << 3) | ((4 - layer) << 1) | 0x01;
+    frame[2] = (index << 4) | (rate << 2);
+    frame[3] = channels == 1 ? 0xc0 : 0x00;
+
+    return frame;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make a silent AAC frame in ADTS
+ *----------------------------------------------------------------------------*/
+unsigned char *
+Util :: adtsSilentFrame (   unsigned int            sampleRate,
+                            unsigned int            channels,
+                            unsigned int          * len,
+                            unsigned int          * samples )
+                                                        throw ( Exception )
+{
+    // a single channel element, or a channel pair element without
+    // a common window, with a global gain of 0 and no scale factor
+    // bands, followed by the end element
+    static const unsigned char  sce[] = { 0x00, 0x00, 0x00, 0x07 };
+    static const unsigned char  cpe[] = { 0x20, 0x00, 0x00, 0x00,
+                                          0x00, 0x00, 0x0e };
+    const unsigned char       * raw;
+    unsigned int                rawLen;
+    unsigned int                index;
+    unsigned char             * frame;
+
+    if ( channels == 1 ) {
+        raw    = sce;
+        rawLen = sizeof( sce);
+    } else if ( channels == 2 ) {
+        raw    = cpe;
+        rawLen = sizeof( cpe);
+    } else {
+        return 0;
+    }
+
+    for ( index = 0; index < 13; ++index ) {
+        if ( adtsSampleRates[index] == sampleRate ) {
+            break;
+        }
+    }
+    if ( index == 13 ) {
+        return 0;
+    }
+
+    *samples = 1024;
+    *len     = 7 + rawLen;
+
+    // MPEG-2 AAC LC, no CRC, variable bit rate buffer fullness
+    frame    = new unsigned char[*len];
+    frame[0] = 0xff;
+    frame[1] = 0xf9;
+    frame[2] = 0x40 | (index << 2) | (channels >> 2);
+    frame[3] = ((channels & 0x03) << 6) | ((*len >> 11) & 0x03);
+    frame[4] = (*len >> 3) & 0xff;
+    frame[5] = ((*len & 0x07) << 5) | 0x1f;
+    frame[6] = 0xfc;
+    memcpy( frame + 7, raw, rawLen);
+
+    return frame;
+}
+
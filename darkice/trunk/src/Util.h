@@ -36,6 +36,18 @@
 
 /* ============================================================ include files */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#else
+#error need sys/uio.h
+#endif
+
+#include <string>
+
 #include "Exception.h"
 
 
@@ -229,6 +241,29 @@ class Util
         static char *
         base64Encode ( const char     * str )       throw ( Exception );
 
+        /**
+         *  Encode a string for use in the query part of a URL,
+         *  as described in RFC 3986, section 2.1
+         *
+         *  @param str the string to encode.
+         *  @return the encoded string.
+         */
+        static std::string
+        urlEncode ( const char        * str )       throw ();
+
+        /**
+         *  Format a host and a port for the Host header of an HTTP
+         *  request, as described in RFC 7230, section 5.4. IPv6
+         *  addresses are put in brackets.
+         *
+         *  @param host the host name or address.
+         *  @param port the port.
+         *  @return the string host:port.
+         */
+        static std::string
+        hostPort (  const char        * host,
+                    unsigned int        port )      throw ();
+
         /**
          *  Convert an unsigned char buffer holding 8 or 16 bit PCM values
          *  with channels interleaved to a short int buffer, still
@@ -315,7 +350,130 @@ class Util
         static void
         sleep(  long    sec,
                 long    nsec);
-                
+
+        /**
+         *  Skip some bytes at the start of a list of buffers.
+         *  The buffer where the skipping ends is adjusted in place.
+         *
+         *  @param vec the buffers.
+         *  @param count the number of buffers, updated to the number
+         *         of buffers left.
+         *  @param len the number of bytes to skip.
+         *  @return the first buffer left.
+         */
+        static struct iovec *
+        skipVec (   struct iovec      * vec,
+                    unsigned int      & count,
+                    unsigned int        len )               throw ();
+
+        /**
+         *  Get the total length of a list of buffers.
+         *
+         *  @param vec the buffers.
+         *  @param count the number of buffers.
+         *  @return the sum of the lengths of the buffers.
+         */
+        static unsigned int
+        vecLen (    const struct iovec    * vec,
+                    unsigned int            count )         throw ();
+
+        /**
+         *  Parse the status line at the start of an HTTP response,
+         *  like "HTTP/1.1 200 OK".
+         *
+         *  @param buf the response, not necessarily zero terminated.
+         *  @param len the number of bytes in buf.
+         *  @return the status code of the response, or 0 if buf does not
+         *          start with a status line.
+         */
+        static unsigned int
+        parseHttpStatus (   const char    * buf,
+                            unsigned int    len )           throw ();
+
+        /**
+         *  Get the time elapsed since some unspecified point in the past,
+         *  not affected by changes to the system clock.
+         *
+         *  @return the monotonic time in microseconds.
+         */
+        static unsigned long long
+        getMonotonicTime ( void )                           throw ();
+
+        /**
+         *  Decode the header of an MPEG audio (mp3 or mp2) frame.
+         *
+         *  @param buf the start of the frame, at least 4 bytes.
+         *  @param samples set to the number of samples in the frame.
+         *  @param sampleRate set to the sample rate of the frame.
+         *  @return the length of the frame in bytes, or 0 if buf does
+         *          not start with a valid frame header.
+         */
+        static unsigned int
+        mpegFrameLength (   const unsigned char   * buf,
+                            unsigned int          * samples,
+                            unsigned int          * sampleRate )    throw ();
+
+        /**
+         *  Decode the header of an AAC frame in ADTS, as written by the
+         *  AAC and AAC+ encoders. For AAC+, the sample rate is that of
+         *  the core, thus samples / sampleRate is the right duration.
+         *
+         *  @param buf the start of the frame, at least 7 bytes.
+         *  @param samples set to the number of samples in the frame.
+         *  @param sampleRate set to the sample rate of the frame.
+         *  @return the length of the frame in bytes, including the
+         *          header, or 0 if buf does not start with a valid
+         *          ADTS header.
+         */
+        static unsigned int
+        adtsFrameLength (   const unsigned char   * buf,
+                            unsigned int          * samples,
+                            unsigned int          * sampleRate )    throw ();
+
+        /**
+         *  Make a silent MPEG audio (mp3 or mp2) frame: a frame header
+         *  followed by all zero side information and data, which
+         *  decodes to silence.
+         *
+         *  @param layer the layer, 2 or 3.
+         *  @param sampleRate the sample rate of the stream.
+         *  @param channels the number of channels of the stream.
+         *  @param bitrate the bit rate of the frame in kbits/sec, or 0
+         *         for the lowest one.
+         *  @param len set to the length of the frame in bytes.
+         *  @param samples set to the number of samples in the frame.
+         *  @return the frame, to be freed with delete[] by the caller,
+         *          or 0 if there is no such frame.
+         *  @exception Exception
+         */
+        static unsigned char *
+        mpegSilentFrame (   unsigned int            layer,
+                            unsigned int            sampleRate,
+                            unsigned int            channels,
+                            unsigned int            bitrate,
+                            unsigned int          * len,
+                            unsigned int          * samples )
+                                                        throw ( Exception );
+
+        /**
+         *  Make a silent AAC LC frame in ADTS: a channel element with
+         *  no scale factor bands, which decodes to silence.
+         *
+         *  @param sampleRate the sample rate of the stream.
+         *  @param channels the number of channels of the stream,
+         *         1 or 2.
+         *  @param len set to the length of the frame in bytes.
+         *  @param samples set to the number of samples in the frame.
+         *  @return the frame, to be freed with delete[] by the caller,
+         *          or 0 if there is no such frame.
+         *  @exception Exception
+         */
+        static unsigned char *
+        adtsSilentFrame (   unsigned int            sampleRate,
+                            unsigned int            channels,
+                            unsigned int          * len,
+                            unsigned int          * samples )
+                                                        throw ( Exception );
 };
 
 
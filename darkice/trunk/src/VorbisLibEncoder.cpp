@@ -137,7 +137,9 @@ VorbisLibEncoder :: init ( unsigned int     outMaxBitrate )
 #endif
     }
 
-    encoderOpen = false;
+    encoderOpen    = false;
+    streamSerial   = 0;
+    restartPending = false;
 }
 
 
@@ -148,8 +150,6 @@ bool
 VorbisLibEncoder :: open ( void )
                                                             throw ( Exception )
 {
-    int     ret;
-
     if ( isOpen() ) {
         close();
     }
@@ -160,6 +160,40 @@ VorbisLibEncoder :: open ( void )
                          "vorbis lib opening underlying sink error");
     }
 
+    streamSerial   = 0;
+    restartPending = false;
+    // the first logical stream carries the title set so far
+    takeTitleChange();
+    openStream();
+
+    // initialize the resampling coverter if needed
+    if ( converter ) {
+#ifdef HAVE_SRC_LIB
+        converterData.input_frames   = 4096/((getInBitsPerSample() / 8) * getInChannel());
+        converterData.data_in        = new float[converterData.input_frames*getInChannel()];
+        converterData.output_frames  = (int) (converterData.input_frames * resampleRatio + 1);
+        converterData.data_out       = new float[getInChannel() * converterData.output_frames];
+        converterData.src_ratio      = resampleRatio;
+        converterData.end_of_input   = 0;
+#else
+        converter->initialize( resampleRatio, getInChannel());
+#endif
+    }
+
+    encoderOpen = true;
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start a new logical stream
+ *----------------------------------------------------------------------------*/
+void
+VorbisLibEncoder :: openStream ( void )                 throw ( Exception )
+{
+    int     ret;
+
     vorbis_info_init( &vorbisInfo);
 
     switch ( getOutBitrateMode() ) {
@@ -215,23 +249,18 @@ VorbisLibEncoder :: open ( void )
         throw Exception( __FILE__, __LINE__, "vorbis block init error", ret);
     }
 
-    if ( (ret = ogg_stream_init( &oggStreamState, 0)) ) {
+    if ( (ret = ogg_stream_init( &oggStreamState, streamSerial)) ) {
         throw Exception( __FILE__, __LINE__, "ogg stream init error", ret);
     }
 
-    // create an empty vorbis_comment structure
+    // the comment header, with the title to show in players
     vorbis_comment_init( &vorbisComment);
-    /* FIXME: removed title metadata when the sink type was changed from
-     *        CastSink to the more generic Sink.
-     *        make sure to add metadata somehow
-    // Add comment to vorbis headers to show title in players
-    // stupid cast to (char*) because of stupid vorbis API
-    if ( getSink()->getName() ) {
-        vorbis_comment_add_tag(&vorbisComment,
-                               "TITLE",
-                               (char*) getSink()->getName());
+    char  * title = copyTitle();
+    if ( title ) {
+        // cast to (char*) because of the vorbis API
+        vorbis_comment_add_tag( &vorbisComment, (char*) "TITLE", title);
+        delete[] title;
     }
-    */
 
     // create the vorbis stream headers and send them to the underlying sink
     ogg_packet      header;
@@ -252,27 +281,57 @@ VorbisLibEncoder :: open ( void )
 
     ogg_page        oggPage;
     while ( ogg_stream_flush( &oggStreamState, &oggPage) ) {
-        getSink()->write( oggPage.header, oggPage.header_len);
-        getSink()->write( oggPage.body, oggPage.body_len);
+        struct iovec    vec[2];
+
+        // write the page header and body with a single call
+        vec[0].iov_base = oggPage.header;
+        vec[0].iov_len  = oggPage.header_len;
+        vec[1].iov_base = oggPage.body;
+        vec[1].iov_len  = oggPage.body_len;
+        getSink()->writeVec( vec, 2);
+        getSink()->markFrameEnd();
     }
 
     vorbis_comment_clear( &vorbisComment );
+}
 
-    // initialize the resampling coverter if needed
-    if ( converter ) {
-#ifdef HAVE_SRC_LIB
-        converterData.input_frames   = 4096/((getInBitsPerSample() / 8) * getInChannel());
-        converterData.data_in        = new float[converterData.input_frames*getInChannel()];
-        converterData.output_frames  = (int) (converterData.input_frames * resampleRatio + 1);
-        converterData.data_out       = new float[getInChannel() * converterData.output_frames];
-        converterData.src_ratio      = resampleRatio;
-        converterData.end_of_input   = 0;
-#else
-        converter->initialize( resampleRatio, getInChannel());
-#endif
+
+/*------------------------------------------------------------------------------
+ *  End the current logical stream
+ *----------------------------------------------------------------------------*/
+void
+VorbisLibEncoder :: closeStream ( void )                throw ( Exception )
+{
+    vorbis_analysis_wrote( &vorbisDspState, 0);
+    vorbisBlocksOut();
+
+    ogg_stream_clear( &oggStreamState);
+    vorbis_block_clear( &vorbisBlock);
+    vorbis_dsp_clear( &vorbisDspState);
+    vorbis_comment_clear( &vorbisComment);
+    vorbis_info_clear( &vorbisInfo);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Change the bit rate of the output
+ *----------------------------------------------------------------------------*/
+bool
+VorbisLibEncoder :: setOutBitrate ( unsigned int    bitrate )
+                                                            throw ( Exception )
+{
+    if ( getOutBitrateMode() == vbr ) {
+        return false;
+    }
+    if ( bitrate < VORBIS_MIN_BITRATE ) {
+        bitrate = VORBIS_MIN_BITRATE;
     }
 
-    encoderOpen = true;
+    if ( bitrate != getOutBitrate() ) {
+        storeOutBitrate( bitrate);
+        // the stream is restarted from write(), so that no data is lost
+        restartPending = isOpen();
+    }
 
     return true;
 }
@@ -289,6 +348,19 @@ VorbisLibEncoder :: write ( const void    * buf,
         return 0;
     }
 
+    if ( takeTitleChange() ) {
+        restartPending = true;
+    }
+
+    if ( restartPending ) {
+        // chain a new logical stream, set up for the new bit rate or title
+        restartPending = false;
+        closeStream();
+        ++streamSerial;
+        openStream();
+        reportEvent( 3, "vorbis stream chained, bitrate", getOutBitrate());
+    }
+
     unsigned int    channels      = getInChannel();
     unsigned int    bitsPerSample = getInBitsPerSample();
     unsigned int    sampleSize = (bitsPerSample / 8) * channels;
@@ -412,10 +484,15 @@ VorbisLibEncoder :: vorbisBlocksOut ( void )                throw ( Exception )
             ogg_stream_packetin( &oggStreamState, &oggPacket);
 
             while ( ogg_stream_pageout( &oggStreamState, &oggPage) ) {
-                int    written = 0;
-                
-                written  = getSink()->write(oggPage.header, oggPage.header_len);
-                written += getSink()->write( oggPage.body, oggPage.body_len);
+                int             written = 0;
+                struct iovec    vec[2];
+
+                vec[0].iov_base = oggPage.header;
+                vec[0].iov_len  = oggPage.header_len;
+                vec[1].iov_base = oggPage.body;
+                vec[1].iov_len  = oggPage.body_len;
+                written = getSink()->writeVec( vec, 2);
+                getSink()->markFrameEnd();
 
                 if ( written < oggPage.header_len + oggPage.body_len ) {
                     // just let go data that could not be written
@@ -443,6 +520,7 @@ VorbisLibEncoder :: close ( void )                    throw ( Exception )
         vorbis_dsp_clear( &vorbisDspState);
         vorbis_comment_clear( &vorbisComment);
         vorbis_info_clear( &vorbisInfo);
+        restartPending = false;
 
         encoderOpen = false;
 
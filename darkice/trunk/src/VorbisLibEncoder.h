@@ -113,6 +113,18 @@ class VorbisLibEncoder : public AudioEncoder, public virtual Reporter
          */
         unsigned int                    outMaxBitrate;
 
+        /**
+         *  The serial number of the current logical Ogg stream.
+         */
+        int                             streamSerial;
+
+        /**
+         *  Set when the bit rate or the title was changed, and the current
+         *  logical stream is to be ended and a new one started with the
+         *  new settings before encoding more data.
+         */
+        bool                            restartPending;
+
         /**
          *  Resample ratio
          */
@@ -162,6 +174,24 @@ class VorbisLibEncoder : public AudioEncoder, public virtual Reporter
         void
         vorbisBlocksOut( void )                         throw ( Exception );
 
+        /**
+         *  Set up the Vorbis encoder and start a new logical Ogg stream,
+         *  sending its headers to the underlying sink.
+         *
+         *  @exception Exception
+         */
+        void
+        openStream ( void )                             throw ( Exception );
+
+        /**
+         *  End the current logical Ogg stream, sending out all data
+         *  still in the encoder, and free the Vorbis encoder.
+         *
+         *  @exception Exception
+         */
+        void
+        closeStream ( void )                            throw ( Exception );
+
 
     protected:
 
@@ -385,6 +415,36 @@ class VorbisLibEncoder : public AudioEncoder, public virtual Reporter
             return encoderOpen;
         }
 
+        /**
+         *  Change the bit rate of the output while encoding. As the
+         *  Vorbis rate management can not be changed once set up, the
+         *  current logical stream is ended and a new one is chained
+         *  after it, set up for the new bit rate. Not supported for
+         *  quality based variable bit rate encoding.
+         *
+         *  @param bitrate the new bit rate of the output (kbits/sec).
+         *  @return true if the bit rate was changed, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        setOutBitrate ( unsigned int    bitrate )   throw ( Exception );
+
+        /**
+         *  Change the title of the stream while encoding. The current
+         *  logical stream is ended, and a new one is chained after it,
+         *  with the new title in its comment header.
+         *
+         *  @param title the new title.
+         *  @return true, as the title is always sent in the stream.
+         *  @exception Exception
+         */
+        inline virtual bool
+        setTitle (  const char    * title )         throw ( Exception )
+        {
+            storeTitle( title);
+            return true;
+        }
+
         /**
          *  Check if the encoder is ready to accept data.
          *
@@ -195,6 +195,7 @@ aacPlusEncoder :: write (  const void    * buf,
                                         maxOutputBytes);
 #endif
             unsigned int wrote = getSink()->write(aacplusBuf, outputBytes);
+            getSink()->markFrameEnd();
             
             if (wrote < outputBytes) {
                 reportEvent(3, "aacPlusEncoder :: write, couldn't write full data to underlying sink");
@@ -228,6 +229,7 @@ aacPlusEncoder :: write (  const void    * buf,
                                         maxOutputBytes);
             
             unsigned int wrote = getSink()->write(aacplusBuf, outputBytes);
+            getSink()->markFrameEnd();
             
             if (wrote < outputBytes) {
                 reportEvent(3, "aacPlusEncoder :: write, couldn't write full data to underlying sink");